@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "catalogue.h"
+
+#define CATALOGUE_MIN_CAPACITY 16
+
+/*
+ * PURPOSE: FNV-1a hash of a matrix name
+ * INPUTS:
+ *	name: the nul terminated name
+ * RETURN:
+ *  the 32 bit hash
+ *
+ **/
+static unsigned int hash_name (const char* name) {
+	unsigned int h = 2166136261u;
+	for (; *name; ++name) {
+		h ^= (unsigned char) *name;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * PURPOSE: finds the slot holding name, or the empty slot where it would go
+ * INPUTS:
+ *	cat: the catalogue to search
+ *  name: the name to look for
+ *  hash: hash_name(name)
+ * RETURN:
+ *  index of the slot
+ *
+ **/
+static size_t probe (const Matrix_Catalogue_t* cat, const char* name, unsigned int hash) {
+	const size_t mask = cat->capacity - 1;
+	size_t i = hash & mask;
+	while (cat->slots[i].matrix) {
+		if (cat->slots[i].hash == hash && strcmp(cat->slots[i].matrix->name, name) == 0) {
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+/*
+ * PURPOSE: doubles the table and rehashes every matrix into it
+ * INPUTS:
+ *	cat: the catalogue to grow
+ * RETURN:
+ *  If the new table was allocated then true
+ *  else false and the old table is left as it was.
+ *
+ **/
+static bool grow (Matrix_Catalogue_t* cat) {
+	const size_t new_capacity = cat->capacity * 2;
+	Catalogue_Slot_t* slots = calloc(new_capacity, sizeof(Catalogue_Slot_t));
+	if (!slots) {
+		return false;
+	}
+
+	Catalogue_Slot_t* old = cat->slots;
+	const size_t old_capacity = cat->capacity;
+	cat->slots = slots;
+	cat->capacity = new_capacity;
+	for (size_t i = 0; i < old_capacity; ++i) {
+		if (old[i].matrix) {
+			size_t j = old[i].hash & (new_capacity - 1);
+			while (slots[j].matrix) {
+				j = (j + 1) & (new_capacity - 1);
+			}
+			slots[j] = old[i];
+		}
+	}
+	free(old);
+	return true;
+}
+
+/*
+ * PURPOSE: allocates an empty catalogue
+ * INPUTS:
+ *	cat: where the new catalogue is stored
+ *  initial_capacity: expected number of matrices, rounded up to a power of two
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool create_catalogue (Matrix_Catalogue_t** cat, size_t initial_capacity) {
+
+	if (!cat) {
+		return false;
+	}
+
+	size_t capacity = CATALOGUE_MIN_CAPACITY;
+	while (capacity < initial_capacity * 2) {
+		capacity *= 2;
+	}
+
+	*cat = calloc(1, sizeof(Matrix_Catalogue_t));
+	if (!(*cat)) {
+		return false;
+	}
+	(*cat)->slots = calloc(capacity, sizeof(Catalogue_Slot_t));
+	if (!(*cat)->slots) {
+		free(*cat);
+		*cat = NULL;
+		return false;
+	}
+	(*cat)->capacity = capacity;
+	return true;
+}
+
+/*
+ * PURPOSE: destroys every matrix in the catalogue and the catalogue itself
+ * INPUTS:
+ *	cat: pointer to the catalogue, set to NULL afterwards
+ * RETURN:
+ *  void
+ *
+ **/
+void destroy_catalogue (Matrix_Catalogue_t** cat) {
+
+	if (!cat || !(*cat)) {
+		return;
+	}
+
+	for (size_t i = 0; i < (*cat)->capacity; ++i) {
+		if ((*cat)->slots[i].matrix) {
+			destroy_matrix(&(*cat)->slots[i].matrix);
+		}
+	}
+	free((*cat)->slots);
+	free(*cat);
+	*cat = NULL;
+}
+
+/*
+ * PURPOSE: looks up a matrix by its exact name
+ * INPUTS:
+ *	cat: the catalogue to search
+ *  name: the name of the matrix
+ * RETURN:
+ *  the matrix if found
+ *  else NULL.
+ *
+ **/
+Matrix_t* find_matrix (Matrix_Catalogue_t* cat, const char* name) {
+
+	if (!cat || !name) {
+		return NULL;
+	}
+
+	return cat->slots[probe(cat, name, hash_name(name))].matrix;
+}
+
+/*
+ * PURPOSE: adds a matrix to the catalogue, a matrix already stored under the
+ *          same name is destroyed and replaced
+ * INPUTS:
+ *	cat: the catalogue to add to
+ *  m: the matrix, the catalogue owns it from now on
+ * RETURN:
+ *  If no errors then true
+ *  else false and the caller still owns m.
+ *
+ **/
+bool insert_matrix (Matrix_Catalogue_t* cat, Matrix_t* m) {
+
+	if (!cat || !m) {
+		return false;
+	}
+
+	/*keep the load under 70% so probe chains stay short*/
+	if ((cat->count + 1) * 10 > cat->capacity * 7 && !grow(cat)) {
+		return false;
+	}
+
+	const unsigned int hash = hash_name(m->name);
+	const size_t i = probe(cat, m->name, hash);
+	if (cat->slots[i].matrix) {
+		if (cat->slots[i].matrix != m) {
+			destroy_matrix(&cat->slots[i].matrix);
+		}
+	}
+	else {
+		cat->count++;
+	}
+	cat->slots[i].hash = hash;
+	cat->slots[i].matrix = m;
+	return true;
+}
+
+/*
+ * PURPOSE: destroys the named matrix and takes it out of the catalogue
+ * INPUTS:
+ *	cat: the catalogue to remove from
+ *  name: the name of the matrix
+ * RETURN:
+ *  If the matrix was found then true
+ *  else false.
+ *
+ **/
+bool remove_matrix (Matrix_Catalogue_t* cat, const char* name) {
+
+	if (!cat || !name) {
+		return false;
+	}
+
+	const size_t mask = cat->capacity - 1;
+	size_t i = probe(cat, name, hash_name(name));
+	if (!cat->slots[i].matrix) {
+		return false;
+	}
+	destroy_matrix(&cat->slots[i].matrix);
+	cat->count--;
+
+	/*pull later entries of the chain back so lookups never hit a gap*/
+	size_t j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!cat->slots[j].matrix) {
+			break;
+		}
+		const size_t home = cat->slots[j].hash & mask;
+		/*move j into the hole unless its home lies cyclically in (i, j]*/
+		const bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+		if (!stays) {
+			cat->slots[i] = cat->slots[j];
+			cat->slots[j].matrix = NULL;
+			i = j;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,31 @@
+#ifndef _CATALOGUE_H_
+#define _CATALOGUE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "matrix.h"
+
+typedef struct {
+	unsigned int hash;
+	Matrix_t* matrix;
+}Catalogue_Slot_t;
+
+/*
+ * Open addressing table of matrices keyed by name. Linear probing with
+ * backward shift deletion, so there are no tombstones and a lookup stops
+ * at the first empty slot. The table owns every matrix put into it.
+ */
+typedef struct {
+	Catalogue_Slot_t* slots;
+	size_t capacity;
+	size_t count;
+}Matrix_Catalogue_t;
+
+bool create_catalogue (Matrix_Catalogue_t** cat, size_t initial_capacity);
+void destroy_catalogue (Matrix_Catalogue_t** cat);
+Matrix_t* find_matrix (Matrix_Catalogue_t* cat, const char* name);
+bool insert_matrix (Matrix_Catalogue_t* cat, Matrix_t* m);
+bool remove_matrix (Matrix_Catalogue_t* cat, const char* name);
+
+#endif
@@ -3,78 +3,181 @@
 #include <string.h>
 #include <stdbool.h>
 
-#include "command.h"
-
-#define MAX_CMD_COUNT 50
-#define MAX_CMD_LEN 25
+#include <errno.h>
+#include <unistd.h>
 
+#include "command.h"
 
-	//TODO FUNCTION COMMENT
+/*token separators, anything else is part of a token*/
+static bool is_separator (char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
 
 /*
- * PURPOSE: parse user input into the commands struct
+ * PURPOSE: split user input into the commands struct in place. Separators
+ *          after each token are overwritten with '\0' and the tokens point
+ *          into the input, so nothing is allocated or copied. A last
+ *          token of & sets background instead of being kept.
  * INPUTS:
- *	input: the list of commands from the user
- *  cmd: double pointer to the command struct that holds all the commands
+ *	input: the line from the user, modified by the split
+ *  cmd: the command struct that receives the tokens
  * RETURN:
- *  If no errors occurred  then true
- *  else false for an error in the process.
+ *  If no errors occurred then true
+ *  else false for more than MAX_CMD_COUNT tokens, leaving no tokens.
  *
  **/
 
-bool parse_user_input (const char* input, Commands_t** cmd) {
+bool parse_user_input (char* input, Commands_t* cmd) {
 
-	//TODO ERROR CHECK INCOMING PARAMETERS
 	if(!input || !cmd){
 		return false;
 	}
-	//####################################
-
-	char *string = strdup(input);
-
-	*cmd = calloc (1,sizeof(Commands_t));
-	(*cmd)->cmds = calloc(MAX_CMD_COUNT,sizeof(char*));
 
-	unsigned int i = 0;
-	char *token;
-	token = strtok(string, " \n");
-	for (; token != NULL && i < MAX_CMD_COUNT; ++i) {
-		(*cmd)->cmds[i] = calloc(MAX_CMD_LEN,sizeof(char));
-		if (!(*cmd)->cmds[i]) {
-			perror("Allocation Error\n");
+	cmd->num_cmds = 0;
+	cmd->background = false;
+	char* p = input;
+	for (;;) {
+		while (is_separator(*p)) {
+			++p;
+		}
+		if (*p == '\0') {
+			if (cmd->num_cmds > 1 && strcmp(cmd->cmds[cmd->num_cmds - 1], "&") == 0) {
+				cmd->background = true;
+				--cmd->num_cmds;
+			}
+			return true;
+		}
+		if (cmd->num_cmds == MAX_CMD_COUNT) {
+			cmd->num_cmds = 0;
 			return false;
 		}
-		strncpy((*cmd)->cmds[i],token, strlen(token) + 1);
-		(*cmd)->num_cmds++;
-		token = strtok(NULL, " \n");
+		cmd->cmds[cmd->num_cmds++] = p;
+		while (*p != '\0' && !is_separator(*p)) {
+			++p;
+		}
+		if (*p != '\0') {
+			*p++ = '\0';
+		}
 	}
-	free(string);
-	return true;
 }
 
-	//TODO FUNCTION COMMENT
 /*
- * PURPOSE: free the memory that holds all the commands
+ * PURPOSE: sets up a line reader over an open file descriptor
  * INPUTS:
- *	cmd: double pointer to the struct that holds the commands
+ *	r: the reader
+ *  fd: where the lines come from, it stays open
  * RETURN:
- *  void
+ *  If the buffer could be allocated then true
+ *  else false.
  *
  **/
+bool open_line_reader (Line_Reader_t* r, int fd) {
 
-void destroy_commands(Commands_t** cmd) {
+	if (!r || fd < 0) {
+		return false;
+	}
+	memset(r, 0, sizeof(*r));
+	r->fd = fd;
+	r->buf = malloc(LINE_BUFFER_BYTES + 1);
+	return r->buf != NULL;
+}
 
-	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!(*cmd)){
-		return;
+/*
+ * PURPOSE: refills the buffer, moving the unfinished line to its front
+ * INPUTS:
+ *	r: the reader
+ * RETURN:
+ *  If any bytes were added then true
+ *  else false at the end of the input or on an error.
+ *
+ **/
+static bool fill_line_buffer (Line_Reader_t* r) {
+	if (r->eof) {
+		return false;
+	}
+	if (r->start > 0) {
+		memmove(r->buf, &r->buf[r->start], r->end - r->start);
+		r->end -= r->start;
+		r->start = 0;
+	}
+	for (;;) {
+		ssize_t got = read(r->fd, &r->buf[r->end], LINE_BUFFER_BYTES - r->end);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			r->eof = true;
+			r->failed = got < 0;
+			return false;
+		}
+		r->end += got;
+		return true;
 	}
-	//####################################
+}
+
+/*
+ * PURPOSE: hands out the next line
+ * INPUTS:
+ *	r: the reader
+ * RETURN:
+ *  the line without its newline, valid until the next call
+ *  NULL at the end of the input.
+ *
+ **/
+char* next_line (Line_Reader_t* r) {
 
-	for (int i = 0; i < (*cmd)->num_cmds; ++i) {
-		free((*cmd)->cmds[i]);
+	if (!r || !r->buf) {
+		return NULL;
+	}
+	bool skipping = false;
+	size_t scanned = r->start;
+	for (;;) {
+		char* newline = memchr(&r->buf[scanned], '\n', r->end - scanned);
+		if (newline) {
+			char* line = &r->buf[r->start];
+			*newline = '\0';
+			r->start = newline - r->buf + 1;
+			if (!skipping) {
+				return line;
+			}
+			skipping = false;
+			scanned = r->start;
+			continue;
+		}
+		if (r->end - r->start == LINE_BUFFER_BYTES) {
+			/*too long to ever fit, drop what is here and the rest of the line*/
+			if (!skipping) {
+				r->skipped++;
+			}
+			skipping = true;
+			r->start = r->end = 0;
+		}
+		scanned = r->end - r->start;
+		if (!fill_line_buffer(r)) {
+			/*a last line without a newline still counts*/
+			if (r->end > r->start && !skipping) {
+				char* line = &r->buf[r->start];
+				r->buf[r->end] = '\0';
+				r->start = r->end;
+				return line;
+			}
+			return NULL;
+		}
 	}
-	free((*cmd)->cmds);
-	free((*cmd));
-	*cmd = NULL;
 }
 
+/*
+ * PURPOSE: frees the buffer of a line reader, the descriptor stays open
+ * INPUTS:
+ *	r: the reader
+ * RETURN:
+ *  void
+ *
+ **/
+void close_line_reader (Line_Reader_t* r) {
+	if (!r) {
+		return;
+	}
+	free(r->buf);
+	r->buf = NULL;
+}
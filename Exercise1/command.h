@@ -1,12 +1,41 @@
 #ifndef _COMMAND_H_
 #define _COMMAND_H_
 
+#define MAX_CMD_COUNT 50
+
+/*
+ * tokens are views into the parsed line and live as long as it does, a
+ * trailing & asks for the command to run in the background and is not
+ * one of them
+ */
 typedef struct {
 	unsigned int num_cmds;
-	char** cmds;
+	char* cmds[MAX_CMD_COUNT];
+	bool background;
 }Commands_t;
 
-bool parse_user_input (const char* input, Commands_t** cmd);
-void destroy_commands(Commands_t** cmd);
+bool parse_user_input (char* input, Commands_t* cmd);
+
+/*
+ * Streams lines out of a file descriptor through one large buffer for
+ * scripts. Lines are handed out in place with the newline cut off and
+ * stay valid until the next call. A line that does not fit in the
+ * buffer is skipped and counted.
+ */
+#define LINE_BUFFER_BYTES (1 << 20)
+
+typedef struct {
+	int fd;
+	char* buf;
+	size_t start;		/*first byte not handed out yet*/
+	size_t end;			/*end of the bytes read so far*/
+	bool eof;
+	bool failed;		/*a read error ended the input*/
+	size_t skipped;		/*lines too long for the buffer*/
+}Line_Reader_t;
+
+bool open_line_reader (Line_Reader_t* r, int fd);
+char* next_line (Line_Reader_t* r);
+void close_line_reader (Line_Reader_t* r);
 
 #endif
@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "command_stats.h"
+#include "thread_pool.h"
+
+/*
+ * Latencies go into log linear buckets, 2^STATS_SUB_BITS per power of two,
+ * so a percentile is within 1 / 2^STATS_SUB_BITS of the real value.
+ */
+#define STATS_SUB_BITS 3
+#define STATS_BUCKETS (64 << STATS_SUB_BITS)
+#define STATS_MAX_THREADS 1024
+
+typedef struct {
+	const char* name;
+	unsigned long long calls;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+	unsigned long long bytes;
+	unsigned long long counters[STATS_COUNTERS];
+	unsigned int histogram[STATS_BUCKETS];
+}Command_Stats_t;
+
+typedef struct {
+	const char* name;
+	unsigned long long start_ns;
+	unsigned long long duration_ns;
+	unsigned long long bytes;
+	unsigned long long counters[STATS_COUNTERS];
+}Stats_Span_t;
+
+static const char* counter_names[STATS_COUNTERS] = { "cycles", "instructions", "llc_misses" };
+static const unsigned long long counter_configs[STATS_COUNTERS] = {
+	PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+};
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static Command_Stats_t commands[STATS_MAX_COMMANDS];
+static Stats_Span_t spans[STATS_TRACE_SPANS];
+static size_t num_spans = 0;		/*spans ever recorded, the ring keeps the last ones*/
+static unsigned long long epoch_ns = 0;
+
+/*one perf group per thread, counters present in the order of counter_names*/
+static int group_fds[STATS_MAX_THREADS];
+static unsigned int num_groups = 0;
+static bool counter_present[STATS_COUNTERS];
+
+static unsigned long long now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static unsigned int bucket_of (unsigned long long ns) {
+	if (ns < (1u << STATS_SUB_BITS)) {
+		return ns;
+	}
+	const unsigned int e = 63 - __builtin_clzll(ns);
+	const unsigned int sub = (ns >> (e - STATS_SUB_BITS)) & ((1u << STATS_SUB_BITS) - 1);
+	return ((e - STATS_SUB_BITS + 1) << STATS_SUB_BITS) + sub;
+}
+
+/*middle of the values that land in a bucket*/
+static double bucket_value (unsigned int bucket) {
+	if (bucket < (1u << STATS_SUB_BITS)) {
+		return bucket;
+	}
+	const unsigned int e = (bucket >> STATS_SUB_BITS) + STATS_SUB_BITS - 1;
+	const unsigned long long width = 1ull << (e - STATS_SUB_BITS);
+	const unsigned long long low = (1ull << e) + (bucket & ((1u << STATS_SUB_BITS) - 1)) * width;
+	return low + width / 2.0;
+}
+
+static double histogram_percentile (const Command_Stats_t* c, double p) {
+	const unsigned long long rank = (unsigned long long) (p / 100.0 * c->calls + 0.999999);
+	unsigned long long seen = 0;
+	for (unsigned int b = 0; b < STATS_BUCKETS; ++b) {
+		seen += c->histogram[b];
+		if (seen >= rank && seen > 0) {
+			/*the middle of the top bucket can lie past the slowest call*/
+			const double value = bucket_value(b);
+			return value < c->max_ns ? value : (double) c->max_ns;
+		}
+	}
+	return 0;
+}
+
+static int open_counter (pid_t tid, unsigned long long config, int group) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int) syscall(SYS_perf_event_open, &attr, tid, -1, group, 0);
+}
+
+/*
+ * PURPOSE: opens a counter group on one thread with the counters the
+ *          calling thread could open
+ * INPUTS:
+ *	tid: the thread, 0 for the calling one
+ *  probe: true for the calling thread, which decides the counters
+ * RETURN:
+ *  the group leader, -1 when no counter could be opened
+ *
+ **/
+static int open_group (pid_t tid, bool probe) {
+	int leader = -1;
+	for (unsigned int i = 0; i < STATS_COUNTERS; ++i) {
+		if (!probe && !counter_present[i]) {
+			continue;
+		}
+		const int fd = open_counter(tid, counter_configs[i], leader);
+		if (fd < 0) {
+			if (!probe) {
+				/*the group has to match the others or the reads do not line up*/
+				if (leader >= 0) {
+					close(leader);
+				}
+				return -1;
+			}
+			continue;
+		}
+		if (leader < 0) {
+			leader = fd;
+		}
+		if (probe) {
+			counter_present[i] = true;
+		}
+	}
+	return leader;
+}
+
+/*
+ * PURPOSE: opens the hardware counters on this thread and every pool
+ *          worker, call it after the thread pool has started
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void, without perf_event_open only the timings are kept
+ *
+ **/
+void init_command_stats (void) {
+
+	epoch_ns = now_ns();
+	const char* env = getenv("MATLAB_PERF");
+	if (num_groups > 0 || (env && strcmp(env, "0") == 0)) {
+		return;
+	}
+
+	const int own = open_group(0, true);
+	if (own < 0) {
+		return;
+	}
+	group_fds[num_groups++] = own;
+
+	pid_t tids[STATS_MAX_THREADS - 1];
+	const unsigned int workers = thread_pool_tids(tids, STATS_MAX_THREADS - 1);
+	for (unsigned int i = 0; i < workers; ++i) {
+		const int fd = open_group(tids[i], false);
+		if (fd >= 0) {
+			group_fds[num_groups++] = fd;
+		}
+	}
+}
+
+void close_command_stats (void) {
+	for (unsigned int i = 0; i < num_groups; ++i) {
+		close(group_fds[i]);
+	}
+	num_groups = 0;
+}
+
+/*sums every thread's counters*/
+static void read_counters (unsigned long long* out) {
+	memset(out, 0, STATS_COUNTERS * sizeof(unsigned long long));
+	for (unsigned int g = 0; g < num_groups; ++g) {
+		unsigned long long values[1 + STATS_COUNTERS];
+		if (read(group_fds[g], values, sizeof(values)) < (ssize_t) sizeof(unsigned long long)) {
+			continue;
+		}
+		unsigned int v = 1;
+		for (unsigned int i = 0; i < STATS_COUNTERS && v <= values[0]; ++i) {
+			if (counter_present[i]) {
+				out[i] += values[v++];
+			}
+		}
+	}
+}
+
+/*
+ * PURPOSE: marks the start of a command
+ * INPUTS:
+ *	probe: receives the start time and counters
+ * RETURN:
+ *  void
+ *
+ **/
+void stats_begin (Stats_Probe_t* probe) {
+	if (num_groups) {
+		read_counters(probe->counters);
+	}
+	probe->start_ns = now_ns();
+	probe->end_ns = probe->start_ns;
+}
+
+/*
+ * PURPOSE: marks the end of a command, leaving its time and counts in the probe
+ * INPUTS:
+ *	probe: from stats_begin
+ * RETURN:
+ *  void
+ *
+ **/
+void stats_end (Stats_Probe_t* probe) {
+	probe->end_ns = now_ns();
+	if (num_groups) {
+		unsigned long long counters[STATS_COUNTERS];
+		read_counters(counters);
+		for (unsigned int i = 0; i < STATS_COUNTERS; ++i) {
+			probe->counters[i] = counters[i] - probe->counters[i];
+		}
+	}
+}
+
+/*
+ * PURPOSE: records a finished command
+ * INPUTS:
+ *	probe: from stats_end
+ *  command: index of the command type, below STATS_MAX_COMMANDS
+ *  name: name of the command type, kept by pointer
+ *  bytes: bytes of matrix storage the command touched
+ * RETURN:
+ *  void
+ *
+ **/
+void stats_record (const Stats_Probe_t* probe, unsigned int command, const char* name, size_t bytes) {
+
+	if (command >= STATS_MAX_COMMANDS) {
+		return;
+	}
+	const unsigned long long took = probe->end_ns - probe->start_ns;
+
+	pthread_mutex_lock(&stats_lock);
+	Command_Stats_t* c = &commands[command];
+	c->name = name;
+	c->calls++;
+	c->total_ns += took;
+	c->max_ns = took > c->max_ns ? took : c->max_ns;
+	c->bytes += bytes;
+	c->histogram[bucket_of(took)]++;
+
+	Stats_Span_t* s = &spans[num_spans++ % STATS_TRACE_SPANS];
+	s->name = name;
+	s->start_ns = probe->start_ns;
+	s->duration_ns = took;
+	s->bytes = bytes;
+	for (unsigned int i = 0; i < STATS_COUNTERS; ++i) {
+		const unsigned long long count = num_groups ? probe->counters[i] : 0;
+		c->counters[i] += count;
+		s->counters[i] = count;
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * PURPOSE: prints a line per command type that has run since the last reset
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+void print_command_stats (void) {
+
+	pthread_mutex_lock(&stats_lock);
+	printf("%-10s %9s %12s %10s %10s %10s %14s", "command", "calls", "total ms", "p50 us",
+		"p99 us", "max us", "bytes");
+	for (unsigned int i = 0; i < STATS_COUNTERS; ++i) {
+		if (counter_present[i] && num_groups) {
+			printf(" %14s", counter_names[i]);
+		}
+	}
+	printf("\n");
+	for (unsigned int k = 0; k < STATS_MAX_COMMANDS; ++k) {
+		const Command_Stats_t* c = &commands[k];
+		if (c->calls == 0) {
+			continue;
+		}
+		printf("%-10s %9llu %12.3f %10.2f %10.2f %10.2f %14llu", c->name, c->calls,
+			c->total_ns / 1e6, histogram_percentile(c, 50) / 1e3, histogram_percentile(c, 99) / 1e3,
+			c->max_ns / 1e3, c->bytes);
+		for (unsigned int i = 0; i < STATS_COUNTERS; ++i) {
+			if (counter_present[i] && num_groups) {
+				printf(" %14llu", c->counters[i]);
+			}
+		}
+		printf("\n");
+	}
+	if (!num_groups) {
+		printf("Hardware counters are not available\n");
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * PURPOSE: clears the counts, histograms and trace spans
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+void reset_command_stats (void) {
+	pthread_mutex_lock(&stats_lock);
+	memset(commands, 0, sizeof(commands));
+	num_spans = 0;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/*
+ * PURPOSE: writes the kept spans as Chrome trace events, which chrome://tracing
+ *          and Perfetto show on a timeline
+ * INPUTS:
+ *	path: file to write
+ * RETURN:
+ *  If the file was written then true
+ *  else false.
+ *
+ **/
+bool write_command_trace (const char* path) {
+
+	FILE* f = path ? fopen(path, "w") : NULL;
+	if (!f) {
+		return false;
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	const size_t kept = num_spans < STATS_TRACE_SPANS ? num_spans : STATS_TRACE_SPANS;
+	fprintf(f, "{\"traceEvents\": [\n");
+	for (size_t i = 0; i < kept; ++i) {
+		const Stats_Span_t* s = &spans[(num_spans - kept + i) % STATS_TRACE_SPANS];
+		fprintf(f, "{\"name\": \"%s\", \"cat\": \"command\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+			"\"pid\": %d, \"tid\": 1, \"args\": {\"bytes\": %llu",
+			s->name, (s->start_ns - epoch_ns) / 1e3, s->duration_ns / 1e3, (int) getpid(), s->bytes);
+		for (unsigned int c = 0; c < STATS_COUNTERS; ++c) {
+			if (counter_present[c] && num_groups) {
+				fprintf(f, ", \"%s\": %llu", counter_names[c], s->counters[c]);
+			}
+		}
+		fprintf(f, "}}%s\n", i + 1 < kept ? "," : "");
+	}
+	fprintf(f, "], \"displayTimeUnit\": \"ns\"}\n");
+	pthread_mutex_unlock(&stats_lock);
+
+	return fclose(f) == 0;
+}
@@ -0,0 +1,35 @@
+#ifndef _COMMAND_STATS_H_
+#define _COMMAND_STATS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Always on instrumentation of run_commands. Every command type keeps its
+ * call count, total time, a latency histogram for the percentiles and the
+ * bytes of the matrices it named. Where perf_event_open is allowed,
+ * cycles, instructions and last level cache misses are counted on the
+ * calling thread and on every pool worker, MATLAB_PERF=0 turns that off.
+ * The last STATS_TRACE_SPANS commands are also kept as spans that can be
+ * written out as Chrome trace events.
+ */
+#define STATS_MAX_COMMANDS 64
+#define STATS_TRACE_SPANS 65536
+#define STATS_COUNTERS 3
+
+typedef struct {
+	unsigned long long start_ns;
+	unsigned long long end_ns;
+	unsigned long long counters[STATS_COUNTERS];	/*at the start, then what the command used*/
+}Stats_Probe_t;
+
+void init_command_stats (void);
+void close_command_stats (void);
+void stats_begin (Stats_Probe_t* probe);
+void stats_end (Stats_Probe_t* probe);
+void stats_record (const Stats_Probe_t* probe, unsigned int command, const char* name, size_t bytes);
+void print_command_stats (void);
+void reset_command_stats (void);
+bool write_command_trace (const char* path);
+
+#endif
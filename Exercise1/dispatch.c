@@ -0,0 +1,929 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "catalogue.h"
+#include "command.h"
+#include "command_stats.h"
+#include "dispatch.h"
+#include "matrix.h"
+#include "matrix_expr.h"
+#include "matrix_jobs.h"
+#include "matrix_memory.h"
+#include "matrix_shm.h"
+
+/*
+ * Command handlers. run_commands has already looked the name up and
+ * checked the argument count against the table, so cmds[0] is the
+ * command and the arguments it needs are present.
+ */
+
+/*display <matrix_name>*/
+static void run_display (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	/*find the requested matrix*/
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	if (mat1) {
+		display_matrix (mat1);
+	}
+	else {
+		printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+		return;
+	}
+}
+
+/*add <matrix_one> <matrix_two> <matrix_result>*/
+static void run_add (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	Matrix_t* mat2 = find_matrix(mats,cmd->cmds[2]);
+	if (mat1 && mat2) {
+		Matrix_t* c = NULL;
+		/*the sum of two sparse matrices stays sparse, a sum with a disk matrix goes to disk*/
+		const bool sparse = mat1->sparse && mat2->sparse;
+		const bool disk = mat1->disk || mat2->disk;
+		if( disk ? !create_disk_matrix (&c,cmd->cmds[3], mat1->rows, mat1->cols, mat1->type)
+				: sparse ? !create_sparse_matrix (&c,cmd->cmds[3], mat1->rows, mat1->cols)
+				: !create_matrix_for_overwrite (&c,cmd->cmds[3], mat1->rows, mat1->cols, mat1->type)) {
+			printf("Failure to create the result Matrix (%s)\n", cmd->cmds[3]);
+			return;
+		}
+
+		if (! add_matrices(mat1, mat2,c) ) {
+			printf("Failure to add %s with %s into %s\n", mat1->name, mat2->name,c->name);
+			destroy_matrix(&c);
+			return;
+		}
+		printf ("Addition of %s into %s finished\n", mat1->name, mat2->name);
+
+		/*the result may replace one of the operands, so it goes in last*/
+		if(!insert_matrix(mats,c)){
+			printf("Failure to add the new matrix to the catalogue\n");
+			destroy_matrix(&c);
+			return;
+		} //FINISHTODO ERROR CHECK NEEDED
+	}
+}
+
+/*mul <matrix_one> <matrix_two> <matrix_result> [32|64]*/
+static void run_mul (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	Matrix_t* mat2 = find_matrix(mats,cmd->cmds[2]);
+	Matrix_Mul_Mode_t mode = MUL_WRAP_32;
+	if (cmd->num_cmds == 5) {
+		if (strncmp(cmd->cmds[4],"64",strlen("64") + 1) == 0) {
+			mode = MUL_ACCUM_64;
+		}
+		else if (strncmp(cmd->cmds[4],"32",strlen("32") + 1) != 0) {
+			printf("Accumulation must be 32 or 64\n");
+			return;
+		}
+	}
+	if (!mat1 || !mat2) {
+		printf("Multiply Failed\n");
+		return;
+	}
+	Matrix_t* a = mat1;
+	Matrix_t* b = mat2;
+	if (a->cols != b->rows) {
+		printf("Cannot multiply (%u,%u) by (%u,%u)\n", a->rows, a->cols, b->rows, b->cols);
+		return;
+	}
+	Matrix_t* c = NULL;
+	const bool sparse = a->sparse && b->sparse;
+	if( sparse ? !create_sparse_matrix (&c,cmd->cmds[3], a->rows, b->cols)
+			: !create_matrix_for_overwrite (&c,cmd->cmds[3], a->rows, b->cols, MATRIX_U32)) {
+		printf("Failure to create the result Matrix (%s)\n", cmd->cmds[3]);
+		return;
+	}
+	if (! multiply_matrices(a, b, c, mode) ) {
+		printf("Failure to multiply %s with %s into %s\n", a->name, b->name, c->name);
+		destroy_matrix(&c);
+		return;
+	}
+	printf ("Multiplication of %s by %s into %s finished\n", a->name, b->name, c->name);
+	if(!insert_matrix(mats,c)){
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&c);
+		return;
+	}
+}
+
+/*duplicate <src_matrix> <dest_matrix>*/
+static void run_duplicate (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	if (strlen(cmd->cmds[1]) + 1 > MATRIX_NAME_LEN) {
+		printf("Duplication Failed\n");
+		return;
+	}
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	if (mat1 ) {
+			Matrix_t* dup_mat = NULL;
+			/*an empty shell, duplicate gives it the size and storage of mat1*/
+			if(!create_sparse_matrix (&dup_mat,cmd->cmds[2], 0, 0)) {
+				return;
+			}
+			if(!duplicate_matrix (mat1, dup_mat)){
+				printf("Failure to duplicate the matrix\n");
+				destroy_matrix(&dup_mat);
+				return;
+			} //FINISHTODO ERROR CHECK NEEDED
+
+			printf ("Duplication of %s into %s finished\n", mat1->name, cmd->cmds[2]);
+
+			if(!insert_matrix(mats,dup_mat)){
+				printf("Failure to add the new matrix to the catalogue\n");
+				destroy_matrix(&dup_mat);
+				return;
+			} //FINISHTODO ERROR CHECK NEEDED
+	}
+	else {
+		printf("Duplication Failed\n");
+		return;
+	}
+}
+
+/*equal <matrix_one> <matrix_two>*/
+static void run_equal (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	Matrix_t* mat2 = find_matrix(mats,cmd->cmds[2]);
+	if (mat1 && mat2) {
+		if ( equal_matrices(mat1,mat2) ) {
+			printf("SAME DATA IN BOTH\n");
+		}
+		else {
+			printf("DIFFERENT DATA IN BOTH\n");
+		}
+	}
+	else {
+		printf("Equal Failed\n");
+		return;
+	}
+}
+
+/*shift <matrix_name> <l|r> <shifts>*/
+static void run_shift (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	const int shift_value = atoi(cmd->cmds[3]);
+	if (mat1 ) {
+		if(!bitwise_shift_matrix(mat1,cmd->cmds[2][0], shift_value)){
+			printf("Failure to shift the matrix\n");
+			return;
+		} //FINISHTODO ERROR CHECK NEEDED
+
+		printf("Matrix (%s) has been shifted by %d\n", mat1->name, shift_value);
+
+	}
+	else {
+		printf("Matrix shift failed\n");
+		return;
+	}
+}
+
+/*read <matrix_file> [map|disk] [&]*/
+static void run_read (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	/*read <file> map views the file in place instead of copying it, disk leaves it where it is*/
+	const bool mapped = cmd->num_cmds == 3
+		&& strncmp(cmd->cmds[2],"map",strlen("map") + 1) == 0;
+	const bool disk = cmd->num_cmds == 3
+		&& strncmp(cmd->cmds[2],"disk",strlen("disk") + 1) == 0;
+	if (cmd->num_cmds == 3 && !mapped && !disk) {
+		printf("Read mode must be map or disk\n");
+		return;
+	}
+	if (cmd->background) {
+		unsigned int id = 0;
+		if (mapped || disk) {
+			printf("map and disk reads take no time, they do not run in the background\n");
+		}
+		else if (!start_read_job(cmd->cmds[1], &id)) {
+			printf("Failure to start reading (%s)\n", cmd->cmds[1]);
+		}
+		else {
+			printf("[%u] Reading (%s) in the background\n", id, cmd->cmds[1]);
+		}
+		return;
+	}
+	Matrix_t* new_matrix = NULL;
+	if(mapped ? !read_matrix_mapped(cmd->cmds[1],&new_matrix)
+			: disk ? !read_matrix_disk(cmd->cmds[1],&new_matrix)
+			: !read_matrix(cmd->cmds[1],&new_matrix)) {
+		printf("Read Failed\n");
+		return;
+	}
+
+	if(!insert_matrix(mats,new_matrix)){
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&new_matrix);
+		return;
+	} //FINISHTODO ERROR CHECK NEEDED
+	printf("Matrix (%s) is read from the filesystem\n", cmd->cmds[1]);
+}
+
+/*readtile <matrix_file> <tile> <matrix_result>*/
+static void run_readtile (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* new_matrix = NULL;
+	const unsigned int tile = atoi(cmd->cmds[2]);
+	if(! read_matrix_tile(cmd->cmds[1], tile, cmd->cmds[3], &new_matrix)) {
+		printf("Read Failed\n");
+		return;
+	}
+	if(!insert_matrix(mats,new_matrix)){
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&new_matrix);
+		return;
+	}
+	printf("Tile %u of (%s) is read into Matrix (%s)\n", tile, cmd->cmds[1], cmd->cmds[3]);
+}
+
+/*write <matrix_name> [raw|for|delta] [&]*/
+static void run_write (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	Matrix_Codec_t codec = MATRIX_CODEC_RAW;
+	if (cmd->num_cmds == 3) {
+		if (strncmp(cmd->cmds[2],"for",strlen("for") + 1) == 0) {
+			codec = MATRIX_CODEC_FOR;
+		}
+		else if (strncmp(cmd->cmds[2],"delta",strlen("delta") + 1) == 0) {
+			codec = MATRIX_CODEC_DELTA;
+		}
+		else if (strncmp(cmd->cmds[2],"raw",strlen("raw") + 1) != 0) {
+			printf("Codec must be raw, for or delta\n");
+			return;
+		}
+	}
+	if (mat1 && cmd->background) {
+		unsigned int id = 0;
+		if (!start_write_job(mat1, codec, &id)) {
+			printf("Failure to start writing (%s)\n", mat1->name);
+			return;
+		}
+		printf("[%u] Writing (%s) in the background\n", id, mat1->name);
+		return;
+	}
+	if(!mat1 || !write_matrix(mat1->name,mat1,codec)) {
+		printf("Write Failed\n");
+		return;
+	}
+	else {
+		printf("Matrix (%s) is wrote out to the filesystem\n", mat1->name);
+	}
+}
+
+/*create <matrix_name> <rows> <cols> [type] [disk]*/
+static void run_create (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	if (strlen(cmd->cmds[1]) + 1 > MATRIX_NAME_LEN) {
+		printf("Matrix name is too long\n");
+		return;
+	}
+	Matrix_t* new_mat = NULL;
+	const unsigned int rows = strtoul(cmd->cmds[2], NULL, 10);
+	const unsigned int cols = strtoul(cmd->cmds[3], NULL, 10);
+	Matrix_Type_t type = MATRIX_U32;
+	bool disk = false;
+	for (unsigned int i = 4; i < cmd->num_cmds; ++i) {
+		if (!disk && strncmp(cmd->cmds[i],"disk",strlen("disk") + 1) == 0) {
+			disk = true;
+		}
+		else if (i > 4 || !parse_matrix_type(cmd->cmds[i], &type)) {
+			printf("Element type must be u8, u16, u32, u64, i32, f32 or f64, then optionally disk\n");
+			return;
+		}
+	}
+
+	if(disk ? !create_disk_matrix(&new_mat,cmd->cmds[1],rows, cols, type)
+			: !create_typed_matrix(&new_mat,cmd->cmds[1],rows, cols, type)){
+		printf("Failure to create matrix\n");
+		return;
+	} //FINISHTODO ERROR CHECK NEEDED
+
+	if(!insert_matrix(mats,new_mat)){
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&new_mat);
+		return;
+	} // FINISHTODO ERROR CHECK NEEDED
+
+	printf("Created Matrix (%s,%u,%u)\n", new_mat->name, new_mat->rows, new_mat->cols);
+}
+
+/*random <matrix_name> <start_range> <end_range> [seed]*/
+static void run_random (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	const unsigned int start_range = strtoul(cmd->cmds[2], NULL, 10);
+	const unsigned int end_range = strtoul(cmd->cmds[3], NULL, 10);
+	/*without a seed a fresh one is drawn, it is printed so the matrix can be made again*/
+	const unsigned long long seed = cmd->num_cmds == 5 ? strtoull(cmd->cmds[4], NULL, 10)
+		: ((unsigned long long) rand() << 32) ^ (unsigned long long) rand();
+
+	if(!mat1 || !random_matrix(mat1,start_range, end_range, seed)){
+		printf("Failure in creating random numbers for the matrix\n");
+		return;
+	} //FINISHTODO ERROR CHECK NEEDED
+
+	printf("Matrix (%s) is randomized between %u %u with seed %llu\n", mat1->name, start_range, end_range, seed);
+}
+
+/*slice <matrix_name> <row_begin> <row_end> <col_begin> <col_end> [matrix_result]*/
+static void run_slice (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	/*without a result name the view takes the place of the matrix*/
+	const char* name = cmd->num_cmds == 7 ? cmd->cmds[6] : cmd->cmds[1];
+	if (strlen(name) + 1 > MATRIX_NAME_LEN) {
+		printf("Matrix name is too long\n");
+		return;
+	}
+	Matrix_t* mat1 = find_matrix(mats, cmd->cmds[1]);
+	const unsigned int row_begin = strtoul(cmd->cmds[2], NULL, 10);
+	const unsigned int row_end = strtoul(cmd->cmds[3], NULL, 10);
+	const unsigned int col_begin = strtoul(cmd->cmds[4], NULL, 10);
+	const unsigned int col_end = strtoul(cmd->cmds[5], NULL, 10);
+
+	Matrix_t* view = NULL;
+	/*an empty shell, slice gives it the block of mat1*/
+	if (!mat1 || !create_sparse_matrix(&view, name, 0, 0)) {
+		printf("Failure to slice the matrix\n");
+		return;
+	}
+	if (!slice_matrix(mat1, row_begin, row_end, col_begin, col_end, view)) {
+		printf("Failure to slice the matrix, it must be dense and the block within it\n");
+		destroy_matrix(&view);
+		return;
+	}
+	if (!insert_matrix(mats, view)) {
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&view);
+		return;
+	}
+	printf("Matrix (%s) is rows %u to %u and cols %u to %u of %s\n", name, row_begin, row_end,
+		col_begin, col_end, cmd->cmds[1]);
+}
+
+/*transpose <matrix_name> [matrix_result]*/
+static void run_transpose (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	const char* name = cmd->num_cmds == 3 ? cmd->cmds[2] : cmd->cmds[1];
+	if (strlen(name) + 1 > MATRIX_NAME_LEN) {
+		printf("Matrix name is too long\n");
+		return;
+	}
+	Matrix_t* mat1 = find_matrix(mats, cmd->cmds[1]);
+	if (!mat1 || !mat1->data) {
+		printf("Failure to transpose the matrix, it must exist and be dense\n");
+		return;
+	}
+
+	Matrix_t* result = NULL;
+	if (!create_matrix_for_overwrite(&result, name, mat1->cols, mat1->rows, mat1->type)) {
+		printf("Failure to create matrix\n");
+		return;
+	}
+	if (!transpose_matrix(mat1, result)) {
+		printf("Failure to transpose the matrix\n");
+		destroy_matrix(&result);
+		return;
+	}
+	if (!insert_matrix(mats, result)) {
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&result);
+		return;
+	}
+	printf("Matrix (%s) is the transpose of %s\n", name, cmd->cmds[1]);
+}
+
+/*cast <matrix_name> <type>*/
+static void run_cast (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats, cmd->cmds[1]);
+	Matrix_Type_t type = MATRIX_U32;
+	if (!parse_matrix_type(cmd->cmds[2], &type)) {
+		printf("Element type must be u8, u16, u32, u64, i32, f32 or f64\n");
+		return;
+	}
+	if (!mat1 || !cast_matrix(mat1, type)) {
+		printf("Failure to cast the matrix (%s)\n", cmd->cmds[1]);
+		return;
+	}
+	printf("Matrix (%s) is now %s\n", mat1->name, matrix_type_name(type));
+}
+
+/*sparsify|densify <matrix_name>*/
+static void run_convert (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	const bool to_sparse = cmd->cmds[0][0] == 's';
+	if (!mat1 || (to_sparse ? !sparsify_matrix(mat1) : !densify_matrix(mat1))) {
+		printf("Conversion Failed\n");
+		return;
+	}
+	if (mat1->sparse) {
+		printf("Matrix (%s) is sparse with %zu nonzeros\n", mat1->name, mat1->sparse->nnz);
+	}
+	else {
+		printf("Matrix (%s) is dense\n", mat1->name);
+	}
+}
+
+/*eval <matrix_result> = <expression>*/
+static void run_eval (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	/*the tokens are joined back up so spacing inside the expression is free*/
+	char text[EXPR_MAX_TEXT] = "";
+	for (unsigned int i = 1; i < cmd->num_cmds; ++i) {
+		if (strlen(text) + strlen(cmd->cmds[i]) + 2 > sizeof(text)) {
+			printf("Expression is too long\n");
+			return;
+		}
+		strcat(text, cmd->cmds[i]);
+		strcat(text, " ");
+	}
+	char* equals = strchr(text, '=');
+	char* name = strtok(text, " =");
+	bool usable = equals && name && name < equals && strlen(name) + 1 <= MATRIX_NAME_LEN;
+	/*only spaces may sit between the name and the =*/
+	for (char* c = name ? name + strlen(name) + 1 : NULL; usable && c < equals; ++c) {
+		usable = *c == ' ';
+	}
+	if (!usable) {
+		printf("Usage: eval <matrix_result_name> = <expression>\n");
+		return;
+	}
+
+	Matrix_Expr_t expr;
+	if (!compile_expression(equals + 1, mats, &expr)) {
+		return;
+	}
+	Matrix_t* result = NULL;
+	if (!create_matrix_for_overwrite(&result, name, expr.rows, expr.cols, MATRIX_U32)) {
+		printf("Failure to create the result Matrix (%s)\n", name);
+		return;
+	}
+	if (!evaluate_expression(&expr, result)) {
+		printf("Evaluation Failed\n");
+		destroy_matrix(&result);
+		return;
+	}
+	/*the result may replace one of the inputs, so it goes in last*/
+	if (!insert_matrix(mats, result)) {
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&result);
+		return;
+	}
+	printf("Matrix (%s) is evaluated\n", result->name);
+}
+
+/*delete <matrix_name>*/
+static void run_delete (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	if (!remove_matrix(mats, cmd->cmds[1])) {
+		printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+		return;
+	}
+	printf("Matrix (%s) is deleted\n", cmd->cmds[1]);
+}
+
+/*sum <matrix_name>*/
+static void run_sum (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	unsigned long long sum = 0;
+	if (!mat1 || !sum_matrix(mat1, &sum)) {
+		printf("Sum Failed\n");
+		return;
+	}
+	printf("Sum of Matrix (%s) is %llu\n", mat1->name, sum);
+}
+
+/*min|max|mean <matrix_name>*/
+static void run_summary (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	Matrix_Summary_t summary;
+	if (!mat1 || !summarize_matrix(mat1, &summary)) {
+		printf("Reduction Failed\n");
+		return;
+	}
+	if (cmd->cmds[0][1] == 'i') {
+		printf("Min of Matrix (%s) is %u\n", mat1->name, summary.min);
+	}
+	else if (cmd->cmds[0][1] == 'a') {
+		printf("Max of Matrix (%s) is %u\n", mat1->name, summary.max);
+	}
+	else {
+		printf("Mean of Matrix (%s) is %f\n", mat1->name, summary.mean);
+	}
+}
+
+/*rowsum|colsum <matrix_name>*/
+static void run_sums (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	if (!mat1) {
+		printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+		return;
+	}
+	const bool rows = cmd->cmds[0][0] == 'r';
+	const unsigned int count = rows ? mat1->rows : mat1->cols;
+	unsigned long long* sums = calloc(count + 1, sizeof(unsigned long long));
+	if (!sums) {
+		printf("Failure to allocate the sums\n");
+		return;
+	}
+	bool ok = rows ? row_sums_matrix(mat1, sums) : col_sums_matrix(mat1, sums);
+	if (!ok) {
+		printf("Reduction Failed\n");
+		free(sums);
+		return;
+	}
+	printf("%s sums of Matrix (%s):\n", rows ? "Row" : "Column", mat1->name);
+	for (unsigned int i = 0; i < count; ++i) {
+		printf("%llu ", sums[i]);
+	}
+	printf("\n");
+	free(sums);
+}
+
+/*memory stats|trim*/
+static void run_memory (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	if (strncmp(cmd->cmds[1], "trim", strlen("trim") + 1) == 0) {
+		memory_trim();
+		printf("Cached buffers released\n");
+		return;
+	}
+	if (strncmp(cmd->cmds[1], "stats", strlen("stats") + 1) != 0) {
+		printf("memory takes stats or trim\n");
+		return;
+	}
+	Memory_Stats_t stats;
+	memory_stats(&stats);
+	const double hit_rate = stats.allocs ? 100.0 * stats.hits / stats.allocs : 0.0;
+	printf("Allocations %zu, reused %zu (%.1f%%), frees %zu, released %zu\n",
+		stats.allocs, stats.hits, hit_rate, stats.frees, stats.released);
+	printf("In use %zu bytes, peak %zu bytes, cached %zu bytes\n",
+		stats.bytes_in_use, stats.peak_in_use, stats.bytes_cached);
+	printf("On transparent huge pages %zu, on hugetlb pages %zu\n", stats.huge, stats.hugetlb);
+	for (unsigned int cls = 0; cls < MEMORY_CLASSES; ++cls) {
+		if (stats.in_use[cls] || stats.cached[cls]) {
+			printf("  %12zu bytes: %zu in use, %zu cached\n",
+				(size_t) 1 << (cls + MEMORY_MIN_SHIFT), stats.in_use[cls], stats.cached[cls]);
+		}
+	}
+	Matrix_Disk_Stats_t disk;
+	disk_stats(&disk);
+	printf("Disk streams %zu, bands read %zu (%llu bytes), written %zu (%llu bytes), stalls %zu\n",
+		disk.streams, disk.bands_read, disk.bytes_read, disk.bands_written, disk.bytes_written, disk.stalls);
+	printf("Disk buffers up to %zu bytes, peak %zu bytes\n", disk.pool_bytes, disk.peak_bytes);
+}
+
+/*jobs*/
+static void run_jobs (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	list_jobs();
+}
+
+/*wait [job]*/
+static void run_wait (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	const unsigned int id = cmd->num_cmds == 2 ? strtoul(cmd->cmds[1], NULL, 10) : 0;
+	if (cmd->num_cmds == 2 && id == 0) {
+		printf("Job must be a number from jobs\n");
+		return;
+	}
+	if (!wait_jobs(mats, id) && id != 0) {
+		printf("Job %u failed or does not exist\n", id);
+	}
+}
+
+/*stats [reset|trace <file>]*/
+static void run_stats (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	if (cmd->num_cmds == 1) {
+		print_command_stats();
+	}
+	else if (cmd->num_cmds == 2 && strncmp(cmd->cmds[1], "reset", strlen("reset") + 1) == 0) {
+		reset_command_stats();
+		printf("Command statistics are reset\n");
+	}
+	else if (cmd->num_cmds == 3 && strncmp(cmd->cmds[1], "trace", strlen("trace") + 1) == 0) {
+		if (!write_command_trace(cmd->cmds[2])) {
+			printf("Failure to write the trace to %s\n", cmd->cmds[2]);
+			return;
+		}
+		printf("Trace is written to %s\n", cmd->cmds[2]);
+	}
+	else {
+		printf("Usage: stats [reset|trace <file>]\n");
+	}
+}
+
+/*share <matrix_name>*/
+static void run_share (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	Matrix_t* mat1 = find_matrix(mats,cmd->cmds[1]);
+	if (!mat1) {
+		printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
+		return;
+	}
+	if (!mat1->data) {
+		printf("Only dense matrices in memory can be shared\n");
+		return;
+	}
+	if (!share_matrix(mat1)) {
+		printf("Failure to share Matrix (%s)\n", mat1->name);
+		return;
+	}
+	printf("Matrix (%s) is shared as %s\n", mat1->name, mat1->shm->name);
+}
+
+/*attach <shared_name> [matrix_name]*/
+static void run_attach (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	const char* name = cmd->num_cmds == 3 ? cmd->cmds[2] : cmd->cmds[1];
+	Matrix_t* new_matrix = NULL;
+	if (!attach_matrix(cmd->cmds[1], name, &new_matrix)) {
+		printf("Attach Failed\n");
+		return;
+	}
+	const unsigned long long version = __atomic_load_n(&new_matrix->shm->header->version, __ATOMIC_RELAXED);
+	if(!insert_matrix(mats,new_matrix)){
+		printf("Failure to add the new matrix to the catalogue\n");
+		destroy_matrix(&new_matrix);
+		return;
+	}
+	printf("Matrix (%s) is attached to %s%s at version %llu\n", name, MATRIX_SHM_PREFIX, cmd->cmds[1], version);
+}
+
+typedef struct {
+	const char* name;
+	unsigned int min_args;
+	unsigned int max_args;
+	void (*run) (Commands_t* cmd, Matrix_Catalogue_t* mats);
+	const char* usage;
+	Command_Access_t access;
+	bool background;	/*can run behind the prompt with a trailing &*/
+}Command_Entry_t;
+
+/*sorted by name for bsearch, arguments do not count the command itself*/
+static const Command_Entry_t command_table[] = {
+	{ "add", 3, 3, run_add, "add <matrix_one> <matrix_two> <matrix_result>" },
+	{ "attach", 1, 2, run_attach, "attach <shared_name> [matrix_name]" },
+	{ "cast", 2, 2, run_cast, "cast <matrix_name> <u8|u16|u32|u64|i32|f32|f64>", COMMAND_WRITES },
+	{ "colsum", 1, 1, run_sums, "colsum <matrix_name>", COMMAND_READS },
+	{ "create", 3, 5, run_create, "create <matrix_name> <rows> <cols> [u8|u16|u32|u64|i32|f32|f64] [disk]" },
+	{ "delete", 1, 1, run_delete, "delete <matrix_name>" },
+	{ "densify", 1, 1, run_convert, "densify <matrix_name>", COMMAND_WRITES },
+	{ "display", 1, 1, run_display, "display <matrix_name>", COMMAND_READS },
+	{ "duplicate", 2, 2, run_duplicate, "duplicate <src_matrix> <dest_matrix>" },
+	{ "equal", 2, 2, run_equal, "equal <matrix_one> <matrix_two>", COMMAND_READS },
+	{ "eval", 1, MAX_CMD_COUNT, run_eval, "eval <matrix_result> = <expression>" },
+	{ "jobs", 0, 0, run_jobs, "jobs" },
+	{ "max", 1, 1, run_summary, "max <matrix_name>", COMMAND_READS },
+	{ "mean", 1, 1, run_summary, "mean <matrix_name>", COMMAND_READS },
+	{ "memory", 1, 1, run_memory, "memory stats|trim" },
+	{ "min", 1, 1, run_summary, "min <matrix_name>", COMMAND_READS },
+	{ "mul", 3, 4, run_mul, "mul <matrix_one> <matrix_two> <matrix_result> [32|64]" },
+	{ "random", 3, 4, run_random, "random <matrix_name> <start_range> <end_range> [seed]", COMMAND_WRITES },
+	{ "read", 1, 2, run_read, "read <matrix_file> [map|disk] [&]", COMMAND_EXCLUSIVE, true },
+	{ "readtile", 3, 3, run_readtile, "readtile <matrix_file> <tile> <matrix_result>" },
+	{ "rowsum", 1, 1, run_sums, "rowsum <matrix_name>", COMMAND_READS },
+	{ "share", 1, 1, run_share, "share <matrix_name>", COMMAND_WRITES },
+	{ "shift", 3, 3, run_shift, "shift <matrix_name> <l|r> <shifts>", COMMAND_WRITES },
+	{ "slice", 5, 6, run_slice, "slice <matrix_name> <row_begin> <row_end> <col_begin> <col_end> [matrix_result]" },
+	{ "sparsify", 1, 1, run_convert, "sparsify <matrix_name>", COMMAND_WRITES },
+	{ "stats", 0, 2, run_stats, "stats [reset|trace <file>]" },
+	{ "sum", 1, 1, run_sum, "sum <matrix_name>", COMMAND_READS },
+	{ "transpose", 1, 2, run_transpose, "transpose <matrix_name> [matrix_result]" },
+	{ "wait", 0, 1, run_wait, "wait [job]" },
+	{ "write", 1, 2, run_write, "write <matrix_name> [raw|for|delta] [&]", COMMAND_WRITES, true }
+};
+
+static int compare_command (const void* key, const void* entry) {
+	return strcmp(key, ((const Command_Entry_t*) entry)->name);
+}
+
+/*
+ * PURPOSE: says how a command touches the catalogue, so a caller running
+ *          commands side by side knows what to lock
+ * INPUTS:
+ *	cmd: the parsed command
+ * RETURN:
+ *  COMMAND_READS or COMMAND_WRITES when only the matrices the arguments
+ *  name are touched, COMMAND_EXCLUSIVE when the catalogue itself or state
+ *  shared by every command may change
+ *
+ **/
+Command_Access_t command_access (const Commands_t* cmd) {
+	if (!cmd || cmd->num_cmds == 0) {
+		return COMMAND_READS;
+	}
+	const Command_Entry_t* entry = bsearch(cmd->cmds[0], command_table,
+		sizeof(command_table) / sizeof(command_table[0]), sizeof(command_table[0]), compare_command);
+	/*an unknown command only prints an error*/
+	if (!entry) {
+		return COMMAND_READS;
+	}
+	/*background jobs go on the job list*/
+	return cmd->background ? COMMAND_EXCLUSIVE : entry->access;
+}
+
+typedef struct {
+	FILE* outer;
+	FILE* held;
+	char* buf;
+	size_t len;
+}Held_Stdout_t;
+
+/*default hold, stdout goes to a memory stream until release*/
+static void* hold_stdout (void) {
+	Held_Stdout_t* h = calloc(1, sizeof(Held_Stdout_t));
+	if (!h || !(h->held = open_memstream(&h->buf, &h->len))) {
+		free(h);
+		return NULL;
+	}
+	fflush(stdout);
+	h->outer = stdout;
+	stdout = h->held;
+	return h;
+}
+
+static void release_stdout (void* held, bool keep) {
+	Held_Stdout_t* h = held;
+	if (!h) {
+		return;
+	}
+	stdout = h->outer;
+	fclose(h->held);
+	if (keep) {
+		fwrite(h->buf, 1, h->len, stdout);
+	}
+	free(h->buf);
+	free(h);
+}
+
+static const Output_Holder_t stdout_holder = { hold_stdout, release_stdout };
+static const Output_Holder_t* output_holder = &stdout_holder;
+
+/*
+ * PURPOSE: changes how run_commands holds back output it may throw away
+ * INPUTS:
+ *	holder: the new way, NULL for the default. Set while no command runs.
+ * RETURN:
+ *  void
+ *
+ **/
+void set_output_holder (const Output_Holder_t* holder) {
+	output_holder = holder ? holder : &stdout_holder;
+}
+
+/*
+ * PURPOSE: runs a command that only reads shared matrices, again if a
+ *          writer in another process changed one of them meanwhile. What
+ *          a run printed is held back and only the run that read whole
+ *          matrices gets printed.
+ * INPUTS:
+ *	entry: the command
+ *  cmd: its arguments
+ *  mats: the catalogue
+ *  shms: the segments of the shared matrices named, held
+ *  at: the argument naming each
+ *  count: how many
+ * RETURN:
+ *  void
+ *
+ **/
+static void run_shared_reads (const Command_Entry_t* entry, Commands_t* cmd, Matrix_Catalogue_t* mats,
+		Matrix_Shm_t* const* shms, const unsigned int* at, size_t count) {
+	uint64_t seq[MAX_CMD_COUNT];
+	for (unsigned int tries = 1; ; ++tries) {
+		for (size_t i = 0; i < count; ++i) {
+			if (!shm_read_begin(shms[i], &seq[i])) {
+				printf("Matrix (%s) is held by a writer in another process\n", cmd->cmds[at[i]]);
+				return;
+			}
+		}
+		/*only the output of the run that read whole matrices is printed*/
+		void* held = output_holder->hold();
+		entry->run(cmd, mats);
+		size_t changed = 0;
+		while (changed < count && !shm_read_changed(shms[changed], seq[changed])) {
+			++changed;
+		}
+		output_holder->release(held, changed == count);
+		if (changed == count) {
+			return;
+		}
+		if (tries == MATRIX_SHM_READ_TRIES) {
+			printf("Matrix (%s) kept changing while it was read\n", cmd->cmds[at[changed]]);
+			return;
+		}
+		printf("Matrix (%s) changed while it was read, reading it again\n", cmd->cmds[at[changed]]);
+	}
+}
+
+/*
+ * PURPOSE: runs a command that may change shared matrices with their
+ *          segments held for writing, a matrix that takes the place of a
+ *          shared one of the same size and type goes into its segment and
+ *          any other is reported as no longer shared
+ * INPUTS:
+ *	entry: the command
+ *  cmd: its arguments
+ *  mats: the catalogue
+ *  shms: the segments of the shared matrices named, held
+ *  at: the argument naming each
+ *  count: how many
+ * RETURN:
+ *  void
+ *
+ **/
+static void run_shared_writes (const Command_Entry_t* entry, Commands_t* cmd, Matrix_Catalogue_t* mats,
+		Matrix_Shm_t* const* shms, const unsigned int* at, size_t count) {
+	size_t begun = 0;
+	while (begun < count && shm_write_begin(shms[begun])) {
+		++begun;
+	}
+	if (begun < count) {
+		printf("Matrix (%s) is held by a writer in another process\n", cmd->cmds[at[begun]]);
+	}
+	else {
+		entry->run(cmd, mats);
+		for (size_t i = 0; i < count; ++i) {
+			Matrix_t* m = find_matrix(mats, cmd->cmds[at[i]]);
+			if (m && m->shm != shms[i] && !shm_adopt(shms[i], m) && !m->shm) {
+				printf("Matrix (%s) is no longer shared\n", m->name);
+			}
+		}
+	}
+	for (size_t i = 0; i < begun; ++i) {
+		shm_write_end(shms[i]);
+	}
+}
+
+/*bytes of storage behind a matrix, dense or CSR, 0 for none*/
+static size_t storage_bytes (const Matrix_t* m) {
+	if (!m) {
+		return 0;
+	}
+	if (m->sparse) {
+		return m->sparse->nnz * 2 * sizeof(unsigned int) + ((size_t) m->rows + 1) * sizeof(size_t);
+	}
+	size_t bytes = 0;
+	return matrix_data_bytes(m->rows, m->cols, m->type, &bytes) ? bytes : 0;
+}
+
+//FINISHTODO FUNCTION COMMENT
+/*
+ * PURPOSE: run the commands passed in by the user
+ * INPUTS:
+ *	cmd: pointer to the command structs
+ *  mats: pointer to the catalogue that stores the current matrices
+ * RETURN:
+ *  void
+ *
+ **/
+void run_commands (Commands_t* cmd, Matrix_Catalogue_t* mats) {
+	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
+	if(!cmd || !mats || cmd->num_cmds == 0){
+		printf("There was an error with the inputs :)\n");
+		return;
+	}
+
+	const Command_Entry_t* entry = bsearch(cmd->cmds[0], command_table,
+		sizeof(command_table) / sizeof(command_table[0]), sizeof(command_table[0]), compare_command);
+	if (!entry) {
+		printf("Not a command in this application\n");
+		return;
+	}
+	const unsigned int args = cmd->num_cmds - 1;
+	if (args < entry->min_args || args > entry->max_args) {
+		printf("Usage: %s\n", entry->usage);
+		return;
+	}
+	if (cmd->background && !entry->background) {
+		printf("Only read and write can run in the background\n");
+		return;
+	}
+
+	/*a command touches the matrices its arguments name, as big as they get*/
+	size_t before[MAX_CMD_COUNT];
+	/*and the segments of shared ones stay mapped until it is done*/
+	Matrix_Shm_t* shms[MAX_CMD_COUNT];
+	unsigned int at[MAX_CMD_COUNT];
+	size_t num_shms = 0;
+	for (unsigned int i = 1; i < cmd->num_cmds; ++i) {
+		const Matrix_t* m = find_matrix(mats, cmd->cmds[i]);
+		before[i] = storage_bytes(m);
+		size_t j = 0;
+		while (m && m->shm && j < num_shms && shms[j] != m->shm) {
+			++j;
+		}
+		if (m && m->shm && j == num_shms) {
+			shms[num_shms] = hold_shm(m->shm);
+			at[num_shms++] = i;
+		}
+	}
+	Stats_Probe_t probe;
+	stats_begin(&probe);
+	if (num_shms == 0) {
+		entry->run(cmd, mats);
+	}
+	else if (entry->access == COMMAND_READS) {
+		run_shared_reads(entry, cmd, mats, shms, at, num_shms);
+	}
+	else {
+		run_shared_writes(entry, cmd, mats, shms, at, num_shms);
+	}
+	stats_end(&probe);
+	for (size_t i = 0; i < num_shms; ++i) {
+		release_shm(shms[i]);
+	}
+	size_t bytes = 0;
+	for (unsigned int i = 1; i < cmd->num_cmds; ++i) {
+		const size_t after = storage_bytes(find_matrix(mats, cmd->cmds[i]));
+		bytes += after > before[i] ? after : before[i];
+	}
+	stats_record(&probe, entry - command_table, entry->name, bytes);
+}
@@ -0,0 +1,34 @@
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include <stdbool.h>
+
+#include "catalogue.h"
+#include "command.h"
+
+/*how a command touches the catalogue*/
+typedef enum {
+	COMMAND_EXCLUSIVE = 0,	/*adds or removes matrices, or changes state every command shares*/
+	COMMAND_READS,		/*only reads the matrices its arguments name*/
+	COMMAND_WRITES		/*changes the matrices its arguments name in place*/
+}Command_Access_t;
+
+/*
+ * Holds back what the calling thread prints while a command runs whose
+ * output may be thrown away, a read of a shared matrix that a writer in
+ * another process got into. hold returns what to hand to release, NULL
+ * when nothing is held, and release prints it if keep is true. By default
+ * stdout is swapped for a memory stream, a caller running commands on
+ * several threads at once sets its own and puts back NULL when done.
+ */
+typedef struct {
+	void* (*hold) (void);
+	void (*release) (void* held, bool keep);
+}Output_Holder_t;
+
+/*looks a parsed command up by name and runs its handler on the catalogue*/
+void run_commands (Commands_t* cmd, Matrix_Catalogue_t* mats);
+Command_Access_t command_access (const Commands_t* cmd);
+void set_output_holder (const Output_Holder_t* holder);
+
+#endif
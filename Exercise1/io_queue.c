@@ -0,0 +1,375 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_queue.h"
+
+/*
+ * A ring is set up for each transfer big enough to need more than one
+ * request and torn down after it, so nothing is shared between threads
+ * and a background job and the prompt can both move data at once.
+ */
+typedef struct {
+	int fd;
+	unsigned int entries;
+	void* sq_ptr;
+	size_t sq_len;
+	void* cq_ptr;
+	size_t cq_len;
+	struct io_uring_sqe* sqes;
+	size_t sqes_len;
+	unsigned int* sq_tail;
+	unsigned int* sq_mask;
+	unsigned int* sq_array;
+	unsigned int* cq_head;
+	unsigned int* cq_tail;
+	unsigned int* cq_mask;
+	struct io_uring_cqe* cqes;
+}Io_Ring_t;
+
+/*one request of a transfer, resubmitted from where it stopped when it comes back short*/
+typedef struct {
+	int fd;
+	unsigned char* buf;
+	size_t len;
+	off_t offset;
+	bool busy;
+}Io_Request_t;
+
+static bool use_uring;
+static bool use_direct;
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;
+static __thread size_t* progress = NULL;
+
+static int ring_setup (unsigned int entries, struct io_uring_params* p) {
+	return (int) syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int ring_enter (int fd, unsigned int to_submit, unsigned int min_complete) {
+	return (int) syscall(SYS_io_uring_enter, fd, to_submit, min_complete, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static void pick_backend (void) {
+	const char* io = getenv("MATLAB_IO");
+	const char* direct = getenv("MATLAB_IO_DIRECT");
+	use_direct = direct && strcmp(direct, "1") == 0;
+	if (io && strcmp(io, "sync") == 0) {
+		return;
+	}
+	/*kernels without it, seccomp filters and io_uring_disabled all fail here*/
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	const int fd = ring_setup(1, &p);
+	if (fd >= 0) {
+		close(fd);
+		use_uring = true;
+	}
+}
+
+/*
+ * PURPOSE: name of the way transfers are done in this process
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  "io_uring" or "pread/pwrite", with " O_DIRECT" when that is asked for
+ *
+ **/
+const char* io_backend (void) {
+	pthread_once(&backend_once, pick_backend);
+	if (use_uring) {
+		return use_direct ? "io_uring O_DIRECT" : "io_uring";
+	}
+	return use_direct ? "pread/pwrite O_DIRECT" : "pread/pwrite";
+}
+
+/*
+ * PURPOSE: counts the bytes moved by later transfers on the calling thread
+ * INPUTS:
+ *	done: counter added to atomically as requests complete, NULL stops counting
+ * RETURN:
+ *  void
+ *
+ **/
+void io_track (size_t* done) {
+	progress = done;
+}
+
+static void count (size_t bytes) {
+	if (progress) {
+		__atomic_add_fetch(progress, bytes, __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * PURPOSE: maps the rings of a new io_uring instance
+ * INPUTS:
+ *	r: receives the ring
+ *  entries: submission queue size
+ * RETURN:
+ *  If no errors then true
+ *  else false and nothing is left open.
+ *
+ **/
+static bool ring_open (Io_Ring_t* r, unsigned int entries) {
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	memset(r, 0, sizeof(*r));
+	r->fd = ring_setup(entries, &p);
+	if (r->fd < 0) {
+		return false;
+	}
+	r->entries = p.sq_entries;
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	/*newer kernels put both rings in one mapping*/
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->sq_len = r->cq_len = r->sq_len > r->cq_len ? r->sq_len : r->cq_len;
+	}
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		IORING_OFF_SQ_RING);
+	r->cq_ptr = r->sq_ptr;
+	if (r->sq_ptr != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+			IORING_OFF_CQ_RING);
+	}
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = MAP_FAILED;
+	if (r->sq_ptr != MAP_FAILED && r->cq_ptr != MAP_FAILED) {
+		r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+			IORING_OFF_SQES);
+	}
+	if (r->sqes == MAP_FAILED) {
+		if (r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr) {
+			munmap(r->cq_ptr, r->cq_len);
+		}
+		if (r->sq_ptr != MAP_FAILED) {
+			munmap(r->sq_ptr, r->sq_len);
+		}
+		close(r->fd);
+		return false;
+	}
+
+	unsigned char* sq = r->sq_ptr;
+	unsigned char* cq = r->cq_ptr;
+	r->sq_tail = (unsigned int*) (sq + p.sq_off.tail);
+	r->sq_mask = (unsigned int*) (sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int*) (sq + p.sq_off.array);
+	r->cq_head = (unsigned int*) (cq + p.cq_off.head);
+	r->cq_tail = (unsigned int*) (cq + p.cq_off.tail);
+	r->cq_mask = (unsigned int*) (cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+	return true;
+}
+
+static void ring_close (Io_Ring_t* r) {
+	munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr != r->sq_ptr) {
+		munmap(r->cq_ptr, r->cq_len);
+	}
+	munmap(r->sq_ptr, r->sq_len);
+	close(r->fd);
+}
+
+/*queues request slot, the kernel sees it at the next ring_enter*/
+static void ring_push (Io_Ring_t* r, bool write, const Io_Request_t* req, unsigned int slot) {
+	const unsigned int tail = *r->sq_tail;
+	const unsigned int index = tail & *r->sq_mask;
+	struct io_uring_sqe* sqe = &r->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = req->fd;
+	sqe->addr = (unsigned long) req->buf;
+	sqe->len = req->len;
+	sqe->off = req->offset;
+	sqe->user_data = slot;
+	r->sq_array[index] = index;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * PURPOSE: moves len bytes through a ring, keeping every slot busy until
+ *          the whole range has been handed out
+ * INPUTS:
+ *	r: the ring
+ *  fd: the file
+ *  direct_fd: the same file opened O_DIRECT, or -1
+ *  direct_len: leading bytes that go through direct_fd
+ *  write, buf, len, offset: the transfer
+ * RETURN:
+ *  If every byte was moved then true
+ *  else false, after waiting out the requests still in flight.
+ *
+ **/
+static bool ring_transfer (Io_Ring_t* r, int fd, int direct_fd, size_t direct_len, bool write,
+		unsigned char* buf, size_t len, off_t offset) {
+
+	Io_Request_t reqs[IO_QUEUE_DEPTH];
+	memset(reqs, 0, sizeof(reqs));
+	const unsigned int slots = r->entries < IO_QUEUE_DEPTH ? r->entries : IO_QUEUE_DEPTH;
+	size_t next = 0;
+	unsigned int in_flight = 0;
+	unsigned int to_submit = 0;
+	bool failed = false;
+
+	while ((next < len && !failed) || in_flight > 0) {
+		/*fill the free slots, a request never crosses from the direct part into the tail*/
+		for (unsigned int s = 0; s < slots && next < len && !failed; ++s) {
+			if (reqs[s].busy) {
+				continue;
+			}
+			const bool direct = next < direct_len;
+			const size_t end = direct ? direct_len : len;
+			reqs[s].fd = direct ? direct_fd : fd;
+			reqs[s].buf = buf + next;
+			reqs[s].len = end - next < IO_REQUEST_BYTES ? end - next : IO_REQUEST_BYTES;
+			reqs[s].offset = offset + next;
+			reqs[s].busy = true;
+			next += reqs[s].len;
+			ring_push(r, write, &reqs[s], s);
+			++in_flight;
+			++to_submit;
+		}
+
+		const int entered = ring_enter(r->fd, to_submit, 1);
+		if (entered < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+				continue;
+			}
+			/*what was queued never reached the kernel, with nothing queued there is nothing to wait on*/
+			if (to_submit == 0) {
+				return false;
+			}
+			in_flight -= to_submit;
+			to_submit = 0;
+			failed = true;
+			continue;
+		}
+		to_submit -= (unsigned int) entered;
+
+		unsigned int head = *r->cq_head;
+		const unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) {
+			const struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+			Io_Request_t* req = &reqs[cqe->user_data];
+			const int res = cqe->res;
+			if (res == -EINVAL && req->fd == direct_fd) {
+				/*the file system refused O_DIRECT, carry on through the page cache*/
+				req->fd = fd;
+			}
+			else if (res > 0) {
+				count(res);
+				req->buf += res;
+				req->len -= res;
+				req->offset += res;
+			}
+			else if (res != -EINTR && res != -EAGAIN) {
+				failed = true;
+				req->busy = false;
+				--in_flight;
+				continue;
+			}
+			if (req->len == 0 || failed) {
+				req->busy = false;
+				--in_flight;
+				continue;
+			}
+			ring_push(r, write, req, cqe->user_data);
+			++to_submit;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return !failed;
+}
+
+/*
+ * PURPOSE: moves len bytes with plain pread and pwrite, a request at a time
+ * INPUTS:
+ *	fd: the file
+ *  direct_fd: the same file opened O_DIRECT, or -1
+ *  direct_len: leading bytes that go through direct_fd
+ *  write, buf, len, offset: the transfer
+ * RETURN:
+ *  If every byte was moved then true
+ *  else false.
+ *
+ **/
+static bool sync_transfer (int fd, int direct_fd, size_t direct_len, bool write, unsigned char* buf,
+		size_t len, off_t offset) {
+	size_t done = 0;
+	while (done < len) {
+		const bool direct = done < direct_len;
+		const size_t end = direct ? direct_len : len;
+		const size_t want = end - done < IO_REQUEST_BYTES ? end - done : IO_REQUEST_BYTES;
+		const int use = direct ? direct_fd : fd;
+		const ssize_t got = write ? pwrite(use, buf + done, want, offset + done)
+			: pread(use, buf + done, want, offset + done);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got < 0 && errno == EINVAL && direct) {
+			direct_len = 0;
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+		count(got);
+		done += got;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: reads or writes len bytes at offset in large queued requests,
+ *          short reads and writes are picked up where they stopped
+ * INPUTS:
+ *	fd: the file
+ *  write: true to write buf to the file, false to read into it
+ *  buf: the bytes
+ *  len: number of bytes
+ *  offset: position in the file
+ * RETURN:
+ *  If every byte was moved then true
+ *  else false for an error or the end of the file.
+ *
+ **/
+bool io_transfer (int fd, bool write, void* buf, size_t len, off_t offset) {
+
+	pthread_once(&backend_once, pick_backend);
+
+	/*O_DIRECT needs the buffer, the offset and every length on block boundaries*/
+	int direct_fd = -1;
+	size_t direct_len = 0;
+	if (use_direct && ((size_t) buf | (size_t) offset) % IO_DIRECT_ALIGN == 0 && len >= IO_DIRECT_ALIGN) {
+		char path[64];
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+		direct_fd = open(path, (write ? O_WRONLY : O_RDONLY) | O_DIRECT);
+		direct_len = direct_fd < 0 ? 0 : len / IO_DIRECT_ALIGN * IO_DIRECT_ALIGN;
+	}
+
+	bool ok = false;
+	Io_Ring_t r;
+	if (use_uring && len > IO_REQUEST_BYTES && ring_open(&r, IO_QUEUE_DEPTH)) {
+		ok = ring_transfer(&r, fd, direct_fd, direct_len, write, buf, len, offset);
+		ring_close(&r);
+	}
+	else {
+		ok = sync_transfer(fd, direct_fd, direct_len, write, buf, len, offset);
+	}
+	if (direct_fd >= 0) {
+		close(direct_fd);
+	}
+	return ok;
+}
@@ -0,0 +1,24 @@
+#ifndef _IO_QUEUE_H_
+#define _IO_QUEUE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Bulk file transfers. A transfer is cut into IO_REQUEST_BYTES requests
+ * and up to IO_QUEUE_DEPTH of them are kept in flight through io_uring,
+ * or done one after the other with pread and pwrite where io_uring is
+ * missing or MATLAB_IO=sync. With MATLAB_IO_DIRECT=1 the page aligned
+ * part of a transfer bypasses the page cache (O_DIRECT) where the file
+ * system allows it.
+ */
+#define IO_REQUEST_BYTES (1 << 20)
+#define IO_QUEUE_DEPTH 16
+#define IO_DIRECT_ALIGN 4096
+
+bool io_transfer (int fd, bool write, void* buf, size_t len, off_t offset);
+void io_track (size_t* done);
+const char* io_backend (void);
+
+#endif
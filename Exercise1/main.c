@@ -5,19 +5,27 @@
 #include <math.h>
 #include <stdbool.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
 
 #include<readline/readline.h>
 
+#include "catalogue.h"
 #include "command.h"
+#include "command_stats.h"
+#include "dispatch.h"
 #include "matrix.h"
+#include "matrix_jobs.h"
+#include "matrix_kernels.h"
+#include "matrix_memory.h"
+#include "server.h"
+#include "thread_pool.h"
 
-void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats);
-int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats,
-			const char* target);
+static int run_script (const char* path, Matrix_Catalogue_t* mats);
 
-// FINISHTODO complete the defintion of this function.
-
-void destroy_remaining_heap_allocations(Matrix_t **mats, unsigned int num_mats);
+/*stdout buffer for scripts, flushed when full rather than per line*/
+#define SCRIPT_OUTPUT_BYTES (1 << 20)
 
 //FINISHTODO FUNCTION COMMENT5
 /*
@@ -33,11 +41,63 @@ void destroy_remaining_heap_allocations(Matrix_t **mats, unsigned int num_mats);
  **/
 int main (int argc, char **argv) {
 	srand(time(NULL));
+	init_matrix_kernels();
+
+	/*thread count comes from -t, then MATLAB_THREADS, else one per cpu*/
+	unsigned int num_threads = 0;
+	const char* env_threads = getenv("MATLAB_THREADS");
+	if (env_threads) {
+		num_threads = atoi(env_threads);
+	}
+	/*-f runs a script, - for stdin, and --serve serves a socket instead of the prompt*/
+	const char* script = NULL;
+	const char* socket_path = NULL;
+	static const struct option long_options[] = {
+		{ "serve", required_argument, NULL, 's' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "t:f:", long_options, NULL)) != -1) {
+		if (opt == 't') {
+			num_threads = atoi(optarg);
+		}
+		else if (opt == 'f' && !socket_path) {
+			script = optarg;
+		}
+		else if (opt == 's' && !script) {
+			socket_path = optarg;
+		}
+		else {
+			printf("usage: %s [-t threads] [-f script|- | --serve socket]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (script) {
+		setvbuf(stdout, NULL, _IOFBF, SCRIPT_OUTPUT_BYTES);
+	}
+	if (!init_thread_pool(num_threads)) {
+		printf("Thread pool failed to start, running on %u threads\n", thread_pool_size());
+	}
+	init_command_stats();
 	char *line = NULL;
-	Commands_t* cmd;
+	Commands_t cmd;
 
-	Matrix_t *mats[10];
-	memset(&mats,0, sizeof(Matrix_t*) * 10); // IMPORTANT C FUNCTION TO LEARN
+	Matrix_Catalogue_t* mats = NULL;
+	if (!create_catalogue(&mats, 0)) {
+		perror("PROGRAM FAILED TO CREATE THE MATRIX CATALOGUE");
+		return -1;
+	}
+
+	if (script || socket_path) {
+		/*the server runs as many commands at once as the pool has threads*/
+		const int status = script ? run_script(script, mats) : run_server(socket_path, mats, thread_pool_size());
+		wait_jobs(mats, 0);
+		destroy_catalogue(&mats);
+		close_command_stats();
+		destroy_thread_pool();
+		memory_trim();
+		return status;
+	}
 
 	Matrix_t *temp = NULL;
 
@@ -46,273 +106,97 @@ int main (int argc, char **argv) {
 		return -1;
 	} // FINISHTODO ERROR CHECK
 
-	if(add_matrix_to_array(mats,temp, 10) < 0){
-		perror("PROGRAM FAILD TO ADD MATRIX TO ARRAY");
+	if(!insert_matrix(mats,temp)){
+		perror("PROGRAM FAILD TO ADD MATRIX TO CATALOGUE");
+		destroy_matrix(&temp);
 		return -1;
 	} //FINISHTODO ERROR CHECK NEEDED
 
-	int mat_idx = find_matrix_given_name(mats,10,"temp_mat");
+	random_matrix(temp, 10, 15, rand());
 
-	if (mat_idx < 0) {
-		perror("PROGRAM FAILED TO INIT\n");
-		return -1;
-	}
-	random_matrix(mats[mat_idx], 10, 15);
-
-	if(!write_matrix("temp_mat", mats[mat_idx])){
+	if(!write_matrix("temp_mat", temp, MATRIX_CODEC_RAW)){
 		perror("PROGRAM FAILED TO WRITE TO FILE");
 		return -1;
 	} // FINISHTODO ERROR CHECK
 
 	line = readline("> ");
-	while (strncmp(line,"exit", strlen("exit")  + 1) != 0) {
+	while (line && strncmp(line,"exit", strlen("exit")  + 1) != 0) {
 
+		/*cmd points into line, so line is freed after the command runs*/
 		if (!parse_user_input(line,&cmd)) {
 			printf("Failed at parsing command\n\n");
 		}
-
-		if (cmd->num_cmds > 1) {
-			run_commands(cmd,mats,10);
-		}
-		if (line) {
-			free(line);
+		else if (cmd.num_cmds > 0) {
+			/*background jobs that have finished report in before the next command*/
+			collect_jobs(mats);
+			run_commands(&cmd,mats);
 		}
-		destroy_commands(&cmd);
+		free(line);
 		line = readline("> ");
 	}
 	free(line);
-	destroy_remaining_heap_allocations(mats,10);
+	/*background writes are finished before the program goes*/
+	wait_jobs(mats, 0);
+	destroy_catalogue(&mats);
+	close_command_stats();
+	destroy_thread_pool();
+	memory_trim();
 	return 0;
 }
 
-//FINISHTODO FUNCTION COMMENT
 /*
- * PURPOSE: run the commands passed in by the user
+ * PURPOSE: runs a script of commands without the prompt or temp_mat, lines
+ *          stream through one large buffer and output is flushed in bulk
  * INPUTS:
- *	cmd: pointer to the command structs
- *  mats: pointer to the array that stores the current matrices
- *  num_mats: max number of matrices that the mats array can hold
+ *	path: the script, - reads stdin
+ *  mats: the catalogue the commands work on
  * RETURN:
- *  void
+ *  0 when the whole script was read
+ *  else -1.
  *
  **/
-void run_commands (Commands_t* cmd, Matrix_t** mats, unsigned int num_mats) {
-	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
-	if(!cmd || !mats){
-		printf("There was an error with the inputs :)\n");
-		return;
-	}
-
-	/*Parsing and calling of commands*/
-	if (strncmp(cmd->cmds[0],"display",strlen("display") + 1) == 0
-		&& cmd->num_cmds == 2) {
-			/*find the requested matrix*/
-			int idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-			if (idx >= 0) {
-				display_matrix (mats[idx]);
-			}
-			else {
-				printf("Matrix (%s) doesn't exist\n", cmd->cmds[1]);
-				return;
-			}
-	}
-	else if (strncmp(cmd->cmds[0],"add",strlen("add") + 1) == 0
-		&& cmd->num_cmds == 4) {
-			int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-			int mat2_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
-			if (mat1_idx >= 0 && mat2_idx >= 0) {
-				Matrix_t* c = NULL;
-				if( !create_matrix (&c,cmd->cmds[3], mats[mat1_idx]->rows,
-						mats[mat1_idx]->cols)) {
-					printf("Failure to create the result Matrix (%s)\n", cmd->cmds[3]);
-					return;
-				}
-
-				if(add_matrix_to_array(mats,c, num_mats) < 0){
-					printf("Failure to add the new matrix to the array");
-					return;
-				} //FINISHTODO ERROR CHECK NEEDED
-
+static int run_script (const char* path, Matrix_Catalogue_t* mats) {
 
-				if (! add_matrices(mats[mat1_idx], mats[mat2_idx],c) ) {
-					printf("Failure to add %s with %s into %s\n", mats[mat1_idx]->name, mats[mat2_idx]->name,c->name);
-					return;
-				}
-				printf ("Addition of %s into %s finished\n", mats[mat1_idx]->name, mats[mat2_idx]->name);
-			}
+	const bool from_stdin = strcmp(path, "-") == 0;
+	const int fd = from_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+	if (fd < 0) {
+		perror("PROGRAM FAILED TO OPEN THE SCRIPT");
+		return -1;
 	}
-	else if (strncmp(cmd->cmds[0],"duplicate",strlen("duplicate") + 1) == 0
-		&& cmd->num_cmds == 3 && strlen(cmd->cmds[1]) + 1 <= MATRIX_NAME_LEN) {
-		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-		if (mat1_idx >= 0 ) {
-				Matrix_t* dup_mat = NULL;
-				if( !create_matrix (&dup_mat,cmd->cmds[2], mats[mat1_idx]->rows,
-						mats[mat1_idx]->cols)) {
-					return;
-				}
-				if(!duplicate_matrix (NULL, dup_mat)){ //mats[mat1_idx]
-					printf("Failure to duplicate the matrix");
-					return;
-				} //FINISHTODO ERROR CHECK NEEDED
-
-				if(add_matrix_to_array(mats,dup_mat,num_mats) < 0){
-					printf("Failure to add the new matrix to the array");
-					return;
-				} //FINISHTODO ERROR CHECK NEEDED
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-				printf ("Duplication of %s into %s finished\n", mats[mat1_idx]->name, cmd->cmds[2]);
-		}
-		else {
-			printf("Duplication Failed\n");
-			return;
+	Line_Reader_t reader;
+	if (!open_line_reader(&reader, fd)) {
+		perror("PROGRAM FAILED TO ALLOCATE THE SCRIPT BUFFER");
+		if (!from_stdin) {
+			close(fd);
 		}
+		return -1;
 	}
-	else if (strncmp(cmd->cmds[0],"equal",strlen("equal") + 1) == 0
-		&& cmd->num_cmds == 3) {
-			int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-			int mat2_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[2]);
-			if (mat1_idx >= 0 && mat2_idx >= 0) {
-				if ( equal_matrices(mats[mat1_idx],mats[mat2_idx]) ) {
-					printf("SAME DATA IN BOTH\n");
-				}
-				else {
-					printf("DIFFERENT DATA IN BOTH\n");
-				}
-			}
-			else {
-				printf("Equal Failed\n");
-				return;
-			}
-	}
-	else if (strncmp(cmd->cmds[0],"shift",strlen("shift") + 1) == 0
-		&& cmd->num_cmds == 4) {
-		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-		const int shift_value = atoi(cmd->cmds[3]);
-		if (mat1_idx >= 0 ) {
-			if(!bitwise_shift_matrix(mats[mat1_idx],cmd->cmds[2][0], shift_value)){
-				printf("Failure to shift the matrix");
-				return;
-			} //FINISHTODO ERROR CHECK NEEDED
-
-			printf("Matrix (%s) has been shifted by %d\n", mats[mat1_idx]->name, shift_value);
 
+	Commands_t cmd;
+	char* line = NULL;
+	while ((line = next_line(&reader)) && strncmp(line, "exit", strlen("exit") + 1) != 0) {
+		if (!parse_user_input(line, &cmd)) {
+			printf("Failed at parsing command\n\n");
 		}
-		else {
-			printf("Matrix shift failed\n");
-			return;
-		}
-
-	}
-	else if (strncmp(cmd->cmds[0],"read",strlen("read") + 1) == 0
-		&& cmd->num_cmds == 2) {
-		Matrix_t* new_matrix = NULL;
-		if(! read_matrix(cmd->cmds[1],&new_matrix)) {
-			printf("Read Failed\n");
-			return;
-		}
-
-		if(add_matrix_to_array(mats,new_matrix, num_mats) < 0){
-			printf("Failure to add the new matrix to the array");
-			return;
-		} //FINISHTODO ERROR CHECK NEEDED
-		printf("Matrix (%s) is read from the filesystem\n", cmd->cmds[1]);
-	}
-	else if (strncmp(cmd->cmds[0],"write",strlen("write") + 1) == 0
-		&& cmd->num_cmds == 2) {
-		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-		if(mat1_idx < 0 || !write_matrix(mats[mat1_idx]->name,mats[mat1_idx])) {
-			printf("Write Failed\n");
-			return;
-		}
-		else {
-			printf("Matrix (%s) is wrote out to the filesystem\n", mats[mat1_idx]->name);
+		else if (cmd.num_cmds > 0) {
+			collect_jobs(mats);
+			run_commands(&cmd, mats);
 		}
 	}
-	else if (strncmp(cmd->cmds[0], "create", strlen("create") + 1) == 0
-		&& strlen(cmd->cmds[1]) + 1 <= MATRIX_NAME_LEN && cmd->num_cmds == 4) {
-		Matrix_t* new_mat = NULL;
-		const unsigned int rows = atoi(cmd->cmds[2]);
-		const unsigned int cols = atoi(cmd->cmds[3]);
-
-		if(!create_matrix(&new_mat,cmd->cmds[1],rows, cols)){
-			printf("Failure to create matrix");
-			return;
-		} //FINISHTODO ERROR CHECK NEEDED
-
-		if(add_matrix_to_array(mats,new_mat,num_mats) < 0){
-			printf("Failure to add the new matrix to the array");
-			return;
-		} // FINISHTODO ERROR CHECK NEEDED
-
-		printf("Created Matrix (%s,%u,%u)\n", new_mat->name, new_mat->rows, new_mat->cols);
-	}
-	else if (strncmp(cmd->cmds[0], "random", strlen("random") + 1) == 0
-		&& cmd->num_cmds == 4) {
-		int mat1_idx = find_matrix_given_name(mats,num_mats,cmd->cmds[1]);
-		const unsigned int start_range = atoi(cmd->cmds[2]);
-		const unsigned int end_range = atoi(cmd->cmds[3]);
-
-		if(mat1_idx < 0 || !random_matrix(mats[mat1_idx],start_range, end_range)){
-			printf("Failure in creating random numbers for the matrix");
-			return;
-		} //FINISHTODO ERROR CHECK NEEDED
+	fflush(stdout);
 
-		printf("Matrix (%s) is randomized between %u %u\n", mats[mat1_idx]->name, start_range, end_range);
+	if (reader.skipped) {
+		fprintf(stderr, "Skipped %zu lines longer than %d bytes\n", reader.skipped, LINE_BUFFER_BYTES);
 	}
-	else {
-		printf("Not a command in this application\n");
+	const bool failed = reader.failed;
+	if (failed) {
+		perror("PROGRAM FAILED TO READ THE SCRIPT");
 	}
-
-}
-
-//FINIISHTODO FUNCTION COMMENT
-/*
- * PURPOSE: checks if the passed in name is in the array of stored matrices
- * INPUTS:
- *	mats: double pointer to the struct witht he array of matrices
- * RETURN:
- *  if no errors rturns the position of the matrix
- *  else -1
- *
- * NOTE:: had to add check in for loop to stop seg fault if matrix not found
- **/
-int find_matrix_given_name (Matrix_t** mats, unsigned int num_mats, const char* target) {
-	//TODO ERROR CHECK INCOMING PARAMETERS
-
-	//NOTE: Tried to check
-
-	if(!mats || !target){
-		return -1;
-	}
-
-	for (int i = 0; i < num_mats; ++i) {
-		if (mats[i] && strncmp(mats[i]->name,target,strlen(mats[i]->name)) == 0) {
-			return i;
-		}
-	}
-	return -1;
-}
-
-//FINISHTODO FUNCTION COMMENT
-/*
- * PURPOSE: free the memory that holds all the commands
- * INPUTS:
- *	mats: pointer to the array that holds the pointers
- *	num_mats: the max number of matrices in the array
- * RETURN:
- *  void
- *
- **/
-void destroy_remaining_heap_allocations(Matrix_t **mats, unsigned int num_mats) {
-
-	if(!mats){
-		return;
-	}
-
-	for(int i = 0; i < num_mats; i++){
-		if(mats[i]){
-			free(mats[i]->data);
-			free(mats[i]);
-		}
+	close_line_reader(&reader);
+	if (!from_stdin) {
+		close(fd);
 	}
+	return failed ? -1 : 0;
 }
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "catalogue.h"
+#include "command.h"
+#include "dispatch.h"
+#include "matrix.h"
+#include "matrix_kernels.h"
+#include "thread_pool.h"
+
+/*
+ * matbench times every matrix operation over square sizes from 5x5 up to
+ * the largest that fits the memory budget, printing JSON on stdout and a
+ * table on stderr. Each timing is repeated until it has run for at least
+ * the minimum time and the minimum number of times, then reported as
+ * percentiles. Given a baseline from an earlier run it also reports the
+ * change of each median and exits with 1 when one got slower than the
+ * threshold.
+ */
+#define BENCH_MAX_DIM 32768
+#define BENCH_MAX_REPS 1000
+#define BENCH_MAX_RESULTS 256
+#define BENCH_LINE_LEN 64
+
+typedef struct {
+	Matrix_t* a;
+	Matrix_t* b;		/*equal to a but not sharing its elements*/
+	Matrix_t* c;
+	Matrix_t* tmp;		/*made and dropped around every run*/
+	Matrix_Catalogue_t* mats;
+	char path[4096];
+	char line[BENCH_LINE_LEN];
+	Commands_t cmd;
+}Bench_State_t;
+
+/*
+ * One benchmarked operation. prepare and reset run untimed around every
+ * run, bytes is the memory traffic per element used for GB/s.
+ */
+typedef struct {
+	const char* op;
+	unsigned int bytes;
+	bool (*prepare) (Bench_State_t* s);
+	bool (*run) (Bench_State_t* s);
+	void (*reset) (Bench_State_t* s);
+	bool once;			/*per command rather than per size, run at the smallest size*/
+}Bench_Op_t;
+
+typedef struct {
+	const char* op;
+	unsigned int rows;
+	unsigned int cols;
+	size_t reps;
+	double min_ns;
+	double p50_ns;
+	double p90_ns;
+	double p99_ns;
+	double ns_per_element;
+	double gb_per_s;
+	bool has_baseline;
+	double baseline_ns;
+	double change_pct;
+}Bench_Result_t;
+
+static double now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void drop_tmp (Bench_State_t* s) {
+	destroy_matrix(&s->tmp);
+}
+
+static bool run_create (Bench_State_t* s) {
+	return create_matrix(&s->tmp, "tmp", s->a->rows, s->a->cols);
+}
+
+static bool run_random (Bench_State_t* s) {
+	return random_matrix(s->c, 0, 1000, 1);
+}
+
+static bool run_add (Bench_State_t* s) {
+	return add_matrices(s->a, s->b, s->c);
+}
+
+static bool run_shift (Bench_State_t* s) {
+	return bitwise_shift_matrix(s->c, 'l', 1);
+}
+
+static bool prepare_shell (Bench_State_t* s) {
+	return create_sparse_matrix(&s->tmp, "tmp", 0, 0);
+}
+
+static bool run_duplicate (Bench_State_t* s) {
+	return duplicate_matrix(s->a, s->tmp);
+}
+
+static bool run_equal (Bench_State_t* s) {
+	return equal_matrices(s->a, s->b);
+}
+
+static bool run_write (Bench_State_t* s) {
+	return write_matrix(s->path, s->a, MATRIX_CODEC_RAW);
+}
+
+static bool run_read (Bench_State_t* s) {
+	return read_matrix(s->path, &s->tmp);
+}
+
+static bool run_parse (Bench_State_t* s) {
+	snprintf(s->line, sizeof(s->line), "sum %s", s->a->name);
+	return parse_user_input(s->line, &s->cmd) && s->cmd.num_cmds == 2;
+}
+
+static bool run_dispatch (Bench_State_t* s) {
+	if (!run_parse(s)) {
+		return false;
+	}
+	run_commands(&s->cmd, s->mats);
+	return true;
+}
+
+/*read needs the file write leaves behind, so write goes first*/
+static const Bench_Op_t bench_ops[] = {
+	{ "create", 4, NULL, run_create, drop_tmp, false },
+	{ "random", 4, NULL, run_random, NULL, false },
+	{ "add", 12, NULL, run_add, NULL, false },
+	{ "shift", 8, NULL, run_shift, NULL, false },
+	{ "duplicate", 4, prepare_shell, run_duplicate, drop_tmp, false },
+	{ "equal", 8, NULL, run_equal, NULL, false },
+	{ "write", 4, NULL, run_write, NULL, false },
+	{ "read", 4, NULL, run_read, drop_tmp, false },
+	{ "parse", 0, NULL, run_parse, NULL, true },
+	{ "dispatch", 0, NULL, run_dispatch, NULL, true }
+};
+
+static int compare_double (const void* a, const void* b) {
+	const double x = *(const double*) a;
+	const double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+/*nearest rank percentile of sorted samples*/
+static double percentile (const double* sorted, size_t n, double p) {
+	size_t rank = (size_t) (p / 100.0 * n + 0.999999);
+	if (rank == 0) {
+		rank = 1;
+	}
+	return sorted[(rank > n ? n : rank) - 1];
+}
+
+/*
+ * PURPOSE: times one operation at the current size
+ * INPUTS:
+ *	op: the operation
+ *  s: matrices of the current size
+ *  min_reps, min_seconds: how long to keep repeating
+ *  r: receives the timings
+ * RETURN:
+ *  If every run succeeded then true
+ *  else false.
+ *
+ **/
+static bool time_op (const Bench_Op_t* op, Bench_State_t* s, size_t min_reps, double min_seconds,
+		Bench_Result_t* r) {
+
+	static double samples[BENCH_MAX_REPS];
+	size_t reps = 0;
+	double total = 0;
+
+	/*one untimed run first to fault pages in and warm the buffer pool*/
+	for (int warm = 1; reps < BENCH_MAX_REPS && (warm || reps < min_reps || total < min_seconds * 1e9); warm = 0) {
+		if (op->prepare && !op->prepare(s)) {
+			return false;
+		}
+		const double start = now_ns();
+		const bool ok = op->run(s);
+		const double took = now_ns() - start;
+		if (op->reset) {
+			op->reset(s);
+		}
+		if (!ok) {
+			return false;
+		}
+		if (!warm) {
+			samples[reps++] = took;
+			total += took;
+		}
+	}
+
+	qsort(samples, reps, sizeof(double), compare_double);
+	const double elements = op->once ? 1.0 : (double) s->a->rows * s->a->cols;
+	r->op = op->op;
+	r->rows = op->once ? 0 : s->a->rows;
+	r->cols = op->once ? 0 : s->a->cols;
+	r->reps = reps;
+	r->min_ns = samples[0];
+	r->p50_ns = percentile(samples, reps, 50);
+	r->p90_ns = percentile(samples, reps, 90);
+	r->p99_ns = percentile(samples, reps, 99);
+	r->ns_per_element = r->p50_ns / elements;
+	r->gb_per_s = op->bytes * elements / r->p50_ns;
+	return true;
+}
+
+/*
+ * PURPOSE: makes the matrices for one size, b equal to a in its own buffer
+ * INPUTS:
+ *	s: receives the matrices
+ *  dim: rows and cols
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool setup_size (Bench_State_t* s, unsigned int dim) {
+	if (!create_matrix(&s->a, "bench_a", dim, dim) || !random_matrix(s->a, 0, 1000, 1)
+		|| !create_sparse_matrix(&s->b, "bench_b", 0, 0) || !duplicate_matrix(s->a, s->b)
+		|| !unshare_matrix(s->b) || !create_matrix_for_overwrite(&s->c, "bench_c", dim, dim, MATRIX_U32)) {
+		return false;
+	}
+	return insert_matrix(s->mats, s->a);
+}
+
+static void teardown_size (Bench_State_t* s) {
+	/*a belongs to the catalogue*/
+	remove_matrix(s->mats, "bench_a");
+	s->a = NULL;
+	destroy_matrix(&s->b);
+	destroy_matrix(&s->c);
+	destroy_matrix(&s->tmp);
+	unlink(s->path);
+}
+
+/*
+ * PURPOSE: reads the medians out of an earlier JSON report, one result per line
+ * INPUTS:
+ *	path: the report
+ *  results, n: current results, matching ones get their baseline filled in
+ *  threshold: percent slowdown that counts as a regression
+ * RETURN:
+ *  number of regressions, -1 when the file cannot be read
+ *
+ **/
+static int compare_baseline (const char* path, Bench_Result_t* results, size_t n, double threshold) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		perror("FAILED TO OPEN THE BASELINE");
+		return -1;
+	}
+	char line[512];
+	int regressions = 0;
+	while (fgets(line, sizeof(line), f)) {
+		char op[32];
+		unsigned int rows, cols;
+		double p50;
+		const char* at = strstr(line, "\"op\"");
+		if (!at || sscanf(at, "\"op\": \"%31[^\"]\", \"rows\": %u, \"cols\": %u", op, &rows, &cols) != 3) {
+			continue;
+		}
+		at = strstr(line, "\"p50_ns\"");
+		if (!at || sscanf(at, "\"p50_ns\": %lf", &p50) != 1 || p50 <= 0) {
+			continue;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			Bench_Result_t* r = &results[i];
+			if (strcmp(r->op, op) == 0 && r->rows == rows && r->cols == cols) {
+				r->has_baseline = true;
+				r->baseline_ns = p50;
+				r->change_pct = (r->p50_ns - p50) / p50 * 100.0;
+				regressions += r->change_pct > threshold;
+			}
+		}
+	}
+	fclose(f);
+	return regressions;
+}
+
+static void print_json (FILE* out, const Bench_Result_t* results, size_t n) {
+	fprintf(out, "{\n  \"isa\": \"%s\", \"threads\": %u,\n  \"results\": [\n",
+		matrix_kernels.isa, thread_pool_size());
+	for (size_t i = 0; i < n; ++i) {
+		const Bench_Result_t* r = &results[i];
+		fprintf(out, "    {\"op\": \"%s\", \"rows\": %u, \"cols\": %u, \"reps\": %zu, "
+			"\"min_ns\": %.1f, \"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, "
+			"\"ns_per_element\": %.4f, \"gb_per_s\": %.3f",
+			r->op, r->rows, r->cols, r->reps, r->min_ns, r->p50_ns, r->p90_ns, r->p99_ns,
+			r->ns_per_element, r->gb_per_s);
+		if (r->has_baseline) {
+			fprintf(out, ", \"baseline_p50_ns\": %.1f, \"change_pct\": %.2f", r->baseline_ns, r->change_pct);
+		}
+		fprintf(out, "}%s\n", i + 1 < n ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+static void print_table (const Bench_Result_t* results, size_t n) {
+	fprintf(stderr, "%-10s %11s %6s %12s %12s %12s %10s %8s %9s\n",
+		"op", "size", "reps", "p50 ns", "p90 ns", "p99 ns", "ns/elem", "GB/s", "change");
+	for (size_t i = 0; i < n; ++i) {
+		const Bench_Result_t* r = &results[i];
+		char size[24];
+		snprintf(size, sizeof(size), "%ux%u", r->rows, r->cols);
+		fprintf(stderr, "%-10s %11s %6zu %12.0f %12.0f %12.0f %10.3f %8.2f",
+			r->op, r->rows ? size : "-", r->reps, r->p50_ns, r->p90_ns, r->p99_ns,
+			r->ns_per_element, r->gb_per_s);
+		if (r->has_baseline) {
+			fprintf(stderr, " %+8.1f%%", r->change_pct);
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+static void usage (const char* name) {
+	fprintf(stderr, "usage: %s [-t threads] [-m budget_mb] [-n max_dim] [-r min_reps] [-s min_seconds]\n"
+		"       [-d dir] [-o report.json] [-b baseline.json] [-x threshold_pct]\n", name);
+}
+
+int main (int argc, char** argv) {
+
+	init_matrix_kernels();
+
+	unsigned int num_threads = 0;
+	size_t budget = 0;
+	unsigned int max_dim = BENCH_MAX_DIM;
+	size_t min_reps = 5;
+	double min_seconds = 0.2;
+	double threshold = 10.0;
+	const char* dir = "/tmp";
+	const char* report = NULL;
+	const char* baseline = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:m:n:r:s:d:o:b:x:")) != -1) {
+		switch (opt) {
+		case 't': num_threads = atoi(optarg); break;
+		case 'm': budget = (size_t) strtoull(optarg, NULL, 10) << 20; break;
+		case 'n': max_dim = atoi(optarg); break;
+		case 'r': min_reps = atoi(optarg); break;
+		case 's': min_seconds = atof(optarg); break;
+		case 'd': dir = optarg; break;
+		case 'o': report = optarg; break;
+		case 'b': baseline = optarg; break;
+		case 'x': threshold = atof(optarg); break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (max_dim > BENCH_MAX_DIM || max_dim < 5 || min_reps == 0 || min_reps > BENCH_MAX_REPS) {
+		usage(argv[0]);
+		return 2;
+	}
+	/*by default a quarter of memory, each size holds four matrices*/
+	if (budget == 0) {
+		budget = (size_t) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 4;
+	}
+	if (!init_thread_pool(num_threads)) {
+		fprintf(stderr, "Thread pool failed to start, running on %u threads\n", thread_pool_size());
+	}
+
+	/*dispatch prints its results, which are not what is being measured*/
+	fflush(stdout);
+	const int saved_stdout = dup(STDOUT_FILENO);
+	const int null_fd = open("/dev/null", O_WRONLY);
+	if (saved_stdout < 0 || null_fd < 0) {
+		perror("FAILED TO SET UP OUTPUT");
+		return 2;
+	}
+
+	Bench_State_t s;
+	memset(&s, 0, sizeof(s));
+	snprintf(s.path, sizeof(s.path), "%s/matbench.%d", dir, (int) getpid());
+	if (!create_catalogue(&s.mats, 0)) {
+		return 2;
+	}
+
+	static Bench_Result_t results[BENCH_MAX_RESULTS];
+	size_t num_results = 0;
+	bool failed = false;
+	for (unsigned int dim = 5; dim <= max_dim && !failed; dim = dim < 16 ? 16 : dim * 2) {
+		if ((size_t) dim * dim * sizeof(unsigned int) * 4 > budget) {
+			break;
+		}
+		if (!setup_size(&s, dim)) {
+			fprintf(stderr, "Failed to set up %ux%u\n", dim, dim);
+			failed = true;
+			break;
+		}
+		fprintf(stderr, "timing %ux%u\n", dim, dim);
+		for (size_t i = 0; i < sizeof(bench_ops) / sizeof(bench_ops[0]); ++i) {
+			const Bench_Op_t* op = &bench_ops[i];
+			if ((op->once && dim != 5) || num_results == BENCH_MAX_RESULTS) {
+				continue;
+			}
+			fflush(stdout);
+			dup2(null_fd, STDOUT_FILENO);
+			const bool ok = time_op(op, &s, min_reps, min_seconds, &results[num_results]);
+			fflush(stdout);
+			dup2(saved_stdout, STDOUT_FILENO);
+			if (!ok) {
+				fprintf(stderr, "%s failed at %ux%u\n", op->op, dim, dim);
+				failed = true;
+				break;
+			}
+			num_results++;
+		}
+		teardown_size(&s);
+	}
+	close(null_fd);
+	close(saved_stdout);
+
+	int regressions = 0;
+	if (baseline) {
+		regressions = compare_baseline(baseline, results, num_results, threshold);
+	}
+	print_table(results, num_results);
+
+	FILE* out = report ? fopen(report, "w") : stdout;
+	if (!out) {
+		perror("FAILED TO OPEN THE REPORT");
+		failed = true;
+	}
+	else {
+		print_json(out, results, num_results);
+		if (report) {
+			fclose(out);
+		}
+	}
+	if (regressions > 0) {
+		fprintf(stderr, "%d results more than %.1f%% slower than the baseline\n", regressions, threshold);
+	}
+
+	destroy_catalogue(&s.mats);
+	destroy_thread_pool();
+	if (failed || regressions < 0) {
+		return 2;
+	}
+	return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include<readline/readline.h>
+
+#include "server.h"
+
+/*
+ * matclient sends commands to matlab --serve and prints the replies.
+ *	matclient <socket> <command ...>	runs one command
+ *	matclient <socket>			reads commands from the prompt, or from
+ *						stdin when it is not a terminal, up to exit
+ */
+
+/*
+ * PURPOSE: sends one command line and prints the reply
+ * INPUTS:
+ *	fd: the connection
+ *  line: the command without its newline
+ * RETURN:
+ *  If the whole reply came back then true
+ *  else false and the connection is lost.
+ *
+ **/
+static bool run_remote (int fd, const char* line) {
+	const size_t len = strlen(line);
+	char* request = malloc(len + 1);
+	if (!request) {
+		return false;
+	}
+	memcpy(request, line, len);
+	request[len] = '\n';
+	size_t sent = 0;
+	while (sent < len + 1) {
+		const ssize_t n = send(fd, request + sent, len + 1 - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			free(request);
+			return false;
+		}
+		sent += n;
+	}
+	free(request);
+
+	char buf[1 << 16];
+	for (;;) {
+		const ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		const char* end = memchr(buf, SERVER_END_OF_REPLY, n);
+		fwrite(buf, 1, end ? (size_t) (end - buf) : (size_t) n, stdout);
+		if (end) {
+			fflush(stdout);
+			return true;
+		}
+	}
+}
+
+int main (int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <socket> [command ...]\n", argv[0]);
+		return 1;
+	}
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path %s is too long\n", argv[1]);
+		return 1;
+	}
+	strcpy(addr.sun_path, argv[1]);
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+		perror("CLIENT FAILED TO CONNECT");
+		return 1;
+	}
+
+	bool ok = true;
+	if (argc > 2) {
+		/*the words of the command are joined back into one line*/
+		size_t len = 0;
+		for (int i = 2; i < argc; ++i) {
+			len += strlen(argv[i]) + 1;
+		}
+		char* line = calloc(len, 1);
+		if (!line) {
+			close(fd);
+			return 1;
+		}
+		for (int i = 2; i < argc; ++i) {
+			strcat(line, argv[i]);
+			if (i + 1 < argc) {
+				strcat(line, " ");
+			}
+		}
+		ok = run_remote(fd, line);
+		free(line);
+	}
+	else {
+		const bool prompt = isatty(STDIN_FILENO);
+		char* line = NULL;
+		size_t cap = 0;
+		for (;;) {
+			if (prompt) {
+				free(line);
+				line = readline("> ");
+			}
+			else {
+				const ssize_t len = getline(&line, &cap, stdin);
+				if (len < 0) {
+					break;
+				}
+				if (len > 0 && line[len - 1] == '\n') {
+					line[len - 1] = '\0';
+				}
+			}
+			if (!line || strncmp(line, "exit", strlen("exit") + 1) == 0) {
+				break;
+			}
+			if (!(ok = run_remote(fd, line))) {
+				break;
+			}
+		}
+		free(line);
+	}
+	if (!ok) {
+		fprintf(stderr, "Lost the connection to the server\n");
+	}
+	close(fd);
+	return ok ? 0 : 1;
+}
@@ -2,15 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-#include <fcntl.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
-#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
 
 
 #include "matrix.h"
+#include "matrix_disk.h"
+#include "matrix_kernels.h"
+#include "matrix_memory.h"
+#include "matrix_shm.h"
+#include "matrix_sparse.h"
+#include "thread_pool.h"
 
 
 #define MAX_CMD_COUNT 50
@@ -18,206 +24,1481 @@
 /*protected functions*/
 void load_matrix (Matrix_t* m, unsigned int* data);
 
+/*a matrix has its elements in data, in sparse or in a file*/
+static bool has_storage (const Matrix_t* m) {
+	return m->data || m->sparse || m->disk;
+}
+
+/*names and widths of the element types in Matrix_Type_t order*/
+static const struct {
+	const char* name;
+	size_t size;
+}matrix_types[MATRIX_TYPES] = {
+	{ "u32", sizeof(uint32_t) },
+	{ "u8", sizeof(uint8_t) },
+	{ "u16", sizeof(uint16_t) },
+	{ "u64", sizeof(uint64_t) },
+	{ "i32", sizeof(int32_t) },
+	{ "f32", sizeof(float) },
+	{ "f64", sizeof(double) }
+};
+
+/*
+ * PURPOSE: bytes taken by one element of a type
+ * INPUTS:
+ *	type: the element type
+ * RETURN:
+ *  the width, 0 for an unknown type
+ *
+ **/
+size_t matrix_type_size (Matrix_Type_t type) {
+	return type < MATRIX_TYPES ? matrix_types[type].size : 0;
+}
+
+/*
+ * PURPOSE: bytes of dense storage for rows x cols elements of a type, the
+ *          product is checked so a huge matrix cannot wrap around to a
+ *          small allocation
+ * INPUTS:
+ *	rows, cols: dimensions of the matrix
+ *  type: the element type
+ *  bytes: receives the size
+ * RETURN:
+ *  If the size fits in a size_t then true
+ *  else false.
+ *
+ **/
+bool matrix_data_bytes (unsigned int rows, unsigned int cols, Matrix_Type_t type, size_t* bytes) {
+	size_t elements = 0;
+	return type < MATRIX_TYPES && bytes
+		&& !__builtin_mul_overflow((size_t) rows, (size_t) cols, &elements)
+		&& !__builtin_mul_overflow(elements, matrix_type_size(type), bytes);
+}
+
+/*
+ * PURPOSE: name of an element type as the commands spell it
+ * INPUTS:
+ *	type: the element type
+ * RETURN:
+ *  the name, "?" for an unknown type
+ *
+ **/
+const char* matrix_type_name (Matrix_Type_t type) {
+	return type < MATRIX_TYPES ? matrix_types[type].name : "?";
+}
+
+/*
+ * PURPOSE: looks up an element type by name
+ * INPUTS:
+ *	name: u8, u16, u32, u64, i32, f32 or f64
+ *  type: receives the type
+ * RETURN:
+ *  If the name is a type then true
+ *  else false.
+ *
+ **/
+bool parse_matrix_type (const char* name, Matrix_Type_t* type) {
+	if (!name || !type) {
+		return false;
+	}
+	for (unsigned int i = 0; i < MATRIX_TYPES; ++i) {
+		if (strcmp(name, matrix_types[i].name) == 0) {
+			*type = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Elements up to MATRIX_INLINE_BYTES live in the same block as the header,
+ * right after it, so a small matrix costs a single allocation. Inline
+ * elements go with the header and are never shared by duplicates.
+ */
+#define MATRIX_INLINE_BYTES 4096
+#define MATRIX_HEADER_SPAN ((sizeof(Matrix_t) + MEMORY_ALIGN - 1) / MEMORY_ALIGN * MEMORY_ALIGN)
+
+static bool data_is_inline (const Matrix_t* m) {
+	return m->data && (const char*) m->data == (const char*) m + MATRIX_HEADER_SPAN;
+}
+
+/*elements from the start of one row to the start of the next*/
+static size_t row_stride (const Matrix_t* m) {
+	return m->stride ? m->stride : m->cols;
+}
+
+/*
+ * Chunk tasks handed to parallel_for, each one works on the
+ * [begin, end) slice of the elements counted in row order. A view keeps
+ * its rows stride elements apart in a larger buffer, so the slice is
+ * walked in runs that stop at the end of a row. Buffers with their rows
+ * back to back have a stride of 0 and the whole slice is one run.
+ */
+typedef struct {
+	unsigned int* dst;
+	const unsigned int* a;
+	const unsigned int* b;
+	size_t cols;
+	size_t dst_stride;
+	size_t a_stride;
+	size_t b_stride;
+	unsigned int shift;
+	char direction;
+	unsigned int start_range;
+	unsigned int span;
+	unsigned long long seed;
+	unsigned long long first;	/*counter of element 0 when drawing random values*/
+	Matrix_Type_t type;	/*of dst, and of a and b where the task has them*/
+	Matrix_Type_t from;	/*of a when casting*/
+}Matrix_Task_t;
+
+/*
+ * PURPOSE: finds where element i sits in each buffer of a task and how
+ *          many elements from there on are contiguous in all of them
+ * INPUTS:
+ *	t: the task
+ *  i: the element, counted in row order
+ *  end: the end of the task's slice
+ *  dst, a, b: receive the offset of the element in each buffer
+ * RETURN:
+ *  the length of the run
+ *
+ **/
+static size_t task_run (const Matrix_Task_t* t, size_t i, size_t end, size_t* dst, size_t* a, size_t* b) {
+	if (!t->dst_stride && !t->a_stride && !t->b_stride) {
+		*dst = *a = *b = i;
+		return end - i;
+	}
+	const size_t r = i / t->cols;
+	const size_t c = i % t->cols;
+	*dst = t->dst_stride ? r * t->dst_stride + c : i;
+	*a = t->a_stride ? r * t->a_stride + c : i;
+	*b = t->b_stride ? r * t->b_stride + c : i;
+	return end - i < t->cols - c ? end - i : t->cols - c;
+}
+
+static void add_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		matrix_kernels.add_u32(&t->dst[d], &t->a[a], &t->b[b], len);
+	}
+}
+
+static void shift_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		if (t->direction == 'l') {
+			matrix_kernels.shift_left_u32(&t->dst[d], len, t->shift);
+		}
+		else {
+			matrix_kernels.shift_right_u32(&t->dst[d], len, t->shift);
+		}
+	}
+}
+
+/*
+ * The same for the other element types, begin and end still count
+ * elements so the offsets scale by the width of the type.
+ */
+static void add_typed_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	const size_t width = matrix_type_size(t->type);
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		matrix_kernels.add_typed[t->type]((char*) t->dst + d * width, (const char*) t->a + a * width,
+			(const char*) t->b + b * width, len);
+	}
+}
+
+static void shift_typed_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	const size_t width = matrix_type_size(t->type);
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		char* data = (char*) t->dst + d * width;
+		if (t->direction == 'l') {
+			matrix_kernels.shift_left_typed[t->type](data, len, t->shift);
+		}
+		else {
+			matrix_kernels.shift_right_typed[t->type](data, len, t->shift);
+		}
+	}
+}
+
+static void cast_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		matrix_kernels.cast[t->from][t->type]((char*) t->dst + d * matrix_type_size(t->type),
+			(const char*) t->a + a * matrix_type_size(t->from), len);
+	}
+}
+
+static void copy_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	const size_t width = matrix_type_size(t->type);
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		memcpy((char*) t->dst + d * width, (const char*) t->a + a * width, len * width);
+	}
+}
+
+/*
+ * Reduction tasks write into a slot per chunk, which keeps the threads
+ * apart and makes the combine order the same for every thread count.
+ */
+typedef struct {
+	const unsigned int* data;
+	size_t chunk;
+	size_t cols;
+	size_t stride;		/*of the rows of data, 0 when they are back to back*/
+	Matrix_Summary_t* partials;
+	unsigned long long* sums;
+	pthread_mutex_t lock;
+}Matrix_Reduce_Task_t;
+
+static void summary_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Reduce_Task_t* t = ctx;
+	Matrix_Summary_t* p = &t->partials[begin / t->chunk];
+	if (!t->stride) {
+		matrix_kernels.reduce_u32(&t->data[begin], end - begin, &p->sum, &p->min, &p->max);
+		return;
+	}
+	for (size_t i = begin, len; i < end; i += len) {
+		const size_t c = i % t->cols;
+		len = end - i < t->cols - c ? end - i : t->cols - c;
+		matrix_kernels.reduce_u32(&t->data[i / t->cols * t->stride + c], len, &p->sum, &p->min, &p->max);
+	}
+}
+
+static void row_sums_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Reduce_Task_t* t = ctx;
+	const size_t stride = t->stride ? t->stride : t->cols;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		unsigned int lo = UINT_MAX;
+		unsigned int hi = 0;
+		t->sums[r] = 0;
+		matrix_kernels.reduce_u32(&t->data[r * stride], t->cols, &t->sums[r], &lo, &hi);
+	}
+}
+
+static void col_sums_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Reduce_Task_t* t = ctx;
+	const size_t stride = t->stride ? t->stride : t->cols;
+	unsigned long long* acc = calloc(t->cols, sizeof(unsigned long long));
+	if (!acc) {
+		/*fall back to accumulating straight into the shared sums*/
+		pthread_mutex_lock(&t->lock);
+		for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+			matrix_kernels.accumulate_u32(t->sums, &t->data[r * stride], t->cols);
+		}
+		pthread_mutex_unlock(&t->lock);
+		return;
+	}
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		matrix_kernels.accumulate_u32(acc, &t->data[r * stride], t->cols);
+	}
+	pthread_mutex_lock(&t->lock);
+	for (size_t j = 0; j < t->cols; ++j) {
+		t->sums[j] += acc[j];
+	}
+	pthread_mutex_unlock(&t->lock);
+	free(acc);
+}
+
+/*
+ * PURPOSE: pick a chunk that covers whole rows so row and column tasks
+ *          never split a row between two threads
+ * INPUTS:
+ *	cols: the row length
+ *  min_rows: the least number of rows in a chunk
+ * RETURN:
+ *  chunk size in elements
+ *
+ **/
+static size_t row_aligned_chunk (size_t cols, size_t min_rows) {
+	size_t rows = PARALLEL_CHUNK_ELEMENTS / cols;
+	if (rows < min_rows) {
+		rows = min_rows;
+	}
+	return rows * cols;
+}
+
+/*values for the other element types are drawn as u32 this many at a time, then converted*/
+#define RANDOM_BLOCK 1024
+
+static void random_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Task_t* t = ctx;
+	/*elements are drawn by index, so the chunking and the layout never change the values*/
+	const size_t width = matrix_type_size(t->type);
+	unsigned int block[RANDOM_BLOCK];
+	size_t d, a, b;
+	for (size_t i = begin, len; i < end; i += len) {
+		len = task_run(t, i, end, &d, &a, &b);
+		if (t->type == MATRIX_U32) {
+			matrix_kernels.random_u32(&t->dst[d], len, t->first + i, t->seed, t->start_range, t->span);
+			continue;
+		}
+		for (size_t k = 0; k < len; k += RANDOM_BLOCK) {
+			const size_t n = len - k < RANDOM_BLOCK ? len - k : RANDOM_BLOCK;
+			matrix_kernels.random_u32(block, n, t->first + i + k, t->seed, t->start_range, t->span);
+			matrix_kernels.cast[MATRIX_U32][t->type]((char*) t->dst + (d + k) * width, block, n);
+		}
+	}
+}
+
+/*
+ * PURPOSE: allocates a dense matrix, small ones in a single block
+ * INPUTS:
+ *	new_matrix: receives the new matrix
+ *  name: the name of the matrix
+ *  rows, cols: dimensions of the matrix
+ *  type: the element type
+ *  zero: clear the elements
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool new_dense_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type, bool zero) {
+
+	size_t bytes = 0;
+	if (!new_matrix || !name || strlen(name) + 1 > MATRIX_NAME_LEN
+		|| !matrix_data_bytes(rows, cols, type, &bytes)) {
+		return false;
+	}
+
+	if (bytes <= MATRIX_INLINE_BYTES) {
+		*new_matrix = memory_alloc(MATRIX_HEADER_SPAN + bytes, false);
+		if (!(*new_matrix)) {
+			return false;
+		}
+		memset(*new_matrix, 0, sizeof(Matrix_t));
+		(*new_matrix)->data = (unsigned int*) ((char*) *new_matrix + MATRIX_HEADER_SPAN);
+		if (zero) {
+			memset((*new_matrix)->data, 0, bytes);
+		}
+	}
+	else {
+		*new_matrix = memory_alloc(sizeof(Matrix_t), true);
+		if (!(*new_matrix)) {
+			return false;
+		}
+		(*new_matrix)->data = memory_alloc(bytes, zero);
+		if (!(*new_matrix)->data) {
+			memory_free(*new_matrix);
+			*new_matrix = NULL;
+			return false;
+		}
+	}
+	(*new_matrix)->rows = rows;
+	(*new_matrix)->cols = cols;
+	(*new_matrix)->type = type;
+	strncpy((*new_matrix)->name, name, MATRIX_NAME_LEN);
+	return true;
+}
+
+/*
+ * PURPOSE: instantiates a new matrix with the passed name, rows, cols
+ * INPUTS:
+ *	name the name of the matrix limited to 50 characters
+ *  rows the number of rows the matrix
+ *  cols the number of cols the matrix
+ * RETURN:
+ *  If no errors occurred during instantiation then true
+ *  else false for an error in the process.
+ *
+ **/
+
+bool create_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+						const unsigned int cols) {
+
+	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
+	//check for null values
+	//Since rows and cols are unsigned no need to check if they're negitive
+	return new_dense_matrix(new_matrix, name, rows, cols, MATRIX_U32, true);
+}
+
+/*
+ * PURPOSE: instantiates a new all zero matrix of the given element type
+ * INPUTS:
+ *	new_matrix: receives the new matrix
+ *  name: the name of the matrix
+ *  rows, cols: dimensions of the matrix
+ *  type: the element type
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool create_typed_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type) {
+	return new_dense_matrix(new_matrix, name, rows, cols, type, true);
+}
+
+/*
+ * PURPOSE: instantiates a new matrix whose elements are left as they come,
+ *          for callers that write every element before anything reads one
+ * INPUTS:
+ *	new_matrix: receives the new matrix
+ *  name: the name of the matrix
+ *  rows, cols: dimensions of the matrix
+ *  type: the element type
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool create_matrix_for_overwrite (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type) {
+	return new_dense_matrix(new_matrix, name, rows, cols, type, false);
+}
+
+/*
+ * PURPOSE: instantiates an all zero matrix in CSR storage, nothing is
+ *          allocated for the elements themselves
+ * INPUTS:
+ *	new_matrix: receives the new matrix
+ *  name: the name of the matrix
+ *  rows, cols: dimensions of the matrix
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool create_sparse_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols) {
+
+	if (!new_matrix || !name || strlen(name) + 1 > MATRIX_NAME_LEN) {
+		return false;
+	}
+
+	*new_matrix = memory_alloc(sizeof(Matrix_t), true);
+	if (!(*new_matrix)) {
+		return false;
+	}
+	if (!alloc_sparse(&(*new_matrix)->sparse, rows, 0)) {
+		memory_free(*new_matrix);
+		*new_matrix = NULL;
+		return false;
+	}
+	(*new_matrix)->rows = rows;
+	(*new_matrix)->cols = cols;
+	strncpy((*new_matrix)->name, name, MATRIX_NAME_LEN);
+	return true;
+}
+
+	//FINISHTODO FUNCTION COMMENT
+ /*
+ * PURPOSE: free the memory for the matrix array
+ * INPUTS:
+ *	m: pointer to the matrix array to be freed
+ * RETURN:
+ *  void
+ *
+ **/
+void destroy_matrix (Matrix_t** m) {
+
+	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
+	if(!m || !(*m)){
+		return;
+	}
+	//####################################
+
+	release_dense_data(*m);
+	free_sparse(&(*m)->sparse);
+	release_disk(*m);
+	memory_free(*m);
+	*m = NULL;
+}
+
+/*
+ * PURPOSE: drops this matrix's hold on its dense elements, the buffer,
+ *          file mapping or shared memory segment goes with the last holder.
+ *          Inline elements stay until the header itself goes.
+ * INPUTS:
+ *	m: the matrix, left without dense storage
+ * RETURN:
+ *  void
+ *
+ **/
+void release_dense_data (Matrix_t* m) {
+
+	if (m->shm) {
+		release_shm(m->shm);
+		m->shm = NULL;
+	}
+	else if (m->refs && __atomic_sub_fetch(m->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+		m->refs = NULL;
+	}
+	else {
+		free(m->refs);
+		m->refs = NULL;
+		if (m->mapping) {
+			munmap(m->mapping, m->mapping_len);
+		}
+		else if (!data_is_inline(m)) {
+			memory_free((char*) m->data - m->offset);
+		}
+	}
+	m->data = NULL;
+	m->stride = 0;
+	m->offset = 0;
+	m->mapping = NULL;
+	m->mapping_len = 0;
+}
+
+/*
+ * PURPOSE: moves the elements of a dense matrix to a new buffer of its own
+ *          with the rows back to back
+ * INPUTS:
+ *	m: the dense matrix
+ *  keep: copy the values over, false when every element is about to be
+ *        overwritten anyway
+ * RETURN:
+ *  If no errors then true
+ *  else false and the matrix keeps its old storage.
+ *
+ **/
+static bool move_data (Matrix_t* m, bool keep) {
+
+	const size_t n = (size_t) m->rows * m->cols;
+	size_t bytes = 0;
+	if (!matrix_data_bytes(m->rows, m->cols, m->type, &bytes)) {
+		return false;
+	}
+	unsigned int* data = memory_alloc(bytes, false);
+	if (!data) {
+		return false;
+	}
+	if (keep) {
+		Matrix_Task_t t = { .dst = data, .a = m->data, .cols = m->cols, .a_stride = m->stride,
+			.type = m->type };
+		parallel_for(n, 0, copy_task, &t);
+	}
+	release_dense_data(m);
+	m->data = data;
+	return true;
+}
+
+/*
+ * PURPOSE: gives a dense matrix elements of its own before they are written,
+ *          nothing is copied while no duplicate or view shares them
+ * INPUTS:
+ *	m: the dense matrix
+ *  keep: copy the shared values over, false when every element is about
+ *        to be overwritten anyway
+ * RETURN:
+ *  If no errors then true
+ *  else false and the matrix still shares its elements.
+ *
+ **/
+static bool detach_data (Matrix_t* m, bool keep) {
+
+	if (!m->refs) {
+		return true;
+	}
+	/*the last holder of a buffer keeps it, a view with its stride*/
+	if (__atomic_load_n(m->refs, __ATOMIC_ACQUIRE) == 1) {
+		free(m->refs);
+		m->refs = NULL;
+		return true;
+	}
+	return move_data(m, keep);
+}
+
+/*
+ * PURPOSE: takes a matrix off storage it shares with duplicates so it can
+ *          be written in place, its values stay the same
+ * INPUTS:
+ *	m: the matrix
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool unshare_matrix (Matrix_t* m) {
+
+	if (!m || !has_storage(m)) {
+		return false;
+	}
+	if (m->sparse) {
+		return __atomic_load_n(&m->sparse->refs, __ATOMIC_ACQUIRE) == 1 || sparse_copy(m, m);
+	}
+	if (m->disk) {
+		return disk_detach(m, true);
+	}
+	return detach_data(m, true);
+}
+
+/*
+ * PURPOSE: copies a view out to a buffer of its own with the rows back to
+ *          back, for code that walks the elements as one flat array
+ * INPUTS:
+ *	m: the matrix, anything but a dense view is left as it is
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool compact_matrix (Matrix_t* m) {
+
+	if (!m || !has_storage(m)) {
+		return false;
+	}
+	return !m->stride || move_data(m, true);
+}
+
+
+
+	//FINISHTODO FUNCTION COMMENT
+ /*
+ * PURPOSE: check if the data in the two matrices passed in are equal
+ * INPUTS:
+ *	a: pointer to  a matrix to be compared to
+ *  b: pointer to second matrix to be compared to
+ * RETURN:
+ *  If no errors and the data of the two matrices are equal then true
+ *  else false.
+ *
+ **/
+bool equal_matrices (Matrix_t* a, Matrix_t* b) {
+
+	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
+	if (!a || !b || !has_storage(a) || !has_storage(b)) {
+		return false;
+	}
+	//#####################################
+
+
+	if (a->rows != b->rows || a->cols != b->cols || a->type != b->type) {
+		return false;
+	}
+	/*duplicates sharing storage are equal without looking*/
+	if ((a->data && a->data == b->data && row_stride(a) == row_stride(b))
+		|| (a->sparse && a->sparse == b->sparse) || (a->disk && a->disk == b->disk)) {
+		return true;
+	}
+
+	if (a->disk || b->disk) {
+		return !a->sparse && !b->sparse && disk_equal(a, b);
+	}
+
+	if (a->sparse || b->sparse) {
+		return sparse_equal(a, b);
+	}
+	if (a->stride || b->stride) {
+		const size_t width = matrix_type_size(a->type);
+		for (size_t r = 0; r < a->rows; ++r) {
+			if (!matrix_kernels.equal_typed[a->type]((const char*) a->data + r * row_stride(a) * width,
+				(const char*) b->data + r * row_stride(b) * width, a->cols)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	if (a->type != MATRIX_U32) {
+		return matrix_kernels.equal_typed[a->type](a->data, b->data, (size_t) a->rows * a->cols);
+	}
+	return matrix_kernels.equal_u32(a->data, b->data, (size_t) a->rows * a->cols);
+}
+
+	//FINISHTODO FUNCTION COMMENT
+ /*
+ * PURPOSE: duplicate the src matrix into the dest matrix. Nothing is copied,
+ *          dest shares the storage of src until either of them is written.
+ * INPUTS:
+ *	src: pointer to the matrix of the origiinal matrix
+ *  dest: pointer to the matrix to take the size and storage of src, any
+ *        storage it had is released
+ * RETURN:
+ *  If no errors with input and matrix are duplicated then true
+ *  else false for the input errors.
+ *
+ **/
+bool duplicate_matrix (Matrix_t* src, Matrix_t* dest) {
+
+
+	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
+
+	if (!src || !dest || !has_storage(src) || src == dest) {
+		return false;
+	}
+	//####################################
+
+	/*inline elements go with their header and shared ones stay in their segment, both are copied*/
+	unsigned int* copy = NULL;
+	if (data_is_inline(src) || src->shm) {
+		const size_t bytes = (size_t) src->rows * src->cols * matrix_type_size(src->type);
+		copy = memory_alloc(bytes, false);
+		if (!copy) {
+			return false;
+		}
+		memcpy(copy, src->data, bytes);
+	}
+	else if (!src->sparse && !src->disk && !src->refs) {
+		src->refs = malloc(sizeof(unsigned int));
+		if (!src->refs) {
+			return false;
+		}
+		*src->refs = 1;
+	}
+
+	release_dense_data(dest);
+	free_sparse(&dest->sparse);
+	release_disk(dest);
+	dest->rows = src->rows;
+	dest->cols = src->cols;
+	dest->type = src->type;
+
+	if (copy) {
+		dest->data = copy;
+		return true;
+	}
+	if (src->disk) {
+		__atomic_add_fetch(&src->disk->refs, 1, __ATOMIC_RELAXED);
+		dest->disk = src->disk;
+		return true;
+	}
+	if (src->sparse) {
+		__atomic_add_fetch(&src->sparse->refs, 1, __ATOMIC_RELAXED);
+		dest->sparse = src->sparse;
+		return true;
+	}
+	__atomic_add_fetch(src->refs, 1, __ATOMIC_RELAXED);
+	dest->refs = src->refs;
+	dest->data = src->data;
+	dest->stride = src->stride;
+	dest->offset = src->offset;
+	dest->mapping = src->mapping;
+	dest->mapping_len = src->mapping_len;
+	return true;
+}
+
+/*
+ * PURPOSE: makes dest a view of a block of src. Nothing is copied, dest
+ *          points into the elements of src with its rows as far apart as
+ *          they are in src and shares them like a duplicate does, the one
+ *          of the two that is written first gets a private copy.
+ * INPUTS:
+ *	src: the dense matrix to slice
+ *  row_begin, row_end: the rows of the block, row_end itself not included
+ *  col_begin, col_end: the columns of the block, col_end itself not included
+ *  dest: takes the view, any storage it had is released
+ * RETURN:
+ *  If no errors and the block lies within src then true
+ *  else false.
+ *
+ **/
+bool slice_matrix (Matrix_t* src, unsigned int row_begin, unsigned int row_end, unsigned int col_begin,
+		unsigned int col_end, Matrix_t* dest) {
+
+	if (!src || !dest || !src->data || src == dest || row_begin > row_end || row_end > src->rows
+		|| col_begin > col_end || col_end > src->cols) {
+		return false;
+	}
+
+	const unsigned int rows = row_end - row_begin;
+	const unsigned int cols = col_end - col_begin;
+	const size_t width = matrix_type_size(src->type);
+	const size_t stride = row_stride(src);
+	const size_t first = ((size_t) row_begin * stride + col_begin) * width;
+
+	/*inline and shared memory elements are copied, as for duplicate_matrix*/
+	unsigned int* copy = NULL;
+	if (data_is_inline(src) || src->shm) {
+		copy = memory_alloc((size_t) rows * cols * width, false);
+		if (!copy) {
+			return false;
+		}
+		for (size_t r = 0; r < rows; ++r) {
+			memcpy((char*) copy + r * cols * width, (const char*) src->data + first + r * stride * width,
+				cols * width);
+		}
+	}
+	else if (!src->refs) {
+		src->refs = malloc(sizeof(unsigned int));
+		if (!src->refs) {
+			return false;
+		}
+		*src->refs = 1;
+	}
+
+	release_dense_data(dest);
+	free_sparse(&dest->sparse);
+	dest->rows = rows;
+	dest->cols = cols;
+	dest->type = src->type;
+
+	if (copy) {
+		dest->data = copy;
+		return true;
+	}
+	__atomic_add_fetch(src->refs, 1, __ATOMIC_RELAXED);
+	dest->refs = src->refs;
+	dest->data = (unsigned int*) ((char*) src->data + first);
+	dest->offset = src->offset + first;
+	/*full rows, or a single one, are still back to back*/
+	dest->stride = rows <= 1 || cols == stride ? 0 : stride;
+	dest->mapping = src->mapping;
+	dest->mapping_len = src->mapping_len;
+	return true;
+}
+
+/*
+ * Transpose tiles. A task takes whole bands of rows of the source and goes
+ * across them TRANSPOSE_TILE columns at a time, each tile is read along
+ * its rows and written along the rows of the result while both sides of
+ * it sit in L1. A plain walk down the columns would touch a new cache
+ * line, and soon a new page, for every element written.
+ */
+#define TRANSPOSE_TILE 32
+
+typedef struct {
+	const char* src;
+	char* dst;
+	size_t cols;		/*of the source*/
+	size_t src_stride;
+	size_t dst_stride;
+	size_t width;
+}Matrix_Transpose_Task_t;
+
+#define TRANSPOSE_BLOCK(T) \
+	for (size_t i = 0; i < rows; ++i) { \
+		for (size_t j = 0; j < cols; ++j) { \
+			((T*) dst)[j * t->dst_stride + i] = ((const T*) src)[i * t->src_stride + j]; \
+		} \
+	}
+
+/*transposes the rows x cols block of the source at row i, column j*/
+static void transpose_block (const Matrix_Transpose_Task_t* t, size_t i, size_t j, size_t rows, size_t cols) {
+	const char* src = t->src + (i * t->src_stride + j) * t->width;
+	char* dst = t->dst + (j * t->dst_stride + i) * t->width;
+	switch (t->width) {
+	case 1:
+		TRANSPOSE_BLOCK(uint8_t)
+		break;
+	case 2:
+		TRANSPOSE_BLOCK(uint16_t)
+		break;
+	case 4:
+		matrix_kernels.transpose_u32((const unsigned int*) src, t->src_stride, (unsigned int*) dst,
+			t->dst_stride, rows, cols);
+		break;
+	default:
+		TRANSPOSE_BLOCK(uint64_t)
+		break;
+	}
+}
+
+static void transpose_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Transpose_Task_t* t = ctx;
+	const size_t last = end / t->cols;
+	for (size_t i = begin / t->cols; i < last; i += TRANSPOSE_TILE) {
+		const size_t rows = last - i < TRANSPOSE_TILE ? last - i : TRANSPOSE_TILE;
+		for (size_t j = 0; j < t->cols; j += TRANSPOSE_TILE) {
+			transpose_block(t, i, j, rows, t->cols - j < TRANSPOSE_TILE ? t->cols - j : TRANSPOSE_TILE);
+		}
+	}
+}
+
+/*
+ * PURPOSE: writes the transpose of src into dest, tile by tile on the
+ *          thread pool
+ * INPUTS:
+ *	src: the dense matrix to transpose, it may be a view
+ *  dest: a dense matrix of the same type with the rows and columns of src
+ *        swapped, it must not be src
+ * RETURN:
+ *  If no errors and the sizes line up then true
+ *  else false.
+ *
+ **/
+bool transpose_matrix (Matrix_t* src, Matrix_t* dest) {
+
+	if (!src || !dest || !src->data || !dest->data || src == dest) {
+		return false;
+	}
+	if (dest->rows != src->cols || dest->cols != src->rows || dest->type != src->type) {
+		return false;
+	}
+	if (!detach_data(dest, false)) {
+		return false;
+	}
+	if (src->rows == 0 || src->cols == 0) {
+		return true;
+	}
+
+	Matrix_Transpose_Task_t t = { .src = (const char*) src->data, .dst = (char*) dest->data,
+		.cols = src->cols, .src_stride = row_stride(src), .dst_stride = row_stride(dest),
+		.width = matrix_type_size(src->type) };
+	parallel_for((size_t) src->rows * src->cols, row_aligned_chunk(src->cols, TRANSPOSE_TILE),
+		transpose_task, &t);
+	return true;
+}
+
+/*clears every element of a dense matrix, a view row by row*/
+static void clear_data (Matrix_t* m) {
+	const size_t width = matrix_type_size(m->type);
+	if (!m->stride) {
+		memset(m->data, 0, (size_t) m->rows * m->cols * width);
+		return;
+	}
+	for (size_t r = 0; r < m->rows; ++r) {
+		memset((char*) m->data + r * m->stride * width, 0, m->cols * width);
+	}
+}
+
+	//TODO FUNCTION COMMENT
+ /*
+ * PURPOSE: Performs either a left or right shift on all elements in the passed in matrix
+ * INPUTS:
+ *	a: pointer to the matrix to be shifted
+ *  direction: letter to tell which direction to shift to
+ *  shift: the number of bits to be shifted
+ * RETURN:
+ *  If no errors with input then true
+ *  else false for the input errors.
+ *
+ **/
+bool bitwise_shift_matrix (Matrix_t* a, char direction, unsigned int shift) {
+
+	//TODO ERROR CHECK INCOMING PARAMETERS
+	if (!a || !has_storage(a) || !matrix_kernels.shift_left_typed[a->type] || !unshare_matrix(a)) {
+		return false;
+	}
+	//####################################
+
+	if (a->disk) {
+		return disk_shift(a, direction, shift);
+	}
+	if (a->type != MATRIX_U32) {
+		const size_t n = (size_t) a->rows * a->cols;
+		const unsigned int bits = matrix_type_size(a->type) * 8;
+		if (shift >= bits) {
+			/*a signed right shift ends in all sign bits, everything else in zero*/
+			if (a->type != MATRIX_I32 || direction == 'l') {
+				clear_data(a);
+				return true;
+			}
+			shift = bits - 1;
+		}
+		Matrix_Task_t t = { .dst = a->data, .cols = a->cols, .dst_stride = a->stride,
+			.shift = shift, .direction = direction, .type = a->type };
+		parallel_for(n, 0, shift_typed_task, &t);
+		return true;
+	}
+
+	/*zeros stay zero, so a sparse matrix only shifts its stored values*/
+	unsigned int* data = a->sparse ? a->sparse->values : a->data;
+	const size_t n = a->sparse ? a->sparse->nnz : (size_t) a->rows * a->cols;
+
+	/*shifting every bit out leaves zero, C leaves it undefined so do it here*/
+	if (shift >= sizeof(unsigned int) * 8) {
+		if (a->sparse) {
+			memset(a->sparse->row_ptr, 0, (a->rows + 1) * sizeof(size_t));
+			a->sparse->nnz = 0;
+		}
+		else {
+			clear_data(a);
+		}
+		return true;
+	}
+
+	Matrix_Task_t t = { .dst = data, .cols = a->cols, .dst_stride = a->sparse ? 0 : a->stride,
+		.shift = shift, .direction = direction };
+	parallel_for(n, 0, shift_task, &t);
+
+	return true;
+}
+
+	//TODO FUNCTION COMMENT
+ /*
+ * PURPOSE: adds the data at the same element of two matrices passed and places
+ 			in same element of the c matrix
+ * INPUTS:
+ *	a: pointer to the matrix to be added with second matrix
+ *  b: pointer to the matrix to be added to the first matrix
+ *  c: pointer to the matrix to store the result of the sum, it can be
+ *     sparse only when a and b both are
+ * RETURN:
+ *  If no errors with input and the row and column sizes are the same then true
+ *  else false.
+ *
+ **/
+bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+
+	//TODO ERROR CHECK INCOMING PARAMETERS
+	if(!a || !b || !c || !has_storage(a) || !has_storage(b) || !has_storage(c)){
+		return false;
+	}
+	//####################################
+
+	if (a->rows != b->rows || a->cols != b->cols
+		|| a->rows != c->rows || a->cols != c->cols
+		|| a->type != b->type || a->type != c->type) {
+		return false;
+	}
+
+	/*c keeps its values only when it is also an operand*/
+	if (!(c->disk ? disk_detach(c, c == a || c == b) : detach_data(c, c == a || c == b))) {
+		return false;
+	}
+	if (a->disk || b->disk || c->disk) {
+		return !a->sparse && !b->sparse && !c->sparse && disk_add(a, b, c);
+	}
+	if (a->sparse || b->sparse || c->sparse) {
+		if (c == a || c == b || (c->sparse && !(a->sparse && b->sparse))) {
+			return false;
+		}
+		return compact_matrix(a) && compact_matrix(b) && compact_matrix(c) && sparse_add(a, b, c);
+	}
+
+	Matrix_Task_t t = { .dst = c->data, .a = a->data, .b = b->data, .cols = a->cols,
+		.dst_stride = c->stride, .a_stride = a->stride, .b_stride = b->stride, .type = a->type };
+	parallel_for((size_t) a->rows * a->cols, 0, a->type == MATRIX_U32 ? add_task : add_typed_task, &t);
+	return true;
+}
+
+/*
+ * Multiply blocking. B is packed a strip of GEMM_NC columns at a time,
+ * each thread then takes GEMM_MC rows of A and walks the depth in
+ * GEMM_KC steps so the packed A block stays in L2 and each B panel
+ * slice stays in L1 while the micro-kernel runs over it.
+ */
+#define GEMM_MC 128
+#define GEMM_KC 256
+#define GEMM_NC 512
+
+typedef struct {
+	const Matrix_t* a;
+	Matrix_t* c;
+	const unsigned int* b_packed;
+	size_t jc;
+	size_t nc;
+	Matrix_Mul_Mode_t mode;
+	bool failed;
+}Matrix_Gemm_Task_t;
+
+/*
+ * PURPOSE: packs B[0..k, jc..jc+nc] into GEMM_NR wide column panels, each
+ *          panel holds k rows of GEMM_NR values with zeros past the edge
+ * INPUTS:
+ *	b: the right hand matrix
+ *  jc: first column of the strip
+ *  nc: number of columns in the strip
+ *  packed: destination, room for k * round_up(nc, GEMM_NR) values
+ * RETURN:
+ *  void
+ *
+ **/
+static void pack_b_strip (const Matrix_t* b, size_t jc, size_t nc, unsigned int* packed) {
+	const size_t k = b->rows;
+	for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+		unsigned int* panel = &packed[jr * k];
+		const size_t width = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+		for (size_t p = 0; p < k; ++p) {
+			const unsigned int* src = &b->data[p * row_stride(b) + jc + jr];
+			size_t j = 0;
+			for (; j < width; ++j) {
+				panel[p * GEMM_NR + j] = src[j];
+			}
+			for (; j < GEMM_NR; ++j) {
+				panel[p * GEMM_NR + j] = 0;
+			}
+		}
+	}
+}
+
+/*
+ * PURPOSE: packs A[ic..ic+mc, pc..pc+kc] into GEMM_MR tall row panels,
+ *          each step of a panel holds GEMM_MR values down a column
+ * INPUTS:
+ *	a: the left hand matrix
+ *  ic, mc: first row and number of rows
+ *  pc, kc: first column and number of columns
+ *  packed: destination, room for round_up(mc, GEMM_MR) * kc values
+ * RETURN:
+ *  void
+ *
+ **/
+static void pack_a_block (const Matrix_t* a, size_t ic, size_t mc, size_t pc, size_t kc,
+		unsigned int* packed) {
+	for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+		unsigned int* panel = &packed[ir * kc];
+		for (size_t p = 0; p < kc; ++p) {
+			for (size_t r = 0; r < GEMM_MR; ++r) {
+				panel[p * GEMM_MR + r] = ir + r < mc ? a->data[(ic + ir + r) * row_stride(a) + pc + p] : 0;
+			}
+		}
+	}
+}
+
+static void gemm_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Gemm_Task_t* t = ctx;
+	const size_t k = t->a->cols;
+	const size_t nc_pad = (t->nc + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+	const bool wide = t->mode == MUL_ACCUM_64;
+	const size_t elem = wide ? sizeof(unsigned long long) : sizeof(unsigned int);
+
+	unsigned int* a_packed = malloc((size_t) GEMM_MC * GEMM_KC * sizeof(unsigned int));
+	void* acc = malloc((size_t) GEMM_MC * nc_pad * elem);
+	if (!a_packed || !acc) {
+		__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+		free(a_packed);
+		free(acc);
+		return;
+	}
+
+	/*begin and end are element offsets into the strip, nc elements a row*/
+	for (size_t ic = begin / t->nc; ic < end / t->nc; ic += GEMM_MC) {
+		const size_t mc = end / t->nc - ic < GEMM_MC ? end / t->nc - ic : GEMM_MC;
+		memset(acc, 0, (size_t) GEMM_MC * nc_pad * elem);
+
+		for (size_t pc = 0; pc < k; pc += GEMM_KC) {
+			const size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+			pack_a_block(t->a, ic, mc, pc, kc, a_packed);
+			for (size_t jr = 0; jr < t->nc; jr += GEMM_NR) {
+				const unsigned int* b_panel = &t->b_packed[jr * k + pc * GEMM_NR];
+				for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+					if (wide) {
+						matrix_kernels.gemm_u64(kc, &a_packed[ir * kc], b_panel,
+							&((unsigned long long*) acc)[ir * nc_pad + jr], nc_pad);
+					}
+					else {
+						matrix_kernels.gemm_u32(kc, &a_packed[ir * kc], b_panel,
+							&((unsigned int*) acc)[ir * nc_pad + jr], nc_pad);
+					}
+				}
+			}
+		}
+
+		/*acc has GEMM_MC rows so the micro-kernel may spill past mc, only copy out the real ones*/
+		for (size_t r = 0; r < mc; ++r) {
+			unsigned int* out = &t->c->data[(ic + r) * row_stride(t->c) + t->jc];
+			if (wide) {
+				const unsigned long long* row = &((unsigned long long*) acc)[r * nc_pad];
+				for (size_t j = 0; j < t->nc; ++j) {
+					out[j] = row[j] > UINT_MAX ? UINT_MAX : (unsigned int) row[j];
+				}
+			}
+			else {
+				memcpy(out, &((unsigned int*) acc)[r * nc_pad], t->nc * sizeof(unsigned int));
+			}
+		}
+	}
+	free(a_packed);
+	free(acc);
+}
+
+/*
+ * PURPOSE: multiplies a by b into c with packed, cache blocked tiles run on
+ *          the thread pool, sparse operands go row by row through their entries
+ * INPUTS:
+ *	a: pointer to the left hand matrix, rows x k
+ *  b: pointer to the right hand matrix, k x cols
+ *  c: pointer to the result matrix, rows x cols, must not be a or b and can
+ *     be sparse only when a and b both are
+ *  mode: MUL_WRAP_32 wraps like add does, MUL_ACCUM_64 sums in 64 bits and
+ *        clamps anything over UINT_MAX when it is stored in c
+ * RETURN:
+ *  If no errors with input and the dimensions line up then true
+ *  else false.
+ *
+ **/
+bool multiply_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c, Matrix_Mul_Mode_t mode) {
+
+	if (!a || !b || !c || !has_storage(a) || !has_storage(b) || !has_storage(c)) {
+		return false;
+	}
+	if (a->cols != b->rows || c->rows != a->rows || c->cols != b->cols
+		|| c == a || c == b) {
+		return false;
+	}
+	if (a->type != MATRIX_U32 || b->type != MATRIX_U32 || c->type != MATRIX_U32) {
+		return false;
+	}
+	if (mode != MUL_WRAP_32 && mode != MUL_ACCUM_64) {
+		return false;
+	}
+	/*a product reads whole columns, which a band at a time cannot give*/
+	if (a->disk || b->disk || c->disk) {
+		return false;
+	}
+	if (!detach_data(c, false)) {
+		return false;
+	}
+	if (a->sparse || b->sparse || c->sparse) {
+		if (c->sparse && !(a->sparse && b->sparse)) {
+			return false;
+		}
+		return compact_matrix(a) && compact_matrix(b) && compact_matrix(c) && sparse_multiply(a, b, c, mode);
+	}
+
+	const size_t m = a->rows;
+	const size_t n = b->cols;
+	const size_t k = a->cols;
+	if (m == 0 || n == 0) {
+		return true;
+	}
+
+	const size_t n_pad = (GEMM_NC + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+	unsigned int* b_packed = malloc((k ? k : 1) * n_pad * sizeof(unsigned int));
+	if (!b_packed) {
+		return false;
+	}
+
+	Matrix_Gemm_Task_t t = { .a = a, .c = c, .b_packed = b_packed, .mode = mode };
+	for (size_t jc = 0; jc < n && !t.failed; jc += GEMM_NC) {
+		t.jc = jc;
+		t.nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+		pack_b_strip(b, jc, t.nc, b_packed);
+		/*one chunk is GEMM_MC rows of this strip of c*/
+		parallel_for(m * t.nc, (size_t) GEMM_MC * t.nc, gemm_task, &t);
+	}
+
+	free(b_packed);
+	return !t.failed;
+}
+
 /*
- * PURPOSE: instantiates a new matrix with the passed name, rows, cols
+ * PURPOSE: sum, min, max and mean of all elements in a single pass over the data
  * INPUTS:
- *	name the name of the matrix limited to 50 characters
- *  rows the number of rows the matrix
- *  cols the number of cols the matrix
+ *	m: pointer to the matrix to reduce
+ *  summary: where the results are stored
  * RETURN:
- *  If no errors occurred during instantiation then true
- *  else false for an error in the process.
+ *  If no errors with input and the matrix has elements then true
+ *  else false.
  *
  **/
+bool summarize_matrix (Matrix_t* m, Matrix_Summary_t* summary) {
 
-bool create_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
-						const unsigned int cols) {
-
-	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
-	//check for null values
-	//Since rows and cols are unsigned no need to check if they're negitive
-	if(!new_matrix || !name){
+	if (!m || !has_storage(m) || !summary || m->type != MATRIX_U32) {
 		return false;
 	}
 
-	//####################################
-
-	*new_matrix = calloc(1,sizeof(Matrix_t));
-	if (!(*new_matrix)) {
+	const size_t n = (size_t) m->rows * m->cols;
+	if (n == 0) {
 		return false;
 	}
-	(*new_matrix)->data = calloc(rows * cols,sizeof(unsigned int));
-	if (!(*new_matrix)->data) {
-		return false;
+	if (m->disk) {
+		return disk_summary(m, summary);
 	}
-	(*new_matrix)->rows = rows;
-	(*new_matrix)->cols = cols;
-	unsigned int len = strlen(name) + 1;
-	if (len > MATRIX_NAME_LEN) {
+
+	/*a sparse matrix reduces its stored values, the zeros are added at the end*/
+	const size_t stored = m->sparse ? m->sparse->nnz : n;
+	const size_t chunk = PARALLEL_CHUNK_ELEMENTS;
+	const size_t num_chunks = (stored + chunk - 1) / chunk;
+	Matrix_Reduce_Task_t t = { .data = m->sparse ? m->sparse->values : m->data, .chunk = chunk,
+		.cols = m->cols, .stride = m->stride };
+	t.partials = calloc(num_chunks ? num_chunks : 1, sizeof(Matrix_Summary_t));
+	if (!t.partials) {
 		return false;
 	}
-	strncpy((*new_matrix)->name,name,len);
+	/*slots stay neutral when parallel_for runs the range as one piece*/
+	for (size_t i = 0; i < num_chunks; ++i) {
+		t.partials[i].min = UINT_MAX;
+	}
+	parallel_for(stored, chunk, summary_task, &t);
+
+	summary->sum = 0;
+	summary->min = UINT_MAX;
+	summary->max = 0;
+	for (size_t i = 0; i < num_chunks; ++i) {
+		summary->sum += t.partials[i].sum;
+		summary->min = t.partials[i].min < summary->min ? t.partials[i].min : summary->min;
+		summary->max = t.partials[i].max > summary->max ? t.partials[i].max : summary->max;
+	}
+	if (stored < n) {
+		summary->min = 0;
+	}
+	summary->mean = (double) summary->sum / (double) n;
+	free(t.partials);
 	return true;
-
 }
 
-	//FINISHTODO FUNCTION COMMENT
- /*
- * PURPOSE: free the memory for the matrix array
+/*
+ * PURPOSE: adds up every element of the matrix in 64 bits so it cannot overflow
  * INPUTS:
- *	m: pointer to the matrix array to be freed
+ *	m: pointer to the matrix to sum
+ *  sum: where the total is stored
  * RETURN:
- *  void
+ *  If no errors with input then true
+ *  else false.
  *
  **/
-void destroy_matrix (Matrix_t** m) {
+bool sum_matrix (Matrix_t* m, unsigned long long* sum) {
 
-	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
-	if(!m){
-		return;
+	Matrix_Summary_t summary;
+	if (!sum || !summarize_matrix(m, &summary)) {
+		return false;
 	}
-	//####################################
-
-	free((*m)->data);
-	free(*m);
-	*m = NULL;
+	*sum = summary.sum;
+	return true;
 }
 
-
-
-	//FINISHTODO FUNCTION COMMENT
- /*
- * PURPOSE: check if the data in the two matrices passed in are equal
+/*
+ * PURPOSE: finds the smallest element of the matrix
  * INPUTS:
- *	a: pointer to  a matrix to be compared to
- *  b: pointer to second matrix to be compared to
+ *	m: pointer to the matrix to search
+ *  min: where the smallest value is stored
  * RETURN:
- *  If no errors and the data of the two matrices are equal then true
+ *  If no errors with input and the matrix has elements then true
  *  else false.
  *
  **/
-bool equal_matrices (Matrix_t* a, Matrix_t* b) {
+bool min_matrix (Matrix_t* m, unsigned int* min) {
 
-	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
-	if (!a || !b || !a->data || !b->data) {
+	Matrix_Summary_t summary;
+	if (!min || !summarize_matrix(m, &summary)) {
 		return false;
 	}
-	//#####################################
+	*min = summary.min;
+	return true;
+}
 
+/*
+ * PURPOSE: finds the largest element of the matrix
+ * INPUTS:
+ *	m: pointer to the matrix to search
+ *  max: where the largest value is stored
+ * RETURN:
+ *  If no errors with input and the matrix has elements then true
+ *  else false.
+ *
+ **/
+bool max_matrix (Matrix_t* m, unsigned int* max) {
 
-	int result = memcmp(a->data,b->data, sizeof(unsigned int) * a->rows * a->cols);
-	if (result == 0) {
-		return true;
+	Matrix_Summary_t summary;
+	if (!max || !summarize_matrix(m, &summary)) {
+		return false;
 	}
-	return false;
+	*max = summary.max;
+	return true;
 }
 
-	//FINISHTODO FUNCTION COMMENT
- /*
- * PURPOSE: duplicate the data from the src matrix to the dest matrix
+/*
+ * PURPOSE: average value of the elements in the matrix
  * INPUTS:
- *	src: pointer to the matrix of the origiinal matrix
- *  dest: pointer to the matrix to copy the data form src matrix to
+ *	m: pointer to the matrix to average
+ *  mean: where the average is stored
  * RETURN:
- *  If no errors with input and matrix are duplicated and checked then true
- *  else false for the input errors or not equal matrixs after duplication.
+ *  If no errors with input and the matrix has elements then true
+ *  else false.
  *
  **/
-bool duplicate_matrix (Matrix_t* src, Matrix_t* dest) {
-
+bool mean_matrix (Matrix_t* m, double* mean) {
 
-	//FINISHTODO ERROR CHECK INCOMING PARAMETERS
-
-	if (!src || !dest || !src->data) {
+	Matrix_Summary_t summary;
+	if (!mean || !summarize_matrix(m, &summary)) {
 		return false;
 	}
-	//####################################
-
-	/*
-	 * copy over data
-	 */
-	unsigned int bytesToCopy = sizeof(unsigned int) * src->rows * src->cols;
-	memcpy(dest->data,src->data, bytesToCopy);
-
-	return equal_matrices (src,dest);
+	*mean = summary.mean;
+	return true;
 }
 
-	//TODO FUNCTION COMMENT
- /*
- * PURPOSE: Performs either a left or right shift on all elements in the passed in matrix
+/*
+ * PURPOSE: sums each row of the matrix
  * INPUTS:
- *	a: pointer to the matrix to be shifted
- *  direction: letter to tell which direction to shift to
- *  shift: the number of bits to be shifted
+ *	m: pointer to the matrix to sum
+ *  sums: array with room for m->rows totals
  * RETURN:
  *  If no errors with input then true
- *  else false for the input errors.
+ *  else false.
  *
  **/
-bool bitwise_shift_matrix (Matrix_t* a, char direction, unsigned int shift) {
+bool row_sums_matrix (Matrix_t* m, unsigned long long* sums) {
 
-	//TODO ERROR CHECK INCOMING PARAMETERS
-	if (!a || !a->data) {
+	if (!m || !has_storage(m) || !sums || m->type != MATRIX_U32) {
 		return false;
 	}
-	//####################################
-
-	if (direction == 'l') {
-		unsigned int i = 0;
-		for (; i < a->rows; ++i) {
-			unsigned int j = 0;
-			for (; j < a->cols; ++j) {
-				a->data[i * a->cols + j] = a->data[i * a->cols + j] << shift;
-			}
-		}
-
+	if (m->sparse) {
+		return sparse_row_sums(m, sums);
 	}
-	else {
-		unsigned int i = 0;
-		for (; i < a->rows; ++i) {
-			unsigned int j = 0;
-			for (; j < a->cols; ++j) {
-				a->data[i * a->cols + j] = a->data[i * a->cols + j] >> shift;
-			}
-		}
+	if (m->disk) {
+		return disk_row_sums(m, sums);
+	}
+	if (m->rows == 0 || m->cols == 0) {
+		memset(sums, 0, m->rows * sizeof(unsigned long long));
+		return true;
 	}
 
+	Matrix_Reduce_Task_t t = { .data = m->data, .cols = m->cols, .stride = m->stride, .sums = sums };
+	parallel_for((size_t) m->rows * m->cols, row_aligned_chunk(m->cols, 1), row_sums_task, &t);
 	return true;
 }
 
-	//TODO FUNCTION COMMENT
- /*
- * PURPOSE: adds the data at the same element of two matrices passed and places
- 			in same element of the c matrix
+/*
+ * PURPOSE: sums each column of the matrix, rows are walked in order so the
+ *          data is still streamed once front to back
  * INPUTS:
- *	a: pointer to the matrix to be added with second matrix
- *  b: pointer to the matrix to be added to the first matrix
- *  c: pointer to the matrix to store the result of the sum
+ *	m: pointer to the matrix to sum
+ *  sums: array with room for m->cols totals
  * RETURN:
- *  If no errors with input and the row and column sizes are the same then true
+ *  If no errors with input then true
  *  else false.
  *
  **/
-bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+bool col_sums_matrix (Matrix_t* m, unsigned long long* sums) {
 
-	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!a || !b || !c || !a->data || !b->data || !c->data){
+	if (!m || !has_storage(m) || !sums || m->type != MATRIX_U32) {
 		return false;
 	}
-	//####################################
-
-	if (a->rows != b->rows && a->cols != b->cols) {
-		return false;
+	if (m->sparse) {
+		return sparse_col_sums(m, sums);
 	}
-
-	for (int i = 0; i < a->rows; ++i) {
-		for (int j = 0; j < b->cols; ++j) {
-			c->data[i * a->cols +j] = a->data[i * a->cols + j] + b->data[i * a->cols + j];
-		}
+	if (m->disk) {
+		return disk_col_sums(m, sums);
+	}
+	memset(sums, 0, m->cols * sizeof(unsigned long long));
+	if (m->rows == 0 || m->cols == 0) {
+		return true;
 	}
+
+	Matrix_Reduce_Task_t t = { .data = m->data, .cols = m->cols, .stride = m->stride, .sums = sums };
+	pthread_mutex_init(&t.lock, NULL);
+	/*at least 8 rows a chunk so merging the partial sums stays cheap*/
+	parallel_for((size_t) m->rows * m->cols, row_aligned_chunk(m->cols, 8), col_sums_task, &t);
+	pthread_mutex_destroy(&t.lock);
 	return true;
 }
 
+/*prints element i of a dense matrix the way its type reads*/
+static void print_element (const Matrix_t* m, size_t i) {
+	switch (m->type) {
+	case MATRIX_U8:
+		printf("%u ", ((const uint8_t*) m->data)[i]);
+		break;
+	case MATRIX_U16:
+		printf("%u ", ((const uint16_t*) m->data)[i]);
+		break;
+	case MATRIX_U64:
+		printf("%llu ", (unsigned long long) ((const uint64_t*) m->data)[i]);
+		break;
+	case MATRIX_I32:
+		printf("%d ", ((const int32_t*) m->data)[i]);
+		break;
+	case MATRIX_F32:
+		printf("%g ", ((const float*) m->data)[i]);
+		break;
+	case MATRIX_F64:
+		printf("%g ", ((const double*) m->data)[i]);
+		break;
+	default:
+		printf("%u ", m->data[i]);
+		break;
+	}
+}
+
 	//TODO FUNCTION COMMENT
  /*
  * PURPOSE: displays the data from the passed in matrix to the console
@@ -230,276 +1511,154 @@ bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
 void display_matrix (Matrix_t* m) {
 
 	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!m || !m->data){
+	if(!m || !has_storage(m)){
 		return;
 	}
 	//###################################
 
+	if (m->sparse) {
+		sparse_display(m);
+		return;
+	}
+
 	printf("\nMatrix Contents (%s):\n", m->name);
 	printf("DIM = (%u,%u)\n", m->rows, m->cols);
-	for (int i = 0; i < m->rows; ++i) {
-		for (int j = 0; j < m->cols; ++j) {
-			printf("%u ", m->data[i * m->cols + j]);
-		}
-		printf("\n");
+	if (m->type != MATRIX_U32) {
+		printf("TYPE = %s\n", matrix_type_name(m->type));
+	}
+	if (m->disk) {
+		disk_display(m);
+	}
+	else {
+		print_matrix_rows(m);
 	}
 	printf("\n");
 
 }
 
-	//TODO FUNCTION COMMENT
- /*
- * PURPOSE: reads the name, and data from a file then calls load matrix to create the matrix
+/*
+ * PURPOSE: prints the elements of a dense matrix a row to a line
  * INPUTS:
- *	matrix_input_filename: pointer to the name of the file to open
- *  m: pointer to a pointer to the matrix that the new read in data with be loaded into
+ *	m: the dense matrix
  * RETURN:
- *  If no errors with input or reading in the data from the file then true
- *  else false.
+ *  void
  *
  **/
-bool read_matrix (const char* matrix_input_filename, Matrix_t** m) {
-
-	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!matrix_input_filename || !m){
-		return false;
-	}
-	//#####################################
-
-
-	int fd = open(matrix_input_filename,O_RDONLY);
-	if (fd < 0) {
-		printf("FAILED TO OPEN FOR READING\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
-		return false;
-	}
-
-	/*read the wrote dimensions and name length*/
-	unsigned int name_len = 0;
-	unsigned int rows = 0;
-	unsigned int cols = 0;
-
-	if (read(fd,&name_len,sizeof(unsigned int)) != sizeof(unsigned int)) {
-		printf("FAILED TO READING FILE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
-		return false;
-	}
-	char name_buffer[50];
-	if (read (fd,name_buffer,sizeof(char) * name_len) != sizeof(char) * name_len) {
-		printf("FAILED TO READ MATRIX NAME\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
-
-		return false;
-	}
-
-	if (read (fd,&rows, sizeof(unsigned int)) != sizeof(unsigned int)) {
-		printf("FAILED TO READ MATRIX ROW SIZE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
-
-		return false;
-	}
-
-	if (read(fd,&cols,sizeof(unsigned int)) != sizeof(unsigned int)) {
-		printf("FAILED TO READ MATRIX COLUMN SIZE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
-
-		return false;
-	}
-
-	unsigned int numberOfDataBytes = rows * cols * sizeof(unsigned int);
-	unsigned int *data = calloc(rows * cols, sizeof(unsigned int));
-	if (read(fd,data,numberOfDataBytes) != numberOfDataBytes) {
-		printf("FAILED TO READ MATRIX DATA\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
+void print_matrix_rows (const Matrix_t* m) {
+	for (unsigned int i = 0; i < m->rows; ++i) {
+		for (unsigned int j = 0; j < m->cols; ++j) {
+			print_element(m, (size_t) i * row_stride(m) + j);
 		}
-
-		return false;
-	}
-
-	if (!create_matrix(m,name_buffer,rows,cols)) {
-		return false;
-	}
-
-	load_matrix(*m,data);
-	free(data);
-	if (close(fd)) {
-		return false;
-
+		printf("\n");
 	}
-	return true;
 }
 
 	//TODO FUNCTION COMMENT
  /*
- * PURPOSE: create buffer from the data in the passed in matrix then write to a file
+ * PURPOSE: add Random unsigned ints to the passed in matrix
  * INPUTS:
- *	m: pointer to the matrix to write its data to a file
- *  matrix_output_filename: name of the file to write data out to
+ *	m: pointer to the matrix to add the random numbers to
+ *  start_range: the start of the range for the random numbers to be in
+ *  end_range: the end range that the random number will be in
+ *  seed: the stream to draw from, the same seed gives the same matrix
+ *        and the same values for every element type
  * RETURN:
- *  If no errors with opening and writing file then true
- *  else false with errors.
+ *  If no errors with input then true
+ *  else false for the input errors.
  *
  **/
-bool write_matrix (const char* matrix_output_filename, Matrix_t* m) {
+bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range, unsigned long long seed) {
 
 	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!matrix_output_filename || !m){
+	if(!m || !has_storage(m) || end_range < start_range){
 		return false;
 	}
-	//####################################
-
-	int fd = open (matrix_output_filename, O_CREAT | O_RDWR | O_TRUNC, 0644);
-	/* ERROR HANDLING USING errorno*/
-	if (fd < 0) {
-		printf("FAILED TO CREATE/OPEN FILE FOR WRITING\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXISTS\n");
-		}
+	/*the range has to fit the element type*/
+	if ((m->type == MATRIX_U8 && end_range > UINT8_MAX) || (m->type == MATRIX_U16 && end_range > UINT16_MAX)
+		|| (m->type == MATRIX_I32 && end_range > INT32_MAX)) {
 		return false;
 	}
-	/* Calculate the needed buffer for our matrix */
-	unsigned int name_len = strlen(m->name) + 1;
-	unsigned int numberOfBytes = sizeof(unsigned int) + (sizeof(unsigned int)  * 2) + name_len + sizeof(unsigned int) * m->rows * m->cols + 1;
-	/* Allocate the output_buffer in bytes
-	 * IMPORTANT TO UNDERSTAND THIS WAY OF MOVING MEMORY
-	 */
-	unsigned char* output_buffer = calloc(numberOfBytes,sizeof(unsigned char));
-	unsigned int offset = 0;
-	memcpy(&output_buffer[offset], &name_len, sizeof(unsigned int)); // IMPORTANT C FUNCTION TO KNOW
-	offset += sizeof(unsigned int);
-	memcpy(&output_buffer[offset], m->name,name_len);
-	offset += name_len;
-	memcpy(&output_buffer[offset],&m->rows,sizeof(unsigned int));
-	offset += sizeof(unsigned int);
-	memcpy(&output_buffer[offset],&m->cols,sizeof(unsigned int));
-	offset += sizeof(unsigned int);
-	memcpy (&output_buffer[offset],m->data,m->rows * m->cols * sizeof(unsigned int));
-	offset += (m->rows * m->cols * sizeof(unsigned int));
-	output_buffer[numberOfBytes - 1] = EOF;
-
-	if (write(fd,output_buffer,numberOfBytes) != numberOfBytes) {
-		printf("FAILED TO WRITE MATRIX TO FILE\n");
-		if (errno == EACCES ) {
-			perror("DO NOT HAVE ACCESS TO FILE\n");
-		}
-		else if (errno == EADDRINUSE ){
-			perror("FILE ALREADY IN USE\n");
-		}
-		else if (errno == EBADF) {
-			perror("BAD FILE DESCRIPTOR\n");
-		}
-		else if (errno == EEXIST) {
-			perror("FILE EXIST\n");
-		}
+	/*random values are almost never zero, so the matrix goes back to dense*/
+	if (m->sparse && !densify_matrix(m)) {
 		return false;
 	}
-
-	if (close(fd)) {
+	/*the full 0 to 4294967295 range wraps the span around to 0*/
+	if (m->disk) {
+		return disk_detach(m, false) && disk_random(m, start_range, end_range - start_range + 1, seed);
+	}
+	if (!detach_data(m, false)) {
 		return false;
 	}
-	free(output_buffer);
 
+	fill_random(m, start_range, end_range - start_range + 1, seed, 0);
 	return true;
 }
 
-	//TODO FUNCTION COMMENT
- /*
- * PURPOSE: add Random unsigned ints to the passed in matrix
+/*
+ * PURPOSE: draws the elements of a dense matrix as elements first onwards
+ *          of a larger one, so a band of rows gets the values it has in
+ *          the whole matrix
  * INPUTS:
- *	m: pointer to the matrix to add the random numbers to
- *  start_range: the start of the range for the random numbers to be in
- *  end_range: the end range that the random number will be in
+ *	m: the dense matrix
+ *  start_range: the smallest value
+ *  span: how many values from start_range, 0 for all 2^32
+ *  seed: the stream to draw from
+ *  first: the index of the first element in the whole matrix
  * RETURN:
- *  If no errors with input then true
- *  else false for the input errors.
+ *  void
+ *
+ **/
+void fill_random (Matrix_t* m, unsigned int start_range, unsigned int span, unsigned long long seed,
+		size_t first) {
+	Matrix_Task_t t = { .dst = m->data, .cols = m->cols, .dst_stride = m->stride, .start_range = start_range,
+		.span = span, .seed = seed, .first = first, .type = m->type };
+	parallel_for((size_t) m->rows * m->cols, 0, random_task, &t);
+}
+
+/*
+ * PURPOSE: converts the elements of a matrix to another type, values
+ *          outside the new type saturate at its limits, NaN becomes 0
+ *          and floats are truncated toward zero
+ * INPUTS:
+ *	m: the matrix, a sparse one is made dense unless the type stays u32
+ *  type: the new element type
+ * RETURN:
+ *  If no errors then true
+ *  else false and the matrix keeps its values and type.
  *
  **/
-bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range) {
+bool cast_matrix (Matrix_t* m, Matrix_Type_t type) {
 
-	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!m || end_range < start_range){
+	if (!m || !has_storage(m) || type >= MATRIX_TYPES) {
+		return false;
+	}
+	if (m->type == type) {
+		return true;
+	}
+	/*the file would change width under every other holder*/
+	if (m->disk) {
+		return false;
+	}
+	if (m->sparse && !densify_matrix(m)) {
 		return false;
 	}
 
-	for (unsigned int i = 0; i < m->rows; ++i) {
-		for (unsigned int j = 0; j < m->cols; ++j) {
-			m->data[i * m->cols + j] = rand() % (end_range + 1 - start_range) + start_range;
-		}
+	/*a new buffer is needed whenever the width changes, so always convert into one*/
+	const size_t n = (size_t) m->rows * m->cols;
+	size_t bytes = 0;
+	if (!matrix_data_bytes(m->rows, m->cols, type, &bytes)) {
+		return false;
+	}
+	unsigned int* data = memory_alloc(bytes, false);
+	if (!data) {
+		return false;
 	}
+	Matrix_Task_t t = { .dst = data, .a = m->data, .cols = m->cols, .a_stride = m->stride,
+		.type = type, .from = m->type };
+	parallel_for(n, 0, cast_task, &t);
+	release_dense_data(m);
+	m->data = data;
+	m->type = type;
 	return true;
 }
 
@@ -518,39 +1677,11 @@ bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range
 void load_matrix (Matrix_t* m, unsigned int* data) {
 
 	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!m || !m->data || !data){
+	if(!m || !m->data || !data || m->type != MATRIX_U32 || !detach_data(m, false)){
 		return;
 	}
 	//####################################
 
-	memcpy(m->data,data,m->rows * m->cols * sizeof(unsigned int));
-}
-
-	//TODO FUNCTION COMMENT
- /*
- * PURPOSE: add newley created matrix to the array of matrices
- * INPUTS:
- *	mats: pointer to the array of matrices
- *  new_matrix: newly created matrix to be added to the array
- *  num_mats: number of matrixs already in the array
- * RETURN:
- *  If no errors with input then return position of new matrix
- *  else -1 for input erros
- *
- **/
-int add_matrix_to_array (Matrix_t** mats, Matrix_t* new_matrix, unsigned int num_mats) {
-
-	//TODO ERROR CHECK INCOMING PARAMETERS
-	if(!mats || !new_matrix){
-		return -1;
-	}
-
-	static long int current_position = 0;
-	const long int pos = current_position % num_mats;
-	if ( mats[pos] ) {
-		destroy_matrix(&mats[pos]);
-	}
-	mats[pos] = new_matrix;
-	current_position++;
-	return pos;
+	Matrix_Task_t t = { .dst = m->data, .a = data, .cols = m->cols, .dst_stride = m->stride };
+	parallel_for((size_t) m->rows * m->cols, 0, copy_task, &t);
 }
@@ -1,27 +1,152 @@
 #ifndef _MATRIX_H_
 #define _MATRIX_H_
 
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "matrix_format.h"
+
 #define MATRIX_NAME_LEN 25
 
+/*
+ * Compressed sparse row storage. Row r holds the entries row_ptr[r] up to
+ * row_ptr[r + 1], their columns in increasing order in col_idx and their
+ * values alongside. Every element not listed is zero, a listed value may
+ * be zero as well. Duplicates share the storage, refs counts the holders.
+ */
+typedef struct {
+	unsigned int refs;
+	size_t nnz;
+	size_t* row_ptr;
+	unsigned int* col_idx;
+	unsigned int* values;
+}Matrix_Sparse_t;
+
+/*
+ * File backed storage for matrices larger than memory. The file is a raw
+ * version 2 matrix file (matrix_format.h) open for reading and writing,
+ * the elements only come into memory a band of rows at a time while an
+ * operation streams through them. Duplicates share the file, refs counts
+ * the holders.
+ */
+typedef struct {
+	unsigned int refs;
+	int fd;
+	bool temporary;		/*a spill file, unlinked as soon as it was created*/
+	bool dirty;		/*tile checksums changed since the directory was written*/
+	size_t tile_rows;
+	size_t num_tiles;
+	uint64_t dir_offset;
+	uint64_t payload_offset;
+	Matrix_Tile_Entry_t* entries;
+}Matrix_Disk_t;
+
+/*
+ * Elements in a POSIX shared memory segment (matrix_format.h), made by
+ * share_matrix or mapped by attach_matrix so other processes see every
+ * change. Duplicates and views of such a matrix get copies of their own,
+ * so a write to it always lands in the segment. holds counts the matrix
+ * and the commands in progress on it, the last one unmaps the segment and
+ * removes its name when this process made it.
+ */
+typedef struct {
+	unsigned int holds;
+	bool owner;
+	Matrix_Shm_Header_t* header;	/*start of the mapping*/
+	size_t len;
+	char name[sizeof(MATRIX_SHM_PREFIX) + MATRIX_NAME_LEN];
+}Matrix_Shm_t;
+
 typedef struct {
 	char name[MATRIX_NAME_LEN];
 	unsigned int rows;
 	unsigned int cols;
-	unsigned int *data;
+	unsigned int *data;	/*elements of type, read through the width of that type*/
+	Matrix_Type_t type;	/*u32 unless created or cast otherwise, sparse matrices are always u32*/
+	size_t stride;		/*elements from one row to the next in a view, 0 when the rows are back to back*/
+	size_t offset;		/*bytes from the start of the shared buffer to data in a view*/
+	void* mapping;		/*file mapping backing data, NULL when data is on the heap*/
+	size_t mapping_len;
+	unsigned int* refs;	/*holders of data once a duplicate shares it, NULL while there is one*/
+	Matrix_Sparse_t* sparse;	/*CSR storage, data is NULL while this is set*/
+	Matrix_Disk_t* disk;		/*file storage, data is NULL while this is set*/
+	Matrix_Shm_t* shm;		/*shared memory segment data lies in, NULL when it is private*/
 }Matrix_t;
 
+size_t matrix_type_size (Matrix_Type_t type);
+bool matrix_data_bytes (unsigned int rows, unsigned int cols, Matrix_Type_t type, size_t* bytes);
+const char* matrix_type_name (Matrix_Type_t type);
+bool parse_matrix_type (const char* name, Matrix_Type_t* type);
 bool create_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows, const unsigned int cols);
+bool create_typed_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type);
+bool create_matrix_for_overwrite (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type);
+bool cast_matrix (Matrix_t* m, Matrix_Type_t type);
+bool create_sparse_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols);
+bool create_disk_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type);
 void destroy_matrix (Matrix_t** m);
-bool write_matrix (const char* matrix_output_filename, Matrix_t* m);
+bool unshare_matrix (Matrix_t* m);
+bool compact_matrix (Matrix_t* m);
+bool slice_matrix (Matrix_t* src, unsigned int row_begin, unsigned int row_end, unsigned int col_begin,
+		unsigned int col_end, Matrix_t* dest);
+bool transpose_matrix (Matrix_t* src, Matrix_t* dest);
+bool sparsify_matrix (Matrix_t* m);
+bool densify_matrix (Matrix_t* m);
+bool write_matrix (const char* matrix_output_filename, Matrix_t* m, Matrix_Codec_t codec);
 bool read_matrix (const char* matrix_input_filename, Matrix_t** m);
-int sum_matrix (Matrix_t* m);
+bool read_matrix_mapped (const char* matrix_input_filename, Matrix_t** m);
+bool read_matrix_disk (const char* matrix_input_filename, Matrix_t** m);
+bool share_matrix (Matrix_t* m);
+bool attach_matrix (const char* shared_name, const char* name, Matrix_t** m);
+bool read_matrix_tile (const char* matrix_input_filename, unsigned int tile, const char* name,
+		Matrix_t** m);
+typedef struct {
+	unsigned long long sum;
+	unsigned int min;
+	unsigned int max;
+	double mean;
+}Matrix_Summary_t;
+
+bool summarize_matrix (Matrix_t* m, Matrix_Summary_t* summary);
+bool sum_matrix (Matrix_t* m, unsigned long long* sum);
+bool min_matrix (Matrix_t* m, unsigned int* min);
+bool max_matrix (Matrix_t* m, unsigned int* max);
+bool mean_matrix (Matrix_t* m, double* mean);
+bool row_sums_matrix (Matrix_t* m, unsigned long long* sums);
+bool col_sums_matrix (Matrix_t* m, unsigned long long* sums);
 bool add_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c);
+
+typedef enum {
+	MUL_WRAP_32,	/*products and sums wrap around at 32 bits*/
+	MUL_ACCUM_64	/*sums are kept in 64 bits and saturate when stored*/
+}Matrix_Mul_Mode_t;
+
+bool multiply_matrices (Matrix_t* a, Matrix_t* b, Matrix_t* c, Matrix_Mul_Mode_t mode);
 bool bitwise_shift_matrix (Matrix_t* a, char direction, unsigned int shift);
 bool duplicate_matrix (Matrix_t* src, Matrix_t* dest);
 bool equal_matrices (Matrix_t* a, Matrix_t* b);
 void display_matrix (Matrix_t* m);
-bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range);
-int add_matrix_to_array (Matrix_t** mats, Matrix_t* new_matrix, unsigned int num_mats);
+bool random_matrix(Matrix_t* m, unsigned int start_range, unsigned int end_range, unsigned long long seed);
+
+/*
+ * Totals for the streams through disk matrices since the start. pool_bytes
+ * bounds the bands held in memory by a stream, MATLAB_DISK_POOL_MB sets it.
+ */
+typedef struct {
+	size_t streams;
+	size_t bands_read;
+	size_t bands_written;
+	unsigned long long bytes_read;
+	unsigned long long bytes_written;
+	size_t stalls;		/*bands the computation had to wait for*/
+	size_t pool_bytes;
+	size_t peak_bytes;	/*most held by one stream*/
+}Matrix_Disk_Stats_t;
+
+void disk_stats (Matrix_Disk_Stats_t* stats);
 
 
 #endif
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "matrix_codec.h"
+#include "matrix_kernels.h"
+
+/*block headers, bits is the packed width of every value in the block*/
+typedef struct {
+	unsigned int reference;
+	unsigned int bits;
+}Codec_For_Header_t;
+
+typedef struct {
+	unsigned int base[CODEC_LANES];
+	unsigned int bits;
+}Codec_Delta_Header_t;
+
+/*
+ * PURPOSE: number of bits needed to hold v
+ * INPUTS:
+ *	v: the value
+ * RETURN:
+ *  0 for 0, else the position of the highest set bit plus one
+ *
+ **/
+static unsigned int bit_width (unsigned int v) {
+	return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/*
+ * PURPOSE: packs CODEC_BLOCK values of bits width into the vertical layout
+ * INPUTS:
+ *	values: the block, already offset so they fit in bits
+ *  bits: width of each value, 0 to 32
+ *  words: destination, bits * CODEC_LANES words
+ * RETURN:
+ *  void
+ *
+ **/
+static void pack_block (const unsigned int* values, unsigned int bits, unsigned int* words) {
+	memset(words, 0, (size_t) bits * CODEC_LANES * sizeof(unsigned int));
+	if (bits == 0) {
+		return;
+	}
+	for (unsigned int k = 0; k < CODEC_BLOCK / CODEC_LANES; ++k) {
+		const unsigned int w = (k * bits) / 32;
+		const unsigned int s = (k * bits) % 32;
+		for (unsigned int l = 0; l < CODEC_LANES; ++l) {
+			const unsigned int v = values[k * CODEC_LANES + l];
+			words[w * CODEC_LANES + l] |= v << s;
+			if (s + bits > 32) {
+				words[(w + 1) * CODEC_LANES + l] |= v >> (32 - s);
+			}
+		}
+	}
+}
+
+/*
+ * PURPOSE: worst case encoded size of n values
+ * INPUTS:
+ *	codec: the codec
+ *  n: number of values
+ * RETURN:
+ *  bytes
+ *
+ **/
+size_t codec_bound (Matrix_Codec_t codec, size_t n) {
+	const size_t blocks = (n + CODEC_BLOCK - 1) / CODEC_BLOCK;
+	const size_t header = codec == MATRIX_CODEC_DELTA ? sizeof(Codec_Delta_Header_t) : sizeof(Codec_For_Header_t);
+	if (codec == MATRIX_CODEC_RAW) {
+		return n * sizeof(unsigned int);
+	}
+	return blocks * (header + CODEC_BLOCK * sizeof(unsigned int));
+}
+
+/*
+ * PURPOSE: encodes n values, a partial last block is padded with copies of
+ *          its last value which costs nothing in either codec
+ * INPUTS:
+ *	codec: MATRIX_CODEC_FOR or MATRIX_CODEC_DELTA
+ *  in: the values
+ *  n: number of values
+ *  out: destination, at least codec_bound(codec, n) bytes
+ * RETURN:
+ *  encoded bytes, 0 for an unknown codec
+ *
+ **/
+size_t encode_tile (Matrix_Codec_t codec, const unsigned int* in, size_t n, unsigned char* out) {
+
+	if (codec != MATRIX_CODEC_FOR && codec != MATRIX_CODEC_DELTA) {
+		return 0;
+	}
+
+	unsigned int block[CODEC_BLOCK];
+	unsigned char* p = out;
+	for (size_t start = 0; start < n; start += CODEC_BLOCK) {
+		const size_t count = n - start < CODEC_BLOCK ? n - start : CODEC_BLOCK;
+		memcpy(block, &in[start], count * sizeof(unsigned int));
+		for (size_t i = count; i < CODEC_BLOCK; ++i) {
+			block[i] = block[count - 1];
+		}
+
+		if (codec == MATRIX_CODEC_FOR) {
+			Codec_For_Header_t h = { block[0], 0 };
+			unsigned int hi = block[0];
+			for (size_t i = 0; i < CODEC_BLOCK; ++i) {
+				h.reference = block[i] < h.reference ? block[i] : h.reference;
+				hi = block[i] > hi ? block[i] : hi;
+			}
+			h.bits = bit_width(hi - h.reference);
+			for (size_t i = 0; i < CODEC_BLOCK; ++i) {
+				block[i] -= h.reference;
+			}
+			memcpy(p, &h, sizeof(h));
+			p += sizeof(h);
+			pack_block(block, h.bits, (unsigned int*) p);
+			p += (size_t) h.bits * CODEC_LANES * sizeof(unsigned int);
+		}
+		else {
+			Codec_Delta_Header_t h;
+			memcpy(h.base, block, sizeof(h.base));
+			unsigned int zigzag[CODEC_BLOCK];
+			unsigned int all = 0;
+			/*the first lane row is the base itself, its deltas are zero*/
+			for (size_t i = 0; i < CODEC_BLOCK; ++i) {
+				const int d = i < CODEC_LANES ? 0 : (int) (block[i] - block[i - CODEC_LANES]);
+				zigzag[i] = ((unsigned int) d << 1) ^ (unsigned int) (d >> 31);
+				all |= zigzag[i];
+			}
+			h.bits = bit_width(all);
+			memcpy(p, &h, sizeof(h));
+			p += sizeof(h);
+			pack_block(zigzag, h.bits, (unsigned int*) p);
+			p += (size_t) h.bits * CODEC_LANES * sizeof(unsigned int);
+		}
+	}
+	return p - out;
+}
+
+/*
+ * PURPOSE: decodes n values written by encode_tile
+ * INPUTS:
+ *	codec: the codec the tile was written with
+ *  in: the encoded bytes
+ *  len: number of encoded bytes
+ *  out: destination for n values
+ *  n: number of values
+ * RETURN:
+ *  If the input was well formed and exactly used up then true
+ *  else false.
+ *
+ **/
+bool decode_tile (Matrix_Codec_t codec, const unsigned char* in, size_t len, unsigned int* out, size_t n) {
+
+	if (codec != MATRIX_CODEC_FOR && codec != MATRIX_CODEC_DELTA) {
+		return false;
+	}
+
+	unsigned int block[CODEC_BLOCK];
+	const unsigned char* p = in;
+	const unsigned char* end = in + len;
+	for (size_t start = 0; start < n; start += CODEC_BLOCK) {
+		const size_t count = n - start < CODEC_BLOCK ? n - start : CODEC_BLOCK;
+		/*full blocks decode in place, only the tail goes through block*/
+		unsigned int* dst = count == CODEC_BLOCK ? &out[start] : block;
+
+		if (codec == MATRIX_CODEC_FOR) {
+			Codec_For_Header_t h;
+			if ((size_t) (end - p) < sizeof(h)) {
+				return false;
+			}
+			memcpy(&h, p, sizeof(h));
+			p += sizeof(h);
+			const size_t packed = (size_t) h.bits * CODEC_LANES * sizeof(unsigned int);
+			if (h.bits > 32 || (size_t) (end - p) < packed) {
+				return false;
+			}
+			matrix_kernels.unpack_for_u32((const unsigned int*) p, h.bits, h.reference, dst);
+			p += packed;
+		}
+		else {
+			Codec_Delta_Header_t h;
+			if ((size_t) (end - p) < sizeof(h)) {
+				return false;
+			}
+			memcpy(&h, p, sizeof(h));
+			p += sizeof(h);
+			const size_t packed = (size_t) h.bits * CODEC_LANES * sizeof(unsigned int);
+			if (h.bits > 32 || (size_t) (end - p) < packed) {
+				return false;
+			}
+			matrix_kernels.unpack_delta_u32((const unsigned int*) p, h.bits, h.base, dst);
+			p += packed;
+		}
+
+		if (dst == block) {
+			memcpy(&out[start], block, count * sizeof(unsigned int));
+		}
+	}
+	return p == end;
+}
@@ -0,0 +1,31 @@
+#ifndef _MATRIX_CODEC_H_
+#define _MATRIX_CODEC_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "matrix_format.h"
+
+/*
+ * Frame of reference bit packing for stored tiles. A tile is cut into
+ * blocks of CODEC_BLOCK values. Each block stores a small header and
+ * then every value minus the reference in just enough bits for the
+ * widest one.
+ *
+ * Values are packed vertically over CODEC_LANES lanes: lane l holds
+ * values l, l + 8, l + 16 ... and word w of lane l sits at index
+ * w * 8 + l. One vector load then feeds eight lanes, and step k of the
+ * decoder writes the eight consecutive values k * 8 .. k * 8 + 7.
+ *
+ * The delta codec stores each value minus the one eight places before
+ * it, zigzag encoded. The first eight values of a block are kept in the
+ * block header, so decoding stays a vertical running sum.
+ */
+#define CODEC_LANES 8
+#define CODEC_BLOCK 256
+
+size_t codec_bound (Matrix_Codec_t codec, size_t n);
+size_t encode_tile (Matrix_Codec_t codec, const unsigned int* in, size_t n, unsigned char* out);
+bool decode_tile (Matrix_Codec_t codec, const unsigned char* in, size_t len, unsigned int* out, size_t n);
+
+#endif
@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "matrix.h"
+#include "matrix_disk.h"
+#include "matrix_format.h"
+#include "matrix_kernels.h"
+#include "matrix_memory.h"
+
+/*
+ * Out of core execution. An operation on a matrix in a file runs as a
+ * stream over bands of rows, one tile of the file each. A dedicated I/O
+ * thread reads bands ahead of the computation and writes finished ones
+ * behind it through a ring of band buffers that stays within the pool
+ * budget, so the memory an operation needs does not grow with the matrix.
+ * Every band is wrapped in a plain dense matrix and handed to the usual
+ * functions of matrix.c, which spread it over the thread pool.
+ */
+#define DISK_POOL_BYTES ((size_t) 64 << 20)
+#define DISK_MIN_DEPTH 2
+#define DISK_MAX_DEPTH 16
+#define DISK_MAX_OPERANDS 3
+
+/*what a stream does with an operand*/
+#define DISK_READ 0x1u
+#define DISK_WRITE 0x2u
+
+static size_t pool_bytes;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static Matrix_Disk_Stats_t totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const unsigned char zeros[MATRIX_FILE_ALIGN];
+
+static void read_pool_size (void) {
+	const char* env = getenv("MATLAB_DISK_POOL_MB");
+	const unsigned long mb = env ? strtoul(env, NULL, 10) : 0;
+	pool_bytes = mb ? (size_t) mb << 20 : DISK_POOL_BYTES;
+}
+
+/*
+ * PURPOSE: writes exactly len bytes at offset, retrying short writes
+ * INPUTS:
+ *	fd: file to write to
+ *  buf: the bytes
+ *  len: number of bytes
+ *  offset: position in the file
+ * RETURN:
+ *  If all the bytes were written then true
+ *  else false.
+ *
+ **/
+static bool write_full (int fd, const void* buf, size_t len, off_t offset) {
+	const unsigned char* src = buf;
+	while (len > 0) {
+		ssize_t put = pwrite(fd, src, len, offset);
+		if (put < 0 && errno == EINTR) {
+			continue;
+		}
+		if (put <= 0) {
+			return false;
+		}
+		src += put;
+		len -= put;
+		offset += put;
+	}
+	return true;
+}
+
+/*CRC32C of len zero bytes*/
+static unsigned int zero_crc (size_t len) {
+	unsigned int crc = 0;
+	for (size_t done = 0; done < len; done += sizeof(zeros)) {
+		crc = matrix_kernels.crc32c(crc, zeros, len - done < sizeof(zeros) ? len - done : sizeof(zeros));
+	}
+	return crc;
+}
+
+/*
+ * PURPOSE: writes the tile directory back so the checksums match the tiles
+ * INPUTS:
+ *	d: the disk storage
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool flush_directory (Matrix_Disk_t* d) {
+	if (!d->dirty) {
+		return true;
+	}
+	if (!write_full(d->fd, d->entries, d->num_tiles * sizeof(Matrix_Tile_Entry_t), d->dir_offset)) {
+		print_file_error("FAILED TO WRITE MATRIX TILE DIRECTORY");
+		return false;
+	}
+	d->dirty = false;
+	return true;
+}
+
+/*
+ * PURPOSE: creates the file of a new disk matrix, a raw version 2 file of
+ *          zeros that takes no space until its tiles are written
+ * INPUTS:
+ *	path: the file to replace, the new one is made beside it under the name
+ *        put in temp for finish_replacement. NULL for a spill file in
+ *        MATLAB_SPILL_DIR, TMPDIR or /tmp that is unlinked straight away
+ *  temp: receives the name of the new file when path is given, PATH_MAX bytes
+ *  m: the matrix, its name, size and type go in the header
+ *  disk: receives the storage
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool create_disk_file (const char* path, char* temp, const Matrix_t* m, Matrix_Disk_t** disk) {
+
+	size_t bytes = 0;
+	if (!matrix_data_bytes(m->rows, m->cols, m->type, &bytes)) {
+		return false;
+	}
+
+	int fd = -1;
+	if (path) {
+		fd = open_replacement(path, temp);
+	}
+	else {
+		const char* dir = getenv("MATLAB_SPILL_DIR");
+		if (!dir) {
+			dir = getenv("TMPDIR");
+		}
+		char name[PATH_MAX];
+		if (snprintf(name, sizeof(name), "%s/matlab-XXXXXX", dir ? dir : "/tmp") >= (int) sizeof(name)) {
+			return false;
+		}
+		fd = mkstemp(name);
+		if (fd >= 0) {
+			unlink(name);
+		}
+	}
+	if (fd < 0) {
+		print_file_error("FAILED TO CREATE DISK MATRIX FILE");
+		return false;
+	}
+
+	Matrix_File_Header_t h;
+	init_file_header(&h, m);
+	const size_t elements = (size_t) m->rows * m->cols;
+	const size_t row_bytes = (size_t) m->cols * h.elem_size;
+	h.tile_rows = file_tile_rows(row_bytes);
+	const uint64_t num_tiles = file_num_tiles(m->rows, m->cols, h.tile_rows);
+	if (num_tiles > UINT32_MAX) {
+		printf("Matrix (%s) has too many tiles for a file\n", m->name);
+		close(fd);
+		if (path) {
+			unlink(temp);
+		}
+		return false;
+	}
+	h.num_tiles = num_tiles;
+	h.codec = MATRIX_CODEC_RAW;
+	const size_t dir_len = (size_t) h.num_tiles * sizeof(Matrix_Tile_Entry_t);
+	h.payload_offset = (MATRIX_FILE_HEADER_SIZE + dir_len + MATRIX_FILE_ALIGN - 1)
+		/ MATRIX_FILE_ALIGN * MATRIX_FILE_ALIGN;
+	h.payload_len = bytes;
+	h.header_crc = matrix_kernels.crc32c(0, &h, sizeof(h));
+
+	*disk = calloc(1, sizeof(Matrix_Disk_t));
+	Matrix_Tile_Entry_t* entries = calloc(h.num_tiles ? h.num_tiles : 1, sizeof(Matrix_Tile_Entry_t));
+	bool ok = *disk && entries;
+
+	/*every tile starts out as zeros, only a short last one has another checksum*/
+	const size_t tile_bytes = (size_t) h.tile_rows * row_bytes;
+	const unsigned int tile_crc = ok && elements ? zero_crc(tile_bytes) : 0;
+	for (size_t i = 0; ok && i < h.num_tiles; ++i) {
+		const size_t first_row = i * h.tile_rows;
+		const size_t num_rows = m->rows - first_row < h.tile_rows ? m->rows - first_row : h.tile_rows;
+		entries[i].offset = h.payload_offset + first_row * row_bytes;
+		entries[i].length = num_rows * row_bytes;
+		entries[i].crc = entries[i].length == tile_bytes ? tile_crc : zero_crc(entries[i].length);
+	}
+
+	if (ok && (ftruncate(fd, h.payload_offset + h.payload_len) != 0
+		|| !write_full(fd, &h, sizeof(h), 0) || !write_full(fd, entries, dir_len, h.dir_offset))) {
+		print_file_error("FAILED TO CREATE DISK MATRIX FILE");
+		ok = false;
+	}
+	if (!ok) {
+		free(entries);
+		free(*disk);
+		*disk = NULL;
+		close(fd);
+		if (path) {
+			unlink(temp);
+		}
+		return false;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	(*disk)->refs = 1;
+	(*disk)->fd = fd;
+	(*disk)->temporary = !path;
+	(*disk)->tile_rows = h.tile_rows;
+	(*disk)->num_tiles = h.num_tiles;
+	(*disk)->dir_offset = h.dir_offset;
+	(*disk)->payload_offset = h.payload_offset;
+	(*disk)->entries = entries;
+	return true;
+}
+
+/*
+ * PURPOSE: instantiates an all zero matrix kept in a spill file instead of
+ *          memory, the file goes when the matrix does
+ * INPUTS:
+ *	new_matrix: receives the new matrix
+ *  name: the name of the matrix
+ *  rows, cols: dimensions of the matrix
+ *  type: the element type
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool create_disk_matrix (Matrix_t** new_matrix, const char* name, const unsigned int rows,
+		const unsigned int cols, Matrix_Type_t type) {
+
+	if (!new_matrix || !name || strlen(name) + 1 > MATRIX_NAME_LEN || type >= MATRIX_TYPES) {
+		return false;
+	}
+
+	*new_matrix = memory_alloc(sizeof(Matrix_t), true);
+	if (!(*new_matrix)) {
+		return false;
+	}
+	strncpy((*new_matrix)->name, name, MATRIX_NAME_LEN);
+	(*new_matrix)->rows = rows;
+	(*new_matrix)->cols = cols;
+	(*new_matrix)->type = type;
+	if (!create_disk_file(NULL, NULL, *new_matrix, &(*new_matrix)->disk)) {
+		memory_free(*new_matrix);
+		*new_matrix = NULL;
+		return false;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: opens a raw version 2 matrix file as a disk matrix, nothing is
+ *          read beyond the header and directory. The file is the matrix,
+ *          so commands that change the matrix change the file.
+ * INPUTS:
+ *	matrix_input_filename: the file to open
+ *  m: receives the new matrix
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool read_matrix_disk (const char* matrix_input_filename, Matrix_t** m) {
+
+	if (!matrix_input_filename || !m) {
+		return false;
+	}
+
+	int fd = open(matrix_input_filename, O_RDWR);
+	if (fd < 0) {
+		print_file_error("FAILED TO OPEN FOR READING AND WRITING");
+		return false;
+	}
+
+	Matrix_File_Header_t h;
+	Matrix_Tile_Entry_t* entries = NULL;
+	if (!read_file_header(fd, &h, &entries)) {
+		printf("ONLY VERSION 2 MATRIX FILES CAN STAY ON DISK\n");
+		close(fd);
+		return false;
+	}
+	if (h.codec != MATRIX_CODEC_RAW || (h.flags & MATRIX_FILE_FLAG_CSR)) {
+		printf("ENCODED AND SPARSE MATRIX FILES CANNOT STAY ON DISK\n");
+		free(entries);
+		close(fd);
+		return false;
+	}
+
+	*m = memory_alloc(sizeof(Matrix_t), true);
+	Matrix_Disk_t* d = calloc(1, sizeof(Matrix_Disk_t));
+	if (!(*m) || !d) {
+		memory_free(*m);
+		*m = NULL;
+		free(d);
+		free(entries);
+		close(fd);
+		return false;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	strncpy((*m)->name, h.name, MATRIX_NAME_LEN);
+	(*m)->rows = h.rows;
+	(*m)->cols = h.cols;
+	(*m)->type = h.elem_type;
+	d->refs = 1;
+	d->fd = fd;
+	d->tile_rows = h.tile_rows;
+	d->num_tiles = h.num_tiles;
+	d->dir_offset = h.dir_offset;
+	d->payload_offset = h.payload_offset;
+	d->entries = entries;
+	(*m)->disk = d;
+	return true;
+}
+
+/*
+ * PURPOSE: drops this matrix's hold on its file, the last holder writes the
+ *          directory back and closes it
+ * INPUTS:
+ *	m: the matrix, left without disk storage
+ * RETURN:
+ *  void
+ *
+ **/
+void release_disk (Matrix_t* m) {
+
+	Matrix_Disk_t* d = m->disk;
+	if (!d) {
+		return;
+	}
+	m->disk = NULL;
+	if (__atomic_sub_fetch(&d->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+		return;
+	}
+	if (!d->temporary) {
+		flush_directory(d);
+	}
+	close(d->fd);
+	free(d->entries);
+	free(d);
+}
+
+/*
+ * A stream names up to DISK_MAX_OPERANDS matrices of the same size, on
+ * disk or dense in memory, and calls band for each band of rows in order
+ * with every operand wrapped as a dense matrix over just those rows.
+ */
+typedef struct {
+	Matrix_t* m[DISK_MAX_OPERANDS];
+	unsigned int mode[DISK_MAX_OPERANDS];
+	size_t count;
+	/*false ends the stream early, bands already done are still written*/
+	bool (*band) (void* ctx, Matrix_t* const* band, size_t first_row);
+	void* ctx;
+}Disk_Stream_t;
+
+/*adds an operand and returns its index, a matrix named twice is streamed once*/
+static size_t stream_operand (Disk_Stream_t* s, Matrix_t* m, unsigned int mode) {
+	for (size_t i = 0; i < s->count; ++i) {
+		if (s->m[i] == m) {
+			s->mode[i] |= mode;
+			return i;
+		}
+	}
+	s->m[s->count] = m;
+	s->mode[s->count] = mode;
+	return s->count++;
+}
+
+/*
+ * The ring between the computation and the I/O thread. Band b sits in
+ * slot b % depth, it is read into the slot once band b - depth has been
+ * written out of it, so the counters below only ever move forward and
+ * loaded - stored never passes depth.
+ */
+typedef struct {
+	const Disk_Stream_t* s;
+	size_t rows;
+	size_t band_rows;
+	size_t num_bands;
+	size_t depth;
+	size_t row_bytes[DISK_MAX_OPERANDS];
+	size_t row_pitch[DISK_MAX_OPERANDS];	/*bytes between rows of an operand in memory*/
+	unsigned char* frames[DISK_MAX_DEPTH][DISK_MAX_OPERANDS];	/*NULL for operands in memory*/
+	size_t loaded;		/*bands read in*/
+	size_t computed;	/*bands handed to the callback*/
+	size_t stored;		/*bands written out, or let go when nothing is written*/
+	size_t stalls;
+	Matrix_Disk_Stats_t io;	/*read and write counts, only the I/O thread touches them*/
+	bool failed;
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+}Disk_Pipeline_t;
+
+static size_t band_length (const Disk_Pipeline_t* p, size_t band) {
+	const size_t first = band * p->band_rows;
+	return p->rows - first < p->band_rows ? p->rows - first : p->band_rows;
+}
+
+/*
+ * PURPOSE: reads band of every operand that is read from disk, a band that
+ *          is a whole tile of its file is checked against the tile's CRC
+ * INPUTS:
+ *	p: the pipeline
+ *  band: the band
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool load_band (Disk_Pipeline_t* p, size_t band) {
+	const Disk_Stream_t* s = p->s;
+	const size_t rows = band_length(p, band);
+	for (size_t i = 0; i < s->count; ++i) {
+		const Matrix_Disk_t* d = s->m[i]->disk;
+		if (!d || !(s->mode[i] & DISK_READ)) {
+			continue;
+		}
+		unsigned char* frame = p->frames[band % p->depth][i];
+		const size_t len = rows * p->row_bytes[i];
+		if (!read_full(d->fd, frame, len, d->payload_offset + band * p->band_rows * p->row_bytes[i])) {
+			print_file_error("FAILED TO READ DISK MATRIX");
+			return false;
+		}
+		if (d->tile_rows == p->band_rows && matrix_kernels.crc32c(0, frame, len) != d->entries[band].crc) {
+			printf("MATRIX TILE %zu OF (%s) IS CORRUPT\n", band, s->m[i]->name);
+			return false;
+		}
+		++p->io.bands_read;
+		p->io.bytes_read += len;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: writes band of every operand that is written to disk and
+ *          updates its tile's checksum
+ * INPUTS:
+ *	p: the pipeline
+ *  band: the band
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool store_band (Disk_Pipeline_t* p, size_t band) {
+	const Disk_Stream_t* s = p->s;
+	const size_t rows = band_length(p, band);
+	for (size_t i = 0; i < s->count; ++i) {
+		Matrix_Disk_t* d = s->m[i]->disk;
+		if (!d || !(s->mode[i] & DISK_WRITE)) {
+			continue;
+		}
+		const unsigned char* frame = p->frames[band % p->depth][i];
+		const size_t len = rows * p->row_bytes[i];
+		if (!write_full(d->fd, frame, len, d->payload_offset + band * p->band_rows * p->row_bytes[i])) {
+			print_file_error("FAILED TO WRITE DISK MATRIX");
+			return false;
+		}
+		/*the written file sets the bands, so they are always its tiles*/
+		d->entries[band].crc = matrix_kernels.crc32c(0, frame, len);
+		d->dirty = true;
+		++p->io.bands_written;
+		p->io.bytes_written += len;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: the I/O thread of a stream, writes computed bands behind the
+ *          computation first and reads bands ahead of it while slots are free
+ * INPUTS:
+ *	arg: the pipeline
+ * RETURN:
+ *  NULL
+ *
+ **/
+static void* disk_io_thread (void* arg) {
+	Disk_Pipeline_t* p = arg;
+	pthread_mutex_lock(&p->lock);
+	while (!p->failed) {
+		if (p->stored < p->computed) {
+			const size_t band = p->stored;
+			pthread_mutex_unlock(&p->lock);
+			const bool ok = store_band(p, band);
+			pthread_mutex_lock(&p->lock);
+			p->failed = !ok;
+			p->stored = band + 1;
+		}
+		else if (!p->stop && p->loaded < p->num_bands && p->loaded - p->stored < p->depth) {
+			const size_t band = p->loaded;
+			pthread_mutex_unlock(&p->lock);
+			const bool ok = load_band(p, band);
+			pthread_mutex_lock(&p->lock);
+			p->failed = !ok;
+			p->loaded = band + 1;
+		}
+		else if (p->stop) {
+			break;
+		}
+		else {
+			pthread_cond_wait(&p->cond, &p->lock);
+			continue;
+		}
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+	return NULL;
+}
+
+/*
+ * PURPOSE: runs a stream, band by band on the calling thread while the I/O
+ *          thread keeps up to depth bands in flight. The bands follow the
+ *          tiles of the file that is written, or of the first one read.
+ *          The directory of a file written is flushed and synced at the end.
+ * INPUTS:
+ *	s: the stream, at least one operand must be on disk
+ * RETURN:
+ *  If every band was read, computed and written then true
+ *  else false.
+ *
+ **/
+static bool run_stream (const Disk_Stream_t* s) {
+
+	pthread_once(&pool_once, read_pool_size);
+
+	Disk_Pipeline_t p = { .s = s, .rows = s->m[0]->rows };
+	const Matrix_Disk_t* lead = NULL;
+	for (size_t i = 0; i < s->count; ++i) {
+		Matrix_t* m = s->m[i];
+		/*bands of an operand in memory are slices of its elements, views included*/
+		if (!m->disk && !m->data) {
+			return false;
+		}
+		p.row_bytes[i] = (size_t) m->cols * matrix_type_size(m->type);
+		p.row_pitch[i] = (size_t) (m->stride ? m->stride : m->cols) * matrix_type_size(m->type);
+		if (m->disk && (!lead || (s->mode[i] & DISK_WRITE))) {
+			lead = m->disk;
+		}
+	}
+	if (!lead) {
+		return false;
+	}
+	if ((size_t) s->m[0]->rows * s->m[0]->cols == 0) {
+		return true;
+	}
+
+	p.band_rows = lead->tile_rows;
+	p.num_bands = (p.rows + p.band_rows - 1) / p.band_rows;
+	/*a band indexes the tile directory of a written file, and of a read one tiled the same way*/
+	for (size_t i = 0; i < s->count; ++i) {
+		const Matrix_Disk_t* d = s->m[i]->disk;
+		if (d && ((s->mode[i] & DISK_WRITE) || d->tile_rows == p.band_rows)
+			&& (d->tile_rows != p.band_rows || d->num_tiles != p.num_bands)) {
+			printf("MATRIX TILES OF (%s) DO NOT MATCH ITS SIZE\n", s->m[i]->name);
+			return false;
+		}
+	}
+	size_t slot_bytes = 0;
+	for (size_t i = 0; i < s->count; ++i) {
+		slot_bytes += s->m[i]->disk ? p.band_rows * p.row_bytes[i] : 0;
+	}
+	p.depth = pool_bytes / slot_bytes;
+	p.depth = p.depth < DISK_MIN_DEPTH ? DISK_MIN_DEPTH : p.depth > DISK_MAX_DEPTH ? DISK_MAX_DEPTH : p.depth;
+	p.depth = p.depth > p.num_bands ? p.num_bands : p.depth;
+
+	bool ok = true;
+	for (size_t slot = 0; slot < p.depth; ++slot) {
+		for (size_t i = 0; i < s->count; ++i) {
+			if (s->m[i]->disk) {
+				p.frames[slot][i] = memory_alloc(p.band_rows * p.row_bytes[i], false);
+				ok = ok && p.frames[slot][i];
+			}
+		}
+	}
+
+	pthread_t io;
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.cond, NULL);
+	if (ok && pthread_create(&io, NULL, disk_io_thread, &p) != 0) {
+		ok = false;
+	}
+
+	if (ok) {
+		Matrix_t wrap[DISK_MAX_OPERANDS];
+		Matrix_t* band[DISK_MAX_OPERANDS];
+		bool keep = true;
+		for (size_t b = 0; b < p.num_bands && keep; ++b) {
+			pthread_mutex_lock(&p.lock);
+			if (p.loaded <= b && !p.failed) {
+				++p.stalls;
+			}
+			while (p.loaded <= b && !p.failed) {
+				pthread_cond_wait(&p.cond, &p.lock);
+			}
+			const bool failed = p.failed;
+			pthread_mutex_unlock(&p.lock);
+			if (failed) {
+				break;
+			}
+
+			const size_t first_row = b * p.band_rows;
+			for (size_t i = 0; i < s->count; ++i) {
+				memset(&wrap[i], 0, sizeof(Matrix_t));
+				strncpy(wrap[i].name, s->m[i]->name, MATRIX_NAME_LEN);
+				wrap[i].rows = band_length(&p, b);
+				wrap[i].cols = s->m[i]->cols;
+				wrap[i].type = s->m[i]->type;
+				wrap[i].stride = s->m[i]->disk ? 0 : s->m[i]->stride;
+				wrap[i].data = s->m[i]->disk ? (unsigned int*) p.frames[b % p.depth][i]
+					: (unsigned int*) ((char*) s->m[i]->data + first_row * p.row_pitch[i]);
+				band[i] = &wrap[i];
+			}
+			keep = s->band(s->ctx, band, first_row);
+
+			pthread_mutex_lock(&p.lock);
+			p.computed = b + 1;
+			pthread_cond_broadcast(&p.cond);
+			pthread_mutex_unlock(&p.lock);
+		}
+
+		pthread_mutex_lock(&p.lock);
+		p.stop = true;
+		pthread_cond_broadcast(&p.cond);
+		pthread_mutex_unlock(&p.lock);
+		pthread_join(io, NULL);
+		ok = !p.failed;
+	}
+
+	/*the file matches its directory again before the command returns, readtile and read check it*/
+	for (size_t i = 0; i < s->count; ++i) {
+		Matrix_Disk_t* d = s->m[i]->disk;
+		if (!d || !(s->mode[i] & DISK_WRITE) || !d->dirty) {
+			continue;
+		}
+		if (!flush_directory(d)) {
+			ok = false;
+		}
+		else if (!d->temporary && fdatasync(d->fd) != 0) {
+			print_file_error("FAILED TO SYNC DISK MATRIX");
+			ok = false;
+		}
+	}
+	pthread_cond_destroy(&p.cond);
+	pthread_mutex_destroy(&p.lock);
+
+	for (size_t slot = 0; slot < p.depth; ++slot) {
+		for (size_t i = 0; i < s->count; ++i) {
+			memory_free(p.frames[slot][i]);
+		}
+	}
+
+	pthread_mutex_lock(&totals_lock);
+	++totals.streams;
+	totals.bands_read += p.io.bands_read;
+	totals.bands_written += p.io.bands_written;
+	totals.bytes_read += p.io.bytes_read;
+	totals.bytes_written += p.io.bytes_written;
+	totals.stalls += p.stalls;
+	if (p.depth * slot_bytes > totals.peak_bytes) {
+		totals.peak_bytes = p.depth * slot_bytes;
+	}
+	pthread_mutex_unlock(&totals_lock);
+	return ok;
+}
+
+/*
+ * PURPOSE: totals of every stream through disk matrices so far
+ * INPUTS:
+ *	stats: receives the totals
+ * RETURN:
+ *  void
+ *
+ **/
+void disk_stats (Matrix_Disk_Stats_t* stats) {
+	pthread_once(&pool_once, read_pool_size);
+	pthread_mutex_lock(&totals_lock);
+	*stats = totals;
+	stats->pool_bytes = pool_bytes;
+	pthread_mutex_unlock(&totals_lock);
+}
+
+/*Band callbacks, ctx carries the operand indices and whatever is being gathered*/
+static bool copy_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	memcpy(band[1]->data, band[0]->data, (size_t) band[0]->rows * band[0]->cols * matrix_type_size(band[0]->type));
+	return true;
+}
+
+static bool add_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	const size_t* at = ctx;
+	return add_matrices(band[at[0]], band[at[1]], band[at[2]]);
+}
+
+typedef struct {
+	char direction;
+	unsigned int shift;
+}Disk_Shift_t;
+
+static bool shift_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	const Disk_Shift_t* t = ctx;
+	return bitwise_shift_matrix(band[0], t->direction, t->shift);
+}
+
+typedef struct {
+	size_t at[2];
+	bool same;
+}Disk_Equal_t;
+
+static bool equal_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	Disk_Equal_t* t = ctx;
+	t->same = equal_matrices(band[t->at[0]], band[t->at[1]]);
+	return t->same;
+}
+
+typedef struct {
+	unsigned int start_range;
+	unsigned int span;
+	unsigned long long seed;
+}Disk_Random_t;
+
+static bool random_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	const Disk_Random_t* t = ctx;
+	fill_random(band[0], t->start_range, t->span, t->seed, first_row * band[0]->cols);
+	return true;
+}
+
+static bool summary_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	Matrix_Summary_t* total = ctx;
+	Matrix_Summary_t part;
+	if (!summarize_matrix(band[0], &part)) {
+		return false;
+	}
+	total->sum += part.sum;
+	total->min = part.min < total->min ? part.min : total->min;
+	total->max = part.max > total->max ? part.max : total->max;
+	return true;
+}
+
+static bool row_sums_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	unsigned long long* sums = ctx;
+	return row_sums_matrix(band[0], &sums[first_row]);
+}
+
+typedef struct {
+	unsigned long long* sums;
+	unsigned long long* part;
+}Disk_Col_Sums_t;
+
+static bool col_sums_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	Disk_Col_Sums_t* t = ctx;
+	if (!col_sums_matrix(band[0], t->part)) {
+		return false;
+	}
+	for (size_t j = 0; j < band[0]->cols; ++j) {
+		t->sums[j] += t->part[j];
+	}
+	return true;
+}
+
+static bool display_band (void* ctx, Matrix_t* const* band, size_t first_row) {
+	print_matrix_rows(band[0]);
+	return true;
+}
+
+/*
+ * PURPOSE: streams the elements of a disk matrix into the file of another
+ * INPUTS:
+ *	src: the matrix to copy
+ *  d: storage of the same size and type to copy into
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool copy_to (Matrix_t* src, Matrix_Disk_t* d) {
+	Matrix_t dest = *src;
+	dest.disk = d;
+	Disk_Stream_t s = { .band = copy_band };
+	stream_operand(&s, src, DISK_READ);
+	stream_operand(&s, &dest, DISK_WRITE);
+	return run_stream(&s);
+}
+
+/*
+ * PURPOSE: gives a disk matrix a file of its own before it is written,
+ *          nothing is copied while no duplicate shares its file
+ * INPUTS:
+ *	m: the disk matrix
+ *  keep: copy the shared values over, false when every element is about
+ *        to be overwritten anyway
+ * RETURN:
+ *  If no errors then true
+ *  else false and the matrix still shares its file.
+ *
+ **/
+bool disk_detach (Matrix_t* m, bool keep) {
+
+	if (__atomic_load_n(&m->disk->refs, __ATOMIC_ACQUIRE) == 1) {
+		return true;
+	}
+	Matrix_t copy = *m;
+	if (!create_disk_file(NULL, NULL, m, &copy.disk)) {
+		return false;
+	}
+	if (keep && !copy_to(m, copy.disk)) {
+		release_disk(&copy);
+		return false;
+	}
+	release_disk(m);
+	m->disk = copy.disk;
+	return true;
+}
+
+bool disk_add (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+	Disk_Stream_t s = { .band = add_band };
+	size_t at[3];
+	at[0] = stream_operand(&s, a, DISK_READ);
+	at[1] = stream_operand(&s, b, DISK_READ);
+	at[2] = stream_operand(&s, c, DISK_WRITE);
+	s.ctx = at;
+	return run_stream(&s);
+}
+
+bool disk_shift (Matrix_t* m, char direction, unsigned int shift) {
+	Disk_Shift_t t = { .direction = direction, .shift = shift };
+	Disk_Stream_t s = { .band = shift_band, .ctx = &t };
+	stream_operand(&s, m, DISK_READ | DISK_WRITE);
+	return run_stream(&s);
+}
+
+bool disk_equal (Matrix_t* a, Matrix_t* b) {
+	Disk_Equal_t t = { .same = true };
+	Disk_Stream_t s = { .band = equal_band, .ctx = &t };
+	t.at[0] = stream_operand(&s, a, DISK_READ);
+	t.at[1] = stream_operand(&s, b, DISK_READ);
+	return run_stream(&s) && t.same;
+}
+
+bool disk_random (Matrix_t* m, unsigned int start_range, unsigned int span, unsigned long long seed) {
+	Disk_Random_t t = { .start_range = start_range, .span = span, .seed = seed };
+	Disk_Stream_t s = { .band = random_band, .ctx = &t };
+	stream_operand(&s, m, DISK_WRITE);
+	return run_stream(&s);
+}
+
+bool disk_summary (Matrix_t* m, Matrix_Summary_t* summary) {
+	Matrix_Summary_t total = { .sum = 0, .min = UINT_MAX, .max = 0 };
+	Disk_Stream_t s = { .band = summary_band, .ctx = &total };
+	stream_operand(&s, m, DISK_READ);
+	if (!run_stream(&s)) {
+		return false;
+	}
+	total.mean = (double) total.sum / ((double) m->rows * m->cols);
+	*summary = total;
+	return true;
+}
+
+bool disk_row_sums (Matrix_t* m, unsigned long long* sums) {
+	Disk_Stream_t s = { .band = row_sums_band, .ctx = sums };
+	stream_operand(&s, m, DISK_READ);
+	return run_stream(&s);
+}
+
+bool disk_col_sums (Matrix_t* m, unsigned long long* sums) {
+	Disk_Col_Sums_t t = { .sums = sums, .part = calloc(m->cols ? m->cols : 1, sizeof(unsigned long long)) };
+	if (!t.part) {
+		return false;
+	}
+	memset(sums, 0, m->cols * sizeof(unsigned long long));
+	Disk_Stream_t s = { .band = col_sums_band, .ctx = &t };
+	stream_operand(&s, m, DISK_READ);
+	const bool ok = run_stream(&s);
+	free(t.part);
+	return ok;
+}
+
+void disk_display (Matrix_t* m) {
+	Disk_Stream_t s = { .band = display_band };
+	stream_operand(&s, m, DISK_READ);
+	if (!run_stream(&s)) {
+		printf("Failure to read the matrix from disk\n");
+	}
+}
+
+/*
+ * PURPOSE: writes a disk matrix out as a raw version 2 file, streaming it
+ *          tile by tile. Writing it to its own file just brings the tile
+ *          directory up to date.
+ * INPUTS:
+ *	matrix_output_filename: name of the file to write
+ *  m: the disk matrix
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool write_disk_matrix (const char* matrix_output_filename, Matrix_t* m) {
+
+	struct stat target;
+	struct stat source;
+	if (stat(matrix_output_filename, &target) == 0 && fstat(m->disk->fd, &source) == 0
+		&& target.st_dev == source.st_dev && target.st_ino == source.st_ino) {
+		return flush_directory(m->disk);
+	}
+
+	Matrix_t out = *m;
+	char temp[PATH_MAX];
+	if (!create_disk_file(matrix_output_filename, temp, m, &out.disk)) {
+		return false;
+	}
+	bool ok = copy_to(m, out.disk) && flush_directory(out.disk);
+	release_disk(&out);
+	return finish_replacement(temp, matrix_output_filename, ok);
+}
@@ -0,0 +1,44 @@
+#ifndef _MATRIX_DISK_H_
+#define _MATRIX_DISK_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "matrix.h"
+
+/*
+ * Disk side of the matrix operations. matrix.c hands an operation over
+ * when one of its operands lives in a file, arguments and dimensions have
+ * already been checked by then. Operands in memory must be dense.
+ */
+
+/*file helpers from matrix_io.c*/
+void print_file_error (const char* what);
+int open_replacement (const char* path, char* temp);
+bool finish_replacement (const char* temp, const char* path, bool ok);
+bool read_full (int fd, void* buf, size_t len, off_t offset);
+bool read_file_header (int fd, Matrix_File_Header_t* h, Matrix_Tile_Entry_t** entries);
+void init_file_header (Matrix_File_Header_t* h, const Matrix_t* m);
+unsigned int file_tile_rows (size_t row_bytes);
+uint64_t file_num_tiles (uint32_t rows, uint32_t cols, uint32_t tile_rows);
+
+/*dense helpers from matrix.c*/
+void print_matrix_rows (const Matrix_t* m);
+void fill_random (Matrix_t* m, unsigned int start_range, unsigned int span, unsigned long long seed,
+		size_t first);
+
+void release_disk (Matrix_t* m);
+bool disk_detach (Matrix_t* m, bool keep);
+bool disk_add (Matrix_t* a, Matrix_t* b, Matrix_t* c);
+bool disk_shift (Matrix_t* m, char direction, unsigned int shift);
+bool disk_equal (Matrix_t* a, Matrix_t* b);
+bool disk_random (Matrix_t* m, unsigned int start_range, unsigned int span, unsigned long long seed);
+bool disk_summary (Matrix_t* m, Matrix_Summary_t* summary);
+bool disk_row_sums (Matrix_t* m, unsigned long long* sums);
+bool disk_col_sums (Matrix_t* m, unsigned long long* sums);
+void disk_display (Matrix_t* m);
+bool write_disk_matrix (const char* matrix_output_filename, Matrix_t* m);
+
+#endif
@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "matrix_expr.h"
+#include "matrix_kernels.h"
+#include "thread_pool.h"
+
+/*binary operators by binding level, loosest first like C*/
+typedef struct {
+	const char* symbol;
+	Expr_Op_t op;
+	int level;
+}Expr_Binary_t;
+
+static const Expr_Binary_t binary_ops[] = {
+	{ "|", EXPR_OR, 0 },
+	{ "^", EXPR_XOR, 1 },
+	{ "&", EXPR_AND, 2 },
+	{ "<<", EXPR_SHL, 3 },
+	{ ">>", EXPR_SHR, 3 },
+	{ "+", EXPR_ADD, 4 },
+	{ "-", EXPR_SUB, 4 },
+	{ "*", EXPR_MUL, 5 }
+};
+#define EXPR_LEVELS 6
+
+typedef struct {
+	const char* p;
+	Matrix_Catalogue_t* mats;
+	Matrix_Expr_t* expr;
+	size_t depth;
+	bool have_dims;
+	bool failed;
+}Expr_Parser_t;
+
+/*
+ * PURPOSE: one element of a binary operator, shifts of 32 or more give zero
+ * INPUTS:
+ *	op: the operator
+ *  a, b: left and right operands
+ * RETURN:
+ *  the result wrapped to 32 bits
+ *
+ **/
+static unsigned int apply_scalar (Expr_Op_t op, unsigned int a, unsigned int b) {
+	switch (op) {
+	case EXPR_ADD:
+		return a + b;
+	case EXPR_SUB:
+		return a - b;
+	case EXPR_MUL:
+		return a * b;
+	case EXPR_AND:
+		return a & b;
+	case EXPR_OR:
+		return a | b;
+	case EXPR_XOR:
+		return a ^ b;
+	case EXPR_SHL:
+		return b >= 32 ? 0 : a << b;
+	case EXPR_SHR:
+		return b >= 32 ? 0 : a >> b;
+	default:
+		return 0;
+	}
+}
+
+static void skip_space (Expr_Parser_t* ps) {
+	while (isspace((unsigned char) *ps->p)) {
+		ps->p++;
+	}
+}
+
+static void parse_error (Expr_Parser_t* ps, const char* what) {
+	if (!ps->failed) {
+		printf("Expression error: %s at \"%s\"\n", what, ps->p);
+	}
+	ps->failed = true;
+}
+
+/*
+ * PURPOSE: appends an instruction and tracks how deep the stack gets
+ * INPUTS:
+ *	ps: the parser
+ *  in: the instruction
+ * RETURN:
+ *  void
+ *
+ **/
+static void emit (Expr_Parser_t* ps, Expr_Instr_t in) {
+	Matrix_Expr_t* e = ps->expr;
+	if (e->length == EXPR_MAX_CODE) {
+		parse_error(ps, "expression is too long");
+		return;
+	}
+	if (in.op == EXPR_LOAD || in.op == EXPR_CONST) {
+		ps->depth++;
+	}
+	else if (!in.immediate) {
+		ps->depth--;
+	}
+	if (ps->depth > EXPR_MAX_DEPTH) {
+		parse_error(ps, "expression nests too deep");
+		return;
+	}
+	e->depth = ps->depth > e->depth ? ps->depth : e->depth;
+	e->code[e->length++] = in;
+}
+
+/*
+ * PURPOSE: emits a binary operator, folding constant operands. Two constants
+ *          become one and a constant right operand rides along as an
+ *          immediate so it is never spread over a block.
+ * INPUTS:
+ *	ps: the parser
+ *  op: the operator
+ * RETURN:
+ *  void
+ *
+ **/
+static void emit_binary (Expr_Parser_t* ps, Expr_Op_t op) {
+	Matrix_Expr_t* e = ps->expr;
+	Expr_Instr_t in = { .op = op };
+	if (e->length >= 1 && e->code[e->length - 1].op == EXPR_CONST) {
+		const unsigned int right = e->code[--e->length].value;
+		ps->depth--;
+		if (e->length >= 1 && e->code[e->length - 1].op == EXPR_CONST) {
+			Expr_Instr_t* left = &e->code[e->length - 1];
+			left->value = apply_scalar(op, left->value, right);
+			return;
+		}
+		in.immediate = true;
+		in.value = right;
+	}
+	emit(ps, in);
+}
+
+static void parse_level (Expr_Parser_t* ps, int level);
+
+/*
+ * PURPOSE: parses a matrix name, a constant or a parenthesised expression
+ * INPUTS:
+ *	ps: the parser
+ * RETURN:
+ *  void
+ *
+ **/
+static void parse_primary (Expr_Parser_t* ps) {
+	skip_space(ps);
+	const char* start = ps->p;
+
+	if (*start == '(') {
+		ps->p++;
+		parse_level(ps, 0);
+		skip_space(ps);
+		if (*ps->p != ')') {
+			parse_error(ps, "missing )");
+			return;
+		}
+		ps->p++;
+		return;
+	}
+
+	if (isdigit((unsigned char) *start)) {
+		char* end = NULL;
+		errno = 0;
+		const unsigned long value = strtoul(start, &end, 0);
+		if (errno || value > UINT_MAX) {
+			parse_error(ps, "constant does not fit in 32 bits");
+			return;
+		}
+		ps->p = end;
+		emit(ps, (Expr_Instr_t) { .op = EXPR_CONST, .value = (unsigned int) value });
+		return;
+	}
+
+	size_t len = 0;
+	while (isalnum((unsigned char) start[len]) || start[len] == '_' || start[len] == '.') {
+		++len;
+	}
+	if (len == 0) {
+		parse_error(ps, "expected a matrix, a constant or (");
+		return;
+	}
+	if (len >= MATRIX_NAME_LEN) {
+		parse_error(ps, "matrix name is too long");
+		return;
+	}
+
+	char name[MATRIX_NAME_LEN];
+	memcpy(name, start, len);
+	name[len] = '\0';
+	Matrix_t* m = find_matrix(ps->mats, name);
+	if (!m) {
+		parse_error(ps, "no such matrix");
+		return;
+	}
+	if (m->disk) {
+		parse_error(ps, "matrix is on disk, eval works in memory");
+		return;
+	}
+	if (!m->data) {
+		parse_error(ps, "matrix is sparse, densify it first");
+		return;
+	}
+	if (m->type != MATRIX_U32) {
+		parse_error(ps, "matrix is not u32, cast it first");
+		return;
+	}
+	/*the evaluator reads each input as one flat array*/
+	if (!compact_matrix(m)) {
+		parse_error(ps, "out of memory");
+		return;
+	}
+	if (!ps->have_dims) {
+		ps->expr->rows = m->rows;
+		ps->expr->cols = m->cols;
+		ps->have_dims = true;
+	}
+	else if (m->rows != ps->expr->rows || m->cols != ps->expr->cols) {
+		parse_error(ps, "matrix dimensions do not match");
+		return;
+	}
+	ps->p += len;
+	emit(ps, (Expr_Instr_t) { .op = EXPR_LOAD, .matrix = m });
+}
+
+/*
+ * PURPOSE: parses operators of the given binding level and tighter
+ * INPUTS:
+ *	ps: the parser
+ *  level: index into the binding levels, EXPR_LEVELS means a primary
+ * RETURN:
+ *  void
+ *
+ **/
+static void parse_level (Expr_Parser_t* ps, int level) {
+	if (level == EXPR_LEVELS) {
+		parse_primary(ps);
+		return;
+	}
+
+	parse_level(ps, level + 1);
+	while (!ps->failed) {
+		skip_space(ps);
+		const Expr_Binary_t* found = NULL;
+		for (size_t i = 0; i < sizeof(binary_ops) / sizeof(binary_ops[0]); ++i) {
+			const size_t len = strlen(binary_ops[i].symbol);
+			if (binary_ops[i].level == level && strncmp(ps->p, binary_ops[i].symbol, len) == 0) {
+				found = &binary_ops[i];
+				ps->p += len;
+				break;
+			}
+		}
+		if (!found) {
+			return;
+		}
+		parse_level(ps, level + 1);
+		if (ps->failed) {
+			return;
+		}
+		emit_binary(ps, found->op);
+	}
+}
+
+/*
+ * PURPOSE: compiles an expression to postfix code over matrices of the catalogue
+ * INPUTS:
+ *	text: the expression
+ *  mats: where matrix names are looked up
+ *  expr: receives the compiled code
+ * RETURN:
+ *  If the expression parsed and names at least one matrix, all of one size, then true
+ *  else false with the reason printed.
+ *
+ **/
+bool compile_expression (const char* text, Matrix_Catalogue_t* mats, Matrix_Expr_t* expr) {
+
+	if (!text || !mats || !expr) {
+		return false;
+	}
+
+	memset(expr, 0, sizeof(*expr));
+	Expr_Parser_t ps = { .p = text, .mats = mats, .expr = expr };
+	parse_level(&ps, 0);
+	skip_space(&ps);
+	if (!ps.failed && *ps.p != '\0') {
+		parse_error(&ps, "unexpected input");
+	}
+	if (!ps.failed && !ps.have_dims) {
+		parse_error(&ps, "expression needs at least one matrix");
+	}
+	return !ps.failed;
+}
+
+/*
+ * PURPOSE: runs one binary operator over a block
+ * INPUTS:
+ *	in: the instruction
+ *  out: destination, may be l
+ *  l: left operand block
+ *  r: right operand block, NULL for an immediate
+ *  len: elements in the block
+ * RETURN:
+ *  void
+ *
+ **/
+static void apply_block (const Expr_Instr_t* in, unsigned int* out, const unsigned int* l,
+		const unsigned int* r, size_t len) {
+
+	if (in->op == EXPR_ADD && r) {
+		matrix_kernels.add_u32(out, l, r, len);
+		return;
+	}
+	if ((in->op == EXPR_SHL || in->op == EXPR_SHR) && !r) {
+		if (in->value >= 32) {
+			memset(out, 0, len * sizeof(unsigned int));
+			return;
+		}
+		if (out != l) {
+			memcpy(out, l, len * sizeof(unsigned int));
+		}
+		if (in->op == EXPR_SHL) {
+			matrix_kernels.shift_left_u32(out, len, in->value);
+		}
+		else {
+			matrix_kernels.shift_right_u32(out, len, in->value);
+		}
+		return;
+	}
+	if (r) {
+		for (size_t i = 0; i < len; ++i) {
+			out[i] = apply_scalar(in->op, l[i], r[i]);
+		}
+	}
+	else {
+		for (size_t i = 0; i < len; ++i) {
+			out[i] = apply_scalar(in->op, l[i], in->value);
+		}
+	}
+}
+
+typedef struct {
+	const Matrix_Expr_t* expr;
+	unsigned int* dst;
+}Expr_Task_t;
+
+/*
+ * Each block runs the whole program. Loads just point at the source data,
+ * operators write into the scratch block of their stack slot, and the
+ * last instruction writes straight into the result.
+ */
+static void expression_task (void* ctx, size_t begin, size_t end) {
+	const Expr_Task_t* t = ctx;
+	const Matrix_Expr_t* e = t->expr;
+	unsigned int scratch[EXPR_MAX_DEPTH][EXPR_BLOCK];
+	const unsigned int* stack[EXPR_MAX_DEPTH];
+
+	for (size_t start = begin; start < end; start += EXPR_BLOCK) {
+		const size_t len = end - start < EXPR_BLOCK ? end - start : EXPR_BLOCK;
+		size_t sp = 0;
+		for (size_t i = 0; i < e->length; ++i) {
+			const Expr_Instr_t* in = &e->code[i];
+			const bool last = i + 1 == e->length;
+			if (in->op == EXPR_LOAD) {
+				const unsigned int* src = &in->matrix->data[start];
+				if (last && src != &t->dst[start]) {
+					memcpy(&t->dst[start], src, len * sizeof(unsigned int));
+				}
+				stack[sp++] = src;
+			}
+			else if (in->op == EXPR_CONST) {
+				unsigned int* out = last ? &t->dst[start] : scratch[sp];
+				for (size_t j = 0; j < len; ++j) {
+					out[j] = in->value;
+				}
+				stack[sp++] = out;
+			}
+			else {
+				const unsigned int* r = in->immediate ? NULL : stack[--sp];
+				unsigned int* out = last ? &t->dst[start] : scratch[sp - 1];
+				apply_block(in, out, stack[sp - 1], r, len);
+				stack[sp - 1] = out;
+			}
+		}
+	}
+}
+
+/*
+ * PURPOSE: evaluates compiled code into dst in one pass over the inputs
+ * INPUTS:
+ *	expr: code from compile_expression, its matrices must still exist
+ *  dst: dense result of the same size, it may be one of the inputs
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool evaluate_expression (const Matrix_Expr_t* expr, Matrix_t* dst) {
+
+	if (!expr || !dst || !dst->data || dst->type != MATRIX_U32 || expr->length == 0) {
+		return false;
+	}
+	if (dst->rows != expr->rows || dst->cols != expr->cols || !unshare_matrix(dst) || !compact_matrix(dst)) {
+		return false;
+	}
+
+	Expr_Task_t t = { .expr = expr, .dst = dst->data };
+	parallel_for((size_t) dst->rows * dst->cols, 0, expression_task, &t);
+	return true;
+}
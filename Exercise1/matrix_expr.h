@@ -0,0 +1,57 @@
+#ifndef _MATRIX_EXPR_H_
+#define _MATRIX_EXPR_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "catalogue.h"
+#include "matrix.h"
+
+/*
+ * Element-wise expressions over dense matrices such as (a + b) << 2.
+ * The text is compiled to postfix code and evaluated a block of
+ * EXPR_BLOCK elements at a time, so every input is read once, the
+ * result is written once and intermediate values never leave the cache.
+ *
+ * Operators, loosest binding first, all wrap around at 32 bits like add:
+ *   |   ^   &   << >>   + -   *
+ * Operands are matrix names, unsigned constants and parenthesised
+ * expressions. Shifting by 32 or more gives zero like shift does.
+ */
+#define EXPR_MAX_TEXT 1024
+#define EXPR_MAX_CODE 64
+#define EXPR_MAX_DEPTH 16
+#define EXPR_BLOCK 512
+
+typedef enum {
+	EXPR_LOAD,	/*push a matrix*/
+	EXPR_CONST,	/*push a constant*/
+	EXPR_ADD,
+	EXPR_SUB,
+	EXPR_MUL,
+	EXPR_AND,
+	EXPR_OR,
+	EXPR_XOR,
+	EXPR_SHL,
+	EXPR_SHR
+}Expr_Op_t;
+
+typedef struct {
+	Expr_Op_t op;
+	bool immediate;		/*binary op whose right operand is value*/
+	unsigned int value;
+	const Matrix_t* matrix;
+}Expr_Instr_t;
+
+typedef struct {
+	Expr_Instr_t code[EXPR_MAX_CODE];
+	size_t length;
+	size_t depth;		/*deepest the evaluation stack gets*/
+	unsigned int rows;
+	unsigned int cols;
+}Matrix_Expr_t;
+
+bool compile_expression (const char* text, Matrix_Catalogue_t* mats, Matrix_Expr_t* expr);
+bool evaluate_expression (const Matrix_Expr_t* expr, Matrix_t* dst);
+
+#endif
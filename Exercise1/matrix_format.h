@@ -0,0 +1,135 @@
+#ifndef _MATRIX_FORMAT_H_
+#define _MATRIX_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * On-disk layout of a version 2 matrix file:
+ *
+ *   header      MATRIX_FILE_HEADER_SIZE bytes, Matrix_File_Header_t
+ *   directory   num_tiles Matrix_Tile_Entry_t, one per tile
+ *   padding     zeros up to the next page boundary
+ *   payload     the tiles back to back starting at payload_offset
+ *
+ * A tile is a band of tile_rows full rows, so a raw payload is the plain
+ * row major data and can be mapped straight into memory. Every tile has
+ * its own CRC32C and can be read and checked without the others.
+ *
+ * With a codec other than raw every tile is encoded on its own (see
+ * matrix_codec.h), the directory gives each stored tile's offset and
+ * length and the CRC covers the encoded bytes. Such files are always
+ * decoded into memory, they cannot be mapped.
+ *
+ * A sparse matrix sets MATRIX_FILE_FLAG_CSR and is stored raw as a single
+ * tile covering every row: rows + 1 uint64 row offsets, then the uint32
+ * column of every entry, then the uint32 value of every entry.
+ *
+ * elem_type says what the elements are (Matrix_Type_t) and elem_size
+ * how wide they are. Files from before element types have zeros there,
+ * which reads as u32. Only u32 matrices use a codec or CSR, the other
+ * types are always stored raw.
+ *
+ * Files without the magic are the legacy layout: name length, name,
+ * rows, cols, data and a trailing EOF byte.
+ */
+#define MATRIX_FILE_MAGIC "MTRXFILE"
+#define MATRIX_FILE_VERSION 2
+#define MATRIX_FILE_ENDIAN 0x01020304u
+#define MATRIX_FILE_HEADER_SIZE 128
+#define MATRIX_FILE_NAME_LEN 32
+#define MATRIX_FILE_ALIGN 4096
+/*target bytes of raw data per tile*/
+#define MATRIX_TILE_BYTES (1 << 20)
+
+/*header flags*/
+#define MATRIX_FILE_FLAG_CSR 0x1u
+
+typedef enum {
+	MATRIX_CODEC_RAW = 0,	/*plain row major unsigned ints*/
+	MATRIX_CODEC_FOR = 1,	/*frame of reference bit packing*/
+	MATRIX_CODEC_DELTA = 2	/*bit packed zigzag deltas*/
+}Matrix_Codec_t;
+
+/*element types, the values are stored in files so only ever add to the end*/
+typedef enum {
+	MATRIX_U32 = 0,
+	MATRIX_U8 = 1,
+	MATRIX_U16 = 2,
+	MATRIX_U64 = 3,
+	MATRIX_I32 = 4,
+	MATRIX_F32 = 5,
+	MATRIX_F64 = 6,
+	MATRIX_TYPES
+}Matrix_Type_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t endian;
+	uint32_t header_size;
+	uint32_t rows;
+	uint32_t cols;
+	uint32_t elem_size;
+	uint32_t tile_rows;
+	uint32_t num_tiles;
+	uint32_t codec;
+	uint32_t flags;
+	uint64_t dir_offset;
+	uint64_t payload_offset;
+	uint64_t payload_len;
+	char name[MATRIX_FILE_NAME_LEN];
+	uint32_t header_crc;	/*CRC32C of the header with this field zeroed*/
+	uint32_t elem_type;
+	uint8_t reserved[16];
+}Matrix_File_Header_t;
+
+typedef struct {
+	uint64_t offset;	/*absolute file offset of the stored tile*/
+	uint64_t length;	/*stored bytes*/
+	uint32_t crc;		/*CRC32C of the stored bytes*/
+	uint32_t reserved;
+}Matrix_Tile_Entry_t;
+
+/*
+ * Layout of a POSIX shared memory segment holding a matrix (share and
+ * attach), named MATRIX_SHM_PREFIX followed by the matrix name:
+ *
+ *   header      MATRIX_SHM_HEADER_SIZE bytes, Matrix_Shm_Header_t
+ *   padding     zeros up to data_offset, a page boundary
+ *   elements    rows x cols of elem_type, row major and back to back
+ *
+ * seq is a seqlock shared by every process mapping the segment. A writer
+ * first takes writer_pid from 0 to its pid with a compare and swap, then
+ * moves seq to odd before touching the elements, adds one to version and
+ * moves seq on to even again when done, and puts writer_pid back to 0. A
+ * reader waits for seq to be even, reads, and reads again if seq has
+ * changed since. When the process in writer_pid is gone, a waiting reader
+ * or writer takes writer_pid over the same way and moves an odd seq on to
+ * even. seq and version are 64 bit and every field of the lock is read and
+ * written atomically.
+ */
+#define MATRIX_SHM_MAGIC "MTRXSHM2"
+#define MATRIX_SHM_PREFIX "/matlab."
+#define MATRIX_SHM_HEADER_SIZE 64
+
+typedef struct {
+	char magic[8];
+	uint32_t header_size;
+	uint32_t rows;
+	uint32_t cols;
+	uint32_t elem_type;
+	uint64_t data_offset;
+	uint64_t data_len;
+	uint64_t seq;		/*odd while a writer is changing the elements*/
+	uint64_t version;	/*writes finished since the segment was made*/
+	uint32_t writer_pid;	/*process holding the write lock, 0 for none*/
+	uint32_t reserved;
+}Matrix_Shm_Header_t;
+
+_Static_assert(sizeof(Matrix_File_Header_t) == MATRIX_FILE_HEADER_SIZE,
+	"matrix file header must stay 128 bytes");
+_Static_assert(sizeof(Matrix_Tile_Entry_t) == 24, "tile entry must stay 24 bytes");
+_Static_assert(sizeof(Matrix_Shm_Header_t) == MATRIX_SHM_HEADER_SIZE,
+	"shared memory header must stay 64 bytes");
+
+#endif
@@ -0,0 +1,1047 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "io_queue.h"
+#include "matrix.h"
+#include "matrix_codec.h"
+#include "matrix_disk.h"
+#include "matrix_format.h"
+#include "matrix_kernels.h"
+#include "matrix_memory.h"
+#include "matrix_sparse.h"
+#include "thread_pool.h"
+
+/*
+ * Reading and writing matrix files. write_matrix always produces the
+ * tiled version 2 layout described in matrix_format.h with the payload
+ * raw or encoded, the readers take either that or the legacy layout.
+ */
+
+static const unsigned char zero_page[MATRIX_FILE_ALIGN];
+
+_Static_assert(sizeof(size_t) == sizeof(uint64_t), "CSR row offsets are read and written in place");
+
+/*
+ * PURPOSE: prints why a file operation failed using errno
+ * INPUTS:
+ *	what: message printed before the errno details
+ * RETURN:
+ *  void
+ *
+ **/
+void print_file_error (const char* what) {
+	printf("%s\n", what);
+	if (errno == EACCES ) {
+		perror("DO NOT HAVE ACCESS TO FILE\n");
+	}
+	else if (errno == EADDRINUSE ){
+		perror("FILE ALREADY IN USE\n");
+	}
+	else if (errno == EBADF) {
+		perror("BAD FILE DESCRIPTOR\n");
+	}
+	else if (errno == EEXIST) {
+		perror("FILE EXIST\n");
+	}
+}
+
+/*
+ * PURPOSE: creates the file a write goes to, next to the file it replaces.
+ *          A matrix mapped from the old file keeps its pages until the new
+ *          one is renamed over it, truncating the old file in place would
+ *          kill it with SIGBUS.
+ * INPUTS:
+ *	path: the file to replace
+ *  temp: receives the name of the new file, PATH_MAX bytes
+ * RETURN:
+ *  the descriptor of the new file, -1 on errors
+ *
+ **/
+int open_replacement (const char* path, char* temp) {
+	if (snprintf(temp, PATH_MAX, "%s.XXXXXX", path) >= PATH_MAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	const int fd = mkstemp(temp);
+	if (fd >= 0 && fchmod(fd, 0644) != 0) {
+		close(fd);
+		unlink(temp);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * PURPOSE: puts the file written by open_replacement in place of the old
+ *          one, or removes it when the write failed
+ * INPUTS:
+ *	temp: the new file, already closed or still held by the caller
+ *  path: the file to replace
+ *  ok: whether the new file was written in full
+ * RETURN:
+ *  If the new file took the place of the old one then true
+ *  else false and the old file is as it was.
+ *
+ **/
+bool finish_replacement (const char* temp, const char* path, bool ok) {
+	if (ok && rename(temp, path) != 0) {
+		print_file_error("FAILED TO REPLACE FILE");
+		ok = false;
+	}
+	if (!ok) {
+		unlink(temp);
+	}
+	return ok;
+}
+
+/*
+ * PURPOSE: reads exactly len bytes at offset, retrying short reads
+ * INPUTS:
+ *	fd: file to read from
+ *  buf: destination
+ *  len: number of bytes wanted
+ *  offset: position in the file
+ * RETURN:
+ *  If all the bytes were read then true
+ *  else false for an error or the end of the file.
+ *
+ **/
+bool read_full (int fd, void* buf, size_t len, off_t offset) {
+	unsigned char* dst = buf;
+	while (len > 0) {
+		ssize_t got = pread(fd, dst, len, offset);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			return false;
+		}
+		dst += got;
+		len -= got;
+		offset += got;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: decodes the legacy header, name length then name then rows and cols
+ * INPUTS:
+ *	buf: the start of the file
+ *  len: bytes available in buf
+ *  name: receives the matrix name, MATRIX_NAME_LEN bytes
+ *  rows, cols: receive the dimensions
+ *  payload_offset: receives where the data starts in the file
+ * RETURN:
+ *  If the header is complete and sane then true
+ *  else false.
+ *
+ **/
+static bool parse_legacy_header (const unsigned char* buf, size_t len, char* name,
+		unsigned int* rows, unsigned int* cols, size_t* payload_offset) {
+
+	unsigned int name_len = 0;
+	if (len < sizeof(unsigned int)) {
+		return false;
+	}
+	memcpy(&name_len, buf, sizeof(unsigned int));
+	if (name_len == 0 || name_len > MATRIX_NAME_LEN
+		|| len < sizeof(unsigned int) * 3 + name_len) {
+		return false;
+	}
+	memcpy(name, &buf[sizeof(unsigned int)], name_len);
+	if (name[name_len - 1] != '\0') {
+		return false;
+	}
+	memcpy(rows, &buf[sizeof(unsigned int) + name_len], sizeof(unsigned int));
+	memcpy(cols, &buf[sizeof(unsigned int) * 2 + name_len], sizeof(unsigned int));
+	*payload_offset = sizeof(unsigned int) * 3 + name_len;
+	return true;
+}
+
+/*
+ * PURPOSE: writes every byte described by iov, resuming after short writes
+ * INPUTS:
+ *	fd: file to write to
+ *  iov: the pieces to write, advanced in place as bytes go out
+ *  iovcnt: number of pieces
+ * RETURN:
+ *  If all the bytes were written then true
+ *  else false.
+ *
+ **/
+static bool write_full_iov (int fd, struct iovec* iov, int iovcnt) {
+	while (iovcnt > 0) {
+		/*skip pieces that are already done so writev never sees an empty list*/
+		if (iov->iov_len == 0) {
+			++iov;
+			--iovcnt;
+			continue;
+		}
+		/*an encoded file has one piece per tile which can pass UIO_MAXIOV*/
+		ssize_t put = writev(fd, iov, iovcnt < UIO_MAXIOV ? iovcnt : UIO_MAXIOV);
+		if (put < 0 && errno == EINTR) {
+			continue;
+		}
+		if (put <= 0) {
+			return false;
+		}
+		while (put > 0) {
+			size_t step = (size_t) put < iov->iov_len ? (size_t) put : iov->iov_len;
+			iov->iov_base = (unsigned char*) iov->iov_base + step;
+			iov->iov_len -= step;
+			put -= step;
+			if (iov->iov_len == 0) {
+				++iov;
+				--iovcnt;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: checks a version 2 header read from disk
+ * INPUTS:
+ *	h: the header
+ *  file_len: size of the file, 0 when it is not known
+ * RETURN:
+ *  If the header is intact and describes something this build can load then true
+ *  else false with the reason printed.
+ *
+ **/
+static bool validate_file_header (Matrix_File_Header_t* h, size_t file_len) {
+
+	if (h->endian != MATRIX_FILE_ENDIAN) {
+		printf("MATRIX FILE WAS WRITTEN ON A MACHINE WITH THE OTHER BYTE ORDER\n");
+		return false;
+	}
+	if (h->version != MATRIX_FILE_VERSION || h->header_size != MATRIX_FILE_HEADER_SIZE) {
+		printf("UNSUPPORTED MATRIX FILE VERSION %u\n", h->version);
+		return false;
+	}
+
+	const uint32_t stored_crc = h->header_crc;
+	h->header_crc = 0;
+	const uint32_t crc = matrix_kernels.crc32c(0, h, sizeof(*h));
+	h->header_crc = stored_crc;
+	if (crc != stored_crc) {
+		printf("MATRIX FILE HEADER IS CORRUPT\n");
+		return false;
+	}
+
+	const size_t elements = (size_t) h->rows * h->cols;
+	const bool csr = h->flags & MATRIX_FILE_FLAG_CSR;
+	/*a CSR payload is one tile of row offsets then two entries of 4 bytes each per nonzero*/
+	const uint64_t row_ptr_bytes = ((uint64_t) h->rows + 1) * sizeof(uint64_t);
+	const bool csr_ok = h->codec == MATRIX_CODEC_RAW && h->payload_len >= row_ptr_bytes
+		&& (h->payload_len - row_ptr_bytes) % (2 * sizeof(uint32_t)) == 0
+		&& (h->payload_len - row_ptr_bytes) / (2 * sizeof(uint32_t)) <= elements;
+	const uint64_t expected_tiles = csr ? 1 : file_num_tiles(h->rows, h->cols, h->tile_rows);
+	/*only u32 matrices are encoded or sparse, and the raw size must not wrap*/
+	size_t raw_bytes = 0;
+	const bool type_ok = matrix_data_bytes(h->rows, h->cols, h->elem_type, &raw_bytes)
+		&& h->elem_size == matrix_type_size(h->elem_type)
+		&& (h->elem_type == MATRIX_U32 || (h->codec == MATRIX_CODEC_RAW && !csr));
+	if (!type_ok || h->codec > MATRIX_CODEC_DELTA
+		|| (h->flags & ~MATRIX_FILE_FLAG_CSR) || (csr && !csr_ok)
+		|| (!csr && elements && h->tile_rows == 0) || h->num_tiles != expected_tiles
+		|| strnlen(h->name, MATRIX_FILE_NAME_LEN) >= MATRIX_NAME_LEN
+		|| h->payload_offset % MATRIX_FILE_ALIGN != 0
+		|| (!csr && h->codec == MATRIX_CODEC_RAW && h->payload_len != raw_bytes)
+		|| h->dir_offset + (uint64_t) h->num_tiles * sizeof(Matrix_Tile_Entry_t) > h->payload_offset) {
+		printf("MATRIX FILE HEADER IS INVALID\n");
+		return false;
+	}
+	if (file_len && h->payload_offset + h->payload_len > file_len) {
+		printf("MATRIX FILE IS TRUNCATED\n");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: first row and row count of a tile
+ * INPUTS:
+ *	h: the file header
+ *  tile: tile index
+ *  first_row, num_rows: receive the band of rows the tile covers
+ * RETURN:
+ *  void
+ *
+ **/
+static void tile_rows_of (const Matrix_File_Header_t* h, size_t tile, size_t* first_row, size_t* num_rows) {
+	*first_row = tile * h->tile_rows;
+	*num_rows = h->rows - *first_row < h->tile_rows ? h->rows - *first_row : h->tile_rows;
+}
+
+/*
+ * PURPOSE: checks a directory entry against where its tile has to be, a raw
+ *          tile sits at a fixed place and an encoded one anywhere in the
+ *          payload no longer than its worst case encoding, a CSR file has
+ *          the whole payload as its one tile
+ * INPUTS:
+ *	h: the file header
+ *  e: the entry
+ *  tile: its index
+ * RETURN:
+ *  If the entry fits the layout then true
+ *  else false.
+ *
+ **/
+static bool tile_entry_is_sane (const Matrix_File_Header_t* h, const Matrix_Tile_Entry_t* e, size_t tile) {
+	size_t first_row = 0;
+	size_t num_rows = 0;
+	tile_rows_of(h, tile, &first_row, &num_rows);
+	const uint64_t row_bytes = (uint64_t) h->cols * h->elem_size;
+	if (h->flags & MATRIX_FILE_FLAG_CSR) {
+		return e->offset == h->payload_offset && e->length == h->payload_len;
+	}
+	if (h->codec == MATRIX_CODEC_RAW) {
+		return e->offset == h->payload_offset + first_row * row_bytes
+			&& e->length == num_rows * row_bytes;
+	}
+	return e->offset >= h->payload_offset
+		&& e->length <= codec_bound(h->codec, num_rows * h->cols)
+		&& e->offset + e->length <= h->payload_offset + h->payload_len;
+}
+
+/*
+ * PURPOSE: reads one stored tile, checks its CRC and decodes it if needed
+ * INPUTS:
+ *	fd: the open file
+ *  h: the file header
+ *  e: the tile's directory entry
+ *  dst: destination for the tile's values, of the file's element type
+ *  n: number of values in the tile
+ * RETURN:
+ *  If the tile was read, matched its CRC and decoded then true
+ *  else false.
+ *
+ **/
+static bool load_tile (int fd, const Matrix_File_Header_t* h, const Matrix_Tile_Entry_t* e,
+		void* dst, size_t n) {
+
+	if (h->codec == MATRIX_CODEC_RAW) {
+		return read_full(fd, dst, e->length, e->offset)
+			&& matrix_kernels.crc32c(0, dst, e->length) == e->crc;
+	}
+
+	unsigned char* stored = malloc(e->length ? e->length : 1);
+	if (!stored) {
+		return false;
+	}
+	bool ok = read_full(fd, stored, e->length, e->offset)
+		&& matrix_kernels.crc32c(0, stored, e->length) == e->crc
+		&& decode_tile(h->codec, stored, e->length, dst, n);
+	free(stored);
+	return ok;
+}
+
+/*
+ * PURPOSE: reads the version 2 header and tile directory of an open file
+ * INPUTS:
+ *	fd: the open file
+ *  h: receives the header
+ *  entries: receives a calloc'd directory the caller frees
+ * RETURN:
+ *  If both were read and make sense then true
+ *  else false.
+ *
+ **/
+bool read_file_header (int fd, Matrix_File_Header_t* h, Matrix_Tile_Entry_t** entries) {
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !read_full(fd, h, sizeof(*h), 0)) {
+		print_file_error("FAILED TO READ MATRIX HEADER");
+		return false;
+	}
+	if (memcmp(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic)) != 0
+		|| !validate_file_header(h, st.st_size)) {
+		return false;
+	}
+
+	*entries = calloc(h->num_tiles ? h->num_tiles : 1, sizeof(Matrix_Tile_Entry_t));
+	if (!(*entries)) {
+		return false;
+	}
+	if (!read_full(fd, *entries, h->num_tiles * sizeof(Matrix_Tile_Entry_t), h->dir_offset)) {
+		print_file_error("FAILED TO READ MATRIX TILE DIRECTORY");
+		free(*entries);
+		return false;
+	}
+	for (size_t i = 0; i < h->num_tiles; ++i) {
+		if (!tile_entry_is_sane(h, &(*entries)[i], i)) {
+			printf("MATRIX TILE DIRECTORY IS INVALID\n");
+			free(*entries);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Tile tasks for parallel_for, the range is in elements and every chunk
+ * is one whole tile so the tile index is begin / chunk. data is in bytes
+ * since the element width comes from the header.
+ */
+typedef struct {
+	int fd;
+	const Matrix_File_Header_t* h;
+	Matrix_Tile_Entry_t* entries;
+	unsigned char* data;
+	size_t elements;
+	size_t tile_elements;
+	unsigned char** stored;	/*encoded tiles when writing with a codec*/
+	bool failed;
+}Matrix_Tile_Task_t;
+
+/*where a tile's values start in the matrix*/
+static unsigned char* tile_data (const Matrix_Tile_Task_t* t, size_t tile) {
+	return &t->data[tile * t->tile_elements * t->h->elem_size];
+}
+
+/*number of values in a tile, the last one may be short*/
+static size_t tile_length (const Matrix_Tile_Task_t* t, size_t tile) {
+	const size_t first = tile * t->tile_elements;
+	return t->elements - first < t->tile_elements ? t->elements - first : t->tile_elements;
+}
+
+static void read_tiles_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Tile_Task_t* t = ctx;
+	for (size_t tile = begin / t->tile_elements; tile * t->tile_elements < end; ++tile) {
+		if (!load_tile(t->fd, t->h, &t->entries[tile], tile_data(t, tile), tile_length(t, tile))) {
+			__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+static void verify_tiles_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Tile_Task_t* t = ctx;
+	for (size_t tile = begin / t->tile_elements; tile * t->tile_elements < end; ++tile) {
+		const Matrix_Tile_Entry_t* e = &t->entries[tile];
+		if (matrix_kernels.crc32c(0, tile_data(t, tile), e->length) != e->crc) {
+			__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+static void checksum_tiles_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Tile_Task_t* t = ctx;
+	for (size_t tile = begin / t->tile_elements; tile * t->tile_elements < end; ++tile) {
+		Matrix_Tile_Entry_t* e = &t->entries[tile];
+		e->crc = matrix_kernels.crc32c(0, tile_data(t, tile), e->length);
+	}
+}
+
+static void encode_tiles_task (void* ctx, size_t begin, size_t end) {
+	Matrix_Tile_Task_t* t = ctx;
+	for (size_t tile = begin / t->tile_elements; tile * t->tile_elements < end; ++tile) {
+		const size_t n = tile_length(t, tile);
+		Matrix_Tile_Entry_t* e = &t->entries[tile];
+		t->stored[tile] = malloc(codec_bound(t->h->codec, n));
+		if (!t->stored[tile]) {
+			__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+			return;
+		}
+		e->length = encode_tile(t->h->codec, (const unsigned int*) tile_data(t, tile), n, t->stored[tile]);
+		e->crc = matrix_kernels.crc32c(0, t->stored[tile], e->length);
+	}
+}
+
+/*
+ * PURPOSE: loads the CSR payload of a version 2 file into a sparse matrix
+ * INPUTS:
+ *	fd: the open file
+ *  h: the validated header
+ *  e: the single tile entry covering the payload
+ *  m: receives the new matrix
+ * RETURN:
+ *  If the payload was read, matched its CRC and is consistent then true
+ *  else false.
+ *
+ **/
+static bool read_sparse_matrix (int fd, const Matrix_File_Header_t* h, const Matrix_Tile_Entry_t* e,
+		Matrix_t** m) {
+
+	const size_t row_ptr_bytes = ((size_t) h->rows + 1) * sizeof(uint64_t);
+	const size_t nnz = (h->payload_len - row_ptr_bytes) / (2 * sizeof(uint32_t));
+	if (!create_sparse_matrix(m, h->name, h->rows, h->cols)) {
+		return false;
+	}
+	free_sparse(&(*m)->sparse);
+	if (!alloc_sparse(&(*m)->sparse, h->rows, nnz)) {
+		destroy_matrix(m);
+		return false;
+	}
+
+	Matrix_Sparse_t* s = (*m)->sparse;
+	const size_t entry_bytes = nnz * sizeof(uint32_t);
+	bool ok = io_transfer(fd, false, s->row_ptr, row_ptr_bytes, e->offset)
+		&& io_transfer(fd, false, s->col_idx, entry_bytes, e->offset + row_ptr_bytes)
+		&& io_transfer(fd, false, s->values, entry_bytes, e->offset + row_ptr_bytes + entry_bytes);
+	if (ok) {
+		unsigned int crc = matrix_kernels.crc32c(0, s->row_ptr, row_ptr_bytes);
+		crc = matrix_kernels.crc32c(crc, s->col_idx, entry_bytes);
+		crc = matrix_kernels.crc32c(crc, s->values, entry_bytes);
+		ok = crc == e->crc && sparse_is_well_formed(s, h->rows, h->cols);
+	}
+	if (!ok) {
+		printf("MATRIX FILE DATA IS CORRUPT OR TRUNCATED\n");
+		destroy_matrix(m);
+	}
+	return ok;
+}
+
+/*
+ * PURPOSE: loads a version 2 file, every tile is checked against its CRC
+ * INPUTS:
+ *	fd: the open file
+ *  m: receives the new matrix
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool read_tiled_matrix (int fd, Matrix_t** m) {
+
+	Matrix_File_Header_t h;
+	Matrix_Tile_Entry_t* entries = NULL;
+	if (!read_file_header(fd, &h, &entries)) {
+		return false;
+	}
+
+	if (h.flags & MATRIX_FILE_FLAG_CSR) {
+		bool ok = read_sparse_matrix(fd, &h, &entries[0], m);
+		free(entries);
+		return ok;
+	}
+
+	if (!create_matrix_for_overwrite(m, h.name, h.rows, h.cols, h.elem_type)) {
+		free(entries);
+		return false;
+	}
+
+	/*
+	 * a raw payload is the matrix as it is, it comes in through the I/O queue
+	 * and the tiles are checked on the pool after, encoded tiles are read and
+	 * decoded on the pool, each chunk is one tile
+	 */
+	Matrix_Tile_Task_t t = { .fd = fd, .h = &h, .entries = entries, .data = (unsigned char*) (*m)->data,
+		.elements = (size_t) h.rows * h.cols, .tile_elements = (size_t) h.tile_rows * h.cols };
+	if (h.codec == MATRIX_CODEC_RAW) {
+		t.failed = !io_transfer(fd, false, t.data, h.payload_len, h.payload_offset);
+		if (!t.failed) {
+			parallel_for(t.elements, t.tile_elements, verify_tiles_task, &t);
+		}
+	}
+	else {
+		parallel_for(t.elements, t.tile_elements, read_tiles_task, &t);
+	}
+	free(entries);
+
+	if (t.failed) {
+		printf("MATRIX FILE DATA IS CORRUPT OR TRUNCATED\n");
+		destroy_matrix(m);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: loads the legacy layout from an open file
+ * INPUTS:
+ *	fd: the open file
+ *  header: the start of the file
+ *  header_len: bytes of header that were read
+ *  m: receives the new matrix
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+static bool read_legacy_matrix (int fd, const unsigned char* header, size_t header_len, Matrix_t** m) {
+
+	char name_buffer[MATRIX_NAME_LEN];
+	unsigned int rows = 0;
+	unsigned int cols = 0;
+	size_t payload_offset = 0;
+	if (!parse_legacy_header(header, header_len, name_buffer, &rows, &cols, &payload_offset)) {
+		print_file_error("FAILED TO READ MATRIX HEADER");
+		return false;
+	}
+
+	if (!create_matrix_for_overwrite(m,name_buffer,rows,cols,MATRIX_U32)) {
+		return false;
+	}
+
+	/*no staging buffer, the payload lands in the matrix itself*/
+	/*create_matrix_for_overwrite has already checked that the size fits*/
+	size_t bytes = 0;
+	matrix_data_bytes(rows, cols, MATRIX_U32, &bytes);
+	if (!io_transfer(fd, false, (*m)->data, bytes, payload_offset)) {
+		print_file_error("FAILED TO READ MATRIX DATA");
+		destroy_matrix(m);
+		return false;
+	}
+	return true;
+}
+
+	//TODO FUNCTION COMMENT
+ /*
+ * PURPOSE: reads a matrix file in either the tiled or the legacy layout
+ *          straight into a new matrix
+ * INPUTS:
+ *	matrix_input_filename: pointer to the name of the file to open
+ *  m: pointer to a pointer to the matrix that the new read in data with be loaded into
+ * RETURN:
+ *  If no errors with input or reading in the data from the file then true
+ *  else false.
+ *
+ **/
+bool read_matrix (const char* matrix_input_filename, Matrix_t** m) {
+
+	//TODO ERROR CHECK INCOMING PARAMETERS
+	if(!matrix_input_filename || !m){
+		return false;
+	}
+	//#####################################
+
+
+	int fd = open(matrix_input_filename,O_RDONLY);
+	if (fd < 0) {
+		print_file_error("FAILED TO OPEN FOR READING");
+		return false;
+	}
+
+	/*either header fits in one read, the magic tells them apart*/
+	unsigned char header[MATRIX_FILE_HEADER_SIZE];
+	ssize_t header_len = read(fd, header, sizeof(header));
+	bool ok = false;
+	if (header_len < 0) {
+		print_file_error("FAILED TO READ MATRIX HEADER");
+	}
+	else if (header_len >= (ssize_t) sizeof(Matrix_File_Header_t)
+		&& memcmp(header, MATRIX_FILE_MAGIC, strlen(MATRIX_FILE_MAGIC)) == 0) {
+		ok = read_tiled_matrix(fd, m);
+	}
+	else {
+		ok = read_legacy_matrix(fd, header, header_len, m);
+	}
+
+	if (close(fd) && ok) {
+		destroy_matrix(m);
+		return false;
+	}
+	return ok;
+}
+
+/*
+ * PURPOSE: maps a matrix file into memory and points the matrix data at the
+ *          payload, nothing is copied up front and pages are faulted in on
+ *          first touch. The mapping is private so the first write to a page
+ *          copies just that page and the file is never changed.
+ * INPUTS:
+ *	matrix_input_filename: pointer to the name of the file to map
+ *  m: pointer to a pointer to the matrix that will view the file
+ * RETURN:
+ *  If no errors with input or mapping the file then true
+ *  else false.
+ *
+ * NOTE:: tile checksums are not verified here since that would touch every
+ *        page, use read_matrix for a checked load. Encoded and CSR files and legacy
+ *        payloads that do not start on a 4 byte boundary cannot be used as
+ *        an unsigned int array, those files are read with read_matrix.
+ **/
+bool read_matrix_mapped (const char* matrix_input_filename, Matrix_t** m) {
+
+	if(!matrix_input_filename || !m){
+		return false;
+	}
+
+	int fd = open(matrix_input_filename,O_RDONLY);
+	if (fd < 0) {
+		print_file_error("FAILED TO OPEN FOR READING");
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		print_file_error("FAILED TO STAT MATRIX FILE");
+		close(fd);
+		return false;
+	}
+
+	const size_t file_len = st.st_size;
+	unsigned char* base = mmap(NULL, file_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	/*the mapping holds its own reference to the file*/
+	close(fd);
+	if (base == MAP_FAILED) {
+		print_file_error("FAILED TO MAP MATRIX FILE");
+		return false;
+	}
+
+	char name_buffer[MATRIX_NAME_LEN];
+	unsigned int rows = 0;
+	unsigned int cols = 0;
+	size_t payload_offset = 0;
+	Matrix_Type_t type = MATRIX_U32;
+	bool usable = false;
+	bool copy = false;
+	if (file_len >= sizeof(Matrix_File_Header_t)
+		&& memcmp(base, MATRIX_FILE_MAGIC, strlen(MATRIX_FILE_MAGIC)) == 0) {
+		Matrix_File_Header_t h;
+		memcpy(&h, base, sizeof(h));
+		if (!validate_file_header(&h, file_len)) {
+			munmap(base, file_len);
+			return false;
+		}
+		strncpy(name_buffer, h.name, MATRIX_NAME_LEN);
+		rows = h.rows;
+		cols = h.cols;
+		payload_offset = h.payload_offset;
+		type = h.elem_type;
+		copy = h.codec != MATRIX_CODEC_RAW || (h.flags & MATRIX_FILE_FLAG_CSR);
+		usable = true;
+	}
+	else if (parse_legacy_header(base, file_len, name_buffer, &rows, &cols, &payload_offset)) {
+		size_t bytes = 0;
+		usable = matrix_data_bytes(rows, cols, MATRIX_U32, &bytes) && file_len - payload_offset >= bytes;
+	}
+
+	if (!usable) {
+		printf("FAILED TO READ MATRIX HEADER\n");
+		munmap(base, file_len);
+		return false;
+	}
+
+	if (copy || payload_offset % sizeof(unsigned int) != 0) {
+		munmap(base, file_len);
+		return read_matrix(matrix_input_filename, m);
+	}
+
+	*m = memory_alloc(sizeof(Matrix_t), true);
+	if (!(*m)) {
+		munmap(base, file_len);
+		return false;
+	}
+	strncpy((*m)->name, name_buffer, MATRIX_NAME_LEN);
+	(*m)->rows = rows;
+	(*m)->cols = cols;
+	(*m)->type = type;
+	(*m)->data = (unsigned int*) &base[payload_offset];
+	(*m)->mapping = base;
+	(*m)->mapping_len = file_len;
+	return true;
+}
+
+/*
+ * PURPOSE: reads a single tile of a version 2 file as a matrix of its own
+ * INPUTS:
+ *	matrix_input_filename: the file to read from
+ *  tile: index of the tile, counting from 0
+ *  name: name given to the new matrix
+ *  m: receives the new matrix, tile_rows by cols or fewer rows for the last tile
+ * RETURN:
+ *  If the tile exists and its checksum matches then true
+ *  else false.
+ *
+ **/
+bool read_matrix_tile (const char* matrix_input_filename, unsigned int tile, const char* name,
+		Matrix_t** m) {
+
+	if (!matrix_input_filename || !name || !m) {
+		return false;
+	}
+
+	int fd = open(matrix_input_filename, O_RDONLY);
+	if (fd < 0) {
+		print_file_error("FAILED TO OPEN FOR READING");
+		return false;
+	}
+
+	Matrix_File_Header_t h;
+	Matrix_Tile_Entry_t* entries = NULL;
+	if (!read_file_header(fd, &h, &entries)) {
+		close(fd);
+		return false;
+	}
+	if (h.flags & MATRIX_FILE_FLAG_CSR) {
+		printf("SPARSE MATRIX FILES CAN ONLY BE READ WHOLE\n");
+		free(entries);
+		close(fd);
+		return false;
+	}
+	if (tile >= h.num_tiles) {
+		printf("MATRIX FILE HAS %u TILES\n", h.num_tiles);
+		free(entries);
+		close(fd);
+		return false;
+	}
+
+	size_t first_row = 0;
+	size_t num_rows = 0;
+	tile_rows_of(&h, tile, &first_row, &num_rows);
+	bool ok = create_matrix_for_overwrite(m, name, num_rows, h.cols, h.elem_type);
+	if (ok && !load_tile(fd, &h, &entries[tile], (*m)->data, num_rows * h.cols)) {
+		printf("MATRIX TILE %u IS CORRUPT OR TRUNCATED\n", tile);
+		destroy_matrix(m);
+		ok = false;
+	}
+
+	free(entries);
+	close(fd);
+	return ok;
+}
+
+/*
+ * PURPOSE: fills in the header fields every version 2 file shares
+ * INPUTS:
+ *	h: the header to fill, cleared first
+ *  m: the matrix being written
+ * RETURN:
+ *  void
+ *
+ **/
+void init_file_header (Matrix_File_Header_t* h, const Matrix_t* m) {
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic));
+	h->version = MATRIX_FILE_VERSION;
+	h->endian = MATRIX_FILE_ENDIAN;
+	h->header_size = MATRIX_FILE_HEADER_SIZE;
+	h->rows = m->rows;
+	h->cols = m->cols;
+	h->elem_size = matrix_type_size(m->type);
+	h->elem_type = m->type;
+	h->dir_offset = MATRIX_FILE_HEADER_SIZE;
+	strncpy(h->name, m->name, MATRIX_FILE_NAME_LEN - 1);
+}
+
+/*
+ * PURPOSE: rows in each tile of a raw or encoded file, about MATRIX_TILE_BYTES
+ *          of elements and never less than a whole row
+ * INPUTS:
+ *	row_bytes: bytes in one row of the matrix
+ * RETURN:
+ *  the rows per tile
+ *
+ **/
+unsigned int file_tile_rows (size_t row_bytes) {
+	return row_bytes == 0 || row_bytes >= MATRIX_TILE_BYTES ? 1 : MATRIX_TILE_BYTES / row_bytes;
+}
+
+/*
+ * PURPOSE: tiles a dense matrix is split into, counted in 64 bits so a row
+ *          count near UINT_MAX does not wrap to a handful of tiles
+ * INPUTS:
+ *	rows, cols: size of the matrix
+ *  tile_rows: rows per tile
+ * RETURN:
+ *  the tile count, 0 for an empty matrix or no rows per tile. The caller
+ *  refuses a count that does not fit num_tiles of the header.
+ *
+ **/
+uint64_t file_num_tiles (uint32_t rows, uint32_t cols, uint32_t tile_rows) {
+	if ((uint64_t) rows * cols == 0 || tile_rows == 0) {
+		return 0;
+	}
+	return ((uint64_t) rows + tile_rows - 1) / tile_rows;
+}
+
+/*
+ * PURPOSE: writes a sparse matrix as a single CSR tile, the three arrays go
+ *          out from where they live
+ * INPUTS:
+ *	matrix_output_filename: name of the file to write
+ *  m: the sparse matrix
+ * RETURN:
+ *  If no errors with opening and writing file then true
+ *  else false.
+ *
+ **/
+static bool write_sparse_matrix (const char* matrix_output_filename, Matrix_t* m) {
+
+	const Matrix_Sparse_t* s = m->sparse;
+	const size_t row_ptr_bytes = ((size_t) m->rows + 1) * sizeof(uint64_t);
+	const size_t entry_bytes = s->nnz * sizeof(uint32_t);
+
+	Matrix_File_Header_t h;
+	init_file_header(&h, m);
+	h.flags = MATRIX_FILE_FLAG_CSR;
+	h.codec = MATRIX_CODEC_RAW;
+	h.tile_rows = m->rows;
+	h.num_tiles = 1;
+	h.payload_offset = MATRIX_FILE_ALIGN;
+	h.payload_len = row_ptr_bytes + 2 * entry_bytes;
+
+	Matrix_Tile_Entry_t entry = { .offset = h.payload_offset, .length = h.payload_len };
+	entry.crc = matrix_kernels.crc32c(0, s->row_ptr, row_ptr_bytes);
+	entry.crc = matrix_kernels.crc32c(entry.crc, s->col_idx, entry_bytes);
+	entry.crc = matrix_kernels.crc32c(entry.crc, s->values, entry_bytes);
+	h.header_crc = matrix_kernels.crc32c(0, &h, sizeof(h));
+
+	char temp[PATH_MAX];
+	int fd = open_replacement(matrix_output_filename, temp);
+	if (fd < 0) {
+		print_file_error("FAILED TO CREATE/OPEN FILE FOR WRITING");
+		return false;
+	}
+
+	struct iovec iov[6] = {
+		{ &h, sizeof(h) },
+		{ &entry, sizeof(entry) },
+		{ (void*) zero_page, h.payload_offset - MATRIX_FILE_HEADER_SIZE - sizeof(entry) },
+		{ s->row_ptr, row_ptr_bytes },
+		{ s->col_idx, entry_bytes },
+		{ s->values, entry_bytes }
+	};
+	bool ok = write_full_iov(fd, iov, 6);
+	if (!ok) {
+		print_file_error("FAILED TO WRITE MATRIX TO FILE");
+	}
+	if (close(fd)) {
+		ok = false;
+	}
+	return finish_replacement(temp, matrix_output_filename, ok);
+}
+
+	//TODO FUNCTION COMMENT
+ /*
+ * PURPOSE: writes the matrix in the tiled version 2 layout. A raw payload is
+ *          written from where it already lives so no staging copy is made,
+ *          with a codec each tile is encoded on the pool first. A sparse
+ *          matrix is always written as CSR and a matrix on disk or of
+ *          another element type than u32 always raw, the codec is ignored
+ *          for those. The file is written beside the old one and renamed
+ *          over it, so a matrix mapped from the old one keeps working.
+ * INPUTS:
+ *	m: pointer to the matrix to write its data to a file
+ *  matrix_output_filename: name of the file to write data out to
+ *  codec: how the tiles are stored
+ * RETURN:
+ *  If no errors with opening and writing file then true
+ *  else false with errors.
+ *
+ **/
+bool write_matrix (const char* matrix_output_filename, Matrix_t* m, Matrix_Codec_t codec) {
+
+	//TODO ERROR CHECK INCOMING PARAMETERS
+	if(!matrix_output_filename || !m || (!m->data && !m->sparse && !m->disk) || codec > MATRIX_CODEC_DELTA){
+		return false;
+	}
+	//####################################
+
+	if (m->disk) {
+		return write_disk_matrix(matrix_output_filename, m);
+	}
+	if (m->sparse) {
+		return write_sparse_matrix(matrix_output_filename, m);
+	}
+	/*tiles are written and checksummed straight from the elements*/
+	if (!compact_matrix(m)) {
+		return false;
+	}
+
+	if (m->type != MATRIX_U32) {
+		codec = MATRIX_CODEC_RAW;
+	}
+	const size_t elements = (size_t) m->rows * m->cols;
+	const size_t row_bytes = (size_t) m->cols * matrix_type_size(m->type);
+
+	Matrix_File_Header_t h;
+	init_file_header(&h, m);
+	h.tile_rows = file_tile_rows(row_bytes);
+	const uint64_t num_tiles = file_num_tiles(m->rows, m->cols, h.tile_rows);
+	if (num_tiles > UINT32_MAX) {
+		printf("Matrix (%s) has too many tiles for a file\n", m->name);
+		return false;
+	}
+	h.num_tiles = num_tiles;
+	h.codec = codec;
+	const size_t dir_len = (size_t) h.num_tiles * sizeof(Matrix_Tile_Entry_t);
+	h.payload_offset = (MATRIX_FILE_HEADER_SIZE + dir_len + MATRIX_FILE_ALIGN - 1)
+		/ MATRIX_FILE_ALIGN * MATRIX_FILE_ALIGN;
+
+	/*header, directory and padding, then one piece per encoded tile, the raw data goes through the I/O queue*/
+	const size_t num_iov = 3 + (codec == MATRIX_CODEC_RAW ? 0 : h.num_tiles);
+	Matrix_Tile_Entry_t* entries = calloc(h.num_tiles ? h.num_tiles : 1, sizeof(Matrix_Tile_Entry_t));
+	struct iovec* iov = calloc(num_iov, sizeof(struct iovec));
+	unsigned char** stored = calloc(h.num_tiles ? h.num_tiles : 1, sizeof(unsigned char*));
+	bool ok = entries && iov && stored;
+
+	Matrix_Tile_Task_t t = { .h = &h, .entries = entries, .data = (unsigned char*) m->data, .elements = elements,
+		.tile_elements = (size_t) h.tile_rows * m->cols, .stored = stored };
+	if (ok && codec == MATRIX_CODEC_RAW) {
+		for (size_t i = 0; i < h.num_tiles; ++i) {
+			size_t first_row = 0;
+			size_t num_rows = 0;
+			tile_rows_of(&h, i, &first_row, &num_rows);
+			entries[i].offset = h.payload_offset + first_row * row_bytes;
+			entries[i].length = num_rows * row_bytes;
+		}
+		parallel_for(elements, t.tile_elements, checksum_tiles_task, &t);
+		h.payload_len = elements * h.elem_size;
+	}
+	else if (ok) {
+		parallel_for(elements, t.tile_elements, encode_tiles_task, &t);
+		ok = !t.failed;
+		for (size_t i = 0; ok && i < h.num_tiles; ++i) {
+			entries[i].offset = h.payload_offset + h.payload_len;
+			h.payload_len += entries[i].length;
+			iov[3 + i].iov_base = stored[i];
+			iov[3 + i].iov_len = entries[i].length;
+		}
+	}
+	h.header_crc = matrix_kernels.crc32c(0, &h, sizeof(h));
+
+	char temp[PATH_MAX];
+	int fd = -1;
+	if (ok) {
+		fd = open_replacement(matrix_output_filename, temp);
+		/* ERROR HANDLING USING errorno*/
+		if (fd < 0) {
+			print_file_error("FAILED TO CREATE/OPEN FILE FOR WRITING");
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		iov[0].iov_base = &h;
+		iov[0].iov_len = sizeof(h);
+		iov[1].iov_base = entries;
+		iov[1].iov_len = dir_len;
+		iov[2].iov_base = (void*) zero_page;
+		iov[2].iov_len = h.payload_offset - MATRIX_FILE_HEADER_SIZE - dir_len;
+		if (!write_full_iov(fd, iov, num_iov) || (codec == MATRIX_CODEC_RAW
+			&& !io_transfer(fd, true, m->data, h.payload_len, h.payload_offset))) {
+			print_file_error("FAILED TO WRITE MATRIX TO FILE");
+			ok = false;
+		}
+	}
+
+	for (size_t i = 0; stored && i < h.num_tiles; ++i) {
+		free(stored[i]);
+	}
+	free(stored);
+	free(iov);
+	free(entries);
+	if (fd < 0) {
+		return false;
+	}
+	if (close(fd)) {
+		ok = false;
+	}
+	return finish_replacement(temp, matrix_output_filename, ok);
+}
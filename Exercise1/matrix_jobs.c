@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "catalogue.h"
+#include "io_queue.h"
+#include "matrix.h"
+#include "matrix_jobs.h"
+#include "matrix_memory.h"
+
+/*
+ * Jobs are kept in start order. Only the calling thread touches the list,
+ * a job thread only writes its own done counter and finished flag.
+ */
+typedef struct Matrix_Job {
+	unsigned int id;
+	bool write;
+	char* file;
+	Matrix_t* m;		/*the snapshot being written, or the matrix read*/
+	Matrix_Codec_t codec;
+	size_t total;		/*bytes expected through the I/O queue, 0 when unknown*/
+	size_t done;		/*bytes moved so far*/
+	unsigned long long start_ns;
+	pthread_t thread;
+	bool finished;
+	bool ok;
+	struct Matrix_Job* next;
+}Matrix_Job_t;
+
+static Matrix_Job_t* jobs = NULL;
+static unsigned int last_id = 0;
+
+static unsigned long long now_ns (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void* job_thread (void* arg) {
+	Matrix_Job_t* j = arg;
+	io_track(&j->done);
+	const bool ok = j->write ? write_matrix(j->file, j->m, j->codec) : read_matrix(j->file, &j->m);
+	io_track(NULL);
+	j->ok = ok;
+	__atomic_store_n(&j->finished, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void free_job (Matrix_Job_t* j) {
+	if (j->m) {
+		destroy_matrix(&j->m);
+	}
+	free(j->file);
+	free(j);
+}
+
+/*
+ * PURPOSE: starts a job thread and puts the job at the end of the list
+ * INPUTS:
+ *	j: the job, freed if the thread does not start
+ *  id: receives the job number
+ * RETURN:
+ *  If the thread started then true
+ *  else false.
+ *
+ **/
+static bool launch_job (Matrix_Job_t* j, unsigned int* id) {
+	j->start_ns = now_ns();
+	j->id = last_id + 1;
+	if (pthread_create(&j->thread, NULL, job_thread, j) != 0) {
+		free_job(j);
+		return false;
+	}
+	last_id = j->id;
+	Matrix_Job_t** tail = &jobs;
+	while (*tail) {
+		tail = &(*tail)->next;
+	}
+	*tail = j;
+	if (id) {
+		*id = j->id;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: reads a matrix file in the background, the matrix joins the
+ *          catalogue once the job is collected
+ * INPUTS:
+ *	matrix_input_filename: the file to read
+ *  id: receives the job number
+ * RETURN:
+ *  If the job started then true
+ *  else false.
+ *
+ **/
+bool start_read_job (const char* matrix_input_filename, unsigned int* id) {
+
+	if (!matrix_input_filename) {
+		return false;
+	}
+	Matrix_Job_t* j = calloc(1, sizeof(Matrix_Job_t));
+	if (!j || !(j->file = strdup(matrix_input_filename))) {
+		free(j);
+		return false;
+	}
+	/*progress is measured against the size of the file*/
+	struct stat st;
+	if (stat(matrix_input_filename, &st) == 0) {
+		j->total = st.st_size;
+	}
+	return launch_job(j, id);
+}
+
+/*
+ * PURPOSE: writes a matrix to the file of its name in the background. The
+ *          job writes a duplicate that shares the elements, so the matrix
+ *          can be changed or deleted straight away without touching what
+ *          is written.
+ * INPUTS:
+ *	m: the matrix
+ *  codec: how the tiles are stored, as for write_matrix
+ *  id: receives the job number
+ * RETURN:
+ *  If the job started then true
+ *  else false.
+ *
+ **/
+bool start_write_job (Matrix_t* m, Matrix_Codec_t codec, unsigned int* id) {
+
+	if (!m || codec > MATRIX_CODEC_DELTA) {
+		return false;
+	}
+	Matrix_Job_t* j = calloc(1, sizeof(Matrix_Job_t));
+	if (!j || !(j->file = strdup(m->name))) {
+		free(j);
+		return false;
+	}
+	j->write = true;
+	j->codec = codec;
+	j->m = memory_alloc(sizeof(Matrix_t), true);
+	if (!j->m) {
+		free_job(j);
+		return false;
+	}
+	strncpy(j->m->name, m->name, MATRIX_NAME_LEN);
+	if (!duplicate_matrix(m, j->m)) {
+		free_job(j);
+		return false;
+	}
+	/*only raw dense payloads go through the queue, the rest shows no progress until done*/
+	if (j->m->data && (codec == MATRIX_CODEC_RAW || j->m->type != MATRIX_U32)) {
+		matrix_data_bytes(j->m->rows, j->m->cols, j->m->type, &j->total);
+	}
+	return launch_job(j, id);
+}
+
+/*
+ * PURPOSE: prints every job not collected yet with how far it has got
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+void list_jobs (void) {
+	if (!jobs) {
+		printf("No jobs\n");
+		return;
+	}
+	const unsigned long long now = now_ns();
+	for (const Matrix_Job_t* j = jobs; j; j = j->next) {
+		const bool finished = __atomic_load_n(&j->finished, __ATOMIC_ACQUIRE);
+		const size_t done = __atomic_load_n(&j->done, __ATOMIC_RELAXED);
+		const double seconds = (now - j->start_ns) / 1e9;
+		printf("[%u] %s %s: ", j->id, j->write ? "write" : "read", j->file);
+		if (finished) {
+			printf("%s", j->ok ? "done" : "failed");
+		}
+		else if (j->total) {
+			printf("%.1f%%", 100.0 * (done < j->total ? done : j->total) / j->total);
+		}
+		else {
+			printf("running");
+		}
+		printf(", %.1f MB in %.2f s (%.1f MB/s) through %s\n", done / 1e6, seconds,
+			seconds > 0 ? done / 1e6 / seconds : 0.0, io_backend());
+	}
+}
+
+/*
+ * PURPOSE: joins a finished job and reports it, a matrix that was read
+ *          goes into the catalogue
+ * INPUTS:
+ *	mats: the catalogue
+ *  j: the job, freed
+ * RETURN:
+ *  If the job succeeded then true
+ *  else false.
+ *
+ **/
+static bool finish_job (Matrix_Catalogue_t* mats, Matrix_Job_t* j) {
+	pthread_join(j->thread, NULL);
+	bool ok = j->ok;
+	if (!ok) {
+		printf("[%u] Failed to %s (%s)\n", j->id, j->write ? "write" : "read", j->file);
+	}
+	else if (j->write) {
+		printf("[%u] Matrix (%s) is wrote out to the filesystem\n", j->id, j->file);
+	}
+	else if (!insert_matrix(mats, j->m)) {
+		printf("[%u] Failure to add the new matrix to the catalogue\n", j->id);
+		ok = false;
+	}
+	else {
+		printf("[%u] Matrix (%s) is read from the filesystem\n", j->id, j->file);
+		j->m = NULL;
+	}
+	free_job(j);
+	return ok;
+}
+
+/*
+ * PURPOSE: waits for a job, or for all of them, and collects it
+ * INPUTS:
+ *	mats: the catalogue read matrices go into
+ *  id: the job, 0 for every job
+ * RETURN:
+ *  If the jobs waited for exist and succeeded then true
+ *  else false.
+ *
+ **/
+bool wait_jobs (Matrix_Catalogue_t* mats, unsigned int id) {
+	bool ok = true;
+	bool found = id == 0;
+	for (Matrix_Job_t** link = &jobs; *link; ) {
+		Matrix_Job_t* j = *link;
+		if (id != 0 && j->id != id) {
+			link = &j->next;
+			continue;
+		}
+		found = true;
+		*link = j->next;
+		ok = finish_job(mats, j) && ok;
+	}
+	return ok && found;
+}
+
+/*
+ * PURPOSE: collects the jobs that have finished without waiting for the others
+ * INPUTS:
+ *	mats: the catalogue read matrices go into
+ * RETURN:
+ *  void
+ *
+ **/
+void collect_jobs (Matrix_Catalogue_t* mats) {
+	for (Matrix_Job_t** link = &jobs; *link; ) {
+		Matrix_Job_t* j = *link;
+		if (!__atomic_load_n(&j->finished, __ATOMIC_ACQUIRE)) {
+			link = &j->next;
+			continue;
+		}
+		*link = j->next;
+		finish_job(mats, j);
+	}
+}
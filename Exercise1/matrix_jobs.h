@@ -0,0 +1,23 @@
+#ifndef _MATRIX_JOBS_H_
+#define _MATRIX_JOBS_H_
+
+#include <stdbool.h>
+
+#include "catalogue.h"
+#include "matrix.h"
+
+/*
+ * Background reads and writes. Each job runs read_matrix or write_matrix
+ * on a thread of its own while the prompt carries on. A write works on a
+ * copy on write duplicate taken when it starts, so later changes to the
+ * matrix never reach the file. A read only goes into the catalogue when
+ * the job is collected on the calling thread, by collect_jobs before each
+ * command or by wait_jobs.
+ */
+bool start_read_job (const char* matrix_input_filename, unsigned int* id);
+bool start_write_job (Matrix_t* m, Matrix_Codec_t codec, unsigned int* id);
+void list_jobs (void);
+bool wait_jobs (Matrix_Catalogue_t* mats, unsigned int id);
+void collect_jobs (Matrix_Catalogue_t* mats);
+
+#endif
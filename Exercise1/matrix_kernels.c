@@ -0,0 +1,1293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <immintrin.h>
+#include <pthread.h>
+
+#include "matrix_kernels.h"
+
+/*
+ * Every kernel works on the flat data buffer, so callers hand over
+ * rows * cols elements instead of walking i * cols + j themselves.
+ * Shift counts are expected to be below 32, bitwise_shift_matrix
+ * handles the larger ones before getting here.
+ */
+
+/*Scalar fallbacks*/
+
+static void add_u32_scalar (unsigned int* c, const unsigned int* a, const unsigned int* b, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		c[i] = a[i] + b[i];
+	}
+}
+
+static void shift_left_u32_scalar (unsigned int* data, size_t n, unsigned int shift) {
+	for (size_t i = 0; i < n; ++i) {
+		data[i] <<= shift;
+	}
+}
+
+static void shift_right_u32_scalar (unsigned int* data, size_t n, unsigned int shift) {
+	for (size_t i = 0; i < n; ++i) {
+		data[i] >>= shift;
+	}
+}
+
+static bool equal_u32_scalar (const unsigned int* a, const unsigned int* b, size_t n) {
+	return memcmp(a, b, n * sizeof(unsigned int)) == 0;
+}
+
+/*folds n elements into sum, min and max, which hold the running values*/
+static void reduce_u32_scalar (const unsigned int* data, size_t n, unsigned long long* sum,
+		unsigned int* min, unsigned int* max) {
+	unsigned long long s = *sum;
+	unsigned int lo = *min;
+	unsigned int hi = *max;
+	for (size_t i = 0; i < n; ++i) {
+		s += data[i];
+		lo = data[i] < lo ? data[i] : lo;
+		hi = data[i] > hi ? data[i] : hi;
+	}
+	*sum = s;
+	*min = lo;
+	*max = hi;
+}
+
+/*acc[i] += data[i] widened to 64 bits, used for column sums*/
+static void accumulate_u32_scalar (unsigned long long* acc, const unsigned int* data, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		acc[i] += data[i];
+	}
+}
+
+static void gemm_u32_scalar (size_t kc, const unsigned int* a, const unsigned int* b,
+		unsigned int* c, size_t ldc) {
+	unsigned int acc[GEMM_MR][GEMM_NR] = {{0}};
+	for (size_t k = 0; k < kc; ++k) {
+		for (int r = 0; r < GEMM_MR; ++r) {
+			for (int j = 0; j < GEMM_NR; ++j) {
+				acc[r][j] += a[k * GEMM_MR + r] * b[k * GEMM_NR + j];
+			}
+		}
+	}
+	for (int r = 0; r < GEMM_MR; ++r) {
+		for (int j = 0; j < GEMM_NR; ++j) {
+			c[r * ldc + j] += acc[r][j];
+		}
+	}
+}
+
+static void gemm_u64_scalar (size_t kc, const unsigned int* a, const unsigned int* b,
+		unsigned long long* c, size_t ldc) {
+	unsigned long long acc[GEMM_MR][GEMM_NR] = {{0}};
+	for (size_t k = 0; k < kc; ++k) {
+		for (int r = 0; r < GEMM_MR; ++r) {
+			for (int j = 0; j < GEMM_NR; ++j) {
+				acc[r][j] += (unsigned long long) a[k * GEMM_MR + r] * b[k * GEMM_NR + j];
+			}
+		}
+	}
+	for (int r = 0; r < GEMM_MR; ++r) {
+		for (int j = 0; j < GEMM_NR; ++j) {
+			c[r * ldc + j] += acc[r][j];
+		}
+	}
+}
+
+/*
+ * Bit unpacking of one block of the stored tile codecs, see matrix_codec.h
+ * for the vertical layout. Step k of a block reads word (k * bits) / 32 of
+ * every lane and writes the eight values k * 8 .. k * 8 + 7.
+ */
+#define UNPACK_LANES 8
+#define UNPACK_STEPS 32
+
+static unsigned int unpack_mask (unsigned int bits) {
+	return bits >= 32 ? ~0u : (1u << bits) - 1;
+}
+
+static void unpack_for_u32_scalar (const unsigned int* words, unsigned int bits,
+		unsigned int reference, unsigned int* out) {
+	const unsigned int mask = unpack_mask(bits);
+	for (unsigned int k = 0; k < UNPACK_STEPS; ++k) {
+		const unsigned int w = (k * bits) / 32;
+		const unsigned int s = (k * bits) % 32;
+		for (int l = 0; l < UNPACK_LANES; ++l) {
+			unsigned int v = bits ? words[w * UNPACK_LANES + l] >> s : 0;
+			if (s + bits > 32) {
+				v |= words[(w + 1) * UNPACK_LANES + l] << (32 - s);
+			}
+			out[k * UNPACK_LANES + l] = (v & mask) + reference;
+		}
+	}
+}
+
+/*zigzag deltas eight places apart, summed back up from base*/
+static void unpack_delta_u32_scalar (const unsigned int* words, unsigned int bits,
+		const unsigned int* base, unsigned int* out) {
+	const unsigned int mask = unpack_mask(bits);
+	unsigned int prev[UNPACK_LANES];
+	memcpy(prev, base, sizeof(prev));
+	for (unsigned int k = 0; k < UNPACK_STEPS; ++k) {
+		const unsigned int w = (k * bits) / 32;
+		const unsigned int s = (k * bits) % 32;
+		for (int l = 0; l < UNPACK_LANES; ++l) {
+			unsigned int v = bits ? words[w * UNPACK_LANES + l] >> s : 0;
+			if (s + bits > 32) {
+				v |= words[(w + 1) * UNPACK_LANES + l] << (32 - s);
+			}
+			v &= mask;
+			prev[l] += (v >> 1) ^ (0u - (v & 1));
+			out[k * UNPACK_LANES + l] = prev[l];
+		}
+	}
+}
+
+/*
+ * The random generator hashes the 64 bit element index with a key taken
+ * from the seed, two rounds of a 32 bit integer hash that avalanches well,
+ * and maps the hash below span with Lemire's multiply and shift. The few
+ * draws that would bias the result are replaced by hashing again.
+ */
+static inline unsigned int random_mix (unsigned int x) {
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static inline unsigned long long random_key (unsigned long long seed) {
+	seed += 0x9e3779b97f4a7c15ull;
+	seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+	seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+	return seed ^ (seed >> 31);
+}
+
+static inline unsigned int random_at (unsigned long long key, unsigned long long index,
+		unsigned int start, unsigned int span) {
+	const unsigned int k0 = (unsigned int) key;
+	const unsigned int k1 = (unsigned int) (key >> 32);
+	unsigned int x = random_mix(random_mix((unsigned int) index + k0) ^ ((unsigned int) (index >> 32) + k1));
+	if (span == 0) {
+		return x;
+	}
+	unsigned long long m = (unsigned long long) x * span;
+	if ((unsigned int) m < span) {
+		const unsigned int threshold = -span % span;
+		while ((unsigned int) m < threshold) {
+			x = random_mix(x + k1);
+			m = (unsigned long long) x * span;
+		}
+	}
+	return start + (unsigned int) (m >> 32);
+}
+
+static void random_u32_scalar (unsigned int* dst, size_t n, unsigned long long first,
+		unsigned long long seed, unsigned int start, unsigned int span) {
+	const unsigned long long key = random_key(seed);
+	for (size_t i = 0; i < n; ++i) {
+		dst[i] = random_at(key, first + i, start, span);
+	}
+}
+
+static void transpose_u32_scalar (const unsigned int* src, size_t src_stride, unsigned int* dst,
+		size_t dst_stride, size_t rows, size_t cols) {
+	for (size_t i = 0; i < rows; ++i) {
+		for (size_t j = 0; j < cols; ++j) {
+			dst[j * dst_stride + i] = src[i * src_stride + j];
+		}
+	}
+}
+
+/*
+ * Kernels for the element types other than u32. Adds and shifts wrap
+ * within the type like the u32 ones, floats compare by value so a NaN
+ * never equals anything. i32 adds and left shifts are the u32 ones.
+ */
+#define TYPED_ADD_EQUAL_SCALAR(NAME, T) \
+static void add_##NAME##_scalar (void* c, const void* a, const void* b, size_t n) { \
+	T* pc = c; \
+	const T* pa = a; \
+	const T* pb = b; \
+	for (size_t i = 0; i < n; ++i) { \
+		pc[i] = pa[i] + pb[i]; \
+	} \
+} \
+static bool equal_##NAME##_scalar (const void* a, const void* b, size_t n) { \
+	const T* pa = a; \
+	const T* pb = b; \
+	for (size_t i = 0; i < n; ++i) { \
+		if (pa[i] != pb[i]) { \
+			return false; \
+		} \
+	} \
+	return true; \
+}
+
+#define TYPED_SHIFT_SCALAR(NAME, T) \
+static void shift_left_##NAME##_scalar (void* data, size_t n, unsigned int shift) { \
+	T* p = data; \
+	for (size_t i = 0; i < n; ++i) { \
+		p[i] = (T) (p[i] << shift); \
+	} \
+} \
+static void shift_right_##NAME##_scalar (void* data, size_t n, unsigned int shift) { \
+	T* p = data; \
+	for (size_t i = 0; i < n; ++i) { \
+		p[i] = p[i] >> shift; \
+	} \
+}
+
+TYPED_ADD_EQUAL_SCALAR(u8, uint8_t)
+TYPED_ADD_EQUAL_SCALAR(u16, uint16_t)
+TYPED_ADD_EQUAL_SCALAR(u64, uint64_t)
+TYPED_ADD_EQUAL_SCALAR(f32, float)
+TYPED_ADD_EQUAL_SCALAR(f64, double)
+TYPED_SHIFT_SCALAR(u8, uint8_t)
+TYPED_SHIFT_SCALAR(u16, uint16_t)
+TYPED_SHIFT_SCALAR(u64, uint64_t)
+
+/*the sign bit is copied in from the left*/
+static void shift_right_i32_scalar (void* data, size_t n, unsigned int shift) {
+	int32_t* p = data;
+	for (size_t i = 0; i < n; ++i) {
+		p[i] = p[i] >> shift;
+	}
+}
+
+/*reflected Castagnoli polynomial, the table is built on first use*/
+static unsigned int crc32c_table[256];
+
+static void build_crc32c_table (void) {
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned int c = i;
+		for (int k = 0; k < 8; ++k) {
+			c = c & 1 ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+		}
+		crc32c_table[i] = c;
+	}
+}
+
+static unsigned int crc32c_scalar (unsigned int crc, const void* buf, size_t len) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, build_crc32c_table);
+	const unsigned char* p = buf;
+	crc = ~crc;
+	for (size_t i = 0; i < len; ++i) {
+		crc = crc32c_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42 (unsigned int crc, const void* buf, size_t len) {
+	const unsigned char* p = buf;
+	unsigned long long c = ~crc;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		unsigned long long v;
+		memcpy(&v, &p[i], sizeof(v));
+		c = _mm_crc32_u64(c, v);
+	}
+	unsigned int c32 = (unsigned int) c;
+	for (; i < len; ++i) {
+		c32 = _mm_crc32_u8(c32, p[i]);
+	}
+	return ~c32;
+}
+
+/*SSE2*/
+
+__attribute__((target("sse2")))
+static void add_u32_sse2 (unsigned int* c, const unsigned int* a, const unsigned int* b, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i va = _mm_loadu_si128((const __m128i*) &a[i]);
+		__m128i vb = _mm_loadu_si128((const __m128i*) &b[i]);
+		_mm_storeu_si128((__m128i*) &c[i], _mm_add_epi32(va, vb));
+	}
+	add_u32_scalar(&c[i], &a[i], &b[i], n - i);
+}
+
+__attribute__((target("sse2")))
+static void shift_left_u32_sse2 (unsigned int* data, size_t n, unsigned int shift) {
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+		_mm_storeu_si128((__m128i*) &data[i], _mm_sll_epi32(v, count));
+	}
+	shift_left_u32_scalar(&data[i], n - i, shift);
+}
+
+__attribute__((target("sse2")))
+static void shift_right_u32_sse2 (unsigned int* data, size_t n, unsigned int shift) {
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+		_mm_storeu_si128((__m128i*) &data[i], _mm_srl_epi32(v, count));
+	}
+	shift_right_u32_scalar(&data[i], n - i, shift);
+}
+
+__attribute__((target("sse2")))
+static bool equal_u32_sse2 (const unsigned int* a, const unsigned int* b, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i va = _mm_loadu_si128((const __m128i*) &a[i]);
+		__m128i vb = _mm_loadu_si128((const __m128i*) &b[i]);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(va, vb)) != 0xFFFF) {
+			return false;
+		}
+	}
+	return equal_u32_scalar(&a[i], &b[i], n - i);
+}
+
+/*SSE2 has no unsigned 32 bit min/max, flip the sign bit and use the signed compare*/
+__attribute__((target("sse2")))
+static void reduce_u32_sse2 (const unsigned int* data, size_t n, unsigned long long* sum,
+		unsigned int* min, unsigned int* max) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i flip = _mm_set1_epi32((int) 0x80000000u);
+	__m128i acc_lo = zero;
+	__m128i acc_hi = zero;
+	__m128i vmin = _mm_xor_si128(_mm_set1_epi32((int) *min), flip);
+	__m128i vmax = _mm_xor_si128(_mm_set1_epi32((int) *max), flip);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+		acc_lo = _mm_add_epi64(acc_lo, _mm_unpacklo_epi32(v, zero));
+		acc_hi = _mm_add_epi64(acc_hi, _mm_unpackhi_epi32(v, zero));
+		__m128i f = _mm_xor_si128(v, flip);
+		__m128i lt = _mm_cmplt_epi32(f, vmin);
+		vmin = _mm_or_si128(_mm_and_si128(lt, f), _mm_andnot_si128(lt, vmin));
+		__m128i gt = _mm_cmpgt_epi32(f, vmax);
+		vmax = _mm_or_si128(_mm_and_si128(gt, f), _mm_andnot_si128(gt, vmax));
+	}
+	unsigned long long lanes[2];
+	_mm_storeu_si128((__m128i*) lanes, _mm_add_epi64(acc_lo, acc_hi));
+	unsigned int mins[4];
+	unsigned int maxs[4];
+	_mm_storeu_si128((__m128i*) mins, _mm_xor_si128(vmin, flip));
+	_mm_storeu_si128((__m128i*) maxs, _mm_xor_si128(vmax, flip));
+	*sum += lanes[0] + lanes[1];
+	for (int l = 0; l < 4; ++l) {
+		*min = mins[l] < *min ? mins[l] : *min;
+		*max = maxs[l] > *max ? maxs[l] : *max;
+	}
+	reduce_u32_scalar(&data[i], n - i, sum, min, max);
+}
+
+__attribute__((target("sse2")))
+static void accumulate_u32_sse2 (unsigned long long* acc, const unsigned int* data, size_t n) {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*) &data[i]);
+		__m128i a0 = _mm_loadu_si128((const __m128i*) &acc[i]);
+		__m128i a1 = _mm_loadu_si128((const __m128i*) &acc[i + 2]);
+		_mm_storeu_si128((__m128i*) &acc[i], _mm_add_epi64(a0, _mm_unpacklo_epi32(v, zero)));
+		_mm_storeu_si128((__m128i*) &acc[i + 2], _mm_add_epi64(a1, _mm_unpackhi_epi32(v, zero)));
+	}
+	accumulate_u32_scalar(&acc[i], &data[i], n - i);
+}
+
+/*AVX2*/
+
+__attribute__((target("avx2")))
+static void add_u32_avx2 (unsigned int* c, const unsigned int* a, const unsigned int* b, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*) &a[i]);
+		__m256i vb = _mm256_loadu_si256((const __m256i*) &b[i]);
+		_mm256_storeu_si256((__m256i*) &c[i], _mm256_add_epi32(va, vb));
+	}
+	add_u32_scalar(&c[i], &a[i], &b[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void shift_left_u32_avx2 (unsigned int* data, size_t n, unsigned int shift) {
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+		_mm256_storeu_si256((__m256i*) &data[i], _mm256_sll_epi32(v, count));
+	}
+	shift_left_u32_scalar(&data[i], n - i, shift);
+}
+
+__attribute__((target("avx2")))
+static void shift_right_u32_avx2 (unsigned int* data, size_t n, unsigned int shift) {
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+		_mm256_storeu_si256((__m256i*) &data[i], _mm256_srl_epi32(v, count));
+	}
+	shift_right_u32_scalar(&data[i], n - i, shift);
+}
+
+__attribute__((target("avx2")))
+static bool equal_u32_avx2 (const unsigned int* a, const unsigned int* b, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i va = _mm256_loadu_si256((const __m256i*) &a[i]);
+		__m256i vb = _mm256_loadu_si256((const __m256i*) &b[i]);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(va, vb)) != -1) {
+			return false;
+		}
+	}
+	return equal_u32_scalar(&a[i], &b[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void reduce_u32_avx2 (const unsigned int* data, size_t n, unsigned long long* sum,
+		unsigned int* min, unsigned int* max) {
+	__m256i acc_lo = _mm256_setzero_si256();
+	__m256i acc_hi = _mm256_setzero_si256();
+	__m256i vmin = _mm256_set1_epi32((int) *min);
+	__m256i vmax = _mm256_set1_epi32((int) *max);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+		acc_lo = _mm256_add_epi64(acc_lo, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+		acc_hi = _mm256_add_epi64(acc_hi, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+		vmin = _mm256_min_epu32(vmin, v);
+		vmax = _mm256_max_epu32(vmax, v);
+	}
+	unsigned long long lanes[4];
+	_mm256_storeu_si256((__m256i*) lanes, _mm256_add_epi64(acc_lo, acc_hi));
+	unsigned int mins[8];
+	unsigned int maxs[8];
+	_mm256_storeu_si256((__m256i*) mins, vmin);
+	_mm256_storeu_si256((__m256i*) maxs, vmax);
+	*sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	for (int l = 0; l < 8; ++l) {
+		*min = mins[l] < *min ? mins[l] : *min;
+		*max = maxs[l] > *max ? maxs[l] : *max;
+	}
+	reduce_u32_scalar(&data[i], n - i, sum, min, max);
+}
+
+__attribute__((target("avx2")))
+static void accumulate_u32_avx2 (unsigned long long* acc, const unsigned int* data, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &data[i]);
+		__m256i a0 = _mm256_loadu_si256((const __m256i*) &acc[i]);
+		__m256i a1 = _mm256_loadu_si256((const __m256i*) &acc[i + 4]);
+		a0 = _mm256_add_epi64(a0, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)));
+		a1 = _mm256_add_epi64(a1, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1)));
+		_mm256_storeu_si256((__m256i*) &acc[i], a0);
+		_mm256_storeu_si256((__m256i*) &acc[i + 4], a1);
+	}
+	accumulate_u32_scalar(&acc[i], &data[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void gemm_u32_avx2 (size_t kc, const unsigned int* a, const unsigned int* b,
+		unsigned int* c, size_t ldc) {
+	__m256i acc[GEMM_MR][2];
+	for (int r = 0; r < GEMM_MR; ++r) {
+		acc[r][0] = _mm256_setzero_si256();
+		acc[r][1] = _mm256_setzero_si256();
+	}
+	for (size_t k = 0; k < kc; ++k) {
+		__m256i b0 = _mm256_loadu_si256((const __m256i*) &b[k * GEMM_NR]);
+		__m256i b1 = _mm256_loadu_si256((const __m256i*) &b[k * GEMM_NR + 8]);
+		for (int r = 0; r < GEMM_MR; ++r) {
+			__m256i av = _mm256_set1_epi32((int) a[k * GEMM_MR + r]);
+			acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_mullo_epi32(av, b0));
+			acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_mullo_epi32(av, b1));
+		}
+	}
+	for (int r = 0; r < GEMM_MR; ++r) {
+		__m256i* out = (__m256i*) &c[r * ldc];
+		_mm256_storeu_si256(out, _mm256_add_epi32(_mm256_loadu_si256(out), acc[r][0]));
+		_mm256_storeu_si256(out + 1, _mm256_add_epi32(_mm256_loadu_si256(out + 1), acc[r][1]));
+	}
+}
+
+/*
+ * One vector holds the same word of all eight lanes, so a block is 32
+ * shift, mask and add steps with a second load only where a value spans
+ * two words. The AVX-512 tier uses these as well since a block is only
+ * eight lanes wide.
+ */
+__attribute__((target("avx2")))
+static void unpack_for_u32_avx2 (const unsigned int* words, unsigned int bits,
+		unsigned int reference, unsigned int* out) {
+	const __m256i mask = _mm256_set1_epi32((int) unpack_mask(bits));
+	const __m256i ref = _mm256_set1_epi32((int) reference);
+	if (bits == 0) {
+		for (unsigned int k = 0; k < UNPACK_STEPS; ++k) {
+			_mm256_storeu_si256((__m256i*) &out[k * UNPACK_LANES], ref);
+		}
+		return;
+	}
+	for (unsigned int k = 0; k < UNPACK_STEPS; ++k) {
+		const unsigned int w = (k * bits) / 32;
+		const unsigned int s = (k * bits) % 32;
+		__m256i v = _mm256_srl_epi32(_mm256_loadu_si256((const __m256i*) &words[w * UNPACK_LANES]),
+				_mm_cvtsi32_si128((int) s));
+		if (s + bits > 32) {
+			__m256i hi = _mm256_loadu_si256((const __m256i*) &words[(w + 1) * UNPACK_LANES]);
+			v = _mm256_or_si256(v, _mm256_sll_epi32(hi, _mm_cvtsi32_si128((int) (32 - s))));
+		}
+		v = _mm256_add_epi32(_mm256_and_si256(v, mask), ref);
+		_mm256_storeu_si256((__m256i*) &out[k * UNPACK_LANES], v);
+	}
+}
+
+__attribute__((target("avx2")))
+static void unpack_delta_u32_avx2 (const unsigned int* words, unsigned int bits,
+		const unsigned int* base, unsigned int* out) {
+	const __m256i mask = _mm256_set1_epi32((int) unpack_mask(bits));
+	const __m256i one = _mm256_set1_epi32(1);
+	__m256i prev = _mm256_loadu_si256((const __m256i*) base);
+	if (bits == 0) {
+		for (unsigned int k = 0; k < UNPACK_STEPS; ++k) {
+			_mm256_storeu_si256((__m256i*) &out[k * UNPACK_LANES], prev);
+		}
+		return;
+	}
+	for (unsigned int k = 0; k < UNPACK_STEPS; ++k) {
+		const unsigned int w = (k * bits) / 32;
+		const unsigned int s = (k * bits) % 32;
+		__m256i v = _mm256_srl_epi32(_mm256_loadu_si256((const __m256i*) &words[w * UNPACK_LANES]),
+				_mm_cvtsi32_si128((int) s));
+		if (s + bits > 32) {
+			__m256i hi = _mm256_loadu_si256((const __m256i*) &words[(w + 1) * UNPACK_LANES]);
+			v = _mm256_or_si256(v, _mm256_sll_epi32(hi, _mm_cvtsi32_si128((int) (32 - s))));
+		}
+		v = _mm256_and_si256(v, mask);
+		/*zigzag back to signed: (v >> 1) ^ -(v & 1)*/
+		__m256i d = _mm256_xor_si256(_mm256_srli_epi32(v, 1),
+				_mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(v, one)));
+		prev = _mm256_add_epi32(prev, d);
+		_mm256_storeu_si256((__m256i*) &out[k * UNPACK_LANES], prev);
+	}
+}
+
+/*
+ * Sixteen 64 bit lanes a row do not fit in the AVX2 register file for
+ * four rows at once, so the rows are done two at a time with b re-read
+ * from L1.
+ */
+__attribute__((target("avx2")))
+static void gemm_u64_avx2 (size_t kc, const unsigned int* a, const unsigned int* b,
+		unsigned long long* c, size_t ldc) {
+	for (int r0 = 0; r0 < GEMM_MR; r0 += 2) {
+		__m256i acc[2][4];
+		for (int r = 0; r < 2; ++r) {
+			for (int q = 0; q < 4; ++q) {
+				acc[r][q] = _mm256_setzero_si256();
+			}
+		}
+		for (size_t k = 0; k < kc; ++k) {
+			__m256i bq[4];
+			for (int q = 0; q < 4; ++q) {
+				bq[q] = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*) &b[k * GEMM_NR + q * 4]));
+			}
+			for (int r = 0; r < 2; ++r) {
+				__m256i av = _mm256_set1_epi64x(a[k * GEMM_MR + r0 + r]);
+				for (int q = 0; q < 4; ++q) {
+					acc[r][q] = _mm256_add_epi64(acc[r][q], _mm256_mul_epu32(av, bq[q]));
+				}
+			}
+		}
+		for (int r = 0; r < 2; ++r) {
+			__m256i* out = (__m256i*) &c[(r0 + r) * ldc];
+			for (int q = 0; q < 4; ++q) {
+				_mm256_storeu_si256(out + q, _mm256_add_epi64(_mm256_loadu_si256(out + q), acc[r][q]));
+			}
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i random_mix_avx2 (__m256i x) {
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7feb352d));
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int) 0x846ca68bu));
+	return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx2")))
+static void random_u32_avx2 (unsigned int* dst, size_t n, unsigned long long first,
+		unsigned long long seed, unsigned int start, unsigned int span) {
+	const unsigned long long key = random_key(seed);
+	const __m256i k0 = _mm256_set1_epi32((int) (unsigned int) key);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i vspan = _mm256_set1_epi64x(span);
+	/*low halves under this threshold are the biased draws, none when span is a power of two*/
+	const unsigned int threshold = span ? -span % span : 0;
+	const __m256i vthreshold = _mm256_set1_epi32((int) (threshold - 1));
+	const __m256i vstart = _mm256_set1_epi32((int) start);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const unsigned long long index = first + i;
+		/*the eight indices must share their upper half*/
+		if ((unsigned int) index > 0xfffffff8u) {
+			random_u32_scalar(&dst[i], 8, index, seed, start, span);
+			continue;
+		}
+		const unsigned int high = (unsigned int) (index >> 32) + (unsigned int) (key >> 32);
+		__m256i x = _mm256_add_epi32(_mm256_add_epi32(_mm256_set1_epi32((int) (unsigned int) index), lanes), k0);
+		x = random_mix_avx2(_mm256_xor_si256(random_mix_avx2(x), _mm256_set1_epi32((int) high)));
+		if (span == 0) {
+			_mm256_storeu_si256((__m256i*) &dst[i], x);
+			continue;
+		}
+		/*32 x 32 bit products of the even and the odd lanes*/
+		const __m256i even = _mm256_mul_epu32(x, vspan);
+		const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), vspan);
+		const __m256i value = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xaa);
+		_mm256_storeu_si256((__m256i*) &dst[i], _mm256_add_epi32(value, vstart));
+		if (threshold) {
+			/*biased lanes are drawn again one by one*/
+			const __m256i low = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xaa);
+			const __m256i below = _mm256_cmpeq_epi32(_mm256_min_epu32(low, vthreshold), low);
+			unsigned int redraw = _mm256_movemask_ps(_mm256_castsi256_ps(below));
+			while (redraw) {
+				const unsigned int l = __builtin_ctz(redraw);
+				dst[i + l] = random_at(key, index + l, start, span);
+				redraw &= redraw - 1;
+			}
+		}
+	}
+	random_u32_scalar(&dst[i], n - i, first + i, seed, start, span);
+}
+
+/*
+ * Transposes the block in 8 x 8 squares held in registers, interleaving
+ * 32 then 64 bit pairs within each 128 bit half and then swapping the
+ * halves, the edges left over go through the scalar loop.
+ */
+__attribute__((target("avx2")))
+static void transpose_u32_avx2 (const unsigned int* src, size_t src_stride, unsigned int* dst,
+		size_t dst_stride, size_t rows, size_t cols) {
+	const size_t rows8 = rows & ~(size_t) 7;
+	const size_t cols8 = cols & ~(size_t) 7;
+	for (size_t i = 0; i < rows8; i += 8) {
+		for (size_t j = 0; j < cols8; j += 8) {
+			__m256i r[8];
+			__m256i t[8];
+			for (int k = 0; k < 8; ++k) {
+				r[k] = _mm256_loadu_si256((const __m256i*) &src[(i + k) * src_stride + j]);
+			}
+			for (int k = 0; k < 8; k += 2) {
+				t[k] = _mm256_unpacklo_epi32(r[k], r[k + 1]);
+				t[k + 1] = _mm256_unpackhi_epi32(r[k], r[k + 1]);
+			}
+			for (int k = 0; k < 8; k += 4) {
+				r[k] = _mm256_unpacklo_epi64(t[k], t[k + 2]);
+				r[k + 1] = _mm256_unpackhi_epi64(t[k], t[k + 2]);
+				r[k + 2] = _mm256_unpacklo_epi64(t[k + 1], t[k + 3]);
+				r[k + 3] = _mm256_unpackhi_epi64(t[k + 1], t[k + 3]);
+			}
+			for (int k = 0; k < 4; ++k) {
+				_mm256_storeu_si256((__m256i*) &dst[(j + k) * dst_stride + i],
+					_mm256_permute2x128_si256(r[k], r[k + 4], 0x20));
+				_mm256_storeu_si256((__m256i*) &dst[(j + k + 4) * dst_stride + i],
+					_mm256_permute2x128_si256(r[k], r[k + 4], 0x31));
+			}
+		}
+	}
+	transpose_u32_scalar(&src[cols8], src_stride, &dst[cols8 * dst_stride], dst_stride, rows, cols - cols8);
+	transpose_u32_scalar(&src[rows8 * src_stride], src_stride, &dst[rows8], dst_stride, rows - rows8, cols8);
+}
+
+/*the AVX2 kernels of the other element types, AVX-512 machines use these too*/
+#define TYPED_ADD_AVX2(NAME, T, ADD) \
+__attribute__((target("avx2"))) \
+static void add_##NAME##_avx2 (void* c, const void* a, const void* b, size_t n) { \
+	T* pc = c; \
+	const T* pa = a; \
+	const T* pb = b; \
+	const size_t lanes = 32 / sizeof(T); \
+	size_t i = 0; \
+	for (; i + lanes <= n; i += lanes) { \
+		__m256i va = _mm256_loadu_si256((const __m256i*) &pa[i]); \
+		__m256i vb = _mm256_loadu_si256((const __m256i*) &pb[i]); \
+		_mm256_storeu_si256((__m256i*) &pc[i], ADD(va, vb)); \
+	} \
+	add_##NAME##_scalar(&pc[i], &pa[i], &pb[i], n - i); \
+}
+
+#define TYPED_SHIFT_AVX2(NAME, T, SHIFT_LEFT, SHIFT_RIGHT) \
+__attribute__((target("avx2"))) \
+static void shift_left_##NAME##_avx2 (void* data, size_t n, unsigned int shift) { \
+	T* p = data; \
+	const __m128i count = _mm_cvtsi32_si128(shift); \
+	const size_t lanes = 32 / sizeof(T); \
+	size_t i = 0; \
+	for (; i + lanes <= n; i += lanes) { \
+		__m256i v = _mm256_loadu_si256((const __m256i*) &p[i]); \
+		_mm256_storeu_si256((__m256i*) &p[i], SHIFT_LEFT(v, count)); \
+	} \
+	shift_left_##NAME##_scalar(&p[i], n - i, shift); \
+} \
+__attribute__((target("avx2"))) \
+static void shift_right_##NAME##_avx2 (void* data, size_t n, unsigned int shift) { \
+	T* p = data; \
+	const __m128i count = _mm_cvtsi32_si128(shift); \
+	const size_t lanes = 32 / sizeof(T); \
+	size_t i = 0; \
+	for (; i + lanes <= n; i += lanes) { \
+		__m256i v = _mm256_loadu_si256((const __m256i*) &p[i]); \
+		_mm256_storeu_si256((__m256i*) &p[i], SHIFT_RIGHT(v, count)); \
+	} \
+	shift_right_##NAME##_scalar(&p[i], n - i, shift); \
+}
+
+TYPED_ADD_AVX2(u8, uint8_t, _mm256_add_epi8)
+TYPED_ADD_AVX2(u16, uint16_t, _mm256_add_epi16)
+TYPED_ADD_AVX2(u64, uint64_t, _mm256_add_epi64)
+TYPED_SHIFT_AVX2(u16, uint16_t, _mm256_sll_epi16, _mm256_srl_epi16)
+TYPED_SHIFT_AVX2(u64, uint64_t, _mm256_sll_epi64, _mm256_srl_epi64)
+
+/*there is no byte shift, shift 16 bit lanes and clear the bits that crossed over*/
+__attribute__((target("avx2")))
+static void shift_left_u8_avx2 (void* data, size_t n, unsigned int shift) {
+	uint8_t* p = data;
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	const __m256i keep = _mm256_set1_epi8((char) (0xff << shift));
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &p[i]);
+		_mm256_storeu_si256((__m256i*) &p[i], _mm256_and_si256(_mm256_sll_epi16(v, count), keep));
+	}
+	shift_left_u8_scalar(&p[i], n - i, shift);
+}
+
+__attribute__((target("avx2")))
+static void shift_right_u8_avx2 (void* data, size_t n, unsigned int shift) {
+	uint8_t* p = data;
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	const __m256i keep = _mm256_set1_epi8((char) (0xff >> shift));
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &p[i]);
+		_mm256_storeu_si256((__m256i*) &p[i], _mm256_and_si256(_mm256_srl_epi16(v, count), keep));
+	}
+	shift_right_u8_scalar(&p[i], n - i, shift);
+}
+
+__attribute__((target("avx2")))
+static void shift_right_i32_avx2 (void* data, size_t n, unsigned int shift) {
+	int32_t* p = data;
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i*) &p[i]);
+		_mm256_storeu_si256((__m256i*) &p[i], _mm256_sra_epi32(v, count));
+	}
+	shift_right_i32_scalar(&p[i], n - i, shift);
+}
+
+__attribute__((target("avx2")))
+static void add_f32_avx2 (void* c, const void* a, const void* b, size_t n) {
+	float* pc = c;
+	const float* pa = a;
+	const float* pb = b;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(&pc[i], _mm256_add_ps(_mm256_loadu_ps(&pa[i]), _mm256_loadu_ps(&pb[i])));
+	}
+	add_f32_scalar(&pc[i], &pa[i], &pb[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static void add_f64_avx2 (void* c, const void* a, const void* b, size_t n) {
+	double* pc = c;
+	const double* pa = a;
+	const double* pb = b;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(&pc[i], _mm256_add_pd(_mm256_loadu_pd(&pa[i]), _mm256_loadu_pd(&pb[i])));
+	}
+	add_f64_scalar(&pc[i], &pa[i], &pb[i], n - i);
+}
+
+/*integers are equal when their bytes are, whatever their width*/
+__attribute__((target("avx2")))
+static bool equal_bytes_avx2 (const void* a, const void* b, size_t bytes) {
+	const unsigned char* pa = a;
+	const unsigned char* pb = b;
+	size_t i = 0;
+	for (; i + 32 <= bytes; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i*) &pa[i]);
+		__m256i vb = _mm256_loadu_si256((const __m256i*) &pb[i]);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != -1) {
+			return false;
+		}
+	}
+	return memcmp(&pa[i], &pb[i], bytes - i) == 0;
+}
+
+__attribute__((target("avx2")))
+static bool equal_u8_avx2 (const void* a, const void* b, size_t n) {
+	return equal_bytes_avx2(a, b, n);
+}
+
+__attribute__((target("avx2")))
+static bool equal_u16_avx2 (const void* a, const void* b, size_t n) {
+	return equal_bytes_avx2(a, b, n * sizeof(uint16_t));
+}
+
+__attribute__((target("avx2")))
+static bool equal_u64_avx2 (const void* a, const void* b, size_t n) {
+	return equal_bytes_avx2(a, b, n * sizeof(uint64_t));
+}
+
+__attribute__((target("avx2")))
+static bool equal_f32_avx2 (const void* a, const void* b, size_t n) {
+	const float* pa = a;
+	const float* pb = b;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256 eq = _mm256_cmp_ps(_mm256_loadu_ps(&pa[i]), _mm256_loadu_ps(&pb[i]), _CMP_EQ_OQ);
+		if (_mm256_movemask_ps(eq) != 0xff) {
+			return false;
+		}
+	}
+	return equal_f32_scalar(&pa[i], &pb[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static bool equal_f64_avx2 (const void* a, const void* b, size_t n) {
+	const double* pa = a;
+	const double* pb = b;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256d eq = _mm256_cmp_pd(_mm256_loadu_pd(&pa[i]), _mm256_loadu_pd(&pb[i]), _CMP_EQ_OQ);
+		if (_mm256_movemask_pd(eq) != 0xf) {
+			return false;
+		}
+	}
+	return equal_f64_scalar(&pa[i], &pb[i], n - i);
+}
+
+/*AVX-512*/
+
+__attribute__((target("avx512f")))
+static void add_u32_avx512 (unsigned int* c, const unsigned int* a, const unsigned int* b, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i va = _mm512_loadu_si512((const void*) &a[i]);
+		__m512i vb = _mm512_loadu_si512((const void*) &b[i]);
+		_mm512_storeu_si512((void*) &c[i], _mm512_add_epi32(va, vb));
+	}
+	if (i < n) {
+		const __mmask16 tail = (__mmask16) ((1u << (n - i)) - 1);
+		__m512i va = _mm512_maskz_loadu_epi32(tail, &a[i]);
+		__m512i vb = _mm512_maskz_loadu_epi32(tail, &b[i]);
+		_mm512_mask_storeu_epi32(&c[i], tail, _mm512_add_epi32(va, vb));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void shift_left_u32_avx512 (unsigned int* data, size_t n, unsigned int shift) {
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*) &data[i]);
+		_mm512_storeu_si512((void*) &data[i], _mm512_sll_epi32(v, count));
+	}
+	if (i < n) {
+		const __mmask16 tail = (__mmask16) ((1u << (n - i)) - 1);
+		__m512i v = _mm512_maskz_loadu_epi32(tail, &data[i]);
+		_mm512_mask_storeu_epi32(&data[i], tail, _mm512_sll_epi32(v, count));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void shift_right_u32_avx512 (unsigned int* data, size_t n, unsigned int shift) {
+	const __m128i count = _mm_cvtsi32_si128(shift);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*) &data[i]);
+		_mm512_storeu_si512((void*) &data[i], _mm512_srl_epi32(v, count));
+	}
+	if (i < n) {
+		const __mmask16 tail = (__mmask16) ((1u << (n - i)) - 1);
+		__m512i v = _mm512_maskz_loadu_epi32(tail, &data[i]);
+		_mm512_mask_storeu_epi32(&data[i], tail, _mm512_srl_epi32(v, count));
+	}
+}
+
+__attribute__((target("avx512f")))
+static bool equal_u32_avx512 (const unsigned int* a, const unsigned int* b, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i va = _mm512_loadu_si512((const void*) &a[i]);
+		__m512i vb = _mm512_loadu_si512((const void*) &b[i]);
+		if (_mm512_cmpneq_epi32_mask(va, vb)) {
+			return false;
+		}
+	}
+	if (i < n) {
+		const __mmask16 tail = (__mmask16) ((1u << (n - i)) - 1);
+		__m512i va = _mm512_maskz_loadu_epi32(tail, &a[i]);
+		__m512i vb = _mm512_maskz_loadu_epi32(tail, &b[i]);
+		if (_mm512_mask_cmpneq_epi32_mask(tail, va, vb)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+__attribute__((target("avx512f")))
+static void reduce_u32_avx512 (const unsigned int* data, size_t n, unsigned long long* sum,
+		unsigned int* min, unsigned int* max) {
+	__m512i acc_lo = _mm512_setzero_si512();
+	__m512i acc_hi = _mm512_setzero_si512();
+	__m512i vmin = _mm512_set1_epi32((int) *min);
+	__m512i vmax = _mm512_set1_epi32((int) *max);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*) &data[i]);
+		acc_lo = _mm512_add_epi64(acc_lo, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(v)));
+		acc_hi = _mm512_add_epi64(acc_hi, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+		vmin = _mm512_min_epu32(vmin, v);
+		vmax = _mm512_max_epu32(vmax, v);
+	}
+	if (i < n) {
+		const __mmask16 tail = (__mmask16) ((1u << (n - i)) - 1);
+		__m512i v = _mm512_maskz_loadu_epi32(tail, &data[i]);
+		acc_lo = _mm512_add_epi64(acc_lo, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(v)));
+		acc_hi = _mm512_add_epi64(acc_hi, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+		vmin = _mm512_mask_min_epu32(vmin, tail, vmin, v);
+		vmax = _mm512_mask_max_epu32(vmax, tail, vmax, v);
+	}
+	*sum += _mm512_reduce_add_epi64(_mm512_add_epi64(acc_lo, acc_hi));
+	*min = _mm512_reduce_min_epu32(vmin);
+	*max = _mm512_reduce_max_epu32(vmax);
+}
+
+__attribute__((target("avx512f")))
+static void accumulate_u32_avx512 (unsigned long long* acc, const unsigned int* data, size_t n) {
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m512i v = _mm512_loadu_si512((const void*) &data[i]);
+		__m512i a0 = _mm512_loadu_si512((const void*) &acc[i]);
+		__m512i a1 = _mm512_loadu_si512((const void*) &acc[i + 8]);
+		a0 = _mm512_add_epi64(a0, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(v)));
+		a1 = _mm512_add_epi64(a1, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+		_mm512_storeu_si512((void*) &acc[i], a0);
+		_mm512_storeu_si512((void*) &acc[i + 8], a1);
+	}
+	accumulate_u32_scalar(&acc[i], &data[i], n - i);
+}
+
+__attribute__((target("avx512f")))
+static void gemm_u32_avx512 (size_t kc, const unsigned int* a, const unsigned int* b,
+		unsigned int* c, size_t ldc) {
+	__m512i acc[GEMM_MR];
+	for (int r = 0; r < GEMM_MR; ++r) {
+		acc[r] = _mm512_setzero_si512();
+	}
+	for (size_t k = 0; k < kc; ++k) {
+		__m512i bv = _mm512_loadu_si512((const void*) &b[k * GEMM_NR]);
+		for (int r = 0; r < GEMM_MR; ++r) {
+			__m512i av = _mm512_set1_epi32((int) a[k * GEMM_MR + r]);
+			acc[r] = _mm512_add_epi32(acc[r], _mm512_mullo_epi32(av, bv));
+		}
+	}
+	for (int r = 0; r < GEMM_MR; ++r) {
+		void* out = &c[r * ldc];
+		_mm512_storeu_si512(out, _mm512_add_epi32(_mm512_loadu_si512(out), acc[r]));
+	}
+}
+
+__attribute__((target("avx512f")))
+static void gemm_u64_avx512 (size_t kc, const unsigned int* a, const unsigned int* b,
+		unsigned long long* c, size_t ldc) {
+	__m512i acc[GEMM_MR][2];
+	for (int r = 0; r < GEMM_MR; ++r) {
+		acc[r][0] = _mm512_setzero_si512();
+		acc[r][1] = _mm512_setzero_si512();
+	}
+	for (size_t k = 0; k < kc; ++k) {
+		__m512i b0 = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*) &b[k * GEMM_NR]));
+		__m512i b1 = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i*) &b[k * GEMM_NR + 8]));
+		for (int r = 0; r < GEMM_MR; ++r) {
+			__m512i av = _mm512_set1_epi64((long long) a[k * GEMM_MR + r]);
+			acc[r][0] = _mm512_add_epi64(acc[r][0], _mm512_mul_epu32(av, b0));
+			acc[r][1] = _mm512_add_epi64(acc[r][1], _mm512_mul_epu32(av, b1));
+		}
+	}
+	for (int r = 0; r < GEMM_MR; ++r) {
+		void* out0 = &c[r * ldc];
+		void* out1 = &c[r * ldc + 8];
+		_mm512_storeu_si512(out0, _mm512_add_epi64(_mm512_loadu_si512(out0), acc[r][0]));
+		_mm512_storeu_si512(out1, _mm512_add_epi64(_mm512_loadu_si512(out1), acc[r][1]));
+	}
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i random_mix_avx512 (__m512i x) {
+	x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+	x = _mm512_mullo_epi32(x, _mm512_set1_epi32(0x7feb352d));
+	x = _mm512_xor_si512(x, _mm512_srli_epi32(x, 15));
+	x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int) 0x846ca68bu));
+	return _mm512_xor_si512(x, _mm512_srli_epi32(x, 16));
+}
+
+__attribute__((target("avx512f")))
+static void random_u32_avx512 (unsigned int* dst, size_t n, unsigned long long first,
+		unsigned long long seed, unsigned int start, unsigned int span) {
+	const unsigned long long key = random_key(seed);
+	const __m512i k0 = _mm512_set1_epi32((int) (unsigned int) key);
+	const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512i vspan = _mm512_set1_epi64(span);
+	const __m512i vthreshold = _mm512_set1_epi32((int) (span ? -span % span : 0));
+	const __m512i vstart = _mm512_set1_epi32((int) start);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const unsigned long long index = first + i;
+		/*the sixteen indices must share their upper half*/
+		if ((unsigned int) index > 0xfffffff0u) {
+			random_u32_scalar(&dst[i], 16, index, seed, start, span);
+			continue;
+		}
+		const unsigned int high = (unsigned int) (index >> 32) + (unsigned int) (key >> 32);
+		__m512i x = _mm512_add_epi32(_mm512_add_epi32(_mm512_set1_epi32((int) (unsigned int) index), lanes), k0);
+		x = random_mix_avx512(_mm512_xor_si512(random_mix_avx512(x), _mm512_set1_epi32((int) high)));
+		if (span == 0) {
+			_mm512_storeu_si512(&dst[i], x);
+			continue;
+		}
+		const __m512i even = _mm512_mul_epu32(x, vspan);
+		const __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), vspan);
+		const __m512i value = _mm512_mask_blend_epi32(0xaaaa, _mm512_srli_epi64(even, 32), odd);
+		_mm512_storeu_si512(&dst[i], _mm512_add_epi32(value, vstart));
+		const __m512i low = _mm512_mask_blend_epi32(0xaaaa, even, _mm512_slli_epi64(odd, 32));
+		unsigned int redraw = _mm512_cmplt_epu32_mask(low, vthreshold);
+		while (redraw) {
+			const unsigned int l = __builtin_ctz(redraw);
+			dst[i + l] = random_at(key, index + l, start, span);
+			redraw &= redraw - 1;
+		}
+	}
+	random_u32_scalar(&dst[i], n - i, first + i, seed, start, span);
+}
+
+/*
+ * Conversions between element types. Every value is read as an unsigned,
+ * signed or floating value and saturates to the range of the target type,
+ * a NaN becomes 0 and floats are truncated toward zero.
+ */
+#define SATURATE_INT(NAME, T, LO, HI) \
+static inline T NAME##_from_unsigned (unsigned long long v) { \
+	return v > HI ? HI : (T) v; \
+} \
+static inline T NAME##_from_signed (long long v) { \
+	return v < LO ? LO : v > 0 && (unsigned long long) v > HI ? HI : (T) v; \
+} \
+static inline T NAME##_from_float (double v) { \
+	return v != v ? 0 : v <= (double) LO ? LO : v >= (double) HI ? HI : (T) v; \
+}
+
+#define SATURATE_FLOAT(NAME, T) \
+static inline T NAME##_from_unsigned (unsigned long long v) { \
+	return (T) v; \
+} \
+static inline T NAME##_from_signed (long long v) { \
+	return (T) v; \
+} \
+static inline T NAME##_from_float (double v) { \
+	return (T) v; \
+}
+
+SATURATE_INT(u32, uint32_t, 0, UINT32_MAX)
+SATURATE_INT(u8, uint8_t, 0, UINT8_MAX)
+SATURATE_INT(u16, uint16_t, 0, UINT16_MAX)
+SATURATE_INT(u64, uint64_t, 0, UINT64_MAX)
+SATURATE_INT(i32, int32_t, INT32_MIN, INT32_MAX)
+SATURATE_FLOAT(f32, float)
+SATURATE_FLOAT(f64, double)
+
+/*
+ * The types in Matrix_Type_t order with how their values are read. The
+ * target list is a second copy since a macro cannot expand inside itself.
+ */
+#define CAST_SOURCES(X) \
+	X(u32, uint32_t, unsigned) X(u8, uint8_t, unsigned) X(u16, uint16_t, unsigned) \
+	X(u64, uint64_t, unsigned) X(i32, int32_t, signed) X(f32, float, float) X(f64, double, float)
+#define CAST_TARGETS(X, FROM, FROM_T, KIND) \
+	X(FROM, FROM_T, KIND, u32, uint32_t) X(FROM, FROM_T, KIND, u8, uint8_t) \
+	X(FROM, FROM_T, KIND, u16, uint16_t) X(FROM, FROM_T, KIND, u64, uint64_t) \
+	X(FROM, FROM_T, KIND, i32, int32_t) X(FROM, FROM_T, KIND, f32, float) \
+	X(FROM, FROM_T, KIND, f64, double)
+
+#define CAST_KERNEL(FROM, FROM_T, KIND, TO, TO_T) \
+static void cast_##FROM##_##TO (void* dst, const void* src, size_t n) { \
+	TO_T* d = dst; \
+	const FROM_T* s = src; \
+	for (size_t i = 0; i < n; ++i) { \
+		d[i] = TO##_from_##KIND(s[i]); \
+	} \
+}
+#define CAST_KERNELS_FROM(FROM, FROM_T, KIND) CAST_TARGETS(CAST_KERNEL, FROM, FROM_T, KIND)
+CAST_SOURCES(CAST_KERNELS_FROM)
+
+#define CAST_ENTRY(FROM, FROM_T, KIND, TO, TO_T) cast_##FROM##_##TO,
+#define CAST_ROW(FROM, FROM_T, KIND) { CAST_TARGETS(CAST_ENTRY, FROM, FROM_T, KIND) },
+
+/*u32 and i32 go through the u32 kernels picked at startup*/
+static void add_u32_typed (void* c, const void* a, const void* b, size_t n) {
+	matrix_kernels.add_u32(c, a, b, n);
+}
+
+static void shift_left_u32_typed (void* data, size_t n, unsigned int shift) {
+	matrix_kernels.shift_left_u32(data, n, shift);
+}
+
+static void shift_right_u32_typed (void* data, size_t n, unsigned int shift) {
+	matrix_kernels.shift_right_u32(data, n, shift);
+}
+
+static bool equal_u32_typed (const void* a, const void* b, size_t n) {
+	return matrix_kernels.equal_u32(a, b, n);
+}
+
+Matrix_Kernels_t matrix_kernels = {
+	"scalar",
+	add_u32_scalar,
+	shift_left_u32_scalar,
+	shift_right_u32_scalar,
+	equal_u32_scalar,
+	reduce_u32_scalar,
+	accumulate_u32_scalar,
+	gemm_u32_scalar,
+	gemm_u64_scalar,
+	crc32c_scalar,
+	unpack_for_u32_scalar,
+	unpack_delta_u32_scalar,
+	random_u32_scalar,
+	transpose_u32_scalar,
+	{ add_u32_typed, add_u8_scalar, add_u16_scalar, add_u64_scalar, add_u32_typed,
+		add_f32_scalar, add_f64_scalar },
+	{ shift_left_u32_typed, shift_left_u8_scalar, shift_left_u16_scalar, shift_left_u64_scalar,
+		shift_left_u32_typed, NULL, NULL },
+	{ shift_right_u32_typed, shift_right_u8_scalar, shift_right_u16_scalar, shift_right_u64_scalar,
+		shift_right_i32_scalar, NULL, NULL },
+	{ equal_u32_typed, equal_u8_scalar, equal_u16_scalar, equal_u64_scalar, equal_u32_typed,
+		equal_f32_scalar, equal_f64_scalar },
+	{ CAST_SOURCES(CAST_ROW) }
+};
+
+/*
+ * PURPOSE: switches the kernels of the types other than u32 to AVX2
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+static void use_typed_avx2 (void) {
+	matrix_kernels.add_typed[MATRIX_U8] = add_u8_avx2;
+	matrix_kernels.add_typed[MATRIX_U16] = add_u16_avx2;
+	matrix_kernels.add_typed[MATRIX_U64] = add_u64_avx2;
+	matrix_kernels.add_typed[MATRIX_F32] = add_f32_avx2;
+	matrix_kernels.add_typed[MATRIX_F64] = add_f64_avx2;
+	matrix_kernels.shift_left_typed[MATRIX_U8] = shift_left_u8_avx2;
+	matrix_kernels.shift_left_typed[MATRIX_U16] = shift_left_u16_avx2;
+	matrix_kernels.shift_left_typed[MATRIX_U64] = shift_left_u64_avx2;
+	matrix_kernels.shift_right_typed[MATRIX_U8] = shift_right_u8_avx2;
+	matrix_kernels.shift_right_typed[MATRIX_U16] = shift_right_u16_avx2;
+	matrix_kernels.shift_right_typed[MATRIX_U64] = shift_right_u64_avx2;
+	matrix_kernels.shift_right_typed[MATRIX_I32] = shift_right_i32_avx2;
+	matrix_kernels.equal_typed[MATRIX_U8] = equal_u8_avx2;
+	matrix_kernels.equal_typed[MATRIX_U16] = equal_u16_avx2;
+	matrix_kernels.equal_typed[MATRIX_U64] = equal_u64_avx2;
+	matrix_kernels.equal_typed[MATRIX_F32] = equal_f32_avx2;
+	matrix_kernels.equal_typed[MATRIX_F64] = equal_f64_avx2;
+}
+
+/*
+ * PURPOSE: picks the widest kernel set the CPU supports, the environment
+ *          variable MATLAB_ISA (scalar, sse2, avx2, avx512) can cap it
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+void init_matrix_kernels (void) {
+
+	const char* cap = getenv("MATLAB_ISA");
+	int limit = 3;
+	if (cap) {
+		if (strcmp(cap, "scalar") == 0) {
+			limit = 0;
+		}
+		else if (strcmp(cap, "sse2") == 0) {
+			limit = 1;
+		}
+		else if (strcmp(cap, "avx2") == 0) {
+			limit = 2;
+		}
+	}
+
+	__builtin_cpu_init();
+	/*the crc instruction came with SSE4.2 and is picked on its own*/
+	if (limit >= 2 && __builtin_cpu_supports("sse4.2")) {
+		matrix_kernels.crc32c = crc32c_sse42;
+	}
+	if (limit >= 3 && __builtin_cpu_supports("avx512f")) {
+		matrix_kernels.isa = "avx512";
+		matrix_kernels.add_u32 = add_u32_avx512;
+		matrix_kernels.shift_left_u32 = shift_left_u32_avx512;
+		matrix_kernels.shift_right_u32 = shift_right_u32_avx512;
+		matrix_kernels.equal_u32 = equal_u32_avx512;
+		matrix_kernels.reduce_u32 = reduce_u32_avx512;
+		matrix_kernels.accumulate_u32 = accumulate_u32_avx512;
+		matrix_kernels.gemm_u32 = gemm_u32_avx512;
+		matrix_kernels.gemm_u64 = gemm_u64_avx512;
+		matrix_kernels.unpack_for_u32 = unpack_for_u32_avx2;
+		matrix_kernels.unpack_delta_u32 = unpack_delta_u32_avx2;
+		matrix_kernels.random_u32 = random_u32_avx512;
+		matrix_kernels.transpose_u32 = transpose_u32_avx2;
+		use_typed_avx2();
+	}
+	else if (limit >= 2 && __builtin_cpu_supports("avx2")) {
+		matrix_kernels.isa = "avx2";
+		matrix_kernels.add_u32 = add_u32_avx2;
+		matrix_kernels.shift_left_u32 = shift_left_u32_avx2;
+		matrix_kernels.shift_right_u32 = shift_right_u32_avx2;
+		matrix_kernels.equal_u32 = equal_u32_avx2;
+		matrix_kernels.reduce_u32 = reduce_u32_avx2;
+		matrix_kernels.accumulate_u32 = accumulate_u32_avx2;
+		matrix_kernels.gemm_u32 = gemm_u32_avx2;
+		matrix_kernels.gemm_u64 = gemm_u64_avx2;
+		matrix_kernels.unpack_for_u32 = unpack_for_u32_avx2;
+		matrix_kernels.unpack_delta_u32 = unpack_delta_u32_avx2;
+		matrix_kernels.random_u32 = random_u32_avx2;
+		matrix_kernels.transpose_u32 = transpose_u32_avx2;
+		use_typed_avx2();
+	}
+	else if (limit >= 1 && __builtin_cpu_supports("sse2")) {
+		matrix_kernels.isa = "sse2";
+		matrix_kernels.add_u32 = add_u32_sse2;
+		matrix_kernels.shift_left_u32 = shift_left_u32_sse2;
+		matrix_kernels.shift_right_u32 = shift_right_u32_sse2;
+		matrix_kernels.equal_u32 = equal_u32_sse2;
+		matrix_kernels.reduce_u32 = reduce_u32_sse2;
+		matrix_kernels.accumulate_u32 = accumulate_u32_sse2;
+		/*
+		 * SSE2 has no 32 bit lane multiply, the multiply kernels and the
+		 * random generator stay scalar, and a codec block is eight lanes so
+		 * unpacking stays scalar too
+		 */
+	}
+}
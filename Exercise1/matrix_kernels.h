@@ -0,0 +1,80 @@
+#ifndef _MATRIX_KERNELS_H_
+#define _MATRIX_KERNELS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "matrix_format.h"
+
+/*register block of the multiply micro-kernels, rows of A by columns of B*/
+#define GEMM_MR 4
+#define GEMM_NR 16
+
+/*
+ * Element-wise kernels over flat unsigned int buffers. The table starts out
+ * pointing at the scalar versions and init_matrix_kernels() swaps in the
+ * widest instruction set the running CPU supports.
+ */
+typedef struct {
+	const char* isa;
+	void (*add_u32) (unsigned int* c, const unsigned int* a, const unsigned int* b, size_t n);
+	void (*shift_left_u32) (unsigned int* data, size_t n, unsigned int shift);
+	void (*shift_right_u32) (unsigned int* data, size_t n, unsigned int shift);
+	bool (*equal_u32) (const unsigned int* a, const unsigned int* b, size_t n);
+	void (*reduce_u32) (const unsigned int* data, size_t n, unsigned long long* sum,
+			unsigned int* min, unsigned int* max);
+	void (*accumulate_u32) (unsigned long long* acc, const unsigned int* data, size_t n);
+	/*
+	 * c[GEMM_MR][GEMM_NR] += a * b over kc steps. a holds GEMM_MR values per
+	 * step and b holds GEMM_NR, both packed by the caller. ldc is the row
+	 * stride of c in elements.
+	 */
+	void (*gemm_u32) (size_t kc, const unsigned int* a, const unsigned int* b,
+			unsigned int* c, size_t ldc);
+	void (*gemm_u64) (size_t kc, const unsigned int* a, const unsigned int* b,
+			unsigned long long* c, size_t ldc);
+	/*CRC32C (Castagnoli) of len bytes continuing from crc, start with 0*/
+	unsigned int (*crc32c) (unsigned int crc, const void* buf, size_t len);
+	/*
+	 * Decode one 256 value block of the stored tile codecs from bits * 8
+	 * packed words, see matrix_codec.h. The frame of reference variant adds
+	 * reference to every value, the delta variant sums zigzag deltas onto
+	 * the eight base values.
+	 */
+	void (*unpack_for_u32) (const unsigned int* words, unsigned int bits,
+			unsigned int reference, unsigned int* out);
+	void (*unpack_delta_u32) (const unsigned int* words, unsigned int bits,
+			const unsigned int* base, unsigned int* out);
+	/*
+	 * dst[i] = start + a uniform value below span, drawn for element first + i
+	 * of the stream seed, span 0 stands for the whole 2^32. The generator is
+	 * counter based, an element depends only on seed and its own index, so
+	 * any split of the elements between threads gives the same matrix.
+	 */
+	void (*random_u32) (unsigned int* dst, size_t n, unsigned long long first,
+			unsigned long long seed, unsigned int start, unsigned int span);
+	/*
+	 * dst[j][i] = src[i][j] for a rows x cols block, the strides are the
+	 * distance between rows of src and of dst in elements. The caller keeps
+	 * the block small enough for both sides to stay in L1.
+	 */
+	void (*transpose_u32) (const unsigned int* src, size_t src_stride, unsigned int* dst,
+			size_t dst_stride, size_t rows, size_t cols);
+	/*
+	 * add, shift and equal for every element type, indexed by Matrix_Type_t
+	 * and NULL where a type has no such operation, floats do not shift.
+	 * The u32 entries call the kernels above.
+	 */
+	void (*add_typed[MATRIX_TYPES]) (void* c, const void* a, const void* b, size_t n);
+	void (*shift_left_typed[MATRIX_TYPES]) (void* data, size_t n, unsigned int shift);
+	void (*shift_right_typed[MATRIX_TYPES]) (void* data, size_t n, unsigned int shift);
+	bool (*equal_typed[MATRIX_TYPES]) (const void* a, const void* b, size_t n);
+	/*cast[from][to] converts n elements, saturating at the limits of the target type*/
+	void (*cast[MATRIX_TYPES][MATRIX_TYPES]) (void* dst, const void* src, size_t n);
+}Matrix_Kernels_t;
+
+extern Matrix_Kernels_t matrix_kernels;
+
+void init_matrix_kernels (void);
+
+#endif
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <sys/mman.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "matrix_memory.h"
+
+/*
+ * Every buffer is preceded by one MEMORY_ALIGN sized block header that
+ * says where it came from. While a buffer sits on a free list the header
+ * also links it to the next one. Buffers past the last class use
+ * MEMORY_CLASSES as their class and are never cached.
+ */
+typedef struct Memory_Block {
+	struct Memory_Block* next;
+	size_t bytes;		/*usable bytes after the header*/
+	unsigned int cls;
+	bool mapped;		/*from mmap rather than the heap*/
+	bool zeroed;		/*fresh pages nobody has written yet*/
+	unsigned char pages;	/*MEMORY_PAGES_* the mapping is made of*/
+}Memory_Block_t;
+
+enum {
+	MEMORY_PAGES_NORMAL,
+	MEMORY_PAGES_HUGE,	/*aligned and advised for transparent huge pages*/
+	MEMORY_PAGES_HUGETLB	/*explicit huge pages, unmapped in whole pages*/
+};
+
+_Static_assert(sizeof(Memory_Block_t) <= MEMORY_ALIGN, "block header must fit in one alignment unit");
+
+static pthread_mutex_t memory_lock = PTHREAD_MUTEX_INITIALIZER;
+static Memory_Block_t* free_lists[MEMORY_CLASSES];
+static Memory_Stats_t stats;
+static pthread_once_t huge_once = PTHREAD_ONCE_INIT;
+static bool huge_enabled = true;
+
+static void read_huge_setting (void) {
+	const char* setting = getenv("MATLAB_HUGEPAGES");
+	huge_enabled = !setting || strcmp(setting, "0") != 0;
+}
+
+/*length of the mapping behind a mapped block*/
+static size_t mapping_length (const Memory_Block_t* b) {
+	const size_t len = MEMORY_ALIGN + b->bytes;
+	if (b->pages == MEMORY_PAGES_HUGETLB) {
+		return (len + MEMORY_HUGE_PAGE - 1) / MEMORY_HUGE_PAGE * MEMORY_HUGE_PAGE;
+	}
+	return len;
+}
+
+/*
+ * PURPOSE: maps len bytes on huge pages, explicit ones first for the
+ *          largest blocks, else a normal mapping trimmed to start on a huge
+ *          page boundary and advised for transparent huge pages
+ * INPUTS:
+ *	len: bytes to map
+ *  pages: receives MEMORY_PAGES_HUGETLB or MEMORY_PAGES_HUGE
+ * RETURN:
+ *  the mapping, NULL when it could not be made
+ *
+ **/
+static void* map_huge (size_t len, unsigned char* pages) {
+#ifdef MAP_HUGETLB
+	if (len >= MEMORY_HUGETLB_BYTES) {
+		const size_t rounded = (len + MEMORY_HUGE_PAGE - 1) / MEMORY_HUGE_PAGE * MEMORY_HUGE_PAGE;
+		void* p = mmap(NULL, rounded, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			*pages = MEMORY_PAGES_HUGETLB;
+			return p;
+		}
+	}
+#endif
+	/*map a huge page more than needed and cut off what lies outside the aligned range*/
+	char* p = mmap(NULL, len + MEMORY_HUGE_PAGE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+	char* start = (char*) (((uintptr_t) p + MEMORY_HUGE_PAGE - 1) & ~(uintptr_t) (MEMORY_HUGE_PAGE - 1));
+	const size_t page = sysconf(_SC_PAGESIZE);
+	char* end = start + (len + page - 1) / page * page;
+	if (start > p) {
+		munmap(p, start - p);
+	}
+	if (p + len + MEMORY_HUGE_PAGE > end) {
+		munmap(end, p + len + MEMORY_HUGE_PAGE - end);
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(start, len, MADV_HUGEPAGE);
+#endif
+	*pages = MEMORY_PAGES_HUGE;
+	return start;
+}
+
+/*
+ * PURPOSE: smallest size class holding a request
+ * INPUTS:
+ *	bytes: size of the request
+ * RETURN:
+ *  the class, MEMORY_CLASSES when the request is too big for any
+ *
+ **/
+static unsigned int size_class (size_t bytes) {
+	unsigned int cls = 0;
+	while (cls < MEMORY_CLASSES && ((size_t) 1 << (cls + MEMORY_MIN_SHIFT)) < bytes) {
+		++cls;
+	}
+	return cls;
+}
+
+/*
+ * PURPOSE: gets a new block from the system
+ * INPUTS:
+ *	bytes: usable bytes the block needs
+ *  cls: its size class
+ * RETURN:
+ *  the block header, NULL when out of memory
+ *
+ **/
+static Memory_Block_t* system_block (size_t bytes, unsigned int cls) {
+	Memory_Block_t* b = NULL;
+	bool mapped = bytes >= MEMORY_MAP_BYTES;
+	unsigned char pages = MEMORY_PAGES_NORMAL;
+	pthread_once(&huge_once, read_huge_setting);
+	if (mapped && huge_enabled && bytes >= MEMORY_HUGE_BYTES) {
+		b = map_huge(MEMORY_ALIGN + bytes, &pages);
+	}
+	else if (mapped) {
+		void* p = mmap(NULL, MEMORY_ALIGN + bytes, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		b = p == MAP_FAILED ? NULL : p;
+	}
+	else if (posix_memalign((void**) &b, MEMORY_ALIGN, MEMORY_ALIGN + bytes) != 0) {
+		b = NULL;
+	}
+	if (!b) {
+		return NULL;
+	}
+	b->next = NULL;
+	b->bytes = bytes;
+	b->cls = cls;
+	b->mapped = mapped;
+	b->zeroed = mapped;
+	b->pages = pages;
+	return b;
+}
+
+static void system_release (Memory_Block_t* b) {
+	if (b->mapped) {
+		munmap(b, mapping_length(b));
+	}
+	else {
+		free(b);
+	}
+}
+
+/*
+ * PURPOSE: hands out a MEMORY_ALIGN aligned buffer, reusing a freed one
+ *          of the same class when there is one
+ * INPUTS:
+ *	bytes: size of the buffer
+ *  zero: clear the buffer, callers that write all of it pass false
+ * RETURN:
+ *  the buffer, NULL when out of memory
+ *
+ **/
+void* memory_alloc (size_t bytes, bool zero) {
+
+	/*leave room for the header and the huge page alignment without wrapping*/
+	if (bytes > SIZE_MAX - MEMORY_ALIGN - MEMORY_HUGE_PAGE) {
+		return NULL;
+	}
+
+	const unsigned int cls = size_class(bytes ? bytes : 1);
+	Memory_Block_t* b = NULL;
+
+	pthread_mutex_lock(&memory_lock);
+	if (cls < MEMORY_CLASSES && free_lists[cls]) {
+		b = free_lists[cls];
+		free_lists[cls] = b->next;
+		stats.cached[cls]--;
+		stats.bytes_cached -= b->bytes;
+		stats.hits++;
+	}
+	pthread_mutex_unlock(&memory_lock);
+
+	if (!b) {
+		b = system_block(cls < MEMORY_CLASSES ? (size_t) 1 << (cls + MEMORY_MIN_SHIFT) : bytes, cls);
+		if (!b) {
+			return NULL;
+		}
+	}
+	if (zero && !b->zeroed) {
+		memset((char*) b + MEMORY_ALIGN, 0, bytes);
+	}
+	b->zeroed = false;
+
+	pthread_mutex_lock(&memory_lock);
+	stats.allocs++;
+	if (cls < MEMORY_CLASSES) {
+		stats.in_use[cls]++;
+	}
+	stats.huge += b->pages == MEMORY_PAGES_HUGE;
+	stats.hugetlb += b->pages == MEMORY_PAGES_HUGETLB;
+	stats.bytes_in_use += b->bytes;
+	if (stats.bytes_in_use > stats.peak_in_use) {
+		stats.peak_in_use = stats.bytes_in_use;
+	}
+	pthread_mutex_unlock(&memory_lock);
+	return (char*) b + MEMORY_ALIGN;
+}
+
+/*
+ * PURPOSE: takes a buffer back, it is cached for reuse while the cache has room
+ * INPUTS:
+ *	p: a buffer from memory_alloc, NULL does nothing
+ * RETURN:
+ *  void
+ *
+ **/
+void memory_free (void* p) {
+
+	if (!p) {
+		return;
+	}
+	Memory_Block_t* b = (Memory_Block_t*) ((char*) p - MEMORY_ALIGN);
+	bool keep = false;
+
+	pthread_mutex_lock(&memory_lock);
+	stats.frees++;
+	stats.bytes_in_use -= b->bytes;
+	if (b->cls < MEMORY_CLASSES) {
+		stats.in_use[b->cls]--;
+		if (stats.bytes_cached + b->bytes <= MEMORY_CACHE_BYTES) {
+			b->next = free_lists[b->cls];
+			free_lists[b->cls] = b;
+			stats.cached[b->cls]++;
+			stats.bytes_cached += b->bytes;
+			keep = true;
+		}
+	}
+	if (!keep) {
+		stats.released++;
+	}
+	pthread_mutex_unlock(&memory_lock);
+
+	if (!keep) {
+		system_release(b);
+	}
+}
+
+/*
+ * PURPOSE: copies out the allocator counters
+ * INPUTS:
+ *	out: receives the counters
+ * RETURN:
+ *  void
+ *
+ **/
+void memory_stats (Memory_Stats_t* out) {
+	if (!out) {
+		return;
+	}
+	pthread_mutex_lock(&memory_lock);
+	*out = stats;
+	pthread_mutex_unlock(&memory_lock);
+}
+
+/*
+ * PURPOSE: gives every cached buffer back to the system
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+void memory_trim (void) {
+
+	pthread_mutex_lock(&memory_lock);
+	Memory_Block_t* lists[MEMORY_CLASSES];
+	memcpy(lists, free_lists, sizeof(lists));
+	memset(free_lists, 0, sizeof(free_lists));
+	for (unsigned int cls = 0; cls < MEMORY_CLASSES; ++cls) {
+		stats.released += stats.cached[cls];
+		stats.cached[cls] = 0;
+	}
+	stats.bytes_cached = 0;
+	pthread_mutex_unlock(&memory_lock);
+
+	for (unsigned int cls = 0; cls < MEMORY_CLASSES; ++cls) {
+		while (lists[cls]) {
+			Memory_Block_t* b = lists[cls];
+			lists[cls] = b->next;
+			system_release(b);
+		}
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef _MATRIX_MEMORY_H_
+#define _MATRIX_MEMORY_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Memory for matrix headers and elements. Requests are rounded up to a
+ * power of two size class and every buffer starts on a MEMORY_ALIGN
+ * boundary so SIMD loads never split a cache line. Freed buffers are kept
+ * on a list per class and handed out again, up to MEMORY_CACHE_BYTES in
+ * all, so same shaped intermediates skip the system allocator and its
+ * page faults. Requests past the last class go straight to the system.
+ *
+ * Mapped buffers of MEMORY_HUGE_BYTES and more start on a huge page
+ * boundary and are marked for transparent huge pages, from
+ * MEMORY_HUGETLB_BYTES on explicit MAP_HUGETLB pages are tried first
+ * where the system has them reserved. A sweep over a large matrix then
+ * needs a TLB entry per 2MB instead of per 4KB. MATLAB_HUGEPAGES=0 keeps
+ * every buffer on normal pages.
+ */
+#define MEMORY_ALIGN 64
+#define MEMORY_MIN_SHIFT 6
+#define MEMORY_MAX_SHIFT 30
+#define MEMORY_CLASSES (MEMORY_MAX_SHIFT - MEMORY_MIN_SHIFT + 1)
+#define MEMORY_CACHE_BYTES ((size_t) 256 << 20)
+/*classes from this size on are mapped, so fresh ones come zeroed*/
+#define MEMORY_MAP_BYTES ((size_t) 128 << 10)
+#define MEMORY_HUGE_PAGE ((size_t) 2 << 20)
+#define MEMORY_HUGE_BYTES MEMORY_HUGE_PAGE
+/*a MAP_HUGETLB mapping rounds up to whole huge pages, at this size that wastes under 4%*/
+#define MEMORY_HUGETLB_BYTES ((size_t) 64 << 20)
+
+typedef struct {
+	size_t allocs;		/*buffers handed out*/
+	size_t hits;		/*of those, taken from a free list*/
+	size_t frees;
+	size_t released;	/*buffers given back to the system*/
+	size_t bytes_in_use;
+	size_t peak_in_use;
+	size_t bytes_cached;
+	size_t huge;		/*buffers handed out on transparent huge pages*/
+	size_t hugetlb;		/*buffers handed out on MAP_HUGETLB pages*/
+	size_t in_use[MEMORY_CLASSES];
+	size_t cached[MEMORY_CLASSES];
+}Memory_Stats_t;
+
+void* memory_alloc (size_t bytes, bool zero);
+void memory_free (void* p);
+void memory_stats (Memory_Stats_t* stats);
+void memory_trim (void);
+
+#endif
@@ -0,0 +1,402 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matrix.h"
+#include "matrix_memory.h"
+#include "matrix_shm.h"
+#include "thread_pool.h"
+
+/*spins on an odd seq before yielding and watching the clock*/
+#define SHM_SPINS 64
+
+typedef struct {
+	char* dst;
+	const char* src;
+	size_t cols;
+	size_t stride;		/*elements from one source row to the next*/
+	size_t width;
+}Shm_Copy_Task_t;
+
+/*copies elements [begin, end) row piece by row piece, the source may be a view*/
+static void copy_task (void* ctx, size_t begin, size_t end) {
+	const Shm_Copy_Task_t* t = ctx;
+	while (begin < end) {
+		const size_t r = begin / t->cols;
+		const size_t c = begin % t->cols;
+		const size_t n = t->cols - c < end - begin ? t->cols - c : end - begin;
+		memcpy(t->dst + begin * t->width, t->src + (r * t->stride + c) * t->width, n * t->width);
+		begin += n;
+	}
+}
+
+static void copy_elements (const Matrix_t* m, void* dst) {
+	Shm_Copy_Task_t t = { .dst = dst, .src = (const char*) m->data, .cols = m->cols,
+		.stride = m->stride ? m->stride : m->cols, .width = matrix_type_size(m->type) };
+	parallel_for((size_t) m->rows * m->cols, 0, copy_task, &t);
+}
+
+/*a segment name is a single path component made from the matrix name*/
+static bool segment_name (const char* matrix_name, char* name) {
+	if (!matrix_name[0] || strchr(matrix_name, '/') || strlen(matrix_name) >= MATRIX_NAME_LEN) {
+		return false;
+	}
+	snprintf(name, sizeof(((Matrix_Shm_t*) NULL)->name), "%s%s", MATRIX_SHM_PREFIX, matrix_name);
+	return true;
+}
+
+static unsigned long long now_ms (void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+/*
+ * PURPOSE: takes the write lock of a segment over from a process that died
+ *          holding it, an odd seq it left is moved on to even. The
+ *          elements stay as that writer left them.
+ * INPUTS:
+ *	shm: the segment
+ *  owner: the pid seen holding the lock
+ * RETURN:
+ *  If this process holds the lock now then true
+ *  else false, the owner is alive or another process got there first.
+ *
+ **/
+static bool take_from_dead_writer (Matrix_Shm_t* shm, uint32_t owner) {
+	Matrix_Shm_Header_t* h = shm->header;
+	const uint32_t self = (uint32_t) getpid();
+	/*EPERM means the process is there but belongs to someone else*/
+	if (owner == 0 || owner == self || kill((pid_t) owner, 0) == 0 || errno != ESRCH) {
+		return false;
+	}
+	if (!__atomic_compare_exchange_n(&h->writer_pid, &owner, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return false;
+	}
+	const uint64_t s = __atomic_load_n(&h->seq, __ATOMIC_RELAXED);
+	if (s & 1) {
+		__atomic_store_n(&h->seq, s + 1, __ATOMIC_RELEASE);
+		printf("Shared memory %s: process %u died while writing it, the matrix may be half changed\n",
+			shm->name, owner);
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: waits until no writer is changing the elements, taking the lock
+ *          back from a writer that died
+ * INPUTS:
+ *	shm: the segment
+ *  seq: receives the even sequence number seen
+ * RETURN:
+ *  If seq was even within MATRIX_SHM_WAIT_MS then true
+ *  else false, a writer still holds it.
+ *
+ **/
+static bool wait_even (Matrix_Shm_t* shm, uint64_t* seq) {
+	Matrix_Shm_Header_t* h = shm->header;
+	unsigned long long deadline = 0;
+	for (unsigned int spins = 0; ; ++spins) {
+		const uint64_t s = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE);
+		if (!(s & 1)) {
+			*seq = s;
+			return true;
+		}
+		if (spins < SHM_SPINS) {
+			continue;
+		}
+		if (take_from_dead_writer(shm, __atomic_load_n(&h->writer_pid, __ATOMIC_RELAXED))) {
+			__atomic_store_n(&h->writer_pid, 0, __ATOMIC_RELEASE);
+			continue;
+		}
+		const unsigned long long now = now_ms();
+		if (deadline == 0) {
+			deadline = now + MATRIX_SHM_WAIT_MS;
+		}
+		else if (now > deadline) {
+			return false;
+		}
+		sched_yield();
+	}
+}
+
+/*
+ * PURPOSE: takes the write lock of a segment, against writers in every
+ *          process that maps it, and makes seq odd for the readers
+ * INPUTS:
+ *	shm: the segment
+ * RETURN:
+ *  If it was taken then true
+ *  else false, another writer held it over MATRIX_SHM_WAIT_MS.
+ *
+ **/
+bool shm_write_begin (Matrix_Shm_t* shm) {
+	Matrix_Shm_Header_t* h = shm->header;
+	const uint32_t self = (uint32_t) getpid();
+	unsigned long long deadline = 0;
+	for (unsigned int spins = 0; ; ++spins) {
+		uint32_t owner = 0;
+		if (__atomic_compare_exchange_n(&h->writer_pid, &owner, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+			|| (spins >= SHM_SPINS && take_from_dead_writer(shm, owner))) {
+			break;
+		}
+		if (spins < SHM_SPINS) {
+			continue;
+		}
+		const unsigned long long now = now_ms();
+		if (deadline == 0) {
+			deadline = now + MATRIX_SHM_WAIT_MS;
+		}
+		else if (now > deadline) {
+			return false;
+		}
+		sched_yield();
+	}
+	__atomic_add_fetch(&h->seq, 1, __ATOMIC_RELAXED);
+	/*the elements written next must not be seen before seq is odd*/
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return true;
+}
+
+/*
+ * PURPOSE: publishes the changes made since shm_write_begin and lets the
+ *          next writer in
+ * INPUTS:
+ *	shm: the segment
+ * RETURN:
+ *  void
+ *
+ **/
+void shm_write_end (Matrix_Shm_t* shm) {
+	__atomic_add_fetch(&shm->header->version, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&shm->header->seq, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm->header->writer_pid, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * PURPOSE: starts reading a segment once no writer is at work
+ * INPUTS:
+ *	shm: the segment
+ *  seq: receives what to hand to shm_read_changed
+ * RETURN:
+ *  If no writer held it longer than MATRIX_SHM_WAIT_MS then true
+ *  else false.
+ *
+ **/
+bool shm_read_begin (Matrix_Shm_t* shm, uint64_t* seq) {
+	return wait_even(shm, seq);
+}
+
+/*
+ * PURPOSE: tells whether a writer got in since shm_read_begin
+ * INPUTS:
+ *	shm: the segment
+ *  seq: from shm_read_begin
+ * RETURN:
+ *  If the elements may have changed while they were read then true
+ *  else false.
+ *
+ **/
+bool shm_read_changed (const Matrix_Shm_t* shm, uint64_t seq) {
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&shm->header->seq, __ATOMIC_RELAXED) != seq;
+}
+
+Matrix_Shm_t* hold_shm (Matrix_Shm_t* shm) {
+	__atomic_add_fetch(&shm->holds, 1, __ATOMIC_RELAXED);
+	return shm;
+}
+
+/*
+ * PURPOSE: drops a hold on a segment, the last one unmaps it and removes
+ *          the name of a segment this process made, processes still
+ *          attached keep their mapping
+ * INPUTS:
+ *	shm: the segment
+ * RETURN:
+ *  void
+ *
+ **/
+void release_shm (Matrix_Shm_t* shm) {
+	if (!shm || __atomic_sub_fetch(&shm->holds, 1, __ATOMIC_ACQ_REL) > 0) {
+		return;
+	}
+	if (shm->owner) {
+		shm_unlink(shm->name);
+	}
+	munmap(shm->header, shm->len);
+	free(shm);
+}
+
+/*
+ * PURPOSE: moves the elements of a dense matrix into a new shared memory
+ *          segment named after it, the matrix works on the segment from
+ *          then on
+ * INPUTS:
+ *	m: the matrix, a view is copied out row by row
+ * RETURN:
+ *  If the matrix is shared then true
+ *  else false and it keeps its storage.
+ *
+ **/
+bool share_matrix (Matrix_t* m) {
+
+	if (!m || !m->data || m->sparse || m->disk) {
+		return false;
+	}
+	if (m->shm) {
+		return true;
+	}
+	Matrix_Shm_t* shm = calloc(1, sizeof(Matrix_Shm_t));
+	size_t bytes = 0;
+	if (!shm || !segment_name(m->name, shm->name) || !matrix_data_bytes(m->rows, m->cols, m->type, &bytes)) {
+		free(shm);
+		return false;
+	}
+	shm->len = MATRIX_FILE_ALIGN + bytes;
+
+	/*a segment left by a process that died is removed by hand, see the README*/
+	const int fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		printf("Shared memory %s: %s\n", shm->name, strerror(errno));
+		free(shm);
+		return false;
+	}
+	void* base = ftruncate(fd, shm->len) == 0
+		? mmap(NULL, shm->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (base == MAP_FAILED) {
+		printf("Shared memory %s: %s\n", shm->name, strerror(errno));
+		close(fd);
+		shm_unlink(shm->name);
+		free(shm);
+		return false;
+	}
+	close(fd);
+
+	Matrix_Shm_Header_t* h = base;
+	h->header_size = MATRIX_SHM_HEADER_SIZE;
+	h->rows = m->rows;
+	h->cols = m->cols;
+	h->elem_type = m->type;
+	h->data_offset = MATRIX_FILE_ALIGN;
+	h->data_len = bytes;
+	copy_elements(m, (char*) base + MATRIX_FILE_ALIGN);
+	/*the magic goes in last, a process attaching early finds no matrix rather than half of one*/
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(h->magic, MATRIX_SHM_MAGIC, sizeof(h->magic));
+
+	shm->holds = 1;
+	shm->owner = true;
+	shm->header = h;
+	release_dense_data(m);
+	m->data = (unsigned int*) ((char*) base + MATRIX_FILE_ALIGN);
+	m->shm = shm;
+	return true;
+}
+
+/*
+ * PURPOSE: maps a segment another process shared, the matrix reads and
+ *          writes the elements in place
+ * INPUTS:
+ *	shared_name: the name of the matrix that was shared
+ *  name: the name of the new matrix
+ *  m: receives the matrix
+ * RETURN:
+ *  If the segment holds a matrix then true
+ *  else false.
+ *
+ **/
+bool attach_matrix (const char* shared_name, const char* name, Matrix_t** m) {
+
+	if (!shared_name || !name || !m || strlen(name) >= MATRIX_NAME_LEN) {
+		return false;
+	}
+	Matrix_Shm_t* shm = calloc(1, sizeof(Matrix_Shm_t));
+	if (!shm || !segment_name(shared_name, shm->name)) {
+		free(shm);
+		return false;
+	}
+	const int fd = shm_open(shm->name, O_RDWR | O_CLOEXEC, 0);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size < MATRIX_SHM_HEADER_SIZE) {
+		printf("Shared memory %s: %s\n", shm->name, fd < 0 ? strerror(errno) : "too short");
+		if (fd >= 0) {
+			close(fd);
+		}
+		free(shm);
+		return false;
+	}
+	shm->len = st.st_size;
+	void* base = mmap(NULL, shm->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		printf("Shared memory %s: %s\n", shm->name, strerror(errno));
+		free(shm);
+		return false;
+	}
+	shm->header = base;
+	shm->holds = 1;
+
+	const Matrix_Shm_Header_t* h = base;
+	size_t bytes = 0;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (memcmp(h->magic, MATRIX_SHM_MAGIC, sizeof(h->magic)) != 0 || h->header_size != MATRIX_SHM_HEADER_SIZE
+		|| h->elem_type >= MATRIX_TYPES || !matrix_data_bytes(h->rows, h->cols, h->elem_type, &bytes)
+		|| h->data_len != bytes || h->data_offset % MATRIX_FILE_ALIGN != 0 || h->data_offset > shm->len
+		|| shm->len - h->data_offset < bytes) {
+		printf("Shared memory %s does not hold a matrix\n", shm->name);
+		release_shm(shm);
+		return false;
+	}
+
+	*m = memory_alloc(sizeof(Matrix_t), true);
+	if (!(*m)) {
+		release_shm(shm);
+		return false;
+	}
+	strncpy((*m)->name, name, MATRIX_NAME_LEN);
+	(*m)->rows = h->rows;
+	(*m)->cols = h->cols;
+	(*m)->type = h->elem_type;
+	(*m)->data = (unsigned int*) ((char*) base + h->data_offset);
+	(*m)->shm = shm;
+	return true;
+}
+
+/*
+ * PURPOSE: puts a matrix that took the place of a shared one into the
+ *          segment, so a name stays shared when a command replaces its
+ *          matrix with one of the same size and type. The caller holds
+ *          the segment for writing.
+ * INPUTS:
+ *	shm: the segment of the matrix replaced
+ *  m: the matrix now under its name
+ * RETURN:
+ *  If m moved into the segment then true
+ *  else false and it stays as it was.
+ *
+ **/
+bool shm_adopt (Matrix_Shm_t* shm, Matrix_t* m) {
+
+	const Matrix_Shm_Header_t* h = shm->header;
+	if (!m->data || m->shm || m->rows != h->rows || m->cols != h->cols || m->type != h->elem_type) {
+		return false;
+	}
+	unsigned int* data = (unsigned int*) ((char*) shm->header + h->data_offset);
+	copy_elements(m, data);
+	release_dense_data(m);
+	m->data = data;
+	m->shm = hold_shm(shm);
+	return true;
+}
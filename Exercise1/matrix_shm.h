@@ -0,0 +1,32 @@
+#ifndef _MATRIX_SHM_H_
+#define _MATRIX_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+/*
+ * Shared memory side of the matrices. A command that may change a shared
+ * matrix runs between shm_write_begin and shm_write_end, one that only
+ * reads it takes shm_read_begin before and asks shm_read_changed after
+ * whether a writer in another process got in meanwhile. Waiting on the
+ * writer of another process gives up after MATRIX_SHM_WAIT_MS, unless that
+ * process is gone, then the lock is taken back from it.
+ */
+#define MATRIX_SHM_WAIT_MS 1000
+/*runs of a read before giving up on a matrix that keeps changing under it*/
+#define MATRIX_SHM_READ_TRIES 8
+
+/*dense storage helper from matrix.c, drops one hold on the elements*/
+void release_dense_data (Matrix_t* m);
+
+Matrix_Shm_t* hold_shm (Matrix_Shm_t* shm);
+void release_shm (Matrix_Shm_t* shm);
+bool shm_write_begin (Matrix_Shm_t* shm);
+void shm_write_end (Matrix_Shm_t* shm);
+bool shm_read_begin (Matrix_Shm_t* shm, uint64_t* seq);
+bool shm_read_changed (const Matrix_Shm_t* shm, uint64_t seq);
+bool shm_adopt (Matrix_Shm_t* shm, Matrix_t* m);
+
+#endif
@@ -0,0 +1,791 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <sys/mman.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "matrix.h"
+#include "matrix_kernels.h"
+#include "matrix_memory.h"
+#include "matrix_sparse.h"
+#include "thread_pool.h"
+
+/*
+ * Row tasks for parallel_for. Like the dense row tasks the range is the
+ * logical rows * cols elements and a chunk is always whole rows, so row r
+ * of a chunk is begin / cols onwards.
+ */
+typedef struct {
+	Matrix_t* a;
+	Matrix_t* b;
+	Matrix_t* c;
+	Matrix_Sparse_t* out;	/*CSR being built*/
+	size_t cols;
+	Matrix_Mul_Mode_t mode;
+	unsigned long long* sums;
+	pthread_mutex_t lock;
+	bool failed;
+}Sparse_Task_t;
+
+/*
+ * PURPOSE: pick a chunk of whole rows holding about PARALLEL_CHUNK_ELEMENTS
+ *          units of work, sparse rows cost their entries rather than cols
+ * INPUTS:
+ *	rows: number of rows in the range
+ *  cols: row length of the range
+ *  work: work units spread over all the rows
+ * RETURN:
+ *  chunk size in elements of the rows * cols range
+ *
+ **/
+static size_t sparse_row_chunk (size_t rows, size_t cols, size_t work) {
+	size_t per = work ? PARALLEL_CHUNK_ELEMENTS * rows / work : rows;
+	return (per ? per : 1) * cols;
+}
+
+/*
+ * PURPOSE: allocates CSR storage with an all zero row_ptr
+ * INPUTS:
+ *	s: receives the storage
+ *  rows: number of rows
+ *  nnz: number of entries to make room for
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool alloc_sparse (Matrix_Sparse_t** s, size_t rows, size_t nnz) {
+
+	if (!s) {
+		return false;
+	}
+	*s = calloc(1, sizeof(Matrix_Sparse_t));
+	if (!(*s)) {
+		return false;
+	}
+	(*s)->row_ptr = calloc(rows + 1, sizeof(size_t));
+	(*s)->col_idx = malloc((nnz ? nnz : 1) * sizeof(unsigned int));
+	(*s)->values = malloc((nnz ? nnz : 1) * sizeof(unsigned int));
+	if (!(*s)->row_ptr || !(*s)->col_idx || !(*s)->values) {
+		free_sparse(s);
+		return false;
+	}
+	(*s)->nnz = nnz;
+	(*s)->refs = 1;
+	return true;
+}
+
+/*
+ * PURPOSE: drops one hold on CSR storage, freeing it with the last holder
+ * INPUTS:
+ *	s: the storage, set to NULL afterwards
+ * RETURN:
+ *  void
+ *
+ **/
+void free_sparse (Matrix_Sparse_t** s) {
+
+	if (!s || !(*s)) {
+		return;
+	}
+	if (__atomic_sub_fetch(&(*s)->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+		*s = NULL;
+		return;
+	}
+	free((*s)->row_ptr);
+	free((*s)->col_idx);
+	free((*s)->values);
+	free(*s);
+	*s = NULL;
+}
+
+/*
+ * PURPOSE: checks CSR storage read from outside, row_ptr has to run from 0
+ *          to nnz without going back and columns have to rise within a row
+ * INPUTS:
+ *	s: the storage
+ *  rows, cols: dimensions of the matrix
+ * RETURN:
+ *  If the storage is consistent then true
+ *  else false.
+ *
+ **/
+bool sparse_is_well_formed (const Matrix_Sparse_t* s, unsigned int rows, unsigned int cols) {
+
+	if (!s || s->row_ptr[0] != 0 || s->row_ptr[rows] != s->nnz) {
+		return false;
+	}
+	for (size_t r = 0; r < rows; ++r) {
+		if (s->row_ptr[r + 1] < s->row_ptr[r] || s->row_ptr[r + 1] > s->nnz) {
+			return false;
+		}
+		for (size_t p = s->row_ptr[r]; p < s->row_ptr[r + 1]; ++p) {
+			if (s->col_idx[p] >= cols || (p > s->row_ptr[r] && s->col_idx[p] <= s->col_idx[p - 1])) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: turns the per row counts left in row_ptr[r + 1] into offsets and
+ *          sizes the entry arrays to match
+ * INPUTS:
+ *	s: storage whose row_ptr holds the counts
+ *  rows: number of rows
+ * RETURN:
+ *  If the entry arrays could be sized then true
+ *  else false.
+ *
+ **/
+static bool finish_row_counts (Matrix_Sparse_t* s, size_t rows) {
+	for (size_t r = 0; r < rows; ++r) {
+		s->row_ptr[r + 1] += s->row_ptr[r];
+	}
+	s->nnz = s->row_ptr[rows];
+	const size_t bytes = (s->nnz ? s->nnz : 1) * sizeof(unsigned int);
+	unsigned int* col_idx = realloc(s->col_idx, bytes);
+	if (col_idx) {
+		s->col_idx = col_idx;
+	}
+	unsigned int* values = realloc(s->values, bytes);
+	if (values) {
+		s->values = values;
+	}
+	return col_idx && values;
+}
+
+/*
+ * PURPOSE: a sparse result more than half full takes more memory as CSR
+ *          than dense, so it is converted
+ * INPUTS:
+ *	m: the sparse result
+ * RETURN:
+ *  void
+ *
+ **/
+static void settle_storage (Matrix_t* m) {
+	if (m->sparse && m->sparse->nnz * 2 > (size_t) m->rows * m->cols) {
+		densify_matrix(m);
+	}
+}
+
+/*
+ * PURPOSE: copies row r of a matrix in either storage into a dense row
+ * INPUTS:
+ *	m: the matrix
+ *  r: the row
+ *  row: destination, m->cols values
+ * RETURN:
+ *  void
+ *
+ **/
+static void load_row (const Matrix_t* m, size_t r, unsigned int* row) {
+	if (m->sparse) {
+		memset(row, 0, m->cols * sizeof(unsigned int));
+		for (size_t p = m->sparse->row_ptr[r]; p < m->sparse->row_ptr[r + 1]; ++p) {
+			row[m->sparse->col_idx[p]] = m->sparse->values[p];
+		}
+	}
+	else {
+		memcpy(row, &m->data[r * m->cols], m->cols * sizeof(unsigned int));
+	}
+}
+
+/*row += row r of m, wrapping like add*/
+static void add_row (const Matrix_t* m, size_t r, unsigned int* row) {
+	if (m->sparse) {
+		for (size_t p = m->sparse->row_ptr[r]; p < m->sparse->row_ptr[r + 1]; ++p) {
+			row[m->sparse->col_idx[p]] += m->sparse->values[p];
+		}
+	}
+	else {
+		matrix_kernels.add_u32(row, row, &m->data[r * m->cols], m->cols);
+	}
+}
+
+static void count_nonzero_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		const unsigned int* row = &t->a->data[r * t->cols];
+		size_t count = 0;
+		for (size_t j = 0; j < t->cols; ++j) {
+			count += row[j] != 0;
+		}
+		t->out->row_ptr[r + 1] = count;
+	}
+}
+
+static void gather_nonzero_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		const unsigned int* row = &t->a->data[r * t->cols];
+		size_t p = t->out->row_ptr[r];
+		for (size_t j = 0; j < t->cols; ++j) {
+			if (row[j]) {
+				t->out->col_idx[p] = j;
+				t->out->values[p] = row[j];
+				++p;
+			}
+		}
+	}
+}
+
+static void scatter_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		load_row(t->a, r, &t->c->data[r * t->cols]);
+	}
+}
+
+/*
+ * PURPOSE: converts a dense matrix to CSR in place, dropping its zeros
+ * INPUTS:
+ *	m: the matrix, nothing happens if it is already sparse
+ * RETURN:
+ *  If no errors then true
+ *  else false and the matrix is left dense.
+ *
+ **/
+bool sparsify_matrix (Matrix_t* m) {
+
+	/*CSR values are unsigned ints, the other element types stay dense*/
+	if (!m || (!m->data && !m->sparse) || m->type != MATRIX_U32) {
+		return false;
+	}
+	if (m->sparse) {
+		return true;
+	}
+	if (!compact_matrix(m)) {
+		return false;
+	}
+
+	Matrix_Sparse_t* out = NULL;
+	if (!alloc_sparse(&out, m->rows, 0)) {
+		return false;
+	}
+	const size_t n = (size_t) m->rows * m->cols;
+	if (n) {
+		/*count each row, then fill each row at its offset*/
+		Sparse_Task_t t = { .a = m, .out = out, .cols = m->cols };
+		const size_t chunk = sparse_row_chunk(m->rows, m->cols, n);
+		parallel_for(n, chunk, count_nonzero_task, &t);
+		if (!finish_row_counts(out, m->rows)) {
+			free_sparse(&out);
+			return false;
+		}
+		parallel_for(n, chunk, gather_nonzero_task, &t);
+	}
+
+	release_dense_data(m);
+	m->sparse = out;
+	return true;
+}
+
+/*
+ * PURPOSE: converts a CSR matrix to a dense buffer in place
+ * INPUTS:
+ *	m: the matrix, nothing happens if it is already dense
+ * RETURN:
+ *  If no errors then true
+ *  else false and the matrix is left sparse.
+ *
+ **/
+bool densify_matrix (Matrix_t* m) {
+
+	if (!m || (!m->data && !m->sparse)) {
+		return false;
+	}
+	if (!m->sparse) {
+		return true;
+	}
+
+	const size_t n = (size_t) m->rows * m->cols;
+	unsigned int* data = memory_alloc(n * sizeof(unsigned int), false);
+	if (!data) {
+		return false;
+	}
+	Matrix_t dense = *m;
+	dense.data = data;
+	if (n) {
+		Sparse_Task_t t = { .a = m, .c = &dense, .cols = m->cols };
+		parallel_for(n, sparse_row_chunk(m->rows, m->cols, n), scatter_task, &t);
+	}
+
+	free_sparse(&m->sparse);
+	m->data = data;
+	return true;
+}
+
+static void merge_count_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_Sparse_t* a = t->a->sparse;
+	const Matrix_Sparse_t* b = t->b->sparse;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		size_t p = a->row_ptr[r];
+		size_t q = b->row_ptr[r];
+		size_t count = 0;
+		while (p < a->row_ptr[r + 1] && q < b->row_ptr[r + 1]) {
+			const unsigned int ca = a->col_idx[p];
+			const unsigned int cb = b->col_idx[q];
+			p += ca <= cb;
+			q += cb <= ca;
+			++count;
+		}
+		t->out->row_ptr[r + 1] = count + (a->row_ptr[r + 1] - p) + (b->row_ptr[r + 1] - q);
+	}
+}
+
+static void merge_add_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_Sparse_t* a = t->a->sparse;
+	const Matrix_Sparse_t* b = t->b->sparse;
+	Matrix_Sparse_t* c = t->out;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		size_t p = a->row_ptr[r];
+		size_t q = b->row_ptr[r];
+		size_t o = c->row_ptr[r];
+		while (p < a->row_ptr[r + 1] || q < b->row_ptr[r + 1]) {
+			const unsigned int ca = p < a->row_ptr[r + 1] ? a->col_idx[p] : UINT_MAX;
+			const unsigned int cb = q < b->row_ptr[r + 1] ? b->col_idx[q] : UINT_MAX;
+			unsigned int v = 0;
+			if (ca <= cb) {
+				v += a->values[p++];
+			}
+			if (cb <= ca) {
+				v += b->values[q++];
+			}
+			c->col_idx[o] = ca < cb ? ca : cb;
+			c->values[o] = v;
+			++o;
+		}
+	}
+}
+
+static void dense_add_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		unsigned int* row = &t->c->data[r * t->cols];
+		load_row(t->a, r, row);
+		add_row(t->b, r, row);
+	}
+}
+
+/*
+ * PURPOSE: c = a + b with at least one sparse operand. A sparse c is built by
+ *          merging the rows of a and b, a dense c is filled row by row.
+ * INPUTS:
+ *	a, b: the operands
+ *  c: the result, sparse only when a and b both are, never a or b
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool sparse_add (Matrix_t* a, Matrix_t* b, Matrix_t* c) {
+
+	const size_t rows = a->rows;
+	const size_t n = rows * a->cols;
+	Sparse_Task_t t = { .a = a, .b = b, .c = c, .cols = a->cols };
+
+	if (!c->sparse) {
+		if (n) {
+			parallel_for(n, sparse_row_chunk(rows, a->cols, n), dense_add_task, &t);
+		}
+		return true;
+	}
+
+	if (!a->sparse || !b->sparse || !alloc_sparse(&t.out, rows, 0)) {
+		return false;
+	}
+	if (n) {
+		const size_t chunk = sparse_row_chunk(rows, a->cols, a->sparse->nnz + b->sparse->nnz);
+		parallel_for(n, chunk, merge_count_task, &t);
+		if (!finish_row_counts(t.out, rows)) {
+			free_sparse(&t.out);
+			return false;
+		}
+		parallel_for(n, chunk, merge_add_task, &t);
+	}
+	free_sparse(&c->sparse);
+	c->sparse = t.out;
+	settle_storage(c);
+	return true;
+}
+
+/*values are summed in 64 bits, MUL_WRAP_32 keeps the low half like 32 bit sums would*/
+static unsigned int store_product (unsigned long long v, Matrix_Mul_Mode_t mode) {
+	return mode == MUL_ACCUM_64 && v > UINT_MAX ? UINT_MAX : (unsigned int) v;
+}
+
+/*
+ * Dense result: each row of c is summed in a 64 bit row buffer. A row of a
+ * is walked through its entries or its nonzero elements, and each one adds
+ * a scaled row of b, sparse or dense.
+ */
+static void spmm_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_t* a = t->a;
+	const Matrix_t* b = t->b;
+	const size_t n = b->cols;
+	unsigned long long* acc = malloc(n * sizeof(unsigned long long));
+	if (!acc) {
+		__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+		return;
+	}
+	for (size_t r = begin / n; r < end / n; ++r) {
+		memset(acc, 0, n * sizeof(unsigned long long));
+		const size_t p_end = a->sparse ? a->sparse->row_ptr[r + 1] : a->cols;
+		for (size_t p = a->sparse ? a->sparse->row_ptr[r] : 0; p < p_end; ++p) {
+			const size_t k = a->sparse ? a->sparse->col_idx[p] : p;
+			const unsigned long long va = a->sparse ? a->sparse->values[p] : a->data[r * a->cols + p];
+			if (va == 0) {
+				continue;
+			}
+			if (b->sparse) {
+				for (size_t q = b->sparse->row_ptr[k]; q < b->sparse->row_ptr[k + 1]; ++q) {
+					acc[b->sparse->col_idx[q]] += va * b->sparse->values[q];
+				}
+			}
+			else {
+				const unsigned int* brow = &b->data[k * n];
+				for (size_t j = 0; j < n; ++j) {
+					acc[j] += va * brow[j];
+				}
+			}
+		}
+		unsigned int* crow = &t->c->data[r * n];
+		for (size_t j = 0; j < n; ++j) {
+			crow[j] = store_product(acc[j], t->mode);
+		}
+	}
+	free(acc);
+}
+
+/*
+ * Sparse result, Gustavson's row by row product in two passes. The first
+ * counts the distinct columns of each row of c with a marker per column,
+ * the second sums them and writes the row out in column order.
+ */
+static void spgemm_count_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_Sparse_t* a = t->a->sparse;
+	const Matrix_Sparse_t* b = t->b->sparse;
+	size_t* mark = calloc(t->cols, sizeof(size_t));
+	if (!mark) {
+		__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+		return;
+	}
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		size_t count = 0;
+		for (size_t p = a->row_ptr[r]; p < a->row_ptr[r + 1]; ++p) {
+			const size_t k = a->col_idx[p];
+			for (size_t q = b->row_ptr[k]; q < b->row_ptr[k + 1]; ++q) {
+				if (mark[b->col_idx[q]] != r + 1) {
+					mark[b->col_idx[q]] = r + 1;
+					++count;
+				}
+			}
+		}
+		t->out->row_ptr[r + 1] = count;
+	}
+	free(mark);
+}
+
+static int compare_columns (const void* x, const void* y) {
+	const unsigned int a = *(const unsigned int*) x;
+	const unsigned int b = *(const unsigned int*) y;
+	return (a > b) - (a < b);
+}
+
+static void spgemm_fill_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_Sparse_t* a = t->a->sparse;
+	const Matrix_Sparse_t* b = t->b->sparse;
+	Matrix_Sparse_t* c = t->out;
+	size_t* mark = calloc(t->cols, sizeof(size_t));
+	unsigned long long* acc = malloc(t->cols * sizeof(unsigned long long));
+	unsigned int* touched = malloc(t->cols * sizeof(unsigned int));
+	if (!mark || !acc || !touched) {
+		__atomic_store_n(&t->failed, true, __ATOMIC_RELAXED);
+		free(mark);
+		free(acc);
+		free(touched);
+		return;
+	}
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		size_t count = 0;
+		for (size_t p = a->row_ptr[r]; p < a->row_ptr[r + 1]; ++p) {
+			const size_t k = a->col_idx[p];
+			const unsigned long long va = a->values[p];
+			for (size_t q = b->row_ptr[k]; q < b->row_ptr[k + 1]; ++q) {
+				const unsigned int j = b->col_idx[q];
+				if (mark[j] != r + 1) {
+					mark[j] = r + 1;
+					acc[j] = 0;
+					touched[count++] = j;
+				}
+				acc[j] += va * b->values[q];
+			}
+		}
+		qsort(touched, count, sizeof(unsigned int), compare_columns);
+		size_t o = c->row_ptr[r];
+		for (size_t i = 0; i < count; ++i) {
+			c->col_idx[o] = touched[i];
+			c->values[o] = store_product(acc[touched[i]], t->mode);
+			++o;
+		}
+	}
+	free(mark);
+	free(acc);
+	free(touched);
+}
+
+/*
+ * PURPOSE: c = a * b with at least one sparse operand
+ * INPUTS:
+ *	a, b: the operands
+ *  c: the result, sparse only when a and b both are, never a or b
+ *  mode: how sums are kept, see multiply_matrices
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool sparse_multiply (Matrix_t* a, Matrix_t* b, Matrix_t* c, Matrix_Mul_Mode_t mode) {
+
+	const size_t m = a->rows;
+	const size_t n = b->cols;
+	Sparse_Task_t t = { .a = a, .b = b, .c = c, .cols = n, .mode = mode };
+
+	if (!c->sparse) {
+		if (m && n) {
+			parallel_for(m * n, sparse_row_chunk(m, n, m * n), spmm_task, &t);
+		}
+		return !t.failed;
+	}
+
+	if (!a->sparse || !b->sparse || !alloc_sparse(&t.out, m, 0)) {
+		return false;
+	}
+	if (m && n) {
+		const size_t chunk = sparse_row_chunk(m, n, a->sparse->nnz);
+		parallel_for(m * n, chunk, spgemm_count_task, &t);
+		if (t.failed || !finish_row_counts(t.out, m)) {
+			free_sparse(&t.out);
+			return false;
+		}
+		parallel_for(m * n, chunk, spgemm_fill_task, &t);
+		if (t.failed) {
+			free_sparse(&t.out);
+			return false;
+		}
+	}
+	free_sparse(&c->sparse);
+	c->sparse = t.out;
+	settle_storage(c);
+	return true;
+}
+
+/*
+ * PURPOSE: compares one row of a sparse matrix with the same row of another
+ *          matrix in either storage, a missing entry counts as zero
+ * INPUTS:
+ *	a: the sparse matrix
+ *  b: the other matrix
+ *  r: the row
+ * RETURN:
+ *  If the rows hold the same values then true
+ *  else false.
+ *
+ **/
+static bool rows_equal (const Matrix_t* a, const Matrix_t* b, size_t r) {
+	const Matrix_Sparse_t* s = a->sparse;
+	size_t p = s->row_ptr[r];
+	if (b->sparse) {
+		size_t q = b->sparse->row_ptr[r];
+		while (p < s->row_ptr[r + 1] || q < b->sparse->row_ptr[r + 1]) {
+			const unsigned int ca = p < s->row_ptr[r + 1] ? s->col_idx[p] : UINT_MAX;
+			const unsigned int cb = q < b->sparse->row_ptr[r + 1] ? b->sparse->col_idx[q] : UINT_MAX;
+			const unsigned int va = ca <= cb ? s->values[p++] : 0;
+			const unsigned int vb = cb <= ca ? b->sparse->values[q++] : 0;
+			if (va != vb) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const unsigned int* row = &b->data[r * (b->stride ? b->stride : b->cols)];
+	for (size_t j = 0; j < b->cols; ++j) {
+		const unsigned int va = p < s->row_ptr[r + 1] && s->col_idx[p] == j ? s->values[p++] : 0;
+		if (va != row[j]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: compares two matrices of the same size when at least one is sparse
+ * INPUTS:
+ *	a, b: the matrices
+ * RETURN:
+ *  If every element matches then true
+ *  else false.
+ *
+ **/
+bool sparse_equal (Matrix_t* a, Matrix_t* b) {
+
+	if (!a->sparse) {
+		Matrix_t* swap = a;
+		a = b;
+		b = swap;
+	}
+	for (size_t r = 0; r < a->rows; ++r) {
+		if (!rows_equal(a, b, r)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: gives dest its own copy of the CSR storage of src, any storage
+ *          dest had is released. With src and dest the same matrix this
+ *          takes it off storage it shares.
+ * INPUTS:
+ *	src: the sparse matrix to copy
+ *  dest: a matrix of the same size
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool sparse_copy (Matrix_t* src, Matrix_t* dest) {
+
+	Matrix_Sparse_t* copy = NULL;
+	if (!alloc_sparse(&copy, src->rows, src->sparse->nnz)) {
+		return false;
+	}
+	memcpy(copy->row_ptr, src->sparse->row_ptr, (src->rows + 1) * sizeof(size_t));
+	memcpy(copy->col_idx, src->sparse->col_idx, src->sparse->nnz * sizeof(unsigned int));
+	memcpy(copy->values, src->sparse->values, src->sparse->nnz * sizeof(unsigned int));
+
+	release_dense_data(dest);
+	free_sparse(&dest->sparse);
+	dest->sparse = copy;
+	return true;
+}
+
+static void sparse_row_sums_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_Sparse_t* s = t->a->sparse;
+	for (size_t r = begin / t->cols; r < end / t->cols; ++r) {
+		unsigned int lo = UINT_MAX;
+		unsigned int hi = 0;
+		t->sums[r] = 0;
+		matrix_kernels.reduce_u32(&s->values[s->row_ptr[r]], s->row_ptr[r + 1] - s->row_ptr[r],
+			&t->sums[r], &lo, &hi);
+	}
+}
+
+/*
+ * PURPOSE: sums each row of a sparse matrix, the values of a row are
+ *          contiguous so this is one reduction per row
+ * INPUTS:
+ *	m: the sparse matrix
+ *  sums: array with room for m->rows totals
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool sparse_row_sums (Matrix_t* m, unsigned long long* sums) {
+
+	memset(sums, 0, m->rows * sizeof(unsigned long long));
+	if (m->rows == 0 || m->cols == 0) {
+		return true;
+	}
+	Sparse_Task_t t = { .a = m, .cols = m->cols, .sums = sums };
+	const size_t n = (size_t) m->rows * m->cols;
+	parallel_for(n, sparse_row_chunk(m->rows, m->cols, m->sparse->nnz), sparse_row_sums_task, &t);
+	return true;
+}
+
+/*the range here is the entries, each chunk sums into its own columns first*/
+static void sparse_col_sums_task (void* ctx, size_t begin, size_t end) {
+	Sparse_Task_t* t = ctx;
+	const Matrix_Sparse_t* s = t->a->sparse;
+	unsigned long long* acc = calloc(t->cols, sizeof(unsigned long long));
+	if (!acc) {
+		pthread_mutex_lock(&t->lock);
+		for (size_t p = begin; p < end; ++p) {
+			t->sums[s->col_idx[p]] += s->values[p];
+		}
+		pthread_mutex_unlock(&t->lock);
+		return;
+	}
+	for (size_t p = begin; p < end; ++p) {
+		acc[s->col_idx[p]] += s->values[p];
+	}
+	pthread_mutex_lock(&t->lock);
+	for (size_t j = 0; j < t->cols; ++j) {
+		t->sums[j] += acc[j];
+	}
+	pthread_mutex_unlock(&t->lock);
+	free(acc);
+}
+
+/*
+ * PURPOSE: sums each column of a sparse matrix by scattering its entries
+ * INPUTS:
+ *	m: the sparse matrix
+ *  sums: array with room for m->cols totals
+ * RETURN:
+ *  If no errors then true
+ *  else false.
+ *
+ **/
+bool sparse_col_sums (Matrix_t* m, unsigned long long* sums) {
+
+	memset(sums, 0, m->cols * sizeof(unsigned long long));
+	if (m->sparse->nnz == 0) {
+		return true;
+	}
+	Sparse_Task_t t = { .a = m, .cols = m->cols, .sums = sums };
+	pthread_mutex_init(&t.lock, NULL);
+	/*a chunk at least as long as a row so merging stays cheaper than summing*/
+	const size_t chunk = m->cols > PARALLEL_CHUNK_ELEMENTS ? m->cols : PARALLEL_CHUNK_ELEMENTS;
+	parallel_for(m->sparse->nnz, chunk, sparse_col_sums_task, &t);
+	pthread_mutex_destroy(&t.lock);
+	return true;
+}
+
+/*
+ * PURPOSE: prints a sparse matrix the same way display_matrix prints a dense one
+ * INPUTS:
+ *	m: the sparse matrix
+ * RETURN:
+ *  void
+ *
+ **/
+void sparse_display (Matrix_t* m) {
+
+	const Matrix_Sparse_t* s = m->sparse;
+	printf("\nMatrix Contents (%s):\n", m->name);
+	printf("DIM = (%u,%u) SPARSE NNZ = %zu\n", m->rows, m->cols, s->nnz);
+	for (size_t r = 0; r < m->rows; ++r) {
+		size_t p = s->row_ptr[r];
+		for (size_t j = 0; j < m->cols; ++j) {
+			const unsigned int v = p < s->row_ptr[r + 1] && s->col_idx[p] == j ? s->values[p++] : 0;
+			printf("%u ", v);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
@@ -0,0 +1,30 @@
+#ifndef _MATRIX_SPARSE_H_
+#define _MATRIX_SPARSE_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "matrix.h"
+
+/*
+ * CSR side of the matrix operations. matrix.c hands an operation over
+ * when one of its operands is sparse, arguments and dimensions have
+ * already been checked by then.
+ */
+
+/*dense storage helper from matrix.c, drops one hold on the elements*/
+void release_dense_data (Matrix_t* m);
+
+bool alloc_sparse (Matrix_Sparse_t** s, size_t rows, size_t nnz);
+void free_sparse (Matrix_Sparse_t** s);
+bool sparse_is_well_formed (const Matrix_Sparse_t* s, unsigned int rows, unsigned int cols);
+
+bool sparse_add (Matrix_t* a, Matrix_t* b, Matrix_t* c);
+bool sparse_multiply (Matrix_t* a, Matrix_t* b, Matrix_t* c, Matrix_Mul_Mode_t mode);
+bool sparse_equal (Matrix_t* a, Matrix_t* b);
+bool sparse_copy (Matrix_t* src, Matrix_t* dest);
+bool sparse_row_sums (Matrix_t* m, unsigned long long* sums);
+bool sparse_col_sums (Matrix_t* m, unsigned long long* sums);
+void sparse_display (Matrix_t* m);
+
+#endif
@@ -0,0 +1,783 @@
+/*fopencookie and the nonportable rwlock kind*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "catalogue.h"
+#include "command.h"
+#include "dispatch.h"
+#include "matrix_jobs.h"
+#include "server.h"
+
+/*bytes a client buffer starts with, it grows up to LINE_BUFFER_BYTES*/
+#define SERVER_INPUT_BYTES 4096
+
+typedef struct {
+	char* buf;
+	size_t len;
+	size_t cap;
+}Server_Output_t;
+
+/*
+ * Only the event loop touches a client, except for line and reply which
+ * belong to the worker between taking the client off the queue and
+ * putting it on the done list.
+ */
+typedef struct Server_Client {
+	int fd;				/*-1 once hung up*/
+	char* in;			/*bytes received and not run yet*/
+	size_t in_len;
+	size_t in_cap;
+	bool eof;			/*the client has sent all it will*/
+	Server_Output_t out;		/*replies waiting to be sent*/
+	size_t out_sent;
+	char* line;			/*the command being run, NULL while idle*/
+	Server_Output_t reply;		/*what that command printed*/
+	bool closed;			/*hung up while its command ran*/
+	struct Server_Client* next;	/*on the work queue or the done list*/
+	struct Server_Client* prev_client;
+	struct Server_Client* next_client;
+}Server_Client_t;
+
+typedef struct {
+	Matrix_Catalogue_t* mats;
+	int epoll_fd;
+	int listen_fd;
+	int wake_fd;			/*an eventfd the workers signal when a command is done*/
+	pthread_rwlock_t catalogue_lock;
+	pthread_rwlock_t matrix_locks[SERVER_LOCK_STRIPES];
+	pthread_mutex_t lock;		/*guards the queue, the done list and stopping*/
+	pthread_cond_t work;
+	Server_Client_t* queue;
+	Server_Client_t** queue_tail;
+	Server_Client_t* done;
+	bool stopping;
+	Server_Client_t* clients;	/*every client not freed yet*/
+	Server_Client_t* gone;		/*hung up and idle, freed after the events in hand*/
+}Server_t;
+
+/*epoll data of the descriptors that are not clients*/
+static char listen_tag, wake_tag, stop_tag;
+
+/*set for SIGINT and SIGTERM, written from the handler*/
+static int stop_fd = -1;
+
+/*where stdout goes on the calling thread, NULL for the real stdout*/
+static __thread Server_Output_t* sink = NULL;
+
+static bool append_output (Server_Output_t* o, const char* buf, size_t len) {
+	if (o->len + len > o->cap) {
+		size_t cap = o->cap ? o->cap : SERVER_INPUT_BYTES;
+		while (cap < o->len + len) {
+			cap *= 2;
+		}
+		char* grown = realloc(o->buf, cap);
+		if (!grown) {
+			return false;
+		}
+		o->buf = grown;
+		o->cap = cap;
+	}
+	memcpy(o->buf + o->len, buf, len);
+	o->len += len;
+	return true;
+}
+
+/*
+ * PURPOSE: write function of the stdout the server swaps in, so whatever a
+ *          command prints goes to the reply of the client that sent it
+ * INPUTS:
+ *	cookie: unused
+ *  buf: the bytes printed
+ *  size: how many
+ * RETURN:
+ *  size
+ *
+ **/
+static ssize_t write_output (void* cookie, const char* buf, size_t size) {
+	/*an error would stick to the stream every worker shares, so bytes that do not fit are dropped*/
+	if (sink) {
+		append_output(sink, buf, size);
+		return size;
+	}
+	for (size_t done = 0; done < size; ) {
+		const ssize_t wrote = write(STDOUT_FILENO, buf + done, size - done);
+		if (wrote < 0 && errno != EINTR) {
+			return done;
+		}
+		done += wrote > 0 ? wrote : 0;
+	}
+	return size;
+}
+
+typedef struct {
+	Server_Output_t out;
+	Server_Output_t* outer;		/*the sink to put back*/
+}Server_Held_t;
+
+/*output holder of the server, the thread prints to a buffer of its own until release*/
+static void* hold_reply (void) {
+	Server_Held_t* h = calloc(1, sizeof(Server_Held_t));
+	if (!h) {
+		return NULL;
+	}
+	h->outer = sink;
+	sink = &h->out;
+	return h;
+}
+
+static void release_reply (void* held, bool keep) {
+	Server_Held_t* h = held;
+	if (!h) {
+		return;
+	}
+	sink = h->outer;
+	if (keep && h->out.len) {
+		write_output(NULL, h->out.buf, h->out.len);
+	}
+	free(h->out.buf);
+	free(h);
+}
+
+static const Output_Holder_t reply_holder = { hold_reply, release_reply };
+
+static void on_stop_signal (int sig) {
+	const uint64_t one = 1;
+	const int saved = errno;
+	if (write(stop_fd, &one, sizeof(one)) < 0) {
+		/*already signalled*/
+	}
+	errno = saved;
+}
+
+/*FNV-1a over the name, matrices that collide just share a lock*/
+static size_t stripe_of (const char* name) {
+	uint32_t h = 2166136261u;
+	for (; *name; ++name) {
+		h ^= (unsigned char) *name;
+		h *= 16777619u;
+	}
+	return h % SERVER_LOCK_STRIPES;
+}
+
+static int compare_stripes (const void* a, const void* b) {
+	const size_t x = *(const size_t*) a;
+	const size_t y = *(const size_t*) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * PURPOSE: locks the stripes of every name among the arguments, in
+ *          ascending order so two commands never wait on each other
+ * INPUTS:
+ *	s: the server
+ *  cmd: the command, arguments that are not matrices lock a stripe too
+ *  write: lock alone rather than shared
+ *  stripes: receives the stripes locked, room for MAX_CMD_COUNT
+ * RETURN:
+ *  how many stripes were locked
+ *
+ **/
+static size_t lock_matrices (Server_t* s, const Commands_t* cmd, bool write, size_t* stripes) {
+	size_t n = 0;
+	for (unsigned int i = 1; i < cmd->num_cmds; ++i) {
+		stripes[n++] = stripe_of(cmd->cmds[i]);
+	}
+	qsort(stripes, n, sizeof(size_t), compare_stripes);
+	size_t unique = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (unique == 0 || stripes[i] != stripes[unique - 1]) {
+			stripes[unique++] = stripes[i];
+		}
+	}
+	for (size_t i = 0; i < unique; ++i) {
+		if (write) {
+			pthread_rwlock_wrlock(&s->matrix_locks[stripes[i]]);
+		}
+		else {
+			pthread_rwlock_rdlock(&s->matrix_locks[stripes[i]]);
+		}
+	}
+	return unique;
+}
+
+/*
+ * PURPOSE: parses and runs a client's line under the locks its command
+ *          needs, with stdout going to the client's reply
+ * INPUTS:
+ *	s: the server
+ *  c: the client, line is run and reply filled
+ * RETURN:
+ *  void
+ *
+ **/
+static void run_line (Server_t* s, Server_Client_t* c) {
+	Commands_t cmd;
+	sink = &c->reply;
+	if (!parse_user_input(c->line, &cmd)) {
+		printf("Failed at parsing command\n\n");
+	}
+	else if (cmd.num_cmds > 0) {
+		const Command_Access_t access = command_access(&cmd);
+		if (access == COMMAND_EXCLUSIVE) {
+			pthread_rwlock_wrlock(&s->catalogue_lock);
+			/*background jobs that have finished report to the next command that may add their matrix*/
+			collect_jobs(s->mats);
+			run_commands(&cmd, s->mats);
+			pthread_rwlock_unlock(&s->catalogue_lock);
+		}
+		else {
+			size_t stripes[MAX_CMD_COUNT];
+			pthread_rwlock_rdlock(&s->catalogue_lock);
+			const size_t n = lock_matrices(s, &cmd, access == COMMAND_WRITES, stripes);
+			run_commands(&cmd, s->mats);
+			for (size_t i = n; i > 0; --i) {
+				pthread_rwlock_unlock(&s->matrix_locks[stripes[i - 1]]);
+			}
+			pthread_rwlock_unlock(&s->catalogue_lock);
+		}
+	}
+	sink = NULL;
+}
+
+static void* worker_thread (void* arg) {
+	Server_t* s = arg;
+	for (;;) {
+		pthread_mutex_lock(&s->lock);
+		while (!s->queue && !s->stopping) {
+			pthread_cond_wait(&s->work, &s->lock);
+		}
+		if (s->stopping) {
+			pthread_mutex_unlock(&s->lock);
+			return NULL;
+		}
+		Server_Client_t* c = s->queue;
+		s->queue = c->next;
+		if (!s->queue) {
+			s->queue_tail = &s->queue;
+		}
+		pthread_mutex_unlock(&s->lock);
+
+		run_line(s, c);
+
+		pthread_mutex_lock(&s->lock);
+		c->next = s->done;
+		s->done = c;
+		pthread_mutex_unlock(&s->lock);
+		const uint64_t one = 1;
+		if (write(s->wake_fd, &one, sizeof(one)) < 0) {
+			/*the counter is already nonzero*/
+		}
+	}
+}
+
+static void free_client (Server_t* s, Server_Client_t* c) {
+	if (c->prev_client) {
+		c->prev_client->next_client = c->next_client;
+	}
+	else {
+		s->clients = c->next_client;
+	}
+	if (c->next_client) {
+		c->next_client->prev_client = c->prev_client;
+	}
+	if (c->fd >= 0) {
+		close(c->fd);
+	}
+	free(c->in);
+	free(c->out.buf);
+	free(c->line);
+	free(c->reply.buf);
+	free(c);
+}
+
+/*
+ * PURPOSE: closes a client's connection. The client is freed after the
+ *          events in hand, as one of them may still name it, or once its
+ *          running command is done.
+ * INPUTS:
+ *	s: the server
+ *  c: the client
+ * RETURN:
+ *  void
+ *
+ **/
+static void hang_up (Server_t* s, Server_Client_t* c) {
+	epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	c->fd = -1;
+	if (c->line) {
+		c->closed = true;
+	}
+	else {
+		c->next = s->gone;
+		s->gone = c;
+	}
+}
+
+/*waits for input while there is room for it and for output while replies are queued*/
+static void update_events (Server_t* s, Server_Client_t* c) {
+	struct epoll_event ev = { .data.ptr = c };
+	if (!c->eof && c->in_len < LINE_BUFFER_BYTES) {
+		ev.events |= EPOLLIN;
+	}
+	if (c->out_sent < c->out.len) {
+		ev.events |= EPOLLOUT;
+	}
+	epoll_ctl(s->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/*
+ * PURPOSE: sends as much of the queued replies as the socket takes
+ * INPUTS:
+ *	s: the server
+ *  c: the client
+ * RETURN:
+ *  If the client is still connected then true
+ *  else false.
+ *
+ **/
+static bool send_replies (Server_t* s, Server_Client_t* c) {
+	while (c->out_sent < c->out.len) {
+		const ssize_t sent = send(c->fd, c->out.buf + c->out_sent, c->out.len - c->out_sent, MSG_NOSIGNAL);
+		if (sent > 0) {
+			c->out_sent += sent;
+		}
+		else if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		else {
+			hang_up(s, c);
+			return false;
+		}
+	}
+	if (c->out_sent == c->out.len) {
+		c->out.len = 0;
+		c->out_sent = 0;
+	}
+	return true;
+}
+
+/*
+ * PURPOSE: hands the next complete line of an idle client to the workers
+ * INPUTS:
+ *	s: the server
+ *  c: the client
+ * RETURN:
+ *  void
+ *
+ **/
+static void next_command (Server_t* s, Server_Client_t* c) {
+	if (!c->line) {
+		char* nl = memchr(c->in, '\n', c->in_len);
+		if (nl) {
+			const size_t len = nl - c->in;
+			c->line = malloc(len + 1);
+			if (!c->line) {
+				hang_up(s, c);
+				return;
+			}
+			memcpy(c->line, c->in, len);
+			c->line[len] = '\0';
+			if (len > 0 && c->line[len - 1] == '\r') {
+				c->line[len - 1] = '\0';
+			}
+			c->in_len -= len + 1;
+			memmove(c->in, nl + 1, c->in_len);
+
+			if (strncmp(c->line, "exit", strlen("exit") + 1) == 0) {
+				free(c->line);
+				c->line = NULL;
+				hang_up(s, c);
+				return;
+			}
+			pthread_mutex_lock(&s->lock);
+			c->next = NULL;
+			*s->queue_tail = c;
+			s->queue_tail = &c->next;
+			pthread_cond_signal(&s->work);
+			pthread_mutex_unlock(&s->lock);
+		}
+		else if (c->in_len == LINE_BUFFER_BYTES) {
+			const char error[] = "Lines longer than 1MB are not run\n";
+			if (append_output(&c->out, error, sizeof(error))) {
+				send_replies(s, c);
+			}
+			if (c->fd >= 0) {
+				hang_up(s, c);
+			}
+			return;
+		}
+	}
+	/*a client that is done sending goes once everything it sent is answered*/
+	if (c->eof && !c->line && c->out.len == 0) {
+		hang_up(s, c);
+		return;
+	}
+	update_events(s, c);
+}
+
+/*
+ * PURPOSE: reads what a client has sent and starts its next command
+ * INPUTS:
+ *	s: the server
+ *  c: the client
+ * RETURN:
+ *  void
+ *
+ **/
+static void receive_lines (Server_t* s, Server_Client_t* c) {
+	while (c->in_len < LINE_BUFFER_BYTES) {
+		if (c->in_len == c->in_cap) {
+			const size_t cap = c->in_cap * 2 < LINE_BUFFER_BYTES ? c->in_cap * 2 : LINE_BUFFER_BYTES;
+			char* grown = realloc(c->in, cap);
+			if (!grown) {
+				hang_up(s, c);
+				return;
+			}
+			c->in = grown;
+			c->in_cap = cap;
+		}
+		const ssize_t got = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+		if (got > 0) {
+			c->in_len += got;
+		}
+		else if (got == 0) {
+			c->eof = true;
+			break;
+		}
+		else if (errno == EINTR) {
+			continue;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		}
+		else {
+			hang_up(s, c);
+			return;
+		}
+	}
+	next_command(s, c);
+}
+
+static void accept_clients (Server_t* s) {
+	for (;;) {
+		const int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+				perror("SERVER FAILED TO ACCEPT A CLIENT");
+			}
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			return;
+		}
+		Server_Client_t* c = calloc(1, sizeof(Server_Client_t));
+		if (c) {
+			c->in = malloc(SERVER_INPUT_BYTES);
+			c->in_cap = SERVER_INPUT_BYTES;
+		}
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+		if (!c || !c->in || epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			if (c) {
+				free(c->in);
+			}
+			free(c);
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->next_client = s->clients;
+		if (s->clients) {
+			s->clients->prev_client = c;
+		}
+		s->clients = c;
+	}
+}
+
+/*
+ * PURPOSE: queues the replies of the commands the workers have finished
+ *          and starts the next command of each of those clients
+ * INPUTS:
+ *	s: the server
+ * RETURN:
+ *  void
+ *
+ **/
+static void finish_commands (Server_t* s) {
+	uint64_t count;
+	if (read(s->wake_fd, &count, sizeof(count)) < 0) {
+		/*nothing new*/
+	}
+	pthread_mutex_lock(&s->lock);
+	Server_Client_t* done = s->done;
+	s->done = NULL;
+	pthread_mutex_unlock(&s->lock);
+
+	while (done) {
+		Server_Client_t* c = done;
+		done = c->next;
+		free(c->line);
+		c->line = NULL;
+		if (c->closed) {
+			c->next = s->gone;
+			s->gone = c;
+			continue;
+		}
+		const char end = SERVER_END_OF_REPLY;
+		const bool queued = append_output(&c->out, c->reply.buf, c->reply.len)
+			&& append_output(&c->out, &end, 1);
+		c->reply.len = 0;
+		if (!queued) {
+			hang_up(s, c);
+		}
+		else if (send_replies(s, c)) {
+			next_command(s, c);
+		}
+	}
+}
+
+/*
+ * PURPOSE: creates the listening socket, a stale socket file left by a
+ *          server that is gone is replaced
+ * INPUTS:
+ *	socket_path: where to listen
+ * RETURN:
+ *  the socket, or -1 with the reason printed
+ *
+ **/
+static int open_listener (const char* socket_path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path %s is longer than %zu bytes\n", socket_path, sizeof(addr.sun_path) - 1);
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		perror("SERVER FAILED TO CREATE ITS SOCKET");
+		return -1;
+	}
+	struct stat st;
+	if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		const bool live = probe >= 0 && connect(probe, (struct sockaddr*) &addr, sizeof(addr)) == 0;
+		if (probe >= 0) {
+			close(probe);
+		}
+		if (live) {
+			fprintf(stderr, "A server is already listening on %s\n", socket_path);
+			close(fd);
+			return -1;
+		}
+		unlink(socket_path);
+	}
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+		perror("SERVER FAILED TO LISTEN ON ITS SOCKET");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool watch (Server_t* s, int fd, void* tag) {
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = tag };
+	return epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+/*
+ * PURPOSE: serves the catalogue on a Unix domain socket until SIGINT or
+ *          SIGTERM, see server.h
+ * INPUTS:
+ *	socket_path: where to listen, removed again when the server stops
+ *  mats: the catalogue every client shares
+ *  num_workers: commands that can run at the same time
+ * RETURN:
+ *  0 when stopped by a signal
+ *  else -1.
+ *
+ **/
+int run_server (const char* socket_path, Matrix_Catalogue_t* mats, unsigned int num_workers) {
+
+	if (!socket_path || !mats) {
+		return -1;
+	}
+	num_workers = num_workers ? num_workers : 1;
+
+	Server_t* s = calloc(1, sizeof(Server_t));
+	if (!s) {
+		perror("SERVER FAILED TO ALLOCATE ITS STATE");
+		return -1;
+	}
+	s->mats = mats;
+	s->queue_tail = &s->queue;
+	s->epoll_fd = s->listen_fd = s->wake_fd = -1;
+
+	/*writers go ahead of new readers so changes are not starved by a stream of reads*/
+	pthread_rwlockattr_t attr;
+	pthread_rwlockattr_init(&attr);
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&s->catalogue_lock, &attr);
+	for (size_t i = 0; i < SERVER_LOCK_STRIPES; ++i) {
+		pthread_rwlock_init(&s->matrix_locks[i], &attr);
+	}
+	pthread_rwlockattr_destroy(&attr);
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->work, NULL);
+
+	int status = -1;
+	pthread_t* workers = calloc(num_workers, sizeof(pthread_t));
+	unsigned int started = 0;
+	FILE* real_stdout = stdout;
+	FILE* replies = NULL;
+	struct sigaction stop = { .sa_handler = on_stop_signal, .sa_flags = SA_RESTART };
+	struct sigaction old_int, old_term;
+	sigemptyset(&stop.sa_mask);
+
+	s->listen_fd = open_listener(socket_path);
+	if (s->listen_fd < 0) {
+		goto cleanup;
+	}
+	stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	sigaction(SIGINT, &stop, &old_int);
+	sigaction(SIGTERM, &stop, &old_term);
+	s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (!workers || s->epoll_fd < 0 || s->wake_fd < 0 || stop_fd < 0
+		|| !watch(s, s->listen_fd, &listen_tag) || !watch(s, s->wake_fd, &wake_tag) || !watch(s, stop_fd, &stop_tag)) {
+		perror("SERVER FAILED TO SET UP ITS EVENTS");
+		goto restore;
+	}
+
+	/*glibc lets stdout be reassigned, every printf of a worker lands in its client's reply*/
+	replies = fopencookie(NULL, "w", (cookie_io_functions_t) { .write = write_output });
+	if (!replies) {
+		perror("SERVER FAILED TO REDIRECT ITS OUTPUT");
+		goto restore;
+	}
+	setvbuf(replies, NULL, _IONBF, 0);
+	/*stdout is shared by the workers, output held back goes aside per thread*/
+	set_output_holder(&reply_holder);
+	for (; started < num_workers; ++started) {
+		if (pthread_create(&workers[started], NULL, worker_thread, s) != 0) {
+			break;
+		}
+	}
+	if (started == 0) {
+		perror("SERVER FAILED TO START ITS WORKERS");
+		goto restore;
+	}
+	printf("Serving on %s with %u workers\n", socket_path, started);
+	fflush(stdout);
+	stdout = replies;
+
+	struct epoll_event events[SERVER_MAX_EVENTS];
+	bool running = true;
+	while (running) {
+		const int n = epoll_wait(s->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("SERVER FAILED TO WAIT FOR EVENTS");
+			break;
+		}
+		for (int i = 0; i < n; ++i) {
+			void* tag = events[i].data.ptr;
+			if (tag == &listen_tag) {
+				accept_clients(s);
+			}
+			else if (tag == &wake_tag) {
+				finish_commands(s);
+			}
+			else if (tag == &stop_tag) {
+				running = false;
+				status = 0;
+			}
+			else {
+				/*a client hung up by an earlier event of the batch is skipped*/
+				Server_Client_t* c = tag;
+				if (c->fd < 0) {
+					continue;
+				}
+				/*with the peer gone nothing can be answered*/
+				if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+					hang_up(s, c);
+				}
+				else if (events[i].events & EPOLLIN) {
+					receive_lines(s, c);
+				}
+				else if (events[i].events & EPOLLOUT && send_replies(s, c)) {
+					next_command(s, c);
+				}
+			}
+		}
+		while (s->gone) {
+			Server_Client_t* c = s->gone;
+			s->gone = c->next;
+			free_client(s, c);
+		}
+	}
+
+	stdout = real_stdout;
+restore:
+	/*commands already running finish, the ones still queued are dropped*/
+	pthread_mutex_lock(&s->lock);
+	s->stopping = true;
+	pthread_cond_broadcast(&s->work);
+	pthread_mutex_unlock(&s->lock);
+	for (unsigned int i = 0; i < started; ++i) {
+		pthread_join(workers[i], NULL);
+	}
+	set_output_holder(NULL);
+	if (replies) {
+		fclose(replies);
+	}
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	unlink(socket_path);
+cleanup:
+	while (s->clients) {
+		free_client(s, s->clients);
+	}
+	if (s->listen_fd >= 0) {
+		close(s->listen_fd);
+	}
+	if (s->epoll_fd >= 0) {
+		close(s->epoll_fd);
+	}
+	if (s->wake_fd >= 0) {
+		close(s->wake_fd);
+	}
+	if (stop_fd >= 0) {
+		close(stop_fd);
+		stop_fd = -1;
+	}
+	for (size_t i = 0; i < SERVER_LOCK_STRIPES; ++i) {
+		pthread_rwlock_destroy(&s->matrix_locks[i]);
+	}
+	pthread_rwlock_destroy(&s->catalogue_lock);
+	pthread_cond_destroy(&s->work);
+	pthread_mutex_destroy(&s->lock);
+	free(workers);
+	free(s);
+	return status;
+}
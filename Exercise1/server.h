@@ -0,0 +1,24 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include "catalogue.h"
+
+/*
+ * Serves the command grammar to many clients over a Unix domain socket.
+ * A client sends one command per line and gets back what the command
+ * printed followed by SERVER_END_OF_REPLY, exit closes the connection.
+ * One thread waits on every socket with epoll and hands complete lines to
+ * a pool of workers, one command per client at a time. A command that
+ * only reads the matrices it names takes their locks shared, one that
+ * changes them in place takes them alone, and one that adds or removes
+ * matrices has the whole catalogue to itself. Matrix locks are striped by
+ * a hash of the name. SIGINT or SIGTERM stops the server once the running
+ * commands are done.
+ */
+#define SERVER_END_OF_REPLY '\0'
+#define SERVER_MAX_EVENTS 64
+#define SERVER_LOCK_STRIPES 256
+
+int run_server (const char* socket_path, Matrix_Catalogue_t* mats, unsigned int num_workers);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+
+/*
+ * Stress test for parallel_for, run by make test. Jobs are handed to the
+ * pool back to back so workers waking late for one job meet the next,
+ * every element of every job has to be visited exactly once. A pool that
+ * deadlocks is stopped by the alarm.
+ */
+#define TEST_THREADS 4
+#define TEST_ROUNDS 20000
+#define TEST_TIMEOUT_S 120
+
+typedef struct {
+	unsigned char* seen;
+	unsigned long long sum;
+}Test_Task_t;
+
+static void count_task (void* ctx, size_t begin, size_t end) {
+	Test_Task_t* t = ctx;
+	unsigned long long sum = 0;
+	for (size_t i = begin; i < end; ++i) {
+		t->seen[i]++;
+		sum += i;
+	}
+	__atomic_add_fetch(&t->sum, sum, __ATOMIC_RELAXED);
+}
+
+static void timed_out (int sig) {
+	(void) sig;
+	static const char msg[] = "FAIL: parallel_for did not return, the pool is deadlocked\n";
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0) {
+		_exit(2);
+	}
+	_exit(1);
+}
+
+/*
+ * PURPOSE: runs one job over n elements and checks every element ran once
+ * INPUTS:
+ *	n: elements in the range
+ *  chunk: elements per chunk
+ *  seen: room for n counters
+ * RETURN:
+ *  If every element ran exactly once then true
+ *  else false.
+ *
+ **/
+static bool run_round (size_t n, size_t chunk, unsigned char* seen) {
+	Test_Task_t t = { .seen = seen, .sum = 0 };
+	memset(seen, 0, n);
+	parallel_for(n, chunk, count_task, &t);
+	for (size_t i = 0; i < n; ++i) {
+		if (seen[i] != 1) {
+			fprintf(stderr, "FAIL: element %zu of %zu ran %u times\n", i, n, seen[i]);
+			return false;
+		}
+	}
+	if (t.sum != (unsigned long long) n * (n - 1) / 2) {
+		fprintf(stderr, "FAIL: sum over %zu elements is %llu\n", n, t.sum);
+		return false;
+	}
+	return true;
+}
+
+int main (void) {
+	signal(SIGALRM, timed_out);
+	alarm(TEST_TIMEOUT_S);
+
+	if (!init_thread_pool(TEST_THREADS)) {
+		fprintf(stderr, "FAIL: could not start %d threads\n", TEST_THREADS);
+		return 1;
+	}
+	const size_t max_n = 1 << 18;
+	unsigned char* seen = malloc(max_n);
+	if (!seen) {
+		destroy_thread_pool();
+		return 1;
+	}
+
+	bool ok = true;
+	for (unsigned int r = 0; ok && r < TEST_ROUNDS; ++r) {
+		/*mostly the smallest job that goes to the pool, it ends before the workers wake*/
+		const size_t n = r % 16 ? PARALLEL_MIN_ELEMENTS : PARALLEL_MIN_ELEMENTS + (r * 7919) % (max_n - PARALLEL_MIN_ELEMENTS);
+		const size_t chunk = r % 3 ? 0 : 1 + r % 4096;
+		ok = run_round(n, chunk, seen);
+	}
+
+	free(seen);
+	destroy_thread_pool();
+	if (ok) {
+		printf("thread pool: %d rounds on %d threads passed\n", TEST_ROUNDS, TEST_THREADS);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "thread_pool.h"
+
+/*
+ * One pool for the whole program. parallel_for publishes a job, the
+ * workers and the calling thread pull chunks off a shared counter until
+ * the range is used up, then the caller waits for the stragglers.
+ */
+typedef struct {
+	Pool_Task_t task;
+	void* ctx;
+	size_t n;
+	size_t chunk;
+	size_t next;
+	unsigned int active;
+}Pool_Job_t;
+
+static pthread_t* workers = NULL;
+static pid_t* worker_tids = NULL;	/*kernel thread ids, for per thread counters*/
+static unsigned int num_workers = 0;
+static unsigned int num_started = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t job_done = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t worker_started = PTHREAD_COND_INITIALIZER;
+static Pool_Job_t job;
+static unsigned long generation = 0;
+static bool shutting_down = false;
+static __thread bool inside_pool = false;
+
+/*
+ * PURPOSE: grab chunks of the current job until none are left
+ * INPUTS:
+ *	j: the job being worked on
+ * RETURN:
+ *  void
+ *
+ **/
+static void run_chunks (Pool_Job_t* j) {
+	for (;;) {
+		size_t begin = __atomic_fetch_add(&j->next, j->chunk, __ATOMIC_RELAXED);
+		if (begin >= j->n) {
+			return;
+		}
+		size_t end = begin + j->chunk < j->n ? begin + j->chunk : j->n;
+		j->task(j->ctx, begin, end);
+	}
+}
+
+/*
+ * PURPOSE: worker loop, publishes its thread id then sleeps until a new
+ *          job generation shows up
+ * INPUTS:
+ *	arg: index of the worker
+ * RETURN:
+ *  NULL
+ *
+ **/
+static void* worker_main (void* arg) {
+	inside_pool = true;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool_lock);
+	worker_tids[(size_t) arg] = (pid_t) syscall(SYS_gettid);
+	num_started++;
+	pthread_cond_signal(&worker_started);
+	for (;;) {
+		while (!shutting_down && generation == seen) {
+			pthread_cond_wait(&job_ready, &pool_lock);
+		}
+		if (shutting_down) {
+			break;
+		}
+		seen = generation;
+		/*
+		 * a worker that wakes after the caller ran the job to the end must
+		 * not join it, the caller may be gone and the next job on its way
+		 */
+		if (__atomic_load_n(&job.next, __ATOMIC_RELAXED) >= job.n) {
+			continue;
+		}
+		job.active++;
+		pthread_mutex_unlock(&pool_lock);
+
+		run_chunks(&job);
+
+		pthread_mutex_lock(&pool_lock);
+		if (--job.active == 0) {
+			pthread_cond_signal(&job_done);
+		}
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return NULL;
+}
+
+/*
+ * PURPOSE: start the worker threads, the calling thread counts as one of them
+ * INPUTS:
+ *	num_threads: total threads to use, 0 means one per online cpu
+ * RETURN:
+ *  If the workers started then true
+ *  else false, the program still works on a single thread.
+ *
+ **/
+bool init_thread_pool (unsigned int num_threads) {
+
+	if (workers) {
+		return false;
+	}
+
+	if (num_threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = cpus > 0 ? (unsigned int) cpus : 1;
+	}
+	if (num_threads <= 1) {
+		return true;
+	}
+
+	workers = calloc(num_threads - 1, sizeof(pthread_t));
+	worker_tids = calloc(num_threads - 1, sizeof(pid_t));
+	if (!workers || !worker_tids) {
+		free(workers);
+		free(worker_tids);
+		workers = NULL;
+		worker_tids = NULL;
+		return false;
+	}
+
+	shutting_down = false;
+	for (unsigned int i = 0; i < num_threads - 1; ++i) {
+		if (pthread_create(&workers[i], NULL, worker_main, (void*) (size_t) i) != 0) {
+			perror("FAILED TO START WORKER THREAD");
+			break;
+		}
+		num_workers++;
+	}
+
+	/*every worker has its id published once this returns*/
+	pthread_mutex_lock(&pool_lock);
+	while (num_started < num_workers) {
+		pthread_cond_wait(&worker_started, &pool_lock);
+	}
+	pthread_mutex_unlock(&pool_lock);
+	return num_workers == num_threads - 1;
+}
+
+/*
+ * PURPOSE: stop and join all the worker threads
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  void
+ *
+ **/
+void destroy_thread_pool (void) {
+
+	if (!workers) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool_lock);
+	shutting_down = true;
+	pthread_cond_broadcast(&job_ready);
+	pthread_mutex_unlock(&pool_lock);
+
+	for (unsigned int i = 0; i < num_workers; ++i) {
+		pthread_join(workers[i], NULL);
+	}
+	free(workers);
+	free(worker_tids);
+	workers = NULL;
+	worker_tids = NULL;
+	num_workers = 0;
+	num_started = 0;
+}
+
+/*
+ * PURPOSE: number of threads taking part in a parallel_for
+ * INPUTS:
+ *	none
+ * RETURN:
+ *  worker count plus the calling thread
+ *
+ **/
+unsigned int thread_pool_size (void) {
+	return num_workers + 1;
+}
+
+/*
+ * PURPOSE: kernel thread ids of the workers, the calling thread not included
+ * INPUTS:
+ *	tids: receives up to max ids
+ *  max: room in tids
+ * RETURN:
+ *  number of ids written
+ *
+ **/
+unsigned int thread_pool_tids (pid_t* tids, unsigned int max) {
+	unsigned int n = num_workers < max ? num_workers : max;
+	if (n) {
+		memcpy(tids, worker_tids, n * sizeof(pid_t));
+	}
+	return n;
+}
+
+/*
+ * PURPOSE: split [0, n) into chunks and run task over them on the pool
+ * INPUTS:
+ *	n: number of elements in the range
+ *  chunk: elements per chunk, 0 picks PARALLEL_CHUNK_ELEMENTS
+ *  task: function run on each chunk
+ *  ctx: passed through to task
+ * RETURN:
+ *  void, returns once every chunk has run
+ *
+ **/
+void parallel_for (size_t n, size_t chunk, Pool_Task_t task, void* ctx) {
+
+	if (!task || n == 0) {
+		return;
+	}
+	if (chunk == 0) {
+		chunk = PARALLEL_CHUNK_ELEMENTS;
+	}
+
+	/*small ranges, nested calls and single threaded runs stay put*/
+	if (num_workers == 0 || n < PARALLEL_MIN_ELEMENTS || n <= chunk || inside_pool) {
+		task(ctx, 0, n);
+		return;
+	}
+
+	pthread_mutex_lock(&submit_lock);
+
+	pthread_mutex_lock(&pool_lock);
+	job.task = task;
+	job.ctx = ctx;
+	job.n = n;
+	job.chunk = chunk;
+	job.next = 0;
+	/*active is left alone, the last job returned with it back at 0*/
+	generation++;
+	pthread_cond_broadcast(&job_ready);
+	pthread_mutex_unlock(&pool_lock);
+
+	inside_pool = true;
+	run_chunks(&job);
+	inside_pool = false;
+
+	pthread_mutex_lock(&pool_lock);
+	while (job.active > 0) {
+		pthread_cond_wait(&job_done, &pool_lock);
+	}
+	/*workers that never woke up must not pick up this job later*/
+	job.next = job.n;
+	pthread_mutex_unlock(&pool_lock);
+
+	pthread_mutex_unlock(&submit_lock);
+}
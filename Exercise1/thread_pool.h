@@ -0,0 +1,22 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*elements below this count run on the calling thread*/
+#define PARALLEL_MIN_ELEMENTS (1 << 16)
+/*elements per chunk handed out to a worker, 64KB of unsigned ints*/
+#define PARALLEL_CHUNK_ELEMENTS (1 << 14)
+
+/*a task handles the half open range [begin, end) of the work*/
+typedef void (*Pool_Task_t) (void* ctx, size_t begin, size_t end);
+
+bool init_thread_pool (unsigned int num_threads);
+void destroy_thread_pool (void);
+unsigned int thread_pool_size (void);
+unsigned int thread_pool_tids (pid_t* tids, unsigned int max);
+void parallel_for (size_t n, size_t chunk, Pool_Task_t task, void* ctx);
+
+#endif